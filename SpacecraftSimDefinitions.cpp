@@ -27,6 +27,7 @@
 extern "C" {
 #include "utilities/linearAlgebra.h"
 #include "utilities/rigidBodyKinematics.h"
+#include "utilities/orbitalMotion.h"
 #include "utilities/astroConstants.h"
 }
 
@@ -192,6 +193,18 @@ Thruster::~Thruster()
     
 };
 
+SpacecraftSample::SpacecraftSample()
+{
+    this->time = 0.0;
+    v3SetZero(this->sigma);
+    v3SetZero(this->omega);
+}
+
+SpacecraftSample::~SpacecraftSample()
+{
+    
+}
+
 SpacecraftSim::SpacecraftSim(void)
 {
     this->time = 0.0;
@@ -278,6 +291,213 @@ SpacecraftSim::~SpacecraftSim(void)
     
 }
 
+void appendSample(const SpacecraftSim &frame, std::vector<SpacecraftSample> &samples)
+{
+    samples.push_back(SpacecraftSample());
+    SpacecraftSample &sample = samples.back();
+    sample.time = frame.time;
+    for(int i = 0; i < 3; i++) {
+        sample.sigma[i] = frame.sigma[i];
+        sample.omega[i] = frame.omega[i];
+    }
+    sample.wheelOmega.resize(frame.reactionWheels.size());
+    for(size_t i = 0; i < frame.reactionWheels.size(); i++) {
+        sample.wheelOmega[i] = frame.reactionWheels[i].Omega;
+    }
+    sample.thrusterLevel.resize(frame.acsThrusters.size() + frame.dvThrusters.size());
+    for(size_t i = 0; i < frame.acsThrusters.size(); i++) {
+        sample.thrusterLevel[i] = frame.acsThrusters[i].level;
+    }
+    for(size_t i = 0; i < frame.dvThrusters.size(); i++) {
+        sample.thrusterLevel[frame.acsThrusters.size() + i] = frame.dvThrusters[i].level;
+    }
+}
+
+/* Display state between two frames. Discrete state is taken from a until b
+ * is reached, the attitude is slerped, the orbit is a cubic Hermite curve
+ * through both position and velocity (a straight blend for states of the
+ * same time) and the remaining continuous values are blended linearly. */
+void interpolateFrame(const SpacecraftSim &a, const SpacecraftSim &b, double alpha, double dt, SpacecraftSim &out)
+{
+    if(alpha >= 1.0) {
+        out = b;
+        return;
+    }
+    out = a;
+    if(alpha <= 0.0) {
+        return;
+    }
+    double beta = 1.0 - alpha;
+    out.time = beta * a.time + alpha * b.time;
+    out.spiceTime.J2000Current = beta * a.spiceTime.J2000Current + alpha * b.spiceTime.J2000Current;
+    double dGamma = b.gamma - a.gamma;
+    if(dGamma > M_PI) {
+        dGamma -= 2.0 * M_PI;
+    } else if(dGamma < -M_PI) {
+        dGamma += 2.0 * M_PI;
+    }
+    out.gamma = a.gamma + alpha * dGamma;
+
+    /* Slerp along the shorter arc, the MRP of the result is taken from the
+     * quaternion with a positive scalar part so it stays within the unit sphere */
+    double sigmaA[3] = {a.sigma[0], a.sigma[1], a.sigma[2]};
+    double sigmaB[3] = {b.sigma[0], b.sigma[1], b.sigma[2]};
+    double qa[4];
+    double qb[4];
+    double q[4];
+    MRP2EP(sigmaA, qa);
+    MRP2EP(sigmaB, qb);
+    double cosAngle = qa[0] * qb[0] + qa[1] * qb[1] + qa[2] * qb[2] + qa[3] * qb[3];
+    double sign = 1.0;
+    if(cosAngle < 0.0) {
+        cosAngle = -cosAngle;
+        sign = -1.0;
+    }
+    double wa = beta;
+    double wb = alpha;
+    if(cosAngle < 0.9995) {
+        double angle = acos(cosAngle);
+        wa = sin(beta * angle) / sin(angle);
+        wb = sin(alpha * angle) / sin(angle);
+    }
+    double norm = 0.0;
+    for(int i = 0; i < 4; i++) {
+        q[i] = wa * qa[i] + sign * wb * qb[i];
+        norm += q[i] * q[i];
+    }
+    norm = q[0] < 0.0 ? -sqrt(norm) : sqrt(norm);
+    for(int i = 0; i < 4; i++) {
+        q[i] /= norm;
+    }
+    EP2MRP(q, out.sigma);
+
+    /* Hermite basis functions and their derivatives */
+    double t2 = alpha * alpha;
+    double t3 = t2 * alpha;
+    double h00 = 2.0 * t3 - 3.0 * t2 + 1.0;
+    double h10 = t3 - 2.0 * t2 + alpha;
+    double h01 = -2.0 * t3 + 3.0 * t2;
+    double h11 = t3 - t2;
+    double d00 = 6.0 * t2 - 6.0 * alpha;
+    double d10 = 3.0 * t2 - 4.0 * alpha + 1.0;
+    double d01 = -d00;
+    double d11 = 3.0 * t2 - 2.0 * alpha;
+    for(int i = 0; i < 3; i++) {
+        if(dt > 0.0) {
+            out.r_N[i] = h00 * a.r_N[i] + h10 * dt * a.v_N[i] + h01 * b.r_N[i] + h11 * dt * b.v_N[i];
+            out.v_N[i] = (d00 * a.r_N[i] + d01 * b.r_N[i]) / dt + d10 * a.v_N[i] + d11 * b.v_N[i];
+        } else {
+            out.r_N[i] = beta * a.r_N[i] + alpha * b.r_N[i];
+            out.v_N[i] = beta * a.v_N[i] + alpha * b.v_N[i];
+        }
+        out.omega[i] = beta * a.omega[i] + alpha * b.omega[i];
+    }
+
+    if(a.reactionWheels.size() == b.reactionWheels.size()) {
+        for(size_t i = 0; i < out.reactionWheels.size(); i++) {
+            out.reactionWheels[i].Omega = beta * a.reactionWheels[i].Omega + alpha * b.reactionWheels[i].Omega;
+        }
+    }
+    if(a.acsThrusters.size() == b.acsThrusters.size()) {
+        for(size_t i = 0; i < out.acsThrusters.size(); i++) {
+            out.acsThrusters[i].level = beta * a.acsThrusters[i].level + alpha * b.acsThrusters[i].level;
+        }
+    }
+    if(a.dvThrusters.size() == b.dvThrusters.size()) {
+        for(size_t i = 0; i < out.dvThrusters.size(); i++) {
+            out.dvThrusters[i].level = beta * a.dvThrusters[i].level + alpha * b.dvThrusters[i].level;
+        }
+    }
+}
+
+/* Predicted state dt seconds after a frame. The orbit is propagated as a
+ * two-body orbit, plus the J2 acceleration at the frame's position held
+ * constant over dt for the bodies whose J2 is known; the attitude is rotated
+ * at the last body rate, the exact solution of the MRP kinematics for a
+ * constant rate. Everything else holds. */
+bool extrapolateFrame(const SpacecraftSim &frame, double dt, SpacecraftSim &out)
+{
+    out = frame;
+    if(dt <= 0.0) {
+        return true;
+    }
+    out.time = frame.time + dt;
+    out.spiceTime.J2000Current = frame.spiceTime.J2000Current + dt;
+    out.gamma = frame.gamma + frame.polarRate * dt;
+
+    double r_N[3] = {frame.r_N[0], frame.r_N[1], frame.r_N[2]};
+    double v_N[3] = {frame.v_N[0], frame.v_N[1], frame.v_N[2]};
+    classicElements oe;
+    bool isPropagated = false;
+    if(frame.mu > 0.0 && v3Norm(r_N) > 0.0) {
+        rv2elem(frame.mu, r_N, v_N, &oe);
+        if(oe.e < 1.0 && oe.a > 0.0) {
+            double n = sqrt(frame.mu / (oe.a * oe.a * oe.a));
+            double M = E2M(f2E(oe.f, oe.e), oe.e) + n * dt;
+            oe.f = E2f(M2E(fmod(M, 2.0 * M_PI), oe.e), oe.e);
+            isPropagated = true;
+        } else if(oe.e > 1.0 && oe.a < 0.0) {
+            double n = sqrt(frame.mu / (-oe.a * oe.a * oe.a));
+            double N = H2N(f2H(oe.f, oe.e), oe.e) + n * dt;
+            oe.f = H2f(N2H(N, oe.e), oe.e);
+            isPropagated = true;
+        }
+    }
+    if(isPropagated) {
+        elem2rv(frame.mu, &oe, out.r_N, out.v_N);
+        double J2 = 0.0;
+        if(frame.celestialObject == CELESTIAL_EARTH) {
+            J2 = J2_EARTH;
+        } else if(frame.celestialObject == CELESTIAL_MARS) {
+            J2 = J2_MARS;
+        }
+        if(J2 > 0.0 && frame.req > 0.0) {
+            /* The J2 acceleration at the start is constant over the short
+               times predicted, osculating elements must not be propagated
+               with the secular rates of mean elements */
+            double r = v3Norm(r_N);
+            double z2 = r_N[2] * r_N[2] / (r * r);
+            double k = 1.5 * J2 * frame.mu * frame.req * frame.req / (r * r * r * r * r);
+            double a_J2[3] = {k * r_N[0] * (5.0 * z2 - 1.0), k * r_N[1] * (5.0 * z2 - 1.0),
+                k * r_N[2] * (5.0 * z2 - 3.0)};
+            for(int i = 0; i < 3; i++) {
+                out.r_N[i] += 0.5 * a_J2[i] * dt * dt;
+                out.v_N[i] += a_J2[i] * dt;
+            }
+        }
+    }
+    if(!isPropagated || out.r_N[0] != out.r_N[0] || out.v_N[0] != out.v_N[0]) {
+        /* Degenerate orbit, coast in a straight line */
+        for(int i = 0; i < 3; i++) {
+            out.r_N[i] = frame.r_N[i] + frame.v_N[i] * dt;
+            out.v_N[i] = frame.v_N[i];
+        }
+    }
+
+    double omega = sqrt(frame.omega[0] * frame.omega[0] + frame.omega[1] * frame.omega[1]
+        + frame.omega[2] * frame.omega[2]);
+    if(omega > 0.0) {
+        double sigma[3] = {frame.sigma[0], frame.sigma[1], frame.sigma[2]};
+        double q_BN[4];
+        double q_BB0[4];
+        double q[4];
+        MRP2EP(sigma, q_BN);
+        double halfAngle = 0.5 * omega * dt;
+        q_BB0[0] = cos(halfAngle);
+        for(int i = 0; i < 3; i++) {
+            q_BB0[i + 1] = sin(halfAngle) * frame.omega[i] / omega;
+        }
+        addEP(q_BN, q_BB0, q);
+        if(q[0] < 0.0) {
+            for(int i = 0; i < 4; i++) {
+                q[i] = -q[i];
+            }
+        }
+        EP2MRP(q, out.sigma);
+    }
+    return true;
+}
+
 //template<> const enumMap<CSSFaultState_t> enumStrings<CSSFaultState_t>::data = {
 //    {CSSFAULT_OFF, "CSSFAULT_OFF"},
 //    {CSSFAULT_STUCK_CURRENT, "CSSFAULT_STUCK_CURRENT"},
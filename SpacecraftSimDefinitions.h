@@ -28,6 +28,8 @@
 #include <boost/serialization/string.hpp>
 #include <boost/archive/xml_iarchive.hpp>
 #include <boost/serialization/vector.hpp>
+#include <boost/serialization/version.hpp>
+#include <boost/cstdint.hpp>
 #include <stdio.h>
 extern "C" {
 #include "spacecraftDefinitions.h"
@@ -550,6 +552,46 @@ private:
 };
 
 
+/* Compact state of one simulation step. Frames carry the steps taken since
+ * the previous frame, so dynamics faster than the frame rate, e.g. wheel
+ * speed jitter or thruster pulses, reach plots and recordings */
+class SpacecraftSample
+{
+public:
+    double time;
+    double sigma[3];                    /*!< MRP attitude set */
+    double omega[3];                    /*!< rad/sec, spacecraft body rates */
+    std::vector<double> wheelOmega;     /*!< Omega of the reactionWheels */
+    std::vector<double> thrusterLevel;  /*!< level of the acsThrusters followed by the dvThrusters */
+
+    SpacecraftSample();
+    ~SpacecraftSample();
+private:
+    friend class boost::serialization::access;
+    template<typename Archive>
+    void serialize(Archive &a, const unsigned int version) {
+        a &BOOST_SERIALIZATION_NVP(time);
+        a &BOOST_SERIALIZATION_NVP(sigma);
+        a &BOOST_SERIALIZATION_NVP(omega);
+        a &BOOST_SERIALIZATION_NVP(wheelOmega);
+        a &BOOST_SERIALIZATION_NVP(thrusterLevel);
+    }
+};
+
+/* Optional parts of a SpacecraftSim frame a viewer can subscribe to, the
+ * rest of the frame (time, orbit, attitude, environment) is always sent */
+typedef enum {
+    SIM_FIELD_THRUSTERS       = 0x01,   /*!< acsThrusters, dvThrusters */
+    SIM_FIELD_CSS             = 0x02,   /*!< css */
+    SIM_FIELD_IRU             = 0x04,   /*!< iru */
+    SIM_FIELD_POD             = 0x08,   /*!< pod */
+    SIM_FIELD_REACTION_WHEELS = 0x10,   /*!< reactionWheels */
+    SIM_FIELD_STAR_TRACKER    = 0x20,   /*!< st */
+    SIM_FIELD_TORQUE_RODS     = 0x40,   /*!< tr */
+    SIM_FIELD_SAMPLES         = 0x80,   /*!< samples */
+    SIM_FIELDS_ALL            = 0xff
+} SimField_t;
+
 class SpacecraftSim
 {
 public:
@@ -652,6 +694,10 @@ public:
     double earthHeadingSim_N[3]; /*!< unit direction vector pointing from spacecraft back to Earth in inertial frame components */
     double earthHeadingSim_B[3]; /*!< unit direction vector pointing from spacecraft back to Earth in body frame components */
     
+    /* Simulation steps since the previous frame, oldest first. The last one
+     * is the state of this frame, empty if the simulation does not batch. */
+    std::vector<SpacecraftSample> samples;
+    
 public:
     SpacecraftSim();
     ~SpacecraftSim();
@@ -678,11 +724,10 @@ public:
 //    void simulatePOD(double t);
 //    void mtbReply(int i);
     
-private:    
-    friend class boost::serialization::access;
-    
+    /* Serializes the fields selected by a SimField_t mask, the full
+     * archive is the same as with all bits set */
     template<typename Archive>
-    void serialize(Archive &a, const unsigned int version) {
+    void serializeFields(Archive &a, unsigned int fieldMask) {
         a &BOOST_SERIALIZATION_NVP(time);
         a &BOOST_SERIALIZATION_NVP(spiceTime);
         a &BOOST_SERIALIZATION_NVP(timeStamp);
@@ -722,14 +767,28 @@ private:
         
         a &BOOST_SERIALIZATION_NVP(adcsState);
         
-        a &BOOST_SERIALIZATION_NVP(acsThrusters);
-        a &BOOST_SERIALIZATION_NVP(dvThrusters);
-        a &BOOST_SERIALIZATION_NVP(css);
-        a &BOOST_SERIALIZATION_NVP(iru);
-        a &BOOST_SERIALIZATION_NVP(pod);
-        a &BOOST_SERIALIZATION_NVP(reactionWheels);
-        a &BOOST_SERIALIZATION_NVP(st);
-        a &BOOST_SERIALIZATION_NVP(tr);
+        if(fieldMask & SIM_FIELD_THRUSTERS) {
+            a &BOOST_SERIALIZATION_NVP(acsThrusters);
+            a &BOOST_SERIALIZATION_NVP(dvThrusters);
+        }
+        if(fieldMask & SIM_FIELD_CSS) {
+            a &BOOST_SERIALIZATION_NVP(css);
+        }
+        if(fieldMask & SIM_FIELD_IRU) {
+            a &BOOST_SERIALIZATION_NVP(iru);
+        }
+        if(fieldMask & SIM_FIELD_POD) {
+            a &BOOST_SERIALIZATION_NVP(pod);
+        }
+        if(fieldMask & SIM_FIELD_REACTION_WHEELS) {
+            a &BOOST_SERIALIZATION_NVP(reactionWheels);
+        }
+        if(fieldMask & SIM_FIELD_STAR_TRACKER) {
+            a &BOOST_SERIALIZATION_NVP(st);
+        }
+        if(fieldMask & SIM_FIELD_TORQUE_RODS) {
+            a &BOOST_SERIALIZATION_NVP(tr);
+        }
         
         a &BOOST_SERIALIZATION_NVP(I);
         a &BOOST_SERIALIZATION_NVP(Iinv);
@@ -761,7 +820,49 @@ private:
         
         a &BOOST_SERIALIZATION_NVP(earthHeadingSim_N);
         a &BOOST_SERIALIZATION_NVP(earthHeadingSim_B);        
+        
+        if(fieldMask & SIM_FIELD_SAMPLES) {
+            a &BOOST_SERIALIZATION_NVP(samples);
+        }
+    }
+    
+private:    
+    friend class boost::serialization::access;
+    
+    template<typename Archive>
+    void serialize(Archive &a, const unsigned int version) {
+        // Archives of version 0 predate samples
+        serializeFields(a, version > 0 ? SIM_FIELDS_ALL : SIM_FIELDS_ALL & ~SIM_FIELD_SAMPLES);
     }
 };
 
+BOOST_CLASS_VERSION(SpacecraftSim, 1)
+
+// Partial frames of the serialize transports, see FieldMaskedFrame
+template <typename Archive>
+void serializeFrameFields(Archive &a, SpacecraftSim &sc, boost::uint32_t fieldMask)
+{
+    sc.serializeFields(a, fieldMask);
+}
+
+// Simulation time carried in the binary frame header and in recording indexes
+inline double frameSimTime(const SpacecraftSim &sc)
+{
+    return sc.time;
+}
+
+// Appends the compact state of frame to samples, for simulations that batch
+// their steps into frames
+void appendSample(const SpacecraftSim &frame, std::vector<SpacecraftSample> &samples);
+
+// Simulation time of a sample, see SampleHistory
+inline double sampleSimTime(const SpacecraftSample &sample)
+{
+    return sample.time;
+}
+
+// Display state between two frames and past the last one, see FrameInterpolator
+void interpolateFrame(const SpacecraftSim &a, const SpacecraftSim &b, double alpha, double dt, SpacecraftSim &out);
+bool extrapolateFrame(const SpacecraftSim &frame, double dt, SpacecraftSim &out);
+
 #endif
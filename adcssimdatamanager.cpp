@@ -20,8 +20,10 @@
 #include "utilities/astroConstants.h"
 #include "linestrip.h"
 #include "graphics.h"
+#include <QTimerEvent>
 #include <sstream>
 #include <chrono>
+#include <algorithm>
 
 
 extern "C" {
@@ -31,12 +33,118 @@ extern "C" {
 #include "utilities/linearAlgebra.h"
 }
 
+const char *AdcsSimDataManager::shmAddressPrefix = "shm://";
+const char *AdcsSimDataManager::jsonAddressPrefix = "json://";
+const char *AdcsSimDataManager::udpAddressPrefix = "udp://";
+
+// Names of the LatencyStage_t values in the diagnostics log
+static const char *latencyStageNames[MAX_LATENCY_STAGE] = {
+    "network", "decode", "handover", "scene", "present", "total"
+};
+
+// Names of the SceneToggle_t values in the toggleable objects
+static const char *sceneToggleNames[MAX_SCENE_TOGGLE] = {
+    "Planet-Centered Fixed Axes",
+    "Planet-Centered Inertial Axes",
+    "Spacecraft Orbit",
+    "Celestial Object Orbits",
+    "Spacecraft Body Frame Axes",
+    "Spacecraft Hill Frame Axes",
+    "Spacecraft Velocity Frame Axes",
+    "Spacecraft Sun-Direction Vector",
+    "Spacecraft Earth-Direction Vector",
+    "Spacecraft Magnetic Field Vector",
+    "CSS Field Of View",
+    "CSS Photo Diode Normals",
+    "Reaction Wheel Pyramid",
+    "Torque Rod Pyramid",
+    "Star Tracker Pointing Normals",
+    "Star Tracker Field of View"
+};
+
+// Bodies whose states updateSimObjects needs around a celestial object, in
+// the order of celestialObject1State, celestialObject2State and sunState.
+// The steps between samples are short against the orbits of the bodies.
+static const std::vector<EphemerisBody> &ephemerisBodies(CelestialObject_t celestialObject)
+{
+    static std::vector<EphemerisBody> sunBodies;
+    static std::vector<EphemerisBody> marsBodies;
+    static std::vector<EphemerisBody> earthBodies;
+    if(sunBodies.empty()) {
+        sunBodies.push_back(EphemerisBody(399, "ECLIPJ2000", 10, 21600.0));
+        sunBodies.push_back(EphemerisBody(499, "ECLIPJ2000", 10, 21600.0));
+        sunBodies.push_back(EphemerisBody(10, "ECLIPJ2000", 499, 21600.0));
+        marsBodies.push_back(EphemerisBody(401, "MARSIAU", 499, 300.0));
+        marsBodies.push_back(EphemerisBody(402, "MARSIAU", 499, 1200.0));
+        marsBodies.push_back(EphemerisBody(10, "J2000", 499, 21600.0));
+        earthBodies.push_back(EphemerisBody(301, "ECLIPJ2000", 399, 3600.0));
+        earthBodies.push_back(EphemerisBody(10, "ECLIPJ2000", 399, 21600.0));
+    }
+    switch(celestialObject) {
+        case CELESTIAL_SUN:
+            return sunBodies;
+        case CELESTIAL_MARS:
+            return marsBodies;
+        default:
+            return earthBodies;
+    }
+}
+
+// Child index of simObjects, appended while the scene is being rebuilt.
+// Holding on to the object returned across the next call on the same
+// simObjects is not safe, appending may move it.
+static SimObject &nextSimObject(QVector<SimObject> &simObjects, int &index)
+{
+    if(index == simObjects.size()) {
+        simObjects.push_back(SimObject());
+    }
+    return simObjects[index++];
+}
+
 AdcsSimDataManager::AdcsSimDataManager(QObject *parent)
     : SimDataManager(parent)
     , m_client()
+    , m_udpArrivalTime(0)
+    , m_transport(TRANSPORT_TCP)
+    , m_pollTimerId(0)
+    , m_displayTimerId(0)
+    , m_diagnosticsTimerId(0)
     , m_isConnected(false)
+    , m_isUpdatePending(false)
+    , m_isSampling(false)
+    , m_playbackTimerId(0)
+    , m_playbackTime(0.0)
+    , m_playbackFrame(0)
+    , m_maxPrediction(0.5)
+    , m_isMotionPredicted(false)
+    , m_displayFields(SIM_FIELDS_ALL)
+    , m_numReactionWheels(0)
+    , m_numThrusters(0)
+    , m_layoutGeneration(0)
+    , m_hasSceneRequest(false)
+    , m_shouldStopScenes(false)
+    , m_builtScene(0)
+    , m_isScenePending(false)
+    , m_isJsonLog(false)
 {
     this->receivedNewData = false;
+    this->realTimeSpeedUpFactor = 1.0;
+    resetDiagnostics();
+    // Deserialization runs on the client's network thread, new frames are
+    // handed over to the GUI thread through a queued signal
+    m_client.setThreaded(true);
+    m_client.setUpdateHandler(boost::bind(&AdcsSimDataManager::handleClientUpdate, this));
+    // Every decoded frame goes to the recorder and the sample history, not
+    // just the ones displayed
+    m_client.setFrameHandler(boost::bind(&AdcsSimDataManager::handleFrame, this, _1));
+    m_jsonClient.setFrameHandler(boost::bind(&AdcsSimDataManager::handleFrame, this, _1));
+    connect(this, SIGNAL(inboundDataReady()), this, SLOT(processInboundData()), Qt::QueuedConnection);
+    // Legends are widgets, their colors are taken here on the GUI thread
+    Legend legend;
+    m_legendPalette = legend.colorPalette;
+    m_scene = &m_scenes.readBuffer();
+    connect(this, SIGNAL(sceneReady()), this, SLOT(presentScene()), Qt::QueuedConnection);
+    m_sceneThread.reset(new boost::thread(boost::bind(&AdcsSimDataManager::runSceneThread, this)));
     m_toggleableObjects.insert("Spacecraft Body Frame Axes", true);
     m_toggleableObjects.insert("Spacecraft Hill Frame Axes", true);
     m_toggleableObjects.insert("Spacecraft Velocity Frame Axes", true);
@@ -57,7 +165,15 @@ AdcsSimDataManager::AdcsSimDataManager(QObject *parent)
 
 AdcsSimDataManager::~AdcsSimDataManager()
 {
-    
+    // Stop the network and scene threads before anything they use goes away
+    {
+        boost::mutex::scoped_lock lock(m_sceneMutex);
+        m_shouldStopScenes = true;
+    }
+    m_sceneCondition.notify_one();
+    m_sceneThread->join();
+    m_client.close();
+    m_recorder.stop();
 }
 
 bool AdcsSimDataManager::openConnection(QString ipAddress, QString port)
@@ -73,10 +189,47 @@ bool AdcsSimDataManager::openConnection(QString ipAddress, QString port)
             break;
     }
     
-    if(m_client.connect(ipAddress.toStdString(), port.toStdString())) {
-        updateSimObjects();
-        // Start timer to keep checking for more data
-        m_connectionTimerId = QObject::startTimer(30);
+    // A simulation on the same host can publish through shared memory,
+    // the port is not used then. Simulations without boost can send JSON.
+    // A multicast group is joined for frames published over UDP, nothing
+    // is sent back to the simulation then.
+    m_transport = TRANSPORT_TCP;
+    if(ipAddress.startsWith(shmAddressPrefix)) {
+        m_transport = TRANSPORT_SHARED_MEMORY;
+    } else if(ipAddress.startsWith(jsonAddressPrefix)) {
+        m_transport = TRANSPORT_JSON;
+    } else if(ipAddress.startsWith(udpAddressPrefix)) {
+        m_transport = TRANSPORT_UDP;
+    }
+    bool isOpen = false;
+    switch(m_transport) {
+        case TRANSPORT_SHARED_MEMORY:
+            isOpen = m_shmClient.connect(ipAddress.mid(QString(shmAddressPrefix).length()).toStdString());
+            break;
+        case TRANSPORT_JSON:
+            isOpen = m_jsonClient.connect(ipAddress.mid(QString(jsonAddressPrefix).length()).toStdString(), port.toStdString());
+            break;
+        case TRANSPORT_UDP:
+            m_udpClient.reset(new UdpSerializeClient<SpacecraftSim>(&m_udpIoService));
+            isOpen = m_udpClient->connect(ipAddress.mid(QString(udpAddressPrefix).length()).toStdString(), port.toStdString()) == 0;
+            break;
+        default:
+            // Unlimited until the first frames show whether they carry samples
+            m_isSampling = false;
+            m_client.setMaxFrameRate(0.0);
+            isOpen = m_client.connect(ipAddress.toStdString(), port.toStdString());
+            break;
+    }
+    if(isOpen && m_transport != TRANSPORT_TCP) {
+        // Both run on this thread and are polled
+        m_pollTimerId = startTimer(pollInterval, Qt::PreciseTimer);
+    }
+    if(isOpen) {
+        requestScene(false);
+        resetDiagnostics();
+        m_interpolator.clear();
+        m_displayTimerId = startTimer(displayInterval, Qt::PreciseTimer);
+        m_diagnosticsTimerId = startTimer(diagnosticsInterval);
         m_inputType = INPUT_CONNECTION;
     } else {
         emit showMessage("Connection attempt failed", 5000);
@@ -85,17 +238,124 @@ bool AdcsSimDataManager::openConnection(QString ipAddress, QString port)
     return true;
 }
 
+void AdcsSimDataManager::setCompression(Compression_t codec)
+{
+    m_client.setCompression(codec);
+}
+
+void AdcsSimDataManager::setDisplayDelay(double seconds)
+{
+    m_interpolator.setDelay(seconds);
+}
+
+double AdcsSimDataManager::getDisplayDelay()
+{
+    return m_interpolator.delay();
+}
+
+void AdcsSimDataManager::setMaxPrediction(double seconds)
+{
+    m_maxPrediction = seconds;
+    setMotionPrediction(m_isMotionPredicted);
+}
+
+double AdcsSimDataManager::getMaxPrediction()
+{
+    return m_maxPrediction;
+}
+
+void AdcsSimDataManager::setMotionPrediction(bool enabled)
+{
+    m_isMotionPredicted = enabled;
+    m_interpolator.setMaxPrediction(enabled ? m_maxPrediction : 0.0);
+}
+
+bool AdcsSimDataManager::isMotionPredicted()
+{
+    return m_isMotionPredicted;
+}
+
+void AdcsSimDataManager::setDisplayFields(unsigned int fields)
+{
+    m_displayFields = fields;
+    updateFieldSubscription();
+}
+
+// Subscribes to the fields shown by the docks and the enabled scene objects.
+// Only TCP connections support subscriptions.
+void AdcsSimDataManager::updateFieldSubscription()
+{
+    unsigned int fields = m_displayFields;
+    // Thruster plumes are always drawn and the sample history always kept
+    fields |= SIM_FIELD_THRUSTERS | SIM_FIELD_SAMPLES;
+    if(m_recorder.isRecording()) {
+        // Recordings keep complete frames
+        fields = SIM_FIELDS_ALL;
+    }
+    if(m_toggleableObjects.value("CSS Field Of View") || m_toggleableObjects.value("CSS Photo Diode Normals")) {
+        fields |= SIM_FIELD_CSS;
+    }
+    if(m_toggleableObjects.value("Reaction Wheel Pyramid")) {
+        fields |= SIM_FIELD_REACTION_WHEELS;
+    }
+    if(m_toggleableObjects.value("Torque Rod Pyramid")) {
+        fields |= SIM_FIELD_TORQUE_RODS;
+    }
+    if(m_toggleableObjects.value("Star Tracker Pointing Normals") || m_toggleableObjects.value("Star Tracker Field of View")) {
+        fields |= SIM_FIELD_STAR_TRACKER;
+    }
+    m_client.setFieldMask(fields);
+}
+
+// Asks a TCP simulation for no more frames than are displayed and than the
+// network thread can decode, so a simulation running as fast as it can is
+// subsampled by its server instead of being paced by the viewer. Recordings
+// and the samples of batching simulations need every frame, so nothing is
+// limited while recording, once a frame carried samples, or before any frame
+// was received.
+void AdcsSimDataManager::updateFrameRateLimit()
+{
+    double rate = 0.0;
+    if(!m_recorder.isRecording() && !m_isSampling && m_diagnostics.framesReceived > 0) {
+        rate = 1000.0 / displayInterval;
+        double decodeTime = m_diagnostics.stages[LATENCY_DECODE].mean();
+        if(decodeTime > 0.0) {
+            // Leaves the network thread half of its time for reading
+            rate = std::min(rate, 500.0 / decodeTime);
+        }
+    }
+    m_client.setMaxFrameRate(rate);
+}
+
 bool AdcsSimDataManager::closeConnection()
 {
     emit showMessage("Closing connection...", 2000);
+    if(m_pollTimerId) {
+        killTimer(m_pollTimerId);
+        m_pollTimerId = 0;
+    }
+    if(m_displayTimerId) {
+        killTimer(m_displayTimerId);
+        m_displayTimerId = 0;
+    }
+    if(m_diagnosticsTimerId) {
+        killTimer(m_diagnosticsTimerId);
+        m_diagnosticsTimerId = 0;
+        resetDiagnostics();
+        emit diagnosticsUpdated();
+    }
+    m_shmClient.close();
+    m_jsonClient.close();
+    m_udpClient.reset();
     if(!m_client.close()) {
         std::cout << "called by " << __FUNCTION__ << std::endl;
         return false;
     }
     m_isConnected = false;
-    this->m_scSim.timeStamp = 0;
+    m_inboundFrame.timeStamp = 0;
+    m_interpolator.clear();
+    m_sampleHistory.clear();
     this->receivedNewData = false;
-    killTimer(m_connectionTimerId);
     m_inputType = INPUT_NONE;
     return true;
 }
@@ -113,35 +373,184 @@ bool AdcsSimDataManager::openFile(QString filename)
             break;
     }
     
-    // TODO: Add code to actually open file
-    
-    updateSimObjects();
-    
+    // Only the index and the first frame are read, everything else is
+    // paged in from the mapped recording while playing
+    if(!m_recording.open(filename.toStdString()) || m_recording.frameCount() == 0
+        || !m_recording.readFrame(0, m_scSim)) {
+        m_recording.close();
+        emit showMessage("Could not open " + filename + " as a recording", 5000);
+        m_inputType = INPUT_NONE;
+        return false;
+    }
+    m_playbackFrame = 0;
+    m_playbackTime = 0.0;
+    this->realTimeSpeedUpFactor = 1.0;
+    this->m_scSim.realTimeSpeedUpFactor = this->realTimeSpeedUpFactor;
+    m_numReactionWheels = this->m_scSim.reactionWheels.size();
+    m_numThrusters = this->m_scSim.acsThrusters.size() + this->m_scSim.dvThrusters.size();
     m_inputType = INPUT_FILE;
+    // The scene is built anew for the new source
+    m_layoutGeneration++;
+    emit simConnected();
+    m_interpolator.clear();
+    loadRecordedFrame(0);
+    showRecordedTime(m_recording.startTime());
+
+    m_playbackClock.start();
+    m_playbackTimerId = startTimer(playbackInterval, Qt::PreciseTimer);
     return true;
 }
 
 bool AdcsSimDataManager::closeFile()
 {
-    // TODO: Add code to actually close file
-    
+    if(m_playbackTimerId) {
+        killTimer(m_playbackTimerId);
+        m_playbackTimerId = 0;
+    }
+    m_recording.close();
+    m_interpolator.clear();
+    m_sampleHistory.clear();
     m_inputType = INPUT_NONE;
     return true;
 }
 
-QVector3D AdcsSimDataManager::getLightPosition()
+bool AdcsSimDataManager::startRecording(QString filename)
 {
-    if (m_scSim.celestialObject != CELESTIAL_SUN) {
-        return QVector3D(m_scSim.sHatN[0], m_scSim.sHatN[1], m_scSim.sHatN[2]).normalized() * (float)AU;
+    if(filename.endsWith(".jsonl", Qt::CaseInsensitive)) {
+        if(m_inputType != INPUT_CONNECTION || m_transport != TRANSPORT_JSON) {
+            emit showMessage("JSON captures need a " + QString(jsonAddressPrefix) + " connection", 5000);
+            return false;
+        }
+        if(!m_jsonClient.startCapture(filename.toStdString())) {
+            emit showMessage("Could not capture to " + filename, 5000);
+            return false;
+        }
+        return true;
+    }
+    if(!m_recorder.start(filename.toStdString())) {
+        emit showMessage("Could not record to " + filename, 5000);
+        return false;
+    }
+    updateFieldSubscription();
+    updateFrameRateLimit();
+    return true;
+}
+
+void AdcsSimDataManager::stopRecording()
+{
+    m_jsonClient.stopCapture();
+    m_recorder.stop();
+    updateFieldSubscription();
+    updateFrameRateLimit();
+}
+
+bool AdcsSimDataManager::isRecording()
+{
+    return m_recorder.isRecording() || m_jsonClient.isCapturing();
+}
+
+RecorderStatistics AdcsSimDataManager::getRecorderStatistics()
+{
+    if(m_jsonClient.isCapturing()) {
+        // Lines are written as they are read, nothing queues up
+        RecorderStatistics statistics;
+        statistics.framesRecorded = m_jsonClient.capturedLines();
+        statistics.bytesWritten = m_jsonClient.capturedBytes();
+        return statistics;
+    }
+    return m_recorder.statistics();
+}
+
+double AdcsSimDataManager::getPlaybackDuration()
+{
+    if(m_inputType != INPUT_FILE) {
+        return 0.0;
+    }
+    return m_recording.endTime() - m_recording.startTime();
+}
+
+// Moves the playback time on by the wall clock time since the last call
+// scaled by the play speed, max speed (-1) shows every recorded frame
+void AdcsSimDataManager::advancePlayback()
+{
+    double elapsed = m_playbackClock.restart() / 1000.0;
+    size_t frame = m_playbackFrame;
+    double time;
+    if(this->realTimeSpeedUpFactor < 0.0) {
+        if(frame + 1 < m_recording.frameCount()) {
+            frame++;
+        }
+        time = m_recording.frameTime(frame);
+        m_playbackTime = time - m_recording.startTime();
     } else {
-        return QVector3D(0., 0., 0.);
+        m_playbackTime = std::min(m_playbackTime + elapsed * this->realTimeSpeedUpFactor, getPlaybackDuration());
+        time = m_recording.startTime() + m_playbackTime;
+        frame = m_recording.findFrame(time);
+    }
+    if(frame != m_playbackFrame) {
+        loadRecordedFrame(frame);
     }
+    showRecordedTime(time);
+}
+
+// Puts the frame at index and the one after it into the interpolator. When
+// playing on to the next frame the one at index is already there.
+bool AdcsSimDataManager::loadRecordedFrame(size_t index)
+{
+    if(m_interpolator.isEmpty() || frameSimTime(m_interpolator.newestFrame()) != m_recording.frameTime(index)) {
+        m_interpolator.clear();
+        if(!m_recording.readFrame(index, m_recordedFrame)) {
+            return false;
+        }
+        m_interpolator.push(m_recordedFrame, 0.0);
+        m_sampleHistory.append(m_recordedFrame.samples);
+    }
+    m_playbackFrame = index;
+    if(index + 1 < m_recording.frameCount() && m_recording.readFrame(index + 1, m_recordedFrame)) {
+        m_interpolator.push(m_recordedFrame, 0.0);
+        m_sampleHistory.append(m_recordedFrame.samples);
+    }
+
+    // Decode the frame expected on the next tick while this one is shown
+    size_t next = index + 2;
+    if(this->realTimeSpeedUpFactor >= 0.0) {
+        next = std::max(next, m_recording.findFrame(m_recording.startTime() + m_playbackTime
+            + this->realTimeSpeedUpFactor * playbackInterval / 1000.0));
+    }
+    m_recording.prefetch(next);
+    return true;
+}
+
+// Shows the recording at simulation time, the scene is only rebuilt when
+// the interpolated state changed
+bool AdcsSimDataManager::showRecordedTime(double time)
+{
+    if(!m_interpolator.sampleAt(time, this->m_scSim)) {
+        return false;
+    }
+    // The play speed shown is the one of the playback, not of the recorded run
+    this->m_scSim.realTimeSpeedUpFactor = this->realTimeSpeedUpFactor;
+    if(this->m_scSim.reactionWheels.size() != m_numReactionWheels
+            || this->m_scSim.acsThrusters.size() + this->m_scSim.dvThrusters.size() != m_numThrusters) {
+        m_numReactionWheels = this->m_scSim.reactionWheels.size();
+        m_numThrusters = this->m_scSim.acsThrusters.size() + this->m_scSim.dvThrusters.size();
+        emit componentsChanged();
+    }
+    requestScene(false);
+    return true;
 }
 
 void AdcsSimDataManager::setSimTime(double time)
 {
     if(m_inputType == INPUT_FILE) {
-        // TODO: Do something here
+        // time is in seconds from the start of the recording
+        m_playbackTime = std::max(0.0, std::min(time, getPlaybackDuration()));
+        m_playbackClock.restart();
+        size_t frame = m_recording.findFrame(m_recording.startTime() + m_playbackTime);
+        if(frame != m_playbackFrame) {
+            loadRecordedFrame(frame);
+        }
+        showRecordedTime(m_recording.startTime() + m_playbackTime);
     }
 }
 
@@ -234,49 +643,492 @@ void AdcsSimDataManager::setPlaySpeed(double value)
     if (value <= 16384) {
         this->realTimeSpeedUpFactor = value;
     }
+    if(m_inputType == INPUT_FILE) {
+        // Playback is driven from here, show the new speed even while paused
+        m_playbackClock.restart();
+        this->m_scSim.realTimeSpeedUpFactor = this->realTimeSpeedUpFactor;
+        emit simDataUpdated();
+    }
 }
 
 
+// Called for every decoded frame, on the network thread for TCP connections
+// and from the poll timer otherwise
+void AdcsSimDataManager::handleFrame(const SpacecraftSim &frame)
+{
+    if(!frame.samples.empty() && !m_isSampling.exchange(true)) {
+        // Subsampled frames would drop the samples of the frames in between
+        m_client.setMaxFrameRate(0.0);
+    }
+    m_sampleHistory.append(frame.samples);
+    m_recorder.record(frame);
+}
+
+bool AdcsSimDataManager::getSamples(double since, std::vector<SpacecraftSample> &samples)
+{
+    return m_sampleHistory.copySince(since, samples);
+}
+
+// Called on the client's network thread, only one queued call is kept
+// outstanding so a slow GUI thread sees the newest frame instead of a backlog
+void AdcsSimDataManager::handleClientUpdate()
+{
+    if(!m_isUpdatePending.exchange(true)) {
+        emit inboundDataReady();
+    }
+}
+
 void AdcsSimDataManager::timerEvent(QTimerEvent *event)
 {
-    if(event->timerId() == m_connectionTimerId) {
-        // Set up the response data to go out
-        // Poll the connection event loop
-        m_client.poll();
-        // Check whether we are actually connected or still attempting
-        if(m_client.isConnected()) {
-            if(!m_isConnected) {
-                m_isConnected = true;
-                emit this->showMessage("Connection established!", 5000);
+    if(event->timerId() == m_playbackTimerId) {
+        advancePlayback();
+        return;
+    }
+    if(event->timerId() == m_displayTimerId) {
+        updateDisplay();
+        return;
+    }
+    if(event->timerId() == m_diagnosticsTimerId) {
+        updateDiagnostics();
+        return;
+    }
+    if(event->timerId() != m_pollTimerId) {
+        SimDataManager::timerEvent(event);
+        return;
+    }
+    if(m_transport == TRANSPORT_JSON) {
+        if(m_jsonClient.poll()) {
+            processInboundData();
+            // Lines are decoded as they are read, the frame is then handed
+            // over at the end of the poll
+            FrameStatistics statistics = m_jsonClient.getFrameStatistics();
+            recordFrameLatency(statistics.receiveTime, statistics.decodeTime);
+            m_latency[LATENCY_HANDOVER].record(preciseTimeStamp() - statistics.decodeTime);
+        }
+        return;
+    }
+    double pollTime = preciseTimeStamp();
+    if(m_transport == TRANSPORT_UDP) {
+        if(m_udpClient && m_udpClient->getData(&m_udpFrame) == 0) {
+            double decodeTime = preciseTimeStamp();
+            m_udpArrivalTime = generateTimeStamp();
+            processInboundData();
+            // Fragments are reassembled and deserialized on this thread
+            recordFrameLatency(pollTime, decodeTime);
+            // Only the newest complete frame is kept, record what is seen
+            handleFrame(m_inboundFrame);
+        }
+        return;
+    }
+    if(m_shmClient.poll()) {
+        double decodeTime = preciseTimeStamp();
+        processInboundData();
+        // The frame is read from the ring and deserialized in one step on
+        // this thread, there is no handover
+        recordFrameLatency(pollTime, decodeTime);
+        // Shared memory only hands out the newest frame, record what is seen
+        handleFrame(m_inboundFrame);
+    }
+}
+
+void AdcsSimDataManager::processInboundData()
+{
+    m_isUpdatePending = false;
+    if(m_inputType != INPUT_CONNECTION) {
+        // Left over from a connection that has been closed since
+        return;
+    }
+    // Check whether we are actually connected or still attempting
+    if(isTransportConnected()) {
+        if(!m_isConnected) {
+            m_isConnected = true;
+            emit this->showMessage("Connection established!", 5000);
+        }
+    } else {
+        if(m_isConnected) {
+            m_isConnected = false;
+            m_inboundFrame.timeStamp = this->generateTimeStamp();
+            this->receivedNewData = false;
+        }
+        // emit showMessage("Attempting to connect...");
+    }
+
+    long prevNumRun = m_inboundFrame.timeStamp;
+    switch(m_transport) {
+        case TRANSPORT_SHARED_MEMORY:
+            m_inboundFrame = m_shmClient.getInboundData();
+            break;
+        case TRANSPORT_JSON:
+            m_inboundFrame = m_jsonClient.getInboundData();
+            break;
+        case TRANSPORT_UDP:
+            m_inboundFrame = m_udpFrame;
+            break;
+        default:
+            m_inboundFrame = m_client.getInboundData();
+            break;
+    }
+    if (m_inboundFrame.timeStamp > prevNumRun && this->receivedNewData == false)
+    {
+        this->receivedNewData = true;
+        this->m_scSim = m_inboundFrame;
+        this->realTimeSpeedUpFactor = this->m_scSim.realTimeSpeedUpFactor;
+        m_numReactionWheels = this->m_scSim.reactionWheels.size();
+        m_numThrusters = this->m_scSim.acsThrusters.size() + this->m_scSim.dvThrusters.size();
+        m_layoutGeneration++;
+        emit simConnected();
+        m_framesProcessed++;
+        m_newestPublishTime = m_inboundFrame.timeStamp;
+        // Return here so slots and signals are processed
+        // once before we reach requestScene().
+        return;
+    }
+
+    if (this->receivedNewData)
+    {
+        if(m_inboundFrame.reactionWheels.size() != m_numReactionWheels
+                || m_inboundFrame.acsThrusters.size() + m_inboundFrame.dvThrusters.size() != m_numThrusters) {
+            // Frames with different components are not interpolated, show
+            // the new one right away so the docks see matching counts
+            m_interpolator.clear();
+            this->m_scSim = m_inboundFrame;
+            m_numReactionWheels = this->m_scSim.reactionWheels.size();
+            m_numThrusters = this->m_scSim.acsThrusters.size() + this->m_scSim.dvThrusters.size();
+            emit componentsChanged();
+        }
+        // The scene is updated from the interpolator at the display rate
+        long arrivalTime = m_client.getInboundArrivalTime();
+        if(m_transport == TRANSPORT_SHARED_MEMORY) {
+            arrivalTime = m_shmClient.getInboundArrivalTime();
+        } else if(m_transport == TRANSPORT_JSON) {
+            arrivalTime = m_jsonClient.getInboundArrivalTime();
+        } else if(m_transport == TRANSPORT_UDP) {
+            arrivalTime = m_udpArrivalTime;
+        }
+        m_interpolator.push(m_inboundFrame, arrivalTime / 1000.0);
+        m_framesProcessed++;
+        m_newestPublishTime = m_inboundFrame.timeStamp;
+        if(m_transport == TRANSPORT_TCP) {
+            FrameStatistics statistics = m_client.getFrameStatistics();
+            recordFrameLatency(statistics.receiveTime, statistics.decodeTime);
+            m_latency[LATENCY_HANDOVER].record(preciseTimeStamp() - statistics.decodeTime);
+        }
+        // Scene toggles may have changed since the last frame
+        this->updateFieldSubscription();
+        this->updateReturnData();
+        switch(m_transport) {
+            case TRANSPORT_SHARED_MEMORY:
+                this->m_shmClient.setOutboundData(&this->m_scSimVisualization);
+                break;
+            case TRANSPORT_JSON:
+                this->m_jsonClient.setOutboundData(&this->m_scSimVisualization);
+                break;
+            case TRANSPORT_UDP:
+                // Multicast has no return channel
+                break;
+            default:
+                this->m_client.setOutboundData(&this->m_scSimVisualization);
+                break;
+        }
+    }
+}
+
+// Shows the connection's state at the current display time, the scene is
+// only rebuilt when that state changed
+void AdcsSimDataManager::updateDisplay()
+{
+    if(!this->receivedNewData) {
+        return;
+    }
+    if(m_interpolator.sample(this->generateTimeStamp() / 1000.0, this->m_scSim)) {
+        requestScene(true);
+    }
+}
+
+// Hands the state in m_scSim to the scene thread, replacing a request it has
+// not started on yet
+void AdcsSimDataManager::requestScene(bool isMeasured)
+{
+    // The toggleable objects are all listed once there is a scene, Mars has
+    // no magnetic field model
+    if(m_toggleableObjects.size() < MAX_SCENE_TOGGLE) {
+        for(int i = 0; i < MAX_SCENE_TOGGLE; i++) {
+            m_toggleableObjects[sceneToggleNames[i]];
+        }
+    }
+    if(m_scSim.celestialObject == CELESTIAL_MARS
+       && m_toggleableObjects.value(sceneToggleNames[TOGGLE_MAGNETIC_FIELD])) {
+        m_toggleableObjects[sceneToggleNames[TOGGLE_MAGNETIC_FIELD]] = false;
+    }
+    {
+        boost::mutex::scoped_lock lock(m_sceneMutex);
+        m_sceneRequest.scSim = m_scSim;
+        m_sceneRequest.toggleableObjects = m_toggleableObjects;
+        m_sceneRequest.isSpacecraftTarget = m_isSpacecraftTarget;
+        m_sceneRequest.layoutGeneration = m_layoutGeneration;
+        m_sceneRequest.isMeasured = isMeasured;
+        m_sceneRequest.publishTime = m_newestPublishTime;
+        m_sceneRequest.requestTime = preciseTimeStamp();
+        m_hasSceneRequest = true;
+    }
+    m_sceneCondition.notify_one();
+}
+
+// Builds the scenes requested, only the newest request is kept so a slow
+// build skips states instead of falling behind
+void AdcsSimDataManager::runSceneThread()
+{
+    while(true) {
+        {
+            boost::mutex::scoped_lock lock(m_sceneMutex);
+            while(!m_hasSceneRequest && !m_shouldStopScenes) {
+                m_sceneCondition.wait(lock);
             }
-        } else {
-            if(m_isConnected) {
-                m_isConnected = false;
-                this->m_scSim.timeStamp = this->generateTimeStamp();
-                this->receivedNewData = false;
+            if(m_shouldStopScenes) {
+                return;
             }
-            // emit showMessage("Attempting to connect...");
+            m_buildRequest = m_sceneRequest;
+            m_hasSceneRequest = false;
         }
+        AdcsScene &scene = m_scenes.writeBuffer();
+        updateSimObjects(m_buildRequest, scene);
+        numberSceneObjects(scene.simObjects, m_builtScene ? &m_builtScene->simObjects : 0);
+        m_builtScene = &scene;
+        scene.isMeasured = m_buildRequest.isMeasured;
+        scene.publishTime = m_buildRequest.publishTime;
+        scene.requestTime = m_buildRequest.requestTime;
+        scene.buildTime = preciseTimeStamp();
+        m_scenes.publish();
+        if(!m_isScenePending.exchange(true)) {
+            emit sceneReady();
+        }
+    }
+}
 
-        long prevNumRun = this->m_scSim.timeStamp;
-        this->m_scSim = m_client.getInboundData();
-        if (this->m_scSim.timeStamp > prevNumRun && this->receivedNewData == false)
-        {
-            this->receivedNewData = true;
-            this->realTimeSpeedUpFactor = this->m_scSim.realTimeSpeedUpFactor;
-            emit simConnected();
-            // Return here so slots and signals are processed
-            // once before we reach updateSimObjects().
-            return;
+// Shows the newest scene built. Copies of its objects must not be kept past
+// the next simDataUpdated, the scene thread then updates them again.
+void AdcsSimDataManager::presentScene()
+{
+    m_isScenePending = false;
+    if(!m_scenes.update()) {
+        return;
+    }
+    const AdcsScene &scene = m_scenes.readBuffer();
+    m_scene = &scene;
+    this->m_scSim.mu = scene.mu;
+    for(int i = 0; i < 3; i++) {
+        this->m_scSim.sHatN[i] = scene.sHatN[i];
+        this->m_scSim.sHatB[i] = scene.sHatB[i];
+    }
+    if(scene.isMeasured) {
+        m_sceneBuildTime = scene.buildTime;
+        m_scenePublishTime = scene.publishTime;
+        m_latency[LATENCY_SCENE].record(scene.buildTime - scene.requestTime);
+    }
+    emit setOnOffDefaults(scene.layout.celestialObject);
+    emit setOnOffLegendRW(scene.layout.isShown[TOGGLE_RW_PYRAMID]);
+    emit setOnOffLegendTR(scene.layout.isShown[TOGGLE_TR_PYRAMID]);
+    emit simDataUpdated();
+}
+
+void AdcsSimDataManager::framePresented()
+{
+    // Repaints of an unchanged scene, e.g. by the camera, are not counted
+    if(m_sceneBuildTime == 0.0) {
+        return;
+    }
+    double now = preciseTimeStamp();
+    m_latency[LATENCY_PRESENT].record(now - m_sceneBuildTime);
+    if(m_scenePublishTime > 0) {
+        m_latency[LATENCY_TOTAL].record(now - m_scenePublishTime);
+    }
+    m_sceneBuildTime = 0.0;
+    m_framesDisplayed++;
+}
+
+// Times in milliseconds since epoch at which m_inboundFrame was read from
+// the transport and deserialized
+void AdcsSimDataManager::recordFrameLatency(double receiveTime, double decodeTime)
+{
+    if(receiveTime <= 0.0) {
+        return;
+    }
+    if(m_inboundFrame.timeStamp > 0) {
+        m_latency[LATENCY_NETWORK].record(receiveTime - m_inboundFrame.timeStamp);
+    }
+    m_latency[LATENCY_DECODE].record(decodeTime - receiveTime);
+}
+
+void AdcsSimDataManager::resetDiagnostics()
+{
+    for(int i = 0; i < MAX_LATENCY_STAGE; i++) {
+        m_latency[i].reset();
+    }
+    m_diagnostics = PipelineDiagnostics();
+    m_diagnosticsClock.start();
+    m_framesProcessed = 0;
+    m_framesDisplayed = 0;
+    m_intervalFrames = 0;
+    m_intervalDisplayed = 0;
+    m_intervalBytes = 0;
+    m_skippedAtOpen = m_shmClient.framesSkipped();
+    m_newestPublishTime = 0;
+    m_scenePublishTime = 0;
+    m_sceneBuildTime = 0.0;
+}
+
+// Closes the current diagnostics interval of the connection
+void AdcsSimDataManager::updateDiagnostics()
+{
+    PipelineDiagnostics diagnostics;
+    diagnostics.interval = m_diagnosticsClock.restart() / 1000.0;
+    if(diagnostics.interval <= 0.0) {
+        return;
+    }
+    for(int i = 0; i < MAX_LATENCY_STAGE; i++) {
+        diagnostics.stages[i] = m_latency[i];
+        m_latency[i].reset();
+    }
+    boost::uint64_t bytes = 0;
+    if(m_transport == TRANSPORT_SHARED_MEMORY) {
+        unsigned long skipped = m_shmClient.framesSkipped() - m_skippedAtOpen;
+        diagnostics.framesReceived = m_framesProcessed + skipped;
+        diagnostics.framesDropped = skipped;
+    } else if(m_transport == TRANSPORT_UDP) {
+        // The client is created per connection, its counters start with it
+        unsigned long completed = m_udpClient ? m_udpClient->framesReceived() : 0;
+        unsigned long lost = m_udpClient ? m_udpClient->framesLost() : 0;
+        unsigned long superseded = completed > m_framesProcessed ? completed - m_framesProcessed : 0;
+        diagnostics.framesReceived = completed + lost;
+        diagnostics.framesDropped = lost + superseded;
+    } else {
+        // The counters of the link start over when it reconnects
+        FrameStatistics statistics = getFrameStatistics();
+        unsigned long superseded = statistics.framesDecoded > m_framesProcessed
+            ? statistics.framesDecoded - m_framesProcessed : 0;
+        diagnostics.framesReceived = statistics.framesDecoded;
+        diagnostics.framesDropped = statistics.sequenceGaps + statistics.corruptFrames + superseded;
+        bytes = statistics.bytesReceived;
+    }
+    diagnostics.framesDisplayed = m_framesDisplayed;
+    if(diagnostics.framesReceived >= m_intervalFrames) {
+        diagnostics.framesPerSecond = (diagnostics.framesReceived - m_intervalFrames) / diagnostics.interval;
+    }
+    diagnostics.displayedPerSecond = (m_framesDisplayed - m_intervalDisplayed) / diagnostics.interval;
+    if(bytes >= m_intervalBytes) {
+        diagnostics.bytesPerSecond = (bytes - m_intervalBytes) / diagnostics.interval;
+    }
+    m_intervalFrames = diagnostics.framesReceived;
+    m_intervalDisplayed = m_framesDisplayed;
+    m_intervalBytes = bytes;
+    m_diagnostics = diagnostics;
+    updateFrameRateLimit();
+    writeDiagnosticsLog();
+    emit diagnosticsUpdated();
+}
+
+PipelineDiagnostics AdcsSimDataManager::getDiagnostics()
+{
+    return m_diagnostics;
+}
+
+bool AdcsSimDataManager::startDiagnosticsLog(QString filename)
+{
+    stopDiagnosticsLog();
+    m_diagnosticsLog.setFileName(filename);
+    if(!m_diagnosticsLog.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        emit showMessage("Could not write diagnostics to " + filename, 5000);
+        return false;
+    }
+    m_isJsonLog = filename.endsWith(".json", Qt::CaseInsensitive);
+    if(!m_isJsonLog) {
+        QString header = "time,interval,frames_per_s,displayed_per_s,bytes_per_s,received,displayed,dropped";
+        for(int i = 0; i < MAX_LATENCY_STAGE; i++) {
+            QString name = latencyStageNames[i];
+            header += QString(",%1_count,%1_mean,%1_p50,%1_p90,%1_p99,%1_max").arg(name);
         }
-        
-        if (this->receivedNewData)
-        {
-            this->updateSimObjects();
-            this->updateReturnData();
-            this->m_client.setOutboundData(&this->m_scSimVisualization);
+        m_diagnosticsLog.write((header + "\n").toUtf8());
+        m_diagnosticsLog.flush();
+    }
+    return true;
+}
+
+void AdcsSimDataManager::stopDiagnosticsLog()
+{
+    if(m_diagnosticsLog.isOpen()) {
+        m_diagnosticsLog.close();
+    }
+}
+
+bool AdcsSimDataManager::isDiagnosticsLogging()
+{
+    return m_diagnosticsLog.isOpen();
+}
+
+// Appends the last diagnostics interval as one line, flushed right away so
+// the log is complete up to a crash
+void AdcsSimDataManager::writeDiagnosticsLog()
+{
+    if(!m_diagnosticsLog.isOpen()) {
+        return;
+    }
+    const PipelineDiagnostics &d = m_diagnostics;
+    QString line;
+    if(m_isJsonLog) {
+        line = QString("{\"time\":%1,\"interval\":%2,\"frames_per_s\":%3,\"displayed_per_s\":%4,"
+            "\"bytes_per_s\":%5,\"received\":%6,\"displayed\":%7,\"dropped\":%8,\"latency\":{")
+            .arg(this->generateTimeStamp()).arg(d.interval, 0, 'f', 3)
+            .arg(d.framesPerSecond, 0, 'f', 2).arg(d.displayedPerSecond, 0, 'f', 2)
+            .arg(d.bytesPerSecond, 0, 'f', 0).arg(d.framesReceived).arg(d.framesDisplayed).arg(d.framesDropped);
+        for(int i = 0; i < MAX_LATENCY_STAGE; i++) {
+            const LatencyHistogram &h = d.stages[i];
+            line += QString("%1\"%2\":{\"count\":%3,\"mean\":%4,\"p50\":%5,\"p90\":%6,\"p99\":%7,\"max\":%8}")
+                .arg(i > 0 ? "," : "").arg(latencyStageNames[i]).arg((qulonglong)h.count())
+                .arg(h.mean(), 0, 'f', 3).arg(h.percentile(50.0), 0, 'f', 3).arg(h.percentile(90.0), 0, 'f', 3)
+                .arg(h.percentile(99.0), 0, 'f', 3).arg(h.max(), 0, 'f', 3);
+        }
+        line += "}}";
+    } else {
+        line = QString("%1,%2,%3,%4,%5,%6,%7,%8")
+            .arg(this->generateTimeStamp()).arg(d.interval, 0, 'f', 3)
+            .arg(d.framesPerSecond, 0, 'f', 2).arg(d.displayedPerSecond, 0, 'f', 2)
+            .arg(d.bytesPerSecond, 0, 'f', 0).arg(d.framesReceived).arg(d.framesDisplayed).arg(d.framesDropped);
+        for(int i = 0; i < MAX_LATENCY_STAGE; i++) {
+            const LatencyHistogram &h = d.stages[i];
+            line += QString(",%1,%2,%3,%4,%5,%6").arg((qulonglong)h.count())
+                .arg(h.mean(), 0, 'f', 3).arg(h.percentile(50.0), 0, 'f', 3).arg(h.percentile(90.0), 0, 'f', 3)
+                .arg(h.percentile(99.0), 0, 'f', 3).arg(h.max(), 0, 'f', 3);
         }
     }
+    if(m_diagnosticsLog.write((line + "\n").toUtf8()) < 0 || !m_diagnosticsLog.flush()) {
+        std::cout << "Error in " << __FUNCTION__ << ": could not write the diagnostics log" << std::endl;
+        m_diagnosticsLog.close();
+        emit showMessage("Diagnostics log stopped, could not write", 5000);
+    }
+}
+
+FrameStatistics AdcsSimDataManager::getFrameStatistics()
+{
+    if(m_inputType != INPUT_CONNECTION || m_transport == TRANSPORT_SHARED_MEMORY
+            || m_transport == TRANSPORT_UDP) {
+        return FrameStatistics();
+    }
+    return m_transport == TRANSPORT_JSON ? m_jsonClient.getFrameStatistics() : m_client.getFrameStatistics();
+}
+
+bool AdcsSimDataManager::isTransportConnected()
+{
+    switch(m_transport) {
+        case TRANSPORT_SHARED_MEMORY:
+            return m_shmClient.isConnected();
+        case TRANSPORT_JSON:
+            return m_jsonClient.isConnected();
+        case TRANSPORT_UDP:
+            // There is no connection, the group is joined once a frame arrived
+            return m_udpClient && m_udpClient->framesReceived() > 0;
+        default:
+            return m_client.isConnected();
+    }
 }
 
 long AdcsSimDataManager::generateTimeStamp()
@@ -293,9 +1145,51 @@ double AdcsSimDataManager::getSimTime()
     return this->m_scSim.time;
 }
 
-void AdcsSimDataManager::updateSimObjects()
+// True if the scene objects have to be created again because the frame or
+// the toggleable objects need other ones than the scene was built from
+bool AdcsSimDataManager::isSceneLayoutChanged(const SceneRequest &request, const SceneLayout &layout)
+{
+    return layout.generation != request.layoutGeneration
+        || layout.celestialObject != request.scSim.celestialObject
+        || layout.acsThrusters != request.scSim.acsThrusters.size()
+        || layout.dvThrusters != request.scSim.dvThrusters.size()
+        || layout.reactionWheels != request.scSim.reactionWheels.size()
+        || layout.toggleableObjects != request.toggleableObjects;
+}
+
+// Updates the X, Y and Z axes at index to be rotated by rotation from their
+// default orientation, the scale and colors are only set when creating them
+void AdcsSimDataManager::updateAxes(QVector<SimObject> &simObjects, int &index, bool isCreated, QQuaternion rotation,
+                                    float scaleFactor, QVector4D xColor, QVector4D yColor, QVector4D zColor)
+{
+    SimObject &xAxis = nextSimObject(simObjects, index);
+    if(isCreated) {
+        xAxis = createXAxis(xColor);
+        xAxis.scaleFactor = scaleFactor;
+    }
+    xAxis.quaternion = rotation;
+
+    SimObject &yAxis = nextSimObject(simObjects, index);
+    if(isCreated) {
+        yAxis = createYAxis(yColor);
+        yAxis.scaleFactor = scaleFactor;
+    }
+    yAxis.quaternion = rotation * SimObject::computeRotation(QVector3D(0, 1, 0));
+
+    SimObject &zAxis = nextSimObject(simObjects, index);
+    if(isCreated) {
+        zAxis = createZAxis(zColor);
+        zAxis.scaleFactor = scaleFactor;
+    }
+    zAxis.quaternion = rotation * SimObject::computeRotation(QVector3D(0, 0, 1));
+}
+
+// Runs on the scene thread and builds the scene of request into scene. The
+// scene objects are only created when the layout of the scene changed. Every
+// other frame walks them in the order they were created in and updates their
+// transforms, colors and geometry parameters in place, without allocating.
+void AdcsSimDataManager::updateSimObjects(SceneRequest &request, AdcsScene &scene)
 {
-    SimObject       tempSimObject;
     QQuaternion     tempq;
     QVector3D       tempPosition;
     QVector4D       tempColor;
@@ -304,64 +1198,83 @@ void AdcsSimDataManager::updateSimObjects()
     double          textureOffsetAngle   = 0.0;
     double          primaryBodyAngle     = 0.0;
     double          sunScaling           = 1.0;
-    double          lightTime; // is the one-way light time between the observer and target in seconds
     double          celestialObject1State[6];
     double          celestialObject2State[6];
     double          sunState[6] = {0,0,0,0,0,0};
     int             i;
     double          helioRadius = 0.0;
+    SpacecraftSim   &scSim = request.scSim;
+    SceneLayout     &layout = scene.layout;
+    double          et = scSim.ics.ET0 + scSim.time;
     
-    switch(m_scSim.celestialObject) {
+    switch(scSim.celestialObject) {
         case CELESTIAL_SUN:
-            spkez_c(399, m_scSim.ics.ET0 + m_scSim.time, "ECLIPJ2000", "NONE", 10, celestialObject1State, &lightTime);
-            spkez_c(499, m_scSim.ics.ET0 + m_scSim.time, "ECLIPJ2000", "NONE", 10, celestialObject2State, &lightTime);
-            spkez_c(10, m_scSim.ics.ET0 + m_scSim.time, "ECLIPJ2000", "NONE", 499, sunState, &lightTime);
-            m_scSim.mu = MU_SUN;
+            m_ephemeris.setBodies(ephemerisBodies(CELESTIAL_SUN));
+            m_ephemeris.state(0, et, celestialObject1State);
+            m_ephemeris.state(1, et, celestialObject2State);
+            m_ephemeris.state(2, et, sunState);
+            scSim.mu = MU_SUN;
             break;
         case CELESTIAL_MARS:
-            spkez_c(401, m_scSim.ics.ET0 + m_scSim.time, "MARSIAU", "NONE", 499, celestialObject1State, &lightTime);
-            spkez_c(402, m_scSim.ics.ET0 + m_scSim.time, "MARSIAU", "NONE", 499, celestialObject2State, &lightTime);
-            spkez_c(10, m_scSim.ics.ET0 + m_scSim.time, "J2000", "NONE", 499, sunState, &lightTime);
-            m_scSim.mu = MU_MARS;
+            m_ephemeris.setBodies(ephemerisBodies(CELESTIAL_MARS));
+            m_ephemeris.state(0, et, celestialObject1State);
+            m_ephemeris.state(1, et, celestialObject2State);
+            m_ephemeris.state(2, et, sunState);
+            scSim.mu = MU_MARS;
             break;
         case CELESTIAL_EARTH:
-            spkez_c(301, m_scSim.ics.ET0 + m_scSim.time, "ECLIPJ2000", "NONE", 399, celestialObject1State, &lightTime);
-            spkez_c(10, m_scSim.ics.ET0 + m_scSim.time, "ECLIPJ2000", "NONE", 399, sunState, &lightTime);
-            m_scSim.mu = MU_EARTH;
+            m_ephemeris.setBodies(ephemerisBodies(CELESTIAL_EARTH));
+            m_ephemeris.state(0, et, celestialObject1State);
+            m_ephemeris.state(1, et, sunState);
+            scSim.mu = MU_EARTH;
         default:
             break;
     }
-    emit setOnOffDefaults(m_scSim.celestialObject);
     
-    m_simObjects.clear();
+    bool isRebuilt = isSceneLayoutChanged(request, layout);
+    if(isRebuilt) {
+        for(i = 0; i < MAX_SCENE_TOGGLE; i++) {
+            layout.isShown[i] = request.toggleableObjects.value(sceneToggleNames[i]);
+        }
+        layout.toggleableObjects = request.toggleableObjects;
+        layout.celestialObject = scSim.celestialObject;
+        layout.acsThrusters = scSim.acsThrusters.size();
+        layout.dvThrusters = scSim.dvThrusters.size();
+        layout.reactionWheels = scSim.reactionWheels.size();
+        layout.generation = request.layoutGeneration;
+        scene.simObjects.clear();
+    }
+    const bool *isShown = layout.isShown;
+    int index = 0;
+    int childIndex;
     
     // The simulation unit length by default is km, the globalScaleFactor parameter
     // allows the scaling of everything to fit in clipping space
-    // All top level objects of m_simObjects must have their scaleFactor parameter set
+    // All top level objects of scene.simObjects must have their scaleFactor parameter set
     // to this value and its position multiplied by this value
     float globalScaleFactor;
-    switch (m_scSim.celestialObject) {
+    switch (scSim.celestialObject) {
         case CELESTIAL_EARTH:
             globalScaleFactor = 1.0;
             break;
         case CELESTIAL_MARS:
-            m_toggleableObjects.remove("Spacecraft Magnetic Field Vector");
             globalScaleFactor = 0.15f;
             break;
         case CELESTIAL_SUN:
-            //m_toggleableObjects.remove("Spacecraft Magnetic Field Vector");
             sunScaling = 15.;
             globalScaleFactor = (float)(REQ_EARTH/AU);
             break;
         default:
             globalScaleFactor = 1.0;
-            printf("Warning: received celestial object %d not implemented.\n", m_scSim.celestialObject);
+            if(isRebuilt) {
+                printf("Warning: received celestial object %d not implemented.\n", scSim.celestialObject);
+            }
             break;
     }
     
     float scScale;
-    if(m_isSpacecraftTarget) {
-        switch (m_scSim.celestialObject) {
+    if(request.isSpacecraftTarget) {
+        switch (scSim.celestialObject) {
             case CELESTIAL_EARTH:
                 scScale = 3. * globalScaleFactor;
                 break;
@@ -376,7 +1289,7 @@ void AdcsSimDataManager::updateSimObjects()
                 break;
         }
     } else {
-        switch (m_scSim.celestialObject) {
+        switch (scSim.celestialObject) {
             case CELESTIAL_EARTH:
                 scScale = 50. * globalScaleFactor;
                 break;
@@ -400,371 +1313,384 @@ void AdcsSimDataManager::updateSimObjects()
         sunPosition = QVector3D(1,0,0);
     }
     helioRadius = sunPosition.length();
-    m_scSim.sHatN[0] = sunPosition[0]/helioRadius;
-    m_scSim.sHatN[1] = sunPosition[1]/helioRadius;
-    m_scSim.sHatN[2] = sunPosition[2]/helioRadius;
+    scSim.sHatN[0] = sunPosition[0]/helioRadius;
+    scSim.sHatN[1] = sunPosition[1]/helioRadius;
+    scSim.sHatN[2] = sunPosition[2]/helioRadius;
     double dcm_BN[3][3];
     double dcm_NB[3][3];
     
-    MRP2C(m_scSim.sigma, dcm_NB);
+    MRP2C(scSim.sigma, dcm_NB);
     m33Transpose(dcm_NB, dcm_BN);
-    m33MultV3(dcm_NB, m_scSim.sHatN, m_scSim.sHatB);
+    m33MultV3(dcm_NB, scSim.sHatN, scSim.sHatB);
     
     // Draw planets first in case spacecraft has transparency
-    SimObject primaryBody;
-    primaryBody.position = QVector3D(0, 0, 0);
-    if(m_scSim.celestialObject == CELESTIAL_EARTH) {
-        primaryBody.name         = "Earth";
-        primaryBody.geometryName = "Earth";
-        primaryBody.scaleFactor  = globalScaleFactor;
+    if(scSim.celestialObject == CELESTIAL_EARTH) {
         textureOffsetAngle       = - 180.0*D2R;
-        primaryBodyAngle         = m_scSim.gamma + textureOffsetAngle;
-        m_simObjects.push_back(createSun(sunPosition, globalScaleFactor));
-    } else if(m_scSim.celestialObject == CELESTIAL_MARS) {
-        primaryBody.name         = "Mars";
-        primaryBody.geometryName = "Mars";
-        primaryBody.scaleFactor  = globalScaleFactor;
+        primaryBodyAngle         = scSim.gamma + textureOffsetAngle;
+    } else if(scSim.celestialObject == CELESTIAL_MARS) {
         textureOffsetAngle       = - 90.0*D2R;
-        primaryBodyAngle         = m_scSim.gamma + textureOffsetAngle;
-        m_simObjects.push_back(createSun(sunPosition, globalScaleFactor));
-    } else if(m_scSim.celestialObject == CELESTIAL_SUN) {
-        primaryBody.name         = "Sun";
-        primaryBody.geometryName = "Sun";
-        primaryBody.scaleFactor  = sunScaling * globalScaleFactor;
-        textureOffsetAngle       = 0.;
-        primaryBodyAngle         = 0.;
+        primaryBodyAngle         = scSim.gamma + textureOffsetAngle;
+    }
+    if(scSim.celestialObject == CELESTIAL_EARTH || scSim.celestialObject == CELESTIAL_MARS) {
+        SimObject &sun = nextSimObject(scene.simObjects, index);
+        if(isRebuilt) {
+            sun = createSun(sunPosition, globalScaleFactor);
+        }
+        sun.position = sunPosition * globalScaleFactor;
+    }
+    // Undoes the planet's rotation of orbits placed on it
+    QQuaternion primaryBodyUndo(cos(primaryBodyAngle/2.), 0.0, 0.0, sin(-primaryBodyAngle/2.));
+    
+    // Place Earth's moon
+    if (scSim.celestialObject == CELESTIAL_EARTH) {
+        SimObject &moon1 = nextSimObject(scene.simObjects, index);
+        if(isRebuilt) {
+            moon1.name = "Moon";
+            moon1.geometryName = "Moon";
+            moon1.scaleFactor = 1.0f * globalScaleFactor;
+        }
+        moon1.position = QVector3D(celestialObject1State[0], celestialObject1State[1], celestialObject1State[2]) * globalScaleFactor;
+    }
+    
+    // Place Mars moons
+    if (scSim.celestialObject == CELESTIAL_MARS) {
+        SimObject &moon1 = nextSimObject(scene.simObjects, index);
+        if(isRebuilt) {
+            moon1.name = "Phobos";
+            moon1.geometryName = "Phobos";
+            moon1.scaleFactor = 1.0f * globalScaleFactor; //30.0f
+        }
+        moon1.position = QVector3D(celestialObject1State[0], celestialObject1State[1], celestialObject1State[2]) * globalScaleFactor;
+    
+        SimObject &moon2 = nextSimObject(scene.simObjects, index);
+        if(isRebuilt) {
+            moon2.name = "Deimos";
+            moon2.geometryName = "Deimos";
+            moon2.scaleFactor = 1.0f * globalScaleFactor; //20.0f
+        }
+        moon2.position = QVector3D(celestialObject2State[0], celestialObject2State[1], celestialObject2State[2]) * globalScaleFactor;
+    }
+    
+    if (scSim.celestialObject == CELESTIAL_SUN) {
+        double    planetScaling = 1200.;
+        SimObject &earth = nextSimObject(scene.simObjects, index);
+        if(isRebuilt) {
+            earth.name = "Earth";
+            earth.geometryName = "Earth";
+            earth.scaleFactor = planetScaling * globalScaleFactor;
+        }
+        earth.position = QVector3D(celestialObject1State[0], celestialObject1State[1], celestialObject1State[2]) * globalScaleFactor;
+    
+        SimObject &mars = nextSimObject(scene.simObjects, index);
+        if(isRebuilt) {
+            mars.name = "Mars";
+            mars.geometryName = "Mars";
+            mars.scaleFactor = planetScaling * REQ_MARS/REQ_EARTH * globalScaleFactor;
+        }
+        mars.position = QVector3D(celestialObject2State[0], celestialObject2State[1], celestialObject2State[2]) * globalScaleFactor;
+    }
+    
+    SimObject &primaryBody = nextSimObject(scene.simObjects, index);
+    if(isRebuilt) {
+        primaryBody.position = QVector3D(0, 0, 0);
+        if(scSim.celestialObject == CELESTIAL_EARTH) {
+            primaryBody.name         = "Earth";
+            primaryBody.geometryName = "Earth";
+            primaryBody.scaleFactor  = globalScaleFactor;
+        } else if(scSim.celestialObject == CELESTIAL_MARS) {
+            primaryBody.name         = "Mars";
+            primaryBody.geometryName = "Mars";
+            primaryBody.scaleFactor  = globalScaleFactor;
+        } else if(scSim.celestialObject == CELESTIAL_SUN) {
+            primaryBody.name         = "Sun";
+            primaryBody.geometryName = "Sun";
+            primaryBody.scaleFactor  = sunScaling * globalScaleFactor;
+        }
     }
     
     // Resolve orientation of primary body
     
     primaryBody.quaternion = QQuaternion(cos(primaryBodyAngle/2.), 0.0, 0.0, sin(primaryBodyAngle/2.));
+    childIndex = 0;
     
-    if(m_toggleableObjects["Planet-Centered Fixed Axes"]) {
-        SimObject temp;
-        temp = createXAxis();
-        temp.quaternion = QQuaternion(cos(textureOffsetAngle/2.), 0.0, 0.0, sin(-textureOffsetAngle/2.))*temp.quaternion;
-        primaryBody.simObjects.push_back(temp);
-        temp = createYAxis();
-        temp.quaternion = QQuaternion(cos(textureOffsetAngle/2.), 0.0, 0.0, sin(-textureOffsetAngle/2.))*temp.quaternion;
-        primaryBody.simObjects.push_back(temp);
-        temp = createZAxis();
-        temp.quaternion = QQuaternion(cos(textureOffsetAngle/2.), 0.0, 0.0, sin(-textureOffsetAngle/2.))*temp.quaternion;
-        primaryBody.simObjects.push_back(temp);
+    if(isShown[TOGGLE_FIXED_AXES]) {
+        updateAxes(primaryBody.simObjects, childIndex, isRebuilt,
+                   QQuaternion(cos(textureOffsetAngle/2.), 0.0, 0.0, sin(-textureOffsetAngle/2.)), 1.25f,
+                   QVector4D(1.0, 0.0, 0.0, 1.0), QVector4D(0.0, 1.0, 0.0, 1.0), QVector4D(0.0, 0.0, 1.0, 1.0));
     }
     
-    if(m_toggleableObjects["Planet-Centered Inertial Axes"]) {
-        SimObject temp;
+    if(isShown[TOGGLE_INERTIAL_AXES]) {
         double axisScale = 1.25;
-        if (m_scSim.celestialObject == CELESTIAL_SUN) {
+        if (scSim.celestialObject == CELESTIAL_SUN) {
             axisScale = 2.0;
         }
-        temp = createXAxis();
-        temp.quaternion = QQuaternion(cos(primaryBodyAngle/2.), 0.0, 0.0, sin(-primaryBodyAngle/2.))*temp.quaternion;
-        temp.scaleFactor = axisScale;
-        primaryBody.simObjects.push_back(temp);
-        temp = createYAxis();
-        temp.quaternion = QQuaternion(cos(primaryBodyAngle/2.), 0.0, 0.0, sin(-primaryBodyAngle/2.))*temp.quaternion;
-        temp.scaleFactor = axisScale;
-        primaryBody.simObjects.push_back(temp);
-        temp = createZAxis();
-        temp.quaternion = QQuaternion(cos(primaryBodyAngle/2.), 0.0, 0.0, sin(-primaryBodyAngle/2.))*temp.quaternion;
-        temp.scaleFactor = axisScale;
-        primaryBody.simObjects.push_back(temp);
+        updateAxes(primaryBody.simObjects, childIndex, isRebuilt, primaryBodyUndo, axisScale,
+                   QVector4D(1.0, 0.0, 0.0, 1.0), QVector4D(0.0, 1.0, 0.0, 1.0), QVector4D(0.0, 0.0, 1.0, 1.0));
     }
     
-    if(m_toggleableObjects["Spacecraft Orbit"]) {
-        classicElements oe;
-        rv2elem(m_scSim.mu, m_scSim.r_N, m_scSim.v_N, &oe);
-        tempSimObject = createOrbit(oe, 0, m_scSim.mu, "Spacecraft");
+    if(isShown[TOGGLE_SPACECRAFT_ORBIT]) {
+        rv2elem(scSim.mu, scSim.r_N, scSim.v_N, &oe);
+        SimObject &orbit = nextSimObject(primaryBody.simObjects, childIndex);
+        if(isRebuilt) {
+            orbit = createOrbit(0, "Spacecraft");
+            orbit.scaleFactor = 1.0/sunScaling;
+        }
         // Undo the Earth's rotation before placing orbit on screen
-        tempSimObject.quaternion = QQuaternion(cos(primaryBodyAngle/2.), 0.0, 0.0, sin(-primaryBodyAngle/2.));
-        tempSimObject.scaleFactor = 1.0/sunScaling;
-        primaryBody.simObjects.push_back(tempSimObject);
-        if (oe.alpha<0.) {
-            tempSimObject = createOrbit(oe, 1, m_scSim.mu,"SpacecraftHyperbolicDeparture");
-            tempSimObject.quaternion = QQuaternion(cos(primaryBodyAngle/2.), 0.0, 0.0, sin(-primaryBodyAngle/2.));
-            tempSimObject.scaleFactor = 1.0/sunScaling;
-            primaryBody.simObjects.push_back(tempSimObject);
+        orbit.quaternion = primaryBodyUndo;
+        updateOrbit(orbit, oe, 0, scSim.mu);
+    
+        // Kept while the orbit is closed, only shown when it is not
+        SimObject &departure = nextSimObject(primaryBody.simObjects, childIndex);
+        if(isRebuilt) {
+            departure = createOrbit(1, "SpacecraftHyperbolicDeparture");
+            departure.scaleFactor = 1.0/sunScaling;
+        }
+        departure.isVisible = oe.alpha < 0.;
+        if (departure.isVisible) {
+            departure.quaternion = primaryBodyUndo;
+            updateOrbit(departure, oe, 1, scSim.mu);
         }
     }
     
-    // Place Earth's moon
-    if (m_scSim.celestialObject == CELESTIAL_EARTH) {
-        SimObject moon1;
-        moon1.name = "Moon";
-        moon1.geometryName = "Moon";
-        moon1.position = QVector3D(celestialObject1State[0], celestialObject1State[1], celestialObject1State[2]) * globalScaleFactor;
-        moon1.scaleFactor = 1.0f * globalScaleFactor;
-        m_simObjects.push_back(moon1);
-        
-        // Create moon's orbit
-        if(m_toggleableObjects["Celestial Object Orbits"]) {
-            double tempR[3] = {celestialObject1State[0], celestialObject1State[1], celestialObject1State[2]};
-            double tempV[3] = {celestialObject1State[3], celestialObject1State[4], celestialObject1State[5]};
+    if(isShown[TOGGLE_CELESTIAL_ORBITS]) {
+        double tempR[3];
+        double tempV[3];
+        if (scSim.celestialObject == CELESTIAL_EARTH) {
+            // Create moon's orbit
+            v3Set(celestialObject1State[0], celestialObject1State[1], celestialObject1State[2], tempR);
+            v3Set(celestialObject1State[3], celestialObject1State[4], celestialObject1State[5], tempV);
             rv2elem(MU_EARTH, tempR, tempV, &oe);
-            tempSimObject = createOrbit(oe, 0, MU_EARTH,"Moon");
+            SimObject &moonOrbit = nextSimObject(primaryBody.simObjects, childIndex);
+            if(isRebuilt) {
+                moonOrbit = createOrbit(0, "Moon");
+            }
             // Undo the planets's rotation before placing orbit on screen
-            tempSimObject.quaternion = QQuaternion(cos(primaryBodyAngle/2.), 0.0, 0.0, sin(-primaryBodyAngle/2.));
-            primaryBody.simObjects.push_back(tempSimObject);
-        }
-    }
-    
-    // Place Mars moons
-    if (m_scSim.celestialObject == CELESTIAL_MARS) {
-        SimObject moon1;
-        moon1.name = "Phobos";
-        moon1.geometryName = "Phobos";
-        moon1.position = QVector3D(celestialObject1State[0], celestialObject1State[1], celestialObject1State[2]) * globalScaleFactor;
-        moon1.scaleFactor = 1.0f * globalScaleFactor; //30.0f
-        m_simObjects.push_back(moon1);
-        
-        SimObject moon2;
-        moon2.name = "Deimos";
-        moon2.geometryName = "Deimos";
-        moon2.position = QVector3D(celestialObject2State[0], celestialObject2State[1], celestialObject2State[2]) * globalScaleFactor;
-        moon2.scaleFactor = 1.0f * globalScaleFactor; //20.0f
-        m_simObjects.push_back(moon2);
-        
-        if(m_toggleableObjects["Celestial Object Orbits"]) {
+            moonOrbit.quaternion = primaryBodyUndo;
+            updateOrbit(moonOrbit, oe, 0, MU_EARTH);
+        } else if (scSim.celestialObject == CELESTIAL_MARS) {
             // Create Phobos orbit
-            double tempR[3] = {celestialObject1State[0], celestialObject1State[1], celestialObject1State[2]};
-            double tempV[3] = {celestialObject1State[3], celestialObject1State[4], celestialObject1State[5]};
+            v3Set(celestialObject1State[0], celestialObject1State[1], celestialObject1State[2], tempR);
+            v3Set(celestialObject1State[3], celestialObject1State[4], celestialObject1State[5], tempV);
             rv2elem(MU_MARS, tempR, tempV, &oe);
-            tempSimObject = createOrbit(oe, 0, MU_MARS,"Phobos");
+            SimObject &phobosOrbit = nextSimObject(primaryBody.simObjects, childIndex);
+            if(isRebuilt) {
+                phobosOrbit = createOrbit(0, "Phobos");
+            }
             // Undo the planets's rotation before placing orbit on screen
-            tempSimObject.quaternion = QQuaternion(cos(primaryBodyAngle/2.), 0.0, 0.0, sin(-primaryBodyAngle/2.));
-            primaryBody.simObjects.push_back(tempSimObject);
-            
+            phobosOrbit.quaternion = primaryBodyUndo;
+            updateOrbit(phobosOrbit, oe, 0, MU_MARS);
+    
             // Create Deimos orbit
             v3Set(celestialObject2State[0], celestialObject2State[1], celestialObject2State[2], tempR);
             v3Set(celestialObject2State[3], celestialObject2State[4], celestialObject2State[5], tempV);
             rv2elem(MU_MARS, tempR, tempV, &oe);
-            tempSimObject = createOrbit(oe, 0, MU_MARS,"Deimos");
+            SimObject &deimosOrbit = nextSimObject(primaryBody.simObjects, childIndex);
+            if(isRebuilt) {
+                deimosOrbit = createOrbit(0, "Deimos");
+            }
             // Undo the planets's rotation before placing orbit on screen
-            tempSimObject.quaternion = QQuaternion(cos(primaryBodyAngle/2.), 0.0, 0.0, sin(-primaryBodyAngle/2.));
-            primaryBody.simObjects.push_back(tempSimObject);
-        }
-    }
-    
-    if (m_scSim.celestialObject == CELESTIAL_SUN) {
-        SimObject temp;
-        double    planetScaling = 1200.;
-        temp.name = "Earth";
-        temp.geometryName = "Earth";
-        temp.position = QVector3D(celestialObject1State[0], celestialObject1State[1], celestialObject1State[2]) * globalScaleFactor;
-        temp.scaleFactor = planetScaling * globalScaleFactor;
-        m_simObjects.push_back(temp);
-        
-        temp.name = "Mars";
-        temp.geometryName = "Mars";
-        temp.position = QVector3D(celestialObject2State[0], celestialObject2State[1], celestialObject2State[2]) * globalScaleFactor;
-        temp.scaleFactor = planetScaling * REQ_MARS/REQ_EARTH * globalScaleFactor;
-        m_simObjects.push_back(temp);
-        
-        if(m_toggleableObjects["Celestial Object Orbits"]) {
+            deimosOrbit.quaternion = primaryBodyUndo;
+            updateOrbit(deimosOrbit, oe, 0, MU_MARS);
+        } else if (scSim.celestialObject == CELESTIAL_SUN) {
             // Create Earth orbit
-            double tempR[3] = {celestialObject1State[0], celestialObject1State[1], celestialObject1State[2]};
-            double tempV[3] = {celestialObject1State[3], celestialObject1State[4], celestialObject1State[5]};
+            v3Set(celestialObject1State[0], celestialObject1State[1], celestialObject1State[2], tempR);
+            v3Set(celestialObject1State[3], celestialObject1State[4], celestialObject1State[5], tempV);
             rv2elem(MU_SUN, tempR, tempV, &oe);
-            tempSimObject = createOrbit(oe, 0, MU_SUN,"Earth");
-            tempSimObject.scaleFactor = 1./sunScaling;
-            primaryBody.simObjects.push_back(tempSimObject);
-            
+            SimObject &earthOrbit = nextSimObject(primaryBody.simObjects, childIndex);
+            if(isRebuilt) {
+                earthOrbit = createOrbit(0, "Earth");
+                earthOrbit.scaleFactor = 1./sunScaling;
+            }
+            updateOrbit(earthOrbit, oe, 0, MU_SUN);
+    
             // Create Mars orbit
             v3Set(celestialObject2State[0], celestialObject2State[1], celestialObject2State[2], tempR);
             v3Set(celestialObject2State[3], celestialObject2State[4], celestialObject2State[5], tempV);
             rv2elem(MU_SUN, tempR, tempV, &oe);
-            tempSimObject = createOrbit(oe, 0, MU_SUN,"Mars");
-            tempSimObject.scaleFactor = 1./sunScaling;
-            primaryBody.simObjects.push_back(tempSimObject);
+            SimObject &marsOrbit = nextSimObject(primaryBody.simObjects, childIndex);
+            if(isRebuilt) {
+                marsOrbit = createOrbit(0, "Mars");
+                marsOrbit.scaleFactor = 1./sunScaling;
+            }
+            updateOrbit(marsOrbit, oe, 0, MU_SUN);
         }
     }
     
-    m_simObjects.push_back(primaryBody);
-    
-    SimObject spacecraft;
-    spacecraft.name = "Spacecraft";
-    spacecraft.position = QVector3D(m_scSim.r_N[0], m_scSim.r_N[1], m_scSim.r_N[2]) * globalScaleFactor;
+    SimObject &spacecraft = nextSimObject(scene.simObjects, index);
+    if(isRebuilt) {
+        spacecraft.name = "Spacecraft";
+        spacecraft.geometryName = "Spacecraft";
+    }
+    spacecraft.position = QVector3D(scSim.r_N[0], scSim.r_N[1], scSim.r_N[2]) * globalScaleFactor;
     double spacecraftq[4];
-    MRP2EP(m_scSim.sigma, spacecraftq);
+    MRP2EP(scSim.sigma, spacecraftq);
     spacecraft.quaternion = QQuaternion(spacecraftq[0], spacecraftq[1], spacecraftq[2], spacecraftq[3]);
     spacecraft.scaleFactor = scScale;
-    spacecraft.geometryName = "Spacecraft";
-    if(m_toggleableObjects["Spacecraft Body Frame Axes"]) {
-        SimObject temp;
-        temp = createXAxis();
-        spacecraft.simObjects.push_back(temp);
-        temp = createYAxis();
-        spacecraft.simObjects.push_back(temp);
-        temp = createZAxis();
-        spacecraft.simObjects.push_back(temp);
-    }
-    if(m_toggleableObjects["Spacecraft Hill Frame Axes"]) {
-        SimObject temp;
-        classicElements oe;
-        rv2elem(m_scSim.mu, m_scSim.r_N, m_scSim.v_N, &oe);
+    childIndex = 0;
+    if(isShown[TOGGLE_BODY_AXES]) {
+        updateAxes(spacecraft.simObjects, childIndex, isRebuilt, QQuaternion(), 1.25f,
+                   QVector4D(1.0, 0.0, 0.0, 1.0), QVector4D(0.0, 1.0, 0.0, 1.0), QVector4D(0.0, 0.0, 1.0, 1.0));
+    }
+    if(isShown[TOGGLE_HILL_AXES]) {
+        rv2elem(scSim.mu, scSim.r_N, scSim.v_N, &oe);
         e[0] = oe.Omega;
         e[1] = oe.i;
         e[2] = oe.omega + oe.f;
         double q[4];
         Euler3132EP(e, q);
-        temp = createXAxis(QVector4D(0.98f, 0.6f, 0.6f, 1.0f));
-        temp.quaternion = QQuaternion(-spacecraftq[0], spacecraftq[1], spacecraftq[2], spacecraftq[3])
-        * QQuaternion(q[0], q[1], q[2], q[3])
-        * temp.quaternion;
-        spacecraft.simObjects.push_back(temp);
-        temp = createYAxis(QVector4D(0.69f, 0.87f, 0.54f, 1.0f));
-        temp.quaternion = QQuaternion(-spacecraftq[0], spacecraftq[1], spacecraftq[2], spacecraftq[3])
-        * QQuaternion(q[0], q[1], q[2], q[3])
-        * temp.quaternion;
-        spacecraft.simObjects.push_back(temp);
-        temp = createZAxis(QVector4D(0.65f, 0.81f, 0.89f, 1.0f));
-        temp.quaternion = QQuaternion(-spacecraftq[0], spacecraftq[1], spacecraftq[2], spacecraftq[3])
-        * QQuaternion(q[0], q[1], q[2], q[3])
-        * temp.quaternion;
-        spacecraft.simObjects.push_back(temp);
-    }
-    if(m_toggleableObjects["Spacecraft Velocity Frame Axes"]) {
-        SimObject temp;
-        classicElements oe;
-        rv2elem(m_scSim.mu, m_scSim.r_N, m_scSim.v_N, &oe);
+        updateAxes(spacecraft.simObjects, childIndex, isRebuilt,
+                   QQuaternion(-spacecraftq[0], spacecraftq[1], spacecraftq[2], spacecraftq[3])
+                   * QQuaternion(q[0], q[1], q[2], q[3]), 1.25f,
+                   QVector4D(0.98f, 0.6f, 0.6f, 1.0f), QVector4D(0.69f, 0.87f, 0.54f, 1.0f), QVector4D(0.65f, 0.81f, 0.89f, 1.0f));
+    }
+    if(isShown[TOGGLE_VELOCITY_AXES]) {
+        rv2elem(scSim.mu, scSim.r_N, scSim.v_N, &oe);
         e[0] = oe.Omega;
         e[1] = oe.i;
         e[2] = oe.omega + oe.f - atan(oe.e*sin(oe.f)/(1.+oe.e*cos(oe.f)));
         double q[4];
         Euler3132EP(e, q);
-        temp = createXAxis(QVector4D(0.98f, 0.6f, 0.6f, 1.0f));
-        temp.quaternion = QQuaternion(-spacecraftq[0], spacecraftq[1], spacecraftq[2], spacecraftq[3])
-        * QQuaternion(q[0], q[1], q[2], q[3])
-        * temp.quaternion;
-        spacecraft.simObjects.push_back(temp);
-        temp = createYAxis(QVector4D(0.69f, 0.87f, 0.54f, 1.0f));
-        temp.quaternion = QQuaternion(-spacecraftq[0], spacecraftq[1], spacecraftq[2], spacecraftq[3])
-        * QQuaternion(q[0], q[1], q[2], q[3])
-        * temp.quaternion;
-        spacecraft.simObjects.push_back(temp);
-        temp = createZAxis(QVector4D(0.65f, 0.81f, 0.89f, 1.0f));
-        temp.quaternion = QQuaternion(-spacecraftq[0], spacecraftq[1], spacecraftq[2], spacecraftq[3])
-        * QQuaternion(q[0], q[1], q[2], q[3])
-        * temp.quaternion;
-        spacecraft.simObjects.push_back(temp);
-    }
-    if(m_toggleableObjects["Spacecraft Sun-Direction Vector"]) {
-        QVector4D color(1.0f, 1.0f, 0.0f, 1.0f);
-        SimObject temp;
-        temp.name = "Sun-Direction";
-        temp.position = QVector3D(0, 0, 0);
-        temp.quaternion = SimObject::computeRotation(QVector3D(m_scSim.sHatB[0], m_scSim.sHatB[1], m_scSim.sHatB[2]));
-        temp.geometryName = "UnitLine";
-        temp.scaleFactor = 1.1f;
-        temp.scaleByParentBoundingRadii = true;
-        temp.defaultMaterialOverride = QSharedPointer<Geometry::MaterialInfo>(new Geometry::MaterialInfo(color));
-        spacecraft.simObjects.push_back(temp);
-    }
-    if(m_toggleableObjects["Spacecraft Earth-Direction Vector"]) {
-        QVector4D color(0.0f, 1.0f, 1.0f, 1.0f);
-        SimObject temp;
-        temp.name = "Earth-Direction";
-        temp.position = QVector3D(0, 0, 0);
-        temp.quaternion = SimObject::computeRotation(QVector3D(m_scSim.earthHeadingSim_B[0],m_scSim.earthHeadingSim_B[1],m_scSim.earthHeadingSim_B[2]));
-        temp.geometryName = "UnitLine";
-        temp.scaleFactor = 1.1f;
-        temp.scaleByParentBoundingRadii = true;
-        temp.defaultMaterialOverride = QSharedPointer<Geometry::MaterialInfo>(new Geometry::MaterialInfo(color));
-        spacecraft.simObjects.push_back(temp);
-    }
-    if(m_toggleableObjects["Spacecraft Magnetic Field Vector"]) {
-        //QVector4D color(0.6f, 0.3f, 0.6f, 1.0f);
-        QVector4D color(220 / 255.0f, 50 / 255.0f, 220 / 255.0f, 1.0f);
-        SimObject temp;
-        temp.name = "Magnetic Field";
-        temp.position = QVector3D(0, 0, 0);
+        updateAxes(spacecraft.simObjects, childIndex, isRebuilt,
+                   QQuaternion(-spacecraftq[0], spacecraftq[1], spacecraftq[2], spacecraftq[3])
+                   * QQuaternion(q[0], q[1], q[2], q[3]), 1.25f,
+                   QVector4D(0.98f, 0.6f, 0.6f, 1.0f), QVector4D(0.69f, 0.87f, 0.54f, 1.0f), QVector4D(0.65f, 0.81f, 0.89f, 1.0f));
+    }
+    if(isShown[TOGGLE_SUN_DIRECTION]) {
+        SimObject &temp = nextSimObject(spacecraft.simObjects, childIndex);
+        if(isRebuilt) {
+            QVector4D color(1.0f, 1.0f, 0.0f, 1.0f);
+            temp.name = "Sun-Direction";
+            temp.position = QVector3D(0, 0, 0);
+            temp.geometryName = "UnitLine";
+            temp.scaleFactor = 1.1f;
+            temp.scaleByParentBoundingRadii = true;
+            temp.defaultMaterialOverride = QSharedPointer<Geometry::MaterialInfo>(new Geometry::MaterialInfo(color));
+        }
+        temp.quaternion = SimObject::computeRotation(QVector3D(scSim.sHatB[0], scSim.sHatB[1], scSim.sHatB[2]));
+    }
+    if(isShown[TOGGLE_EARTH_DIRECTION]) {
+        SimObject &temp = nextSimObject(spacecraft.simObjects, childIndex);
+        if(isRebuilt) {
+            QVector4D color(0.0f, 1.0f, 1.0f, 1.0f);
+            temp.name = "Earth-Direction";
+            temp.position = QVector3D(0, 0, 0);
+            temp.geometryName = "UnitLine";
+            temp.scaleFactor = 1.1f;
+            temp.scaleByParentBoundingRadii = true;
+            temp.defaultMaterialOverride = QSharedPointer<Geometry::MaterialInfo>(new Geometry::MaterialInfo(color));
+        }
+        temp.quaternion = SimObject::computeRotation(QVector3D(scSim.earthHeadingSim_B[0],scSim.earthHeadingSim_B[1],scSim.earthHeadingSim_B[2]));
+    }
+    if(isShown[TOGGLE_MAGNETIC_FIELD]) {
+        SimObject &temp = nextSimObject(spacecraft.simObjects, childIndex);
+        if(isRebuilt) {
+            //QVector4D color(0.6f, 0.3f, 0.6f, 1.0f);
+            QVector4D color(220 / 255.0f, 50 / 255.0f, 220 / 255.0f, 1.0f);
+            temp.name = "Magnetic Field";
+            temp.position = QVector3D(0, 0, 0);
+            temp.geometryName = "UnitLine";
+            temp.scaleFactor = 1.1f;
+            temp.scaleByParentBoundingRadii = true;
+            temp.defaultMaterialOverride = QSharedPointer<Geometry::MaterialInfo>(new Geometry::MaterialInfo(color));
+        }
         temp.quaternion = QQuaternion(-spacecraftq[0], spacecraftq[1], spacecraftq[2], spacecraftq[3])
-        * SimObject::computeRotation(QVector3D(m_scSim.B_N[0], m_scSim.B_N[1], m_scSim.B_N[2]));
-        temp.geometryName = "UnitLine";
-        temp.scaleFactor = 1.1f;
-        temp.scaleByParentBoundingRadii = true;
-        temp.defaultMaterialOverride = QSharedPointer<Geometry::MaterialInfo>(new Geometry::MaterialInfo(color));
-        spacecraft.simObjects.push_back(temp);
+        * SimObject::computeRotation(QVector3D(scSim.B_N[0], scSim.B_N[1], scSim.B_N[2]));
     }
     
-    // Spacecraft ACS Thrusters
+    // Spacecraft ACS Thrusters, kept while off and only shown while firing
     std::vector<Thruster>::iterator itAcsThrst;
-    for (itAcsThrst = m_scSim.acsThrusters.begin(); itAcsThrst != m_scSim.acsThrusters.end(); itAcsThrst++)
+    for (itAcsThrst = scSim.acsThrusters.begin(); itAcsThrst != scSim.acsThrusters.end(); itAcsThrst++)
     {
-        if((*itAcsThrst).level > 0)
-        {
-            tempq = SimObject::computeRotation(QVector3D((*itAcsThrst).gt_B[0], (*itAcsThrst).gt_B[1], (*itAcsThrst).gt_B[2]));
-            tempPosition = QVector3D((*itAcsThrst).r_B[0], (*itAcsThrst).r_B[1], (*itAcsThrst).r_B[2]) * scScale;
-            tempColor = QVector4D(1.0f, 0.5f, 0.0f, 1.0f);
-            double thrusterScaleFactor = 1.0f;
-            if (m_isSpacecraftTarget) {
-                if(m_scSim.celestialObject == CELESTIAL_EARTH) {
-                    thrusterScaleFactor = 0.25f;
-                } else if(m_scSim.celestialObject == CELESTIAL_MARS) {
-                    thrusterScaleFactor = 1.0f;
-                } else if(m_scSim.celestialObject == CELESTIAL_SUN) {
-                    thrusterScaleFactor = 1.5f;
-                } else {
-                    thrusterScaleFactor = 1.0f;
-                }
+        SimObject &thruster = nextSimObject(spacecraft.simObjects, childIndex);
+        if((*itAcsThrst).level <= 0 && !isRebuilt) {
+            thruster.isVisible = false;
+            continue;
+        }
+        tempq = SimObject::computeRotation(QVector3D((*itAcsThrst).gt_B[0], (*itAcsThrst).gt_B[1], (*itAcsThrst).gt_B[2]));
+        tempPosition = QVector3D((*itAcsThrst).r_B[0], (*itAcsThrst).r_B[1], (*itAcsThrst).r_B[2]) * scScale;
+        tempColor = QVector4D(1.0f, 0.5f, 0.0f, 1.0f);
+        double thrusterScaleFactor = 1.0f;
+        if (request.isSpacecraftTarget) {
+            if(scSim.celestialObject == CELESTIAL_EARTH) {
+                thrusterScaleFactor = 0.25f;
+            } else if(scSim.celestialObject == CELESTIAL_MARS) {
+                thrusterScaleFactor = 1.0f;
+            } else if(scSim.celestialObject == CELESTIAL_SUN) {
+                thrusterScaleFactor = 1.5f;
             } else {
-                if(m_scSim.celestialObject == CELESTIAL_EARTH) {
-                    thrusterScaleFactor = 0.25f;
-                } else if(m_scSim.celestialObject == CELESTIAL_MARS) {
-                    thrusterScaleFactor = 0.1f;
-                } else {
-                    thrusterScaleFactor = 0.1f;
-                }
+                thrusterScaleFactor = 1.0f;
+            }
+        } else {
+            if(scSim.celestialObject == CELESTIAL_EARTH) {
+                thrusterScaleFactor = 0.25f;
+            } else if(scSim.celestialObject == CELESTIAL_MARS) {
+                thrusterScaleFactor = 0.1f;
+            } else {
+                thrusterScaleFactor = 0.1f;
             }
-            SimObject thruster = createThruster(tempPosition,
-                                                tempq, 100., (*itAcsThrst).level/100, thrusterScaleFactor, tempColor);
-            spacecraft.simObjects.push_back(thruster);
         }
+        if(isRebuilt) {
+            thruster = createThruster(tempPosition, tempq, 100., (*itAcsThrst).level/100, thrusterScaleFactor, tempColor);
+        } else {
+            thruster.position = tempPosition;
+            thruster.quaternion = tempq;
+            thruster.scaleFactor = thrusterScaleFactor;
+            updateThruster(thruster, 100., (*itAcsThrst).level/100);
+        }
+        thruster.isVisible = (*itAcsThrst).level > 0;
     }
     
     // Spacecraft DV Thrusters
     std::vector<Thruster>::iterator dvIt;
-    for (dvIt = m_scSim.dvThrusters.begin(); dvIt != m_scSim.dvThrusters.end(); ++dvIt)
+    for (dvIt = scSim.dvThrusters.begin(); dvIt != scSim.dvThrusters.end(); ++dvIt)
     {
-        if((*dvIt).level > 0)
-        {
-            tempq = SimObject::computeRotation(QVector3D(-(*dvIt).gt_B[0], -(*dvIt).gt_B[1], -(*dvIt).gt_B[2]));
-            tempPosition = QVector3D((*dvIt).r_B[0], (*dvIt).r_B[1], (*dvIt).r_B[2]) * scScale*0.7;
-            double thrusterScaleFactor = 1.0f;
-            double plumeScale = 2.0;
-            if (m_isSpacecraftTarget) {
-                if(m_scSim.celestialObject == CELESTIAL_EARTH) {
-                    thrusterScaleFactor = 0.25f*plumeScale;
-                } else if(m_scSim.celestialObject == CELESTIAL_MARS) {
-                    thrusterScaleFactor = 1.0f*plumeScale;
-                } else {
-                    thrusterScaleFactor = 1.0f*plumeScale;
-                }
+        SimObject &thruster = nextSimObject(spacecraft.simObjects, childIndex);
+        if((*dvIt).level <= 0 && !isRebuilt) {
+            thruster.isVisible = false;
+            continue;
+        }
+        tempq = SimObject::computeRotation(QVector3D(-(*dvIt).gt_B[0], -(*dvIt).gt_B[1], -(*dvIt).gt_B[2]));
+        tempPosition = QVector3D((*dvIt).r_B[0], (*dvIt).r_B[1], (*dvIt).r_B[2]) * scScale*0.7;
+        double thrusterScaleFactor = 1.0f;
+        double plumeScale = 2.0;
+        if (request.isSpacecraftTarget) {
+            if(scSim.celestialObject == CELESTIAL_EARTH) {
+                thrusterScaleFactor = 0.25f*plumeScale;
+            } else if(scSim.celestialObject == CELESTIAL_MARS) {
+                thrusterScaleFactor = 1.0f*plumeScale;
             } else {
-                if(m_scSim.celestialObject == CELESTIAL_EARTH) {
-                    thrusterScaleFactor = 0.25f*plumeScale;
-                } else if(m_scSim.celestialObject == CELESTIAL_MARS) {
-                    thrusterScaleFactor = 0.1f*plumeScale;
-                } else {
-                    thrusterScaleFactor = 0.1f*plumeScale;
-                }
+                thrusterScaleFactor = 1.0f*plumeScale;
             }
-            SimObject thruster = createThruster(tempPosition, tempq, 25.0f*plumeScale, (*dvIt).level/50, thrusterScaleFactor);
-            spacecraft.simObjects.push_back(thruster);
+        } else {
+            if(scSim.celestialObject == CELESTIAL_EARTH) {
+                thrusterScaleFactor = 0.25f*plumeScale;
+            } else if(scSim.celestialObject == CELESTIAL_MARS) {
+                thrusterScaleFactor = 0.1f*plumeScale;
+            } else {
+                thrusterScaleFactor = 0.1f*plumeScale;
+            }
+        }
+        if(isRebuilt) {
+            thruster = createThruster(tempPosition, tempq, 25.0f*plumeScale, (*dvIt).level/50, thrusterScaleFactor);
+        } else {
+            thruster.position = tempPosition;
+            thruster.quaternion = tempq;
+            thruster.scaleFactor = thrusterScaleFactor;
+            updateThruster(thruster, 25.0f*plumeScale, (*dvIt).level/50);
         }
+        thruster.isVisible = (*dvIt).level > 0;
     }
     
     // Spacecraft CSS
     QVector4D colorSolid;
     QVector4D colorOpaque;
-    for(i = 0; i < NUM_CSS; i ++) {
-        tempq = SimObject::computeRotation(QVector3D(m_scSim.css[i].nHatB[0], m_scSim.css[i].nHatB[1], m_scSim.css[i].nHatB[2]));
-        tempPosition = QVector3D(m_scSim.css[i].r_B[0],m_scSim.css[i].r_B[1],m_scSim.css[i].r_B[2]) * scScale;
-        
-        if(m_scSim.css[i].state!=COMPONENT_FAULT){
-            
-            if (m_scSim.css[i].directValue > 0) {
+    for(i = 0; i < NUM_CSS && (isShown[TOGGLE_CSS_FIELD_OF_VIEW] || isShown[TOGGLE_CSS_NORMALS]); i ++) {
+        tempq = SimObject::computeRotation(QVector3D(scSim.css[i].nHatB[0], scSim.css[i].nHatB[1], scSim.css[i].nHatB[2]));
+        tempPosition = QVector3D(scSim.css[i].r_B[0],scSim.css[i].r_B[1],scSim.css[i].r_B[2]) * scScale;
+    
+        if(scSim.css[i].state!=COMPONENT_FAULT){
+    
+            if (scSim.css[i].directValue > 0) {
                 colorSolid = QVector4D(1.0f, 1.0f, 0.0f, 1.0f);
                 colorOpaque = QVector4D(1.0f, 1.0f, 0.0f, 0.4f);
             } else {
@@ -777,53 +1703,62 @@ void AdcsSimDataManager::updateSimObjects()
             colorSolid = QVector4D(1.0f, 0.0f, 0.0f, 1.0f);
             colorOpaque = QVector4D(1.0f, 0.0f, 0.0f, 0.4f);
         }
-        if (m_toggleableObjects["CSS Field Of View"]) {
-            tempSimObject = createFieldOfView(tempPosition, tempq, 1.0f, 2*m_scSim.css[i].fov*180/M_PI
-                                              , colorOpaque);
+        if (isShown[TOGGLE_CSS_FIELD_OF_VIEW]) {
+            SimObject &fieldOfView = nextSimObject(spacecraft.simObjects, childIndex);
+            if(isRebuilt) {
+                fieldOfView = createFieldOfView(tempPosition, tempq, 1.0f, 2*scSim.css[i].fov*180/M_PI
+                                                , colorOpaque);
+            }
             double fieldOfViewScaleFactor = 1.0f;
-            if (m_isSpacecraftTarget) {
-                if(m_scSim.celestialObject == CELESTIAL_EARTH) {
+            if (request.isSpacecraftTarget) {
+                if(scSim.celestialObject == CELESTIAL_EARTH) {
                     fieldOfViewScaleFactor = 0.35f;
-                } else if(m_scSim.celestialObject == CELESTIAL_MARS) {
+                } else if(scSim.celestialObject == CELESTIAL_MARS) {
                     fieldOfViewScaleFactor = 1.0f;
                 } else {
                     fieldOfViewScaleFactor = 1.0f;
                 }
             } else {
-                if(m_scSim.celestialObject == CELESTIAL_EARTH) {
+                if(scSim.celestialObject == CELESTIAL_EARTH) {
                     fieldOfViewScaleFactor = 0.075f;
-                } else if(m_scSim.celestialObject == CELESTIAL_MARS) {
+                } else if(scSim.celestialObject == CELESTIAL_MARS) {
                     fieldOfViewScaleFactor = 0.05f;
                 } else {
                     fieldOfViewScaleFactor = 0.06f;
                 }
             }
-            tempSimObject.scaleFactor = fieldOfViewScaleFactor;
-            spacecraft.simObjects.push_back(tempSimObject);
+            fieldOfView.position = tempPosition;
+            fieldOfView.quaternion = tempq;
+            fieldOfView.scaleFactor = fieldOfViewScaleFactor;
+            updateColor(fieldOfView, colorOpaque);
         }
-        if (m_toggleableObjects["CSS Photo Diode Normals"]) {
-            tempSimObject = createFadingAxis(tempPosition, tempq, colorSolid);
-            tempSimObject.name = "cssSensorNormal";
-            spacecraft.simObjects.push_back(tempSimObject);
+        if (isShown[TOGGLE_CSS_NORMALS]) {
+            SimObject &sensorNormal = nextSimObject(spacecraft.simObjects, childIndex);
+            if(isRebuilt) {
+                sensorNormal = createFadingAxis(tempPosition, tempq, colorSolid);
+                sensorNormal.name = "cssSensorNormal";
+            }
+            sensorNormal.position = tempPosition;
+            sensorNormal.quaternion = tempq;
+            updateColor(sensorNormal, colorSolid);
         }
     }
     
     // Spacecraft RW
-    Legend m_legendColors;
-    if (m_toggleableObjects["Reaction Wheel Pyramid"])
+    if (isShown[TOGGLE_RW_PYRAMID])
     {
         QVector4D colorRW = QVector4D(1.0f, 1.0f, 1.0f, 0.25f);
         std::vector<RWSim>::iterator itRw;
-        for (itRw = m_scSim.reactionWheels.begin(); itRw != m_scSim.reactionWheels.end(); itRw++)
+        for (itRw = scSim.reactionWheels.begin(); itRw != scSim.reactionWheels.end(); itRw++)
         {
             // Set color
             if (itRw->state == COMPONENT_ON)
             {
                 colorRW = QVector4D(180 / 255.0f, 160 / 255.0f, 240 / 255.0f, 1.0f);
                 float percent =  fabs(itRw->Omega / itRw->Omega_max * 100);
-                int range = 100 / (m_legendColors.colorPalette.size()-1);
+                int range = 100 / (m_legendPalette.size()-1);
                 int colorIndex = 0;
-                for (int i = 0; i < m_legendColors.colorPalette.size(); i++)
+                for (int i = 0; i < m_legendPalette.size(); i++)
                 {
                     if (percent <= range * (i + 1))
                     {
@@ -831,20 +1766,20 @@ void AdcsSimDataManager::updateSimObjects()
                         break;
                     }
                 }
-                colorRW = QVector4D(m_legendColors.colorPalette[colorIndex].red() / 255.0,
-                                    m_legendColors.colorPalette[colorIndex].green() / 255.0,
-                                    m_legendColors.colorPalette[colorIndex].blue() / 255.0,
+                colorRW = QVector4D(m_legendPalette.at(colorIndex).red() / 255.0,
+                                    m_legendPalette.at(colorIndex).green() / 255.0,
+                                    m_legendPalette.at(colorIndex).blue() / 255.0,
                                     1.0f);
             } else if (itRw->state == COMPONENT_OFF && itRw->resetCounter>=3) {
                 colorRW = QVector4D(0.7f, 0.0f, 0.0f, 1.0f);
             } else {
                 colorRW = QVector4D(47.0 / 255, 78.0 / 255, 78.0 / 255, 1.0f);
             }
-            
-            
+    
+    
             colorRW = QVector4D(47.0 / 255, 78.0 / 255, 78.0 / 255, 1.0f);
             float percent_w =  fabs(itRw->Omega / itRw->Omega_max * 100);
-            
+    
             if (percent_w < 10)
             {
                 colorRW = QVector4D(100 / 255, 200 / 255, 78.0 / 255, 1.0f);
@@ -869,70 +1804,70 @@ void AdcsSimDataManager::updateSimObjects()
             //            colorPalette.append (QColor(qRgb(255, 255, 130)));
             //            colorPalette.append (QColor(qRgb(255, 170,100)));
             //            colorPalette.append (QColor(qRgb(255, 0, 70)));
-            
-            
+    
+    
             // RW Spin Normals
-            SimObject temp;
-            temp.name = "RW-Axis";
+            SimObject &temp = nextSimObject(spacecraft.simObjects, childIndex);
+            if(isRebuilt) {
+                temp.name = "RW-Axis";
+                temp.geometryName = "UnitLine";
+                temp.scaleFactor = 1.25f;
+                temp.scaleByParentBoundingRadii = true;
+                temp.defaultMaterialOverride = QSharedPointer<Geometry::MaterialInfo>(new Geometry::MaterialInfo(colorRW));
+            }
             temp.position = QVector3D(itRw->rWB_S[0],itRw->rWB_S[1],itRw->rWB_S[2]) * scScale;
             temp.quaternion = SimObject::computeRotation(QVector3D(itRw->gsHat_S[0], itRw->gsHat_S[1], itRw->gsHat_S[2]));
-            temp.geometryName = "UnitLine";
-            temp.scaleFactor = 1.25f;
-            temp.scaleByParentBoundingRadii = true;
-            temp.defaultMaterialOverride = QSharedPointer<Geometry::MaterialInfo>(new Geometry::MaterialInfo(colorRW));
-            spacecraft.simObjects.push_back(temp);
-            
+            updateColor(temp, colorRW);
+    
             // RW Disks
             tempPosition = QVector3D(itRw->rWB_S[0], itRw->rWB_S[1], itRw->rWB_S[2]) * scScale * 6;
             tempq = SimObject::computeRotation(QVector3D(itRw->gsHat_S[0], itRw->gsHat_S[1], itRw->gsHat_S[2]));
-            
-            if (itRw->Omega < 0)
-            {
-                tempSimObject = createDiskRW(tempPosition, tempq, 1.0f, colorRW, false);
-            } else {
-                tempSimObject = createDiskRW(tempPosition, tempq, 1.0f, colorRW, true);
+    
+            SimObject &diskRW = nextSimObject(spacecraft.simObjects, childIndex);
+            if(isRebuilt) {
+                diskRW = createDiskRW(tempPosition, tempq, 1.0f, colorRW, itRw->Omega >= 0);
             }
-            
+    
             double rwDiskScaleFactor = 1.0f;
-            if (m_isSpacecraftTarget) {
-                if(m_scSim.celestialObject == CELESTIAL_EARTH) {
+            if (request.isSpacecraftTarget) {
+                if(scSim.celestialObject == CELESTIAL_EARTH) {
                     rwDiskScaleFactor = 0.35f;
-                } else if(m_scSim.celestialObject == CELESTIAL_MARS) {
+                } else if(scSim.celestialObject == CELESTIAL_MARS) {
                     rwDiskScaleFactor = 1.0f;
                 } else {
                     rwDiskScaleFactor = 1.0f;
                 }
             } else {
-                if(m_scSim.celestialObject == CELESTIAL_EARTH) {
+                if(scSim.celestialObject == CELESTIAL_EARTH) {
                     rwDiskScaleFactor = 0.075f;
-                } else if(m_scSim.celestialObject == CELESTIAL_MARS) {
+                } else if(scSim.celestialObject == CELESTIAL_MARS) {
                     rwDiskScaleFactor = 0.05f;
                 } else {
                     rwDiskScaleFactor = 0.06f;
                 }
             }
-            tempSimObject.scaleFactor = rwDiskScaleFactor;
-            spacecraft.simObjects.push_back(tempSimObject);
+            diskRW.position = tempPosition;
+            diskRW.quaternion = tempq;
+            diskRW.scaleFactor = rwDiskScaleFactor;
+            updateColor(diskRW, colorRW);
+            updateDiskRW(diskRW, itRw->Omega >= 0);
         }
-        emit setOnOffLegendRW(true);
-    } else {
-        emit setOnOffLegendRW(false);
     }
     
     // Torque Rods
-    if (m_toggleableObjects["Torque Rod Pyramid"])
+    if (isShown[TOGGLE_TR_PYRAMID])
     {
         QVector4D colorTR = QVector4D(1.0f, 1.0f, 1.0f, 0.25f);
         for(i = 0; i < NUM_TR; i ++)
         {
             // Set color
-            if (m_scSim.tr[i].state == COMPONENT_ON)
+            if (scSim.tr[i].state == COMPONENT_ON)
             {
                 colorTR = QVector4D(1.0, 150 / 255.0, 1.0, 1.0f);
-                float percent =  fabs(m_scSim.tr[i].u / 6.0 * 100);
-                int range = 100 / (m_legendColors.colorPalette.size()-1);
+                float percent =  fabs(scSim.tr[i].u / 6.0 * 100);
+                int range = 100 / (m_legendPalette.size()-1);
                 int colorIndex = 0;
-                for (int i = 0; i < m_legendColors.colorPalette.size(); i++)
+                for (int i = 0; i < m_legendPalette.size(); i++)
                 {
                     if (percent <= range * (i + 1))
                     {
@@ -940,114 +1875,140 @@ void AdcsSimDataManager::updateSimObjects()
                         break;
                     }
                 }
-                colorTR = QVector4D(m_legendColors.colorPalette[colorIndex].red() / 255.0,
-                                    m_legendColors.colorPalette[colorIndex].green() / 255.0,
-                                    m_legendColors.colorPalette[colorIndex].blue() / 255.0,
+                colorTR = QVector4D(m_legendPalette.at(colorIndex).red() / 255.0,
+                                    m_legendPalette.at(colorIndex).green() / 255.0,
+                                    m_legendPalette.at(colorIndex).blue() / 255.0,
                                     1.0f);
             } else {
                 colorTR = QVector4D(47.0 / 255, 78.0 / 255, 78.0 / 255, 1.0f);
             }
-            
+    
             // TR Dipole Axes
-            SimObject temp;
-            temp.name = "TR-Axis";
-            temp.position = QVector3D(m_scSim.tr[i].r_B[0], m_scSim.tr[i].r_B[1], m_scSim.tr[i].r_B[2]) * scScale;
-            temp.quaternion = SimObject::computeRotation(QVector3D(m_scSim.tr[i].dipoleAxis[0], m_scSim.tr[i].dipoleAxis[1], m_scSim.tr[i].dipoleAxis[2]));
-            temp.geometryName = "UnitLine";
-            temp.scaleFactor = 1.75f;
-            temp.scaleByParentBoundingRadii = true;
-            temp.defaultMaterialOverride = QSharedPointer<Geometry::MaterialInfo>(new Geometry::MaterialInfo(colorTR));
-            spacecraft.simObjects.push_back(temp);
-            
+            tempPosition = QVector3D(scSim.tr[i].r_B[0], scSim.tr[i].r_B[1], scSim.tr[i].r_B[2]) * scScale;
+            tempq = SimObject::computeRotation(QVector3D(scSim.tr[i].dipoleAxis[0], scSim.tr[i].dipoleAxis[1], scSim.tr[i].dipoleAxis[2]));
+            SimObject &temp = nextSimObject(spacecraft.simObjects, childIndex);
+            if(isRebuilt) {
+                temp.name = "TR-Axis";
+                temp.geometryName = "UnitLine";
+                temp.scaleFactor = 1.75f;
+                temp.scaleByParentBoundingRadii = true;
+                temp.defaultMaterialOverride = QSharedPointer<Geometry::MaterialInfo>(new Geometry::MaterialInfo(colorTR));
+            }
+            temp.position = tempPosition;
+            temp.quaternion = tempq;
+            updateColor(temp, colorTR);
+    
             // TR Bars
-            tempPosition = QVector3D(m_scSim.tr[i].r_B[0], m_scSim.tr[i].r_B[1], m_scSim.tr[i].r_B[2]) * scScale;
-            tempq = SimObject::computeRotation(QVector3D(m_scSim.tr[i].dipoleAxis[0], m_scSim.tr[i].dipoleAxis[1], m_scSim.tr[i].dipoleAxis[2]));
-            tempSimObject = createTorqueBar(tempPosition, tempq, 1.0f, colorTR);
-            
+            SimObject &torqueBar = nextSimObject(spacecraft.simObjects, childIndex);
+            if(isRebuilt) {
+                torqueBar = createTorqueBar(tempPosition, tempq, 1.0f, colorTR);
+            }
+    
             double torqueBarScaleFactor = 1.0f;
-            if (m_isSpacecraftTarget) {
-                if(m_scSim.celestialObject == CELESTIAL_EARTH) {
+            if (request.isSpacecraftTarget) {
+                if(scSim.celestialObject == CELESTIAL_EARTH) {
                     torqueBarScaleFactor = 0.35f;
-                } else if(m_scSim.celestialObject == CELESTIAL_MARS) {
+                } else if(scSim.celestialObject == CELESTIAL_MARS) {
                     torqueBarScaleFactor = 1.0f;
                 } else {
                     torqueBarScaleFactor = 1.0f;
                 }
             } else {
-                if(m_scSim.celestialObject == CELESTIAL_EARTH) {
+                if(scSim.celestialObject == CELESTIAL_EARTH) {
                     torqueBarScaleFactor = 0.075f;
-                } else if(m_scSim.celestialObject == CELESTIAL_MARS) {
+                } else if(scSim.celestialObject == CELESTIAL_MARS) {
                     torqueBarScaleFactor = 0.05f;
                 } else {
                     torqueBarScaleFactor = 0.06f;
                 }
             }
-            tempSimObject.scaleFactor = torqueBarScaleFactor;
-            spacecraft.simObjects.push_back(tempSimObject);
+            torqueBar.position = tempPosition;
+            torqueBar.quaternion = tempq;
+            torqueBar.scaleFactor = torqueBarScaleFactor;
+            updateColor(torqueBar, colorTR);
         }
-        emit setOnOffLegendTR(true);
-    } else {
-        emit setOnOffLegendTR(false);
     }
     
     // Spacecraft ST
     
     QVector4D colorST = QVector4D(0.0f, 1.0f, 1.0f, 1.0f);
-    if (m_toggleableObjects["Star Tracker Pointing Normals"])
+    if (isShown[TOGGLE_ST_NORMALS])
     {
-        tempq = SimObject::computeRotation(QVector3D(m_scSim.st.gs_head1[0],m_scSim.st.gs_head1[1],m_scSim.st.gs_head1[2]) * scScale);
-        tempPosition = QVector3D(m_scSim.st.r_B_head1[0],m_scSim.st.r_B_head1[1],m_scSim.st.r_B_head1[2])* scScale;
-        SimObject starTrackerPointer1 = createFadingAxis(tempPosition, tempq, colorST);
-        spacecraft.simObjects.push_back(starTrackerPointer1);
-        
-        tempq = SimObject::computeRotation(QVector3D(m_scSim.st.gs_head2[0],m_scSim.st.gs_head2[1],m_scSim.st.gs_head2[2]) * scScale );
-        tempPosition = QVector3D(m_scSim.st.r_B_head2[0],m_scSim.st.r_B_head2[1],m_scSim.st.r_B_head2[2])* scScale;
-        SimObject starTrackerPointer2 = createFadingAxis(tempPosition, tempq, colorST);
-        spacecraft.simObjects.push_back(starTrackerPointer2);
+        tempq = SimObject::computeRotation(QVector3D(scSim.st.gs_head1[0],scSim.st.gs_head1[1],scSim.st.gs_head1[2]) * scScale);
+        tempPosition = QVector3D(scSim.st.r_B_head1[0],scSim.st.r_B_head1[1],scSim.st.r_B_head1[2])* scScale;
+        SimObject &starTrackerPointer1 = nextSimObject(spacecraft.simObjects, childIndex);
+        if(isRebuilt) {
+            starTrackerPointer1 = createFadingAxis(tempPosition, tempq, colorST);
+        }
+        starTrackerPointer1.position = tempPosition;
+        starTrackerPointer1.quaternion = tempq;
+    
+        tempq = SimObject::computeRotation(QVector3D(scSim.st.gs_head2[0],scSim.st.gs_head2[1],scSim.st.gs_head2[2]) * scScale );
+        tempPosition = QVector3D(scSim.st.r_B_head2[0],scSim.st.r_B_head2[1],scSim.st.r_B_head2[2])* scScale;
+        SimObject &starTrackerPointer2 = nextSimObject(spacecraft.simObjects, childIndex);
+        if(isRebuilt) {
+            starTrackerPointer2 = createFadingAxis(tempPosition, tempq, colorST);
+        }
+        starTrackerPointer2.position = tempPosition;
+        starTrackerPointer2.quaternion = tempq;
     }
     
-    if (m_toggleableObjects["Star Tracker Field of View"])
+    if (isShown[TOGGLE_ST_FIELD_OF_VIEW])
     {
         // Scale Factor
         double stFovScaleFactor = 1.0f;
-        if (m_isSpacecraftTarget) {
-            if(m_scSim.celestialObject == CELESTIAL_EARTH) {
+        if (request.isSpacecraftTarget) {
+            if(scSim.celestialObject == CELESTIAL_EARTH) {
                 stFovScaleFactor = 0.35f;
-            } else if(m_scSim.celestialObject == CELESTIAL_MARS) {
+            } else if(scSim.celestialObject == CELESTIAL_MARS) {
                 stFovScaleFactor = 1.0f;
             } else {
                 stFovScaleFactor = 1.0f;
             }
         } else {
-            if(m_scSim.celestialObject == CELESTIAL_EARTH) {
+            if(scSim.celestialObject == CELESTIAL_EARTH) {
                 stFovScaleFactor = 0.075f;
-            } else if(m_scSim.celestialObject == CELESTIAL_MARS) {
+            } else if(scSim.celestialObject == CELESTIAL_MARS) {
                 stFovScaleFactor = 0.05f;
             } else {
                 stFovScaleFactor = 0.06f;
             }
         }
         // FOV (cuboid) head 1
-        tempq = SimObject::computeRotation(QVector3D(m_scSim.st.gs_head1[0], m_scSim.st.gs_head1[1], m_scSim.st.gs_head1[2]));
-        tempPosition = QVector3D(m_scSim.st.r_B_head1[0], m_scSim.st.r_B_head1[1], m_scSim.st.r_B_head1[2]) * scScale;
-        SimObject starTrackerFOV1 = createStarTrackerFOV(tempPosition, tempq, 1.0f, M_PI/8, colorST);
+        tempq = SimObject::computeRotation(QVector3D(scSim.st.gs_head1[0], scSim.st.gs_head1[1], scSim.st.gs_head1[2]));
+        tempPosition = QVector3D(scSim.st.r_B_head1[0], scSim.st.r_B_head1[1], scSim.st.r_B_head1[2]) * scScale;
+        SimObject &starTrackerFOV1 = nextSimObject(spacecraft.simObjects, childIndex);
+        if(isRebuilt) {
+            starTrackerFOV1 = createStarTrackerFOV(tempPosition, tempq, 1.0f, M_PI/8, colorST);
+        }
+        starTrackerFOV1.position = tempPosition;
+        starTrackerFOV1.quaternion = tempq;
         starTrackerFOV1.scaleFactor = stFovScaleFactor;
-        spacecraft.simObjects.push_back(starTrackerFOV1);
-        
+    
         // FOV (cuboid) head 2
-        tempq = SimObject::computeRotation(QVector3D(m_scSim.st.gs_head2[0], m_scSim.st.gs_head2[1], m_scSim.st.gs_head2[2]));
-        tempPosition = QVector3D(m_scSim.st.r_B_head2[0], m_scSim.st.r_B_head2[1], m_scSim.st.r_B_head2[2]) * scScale;
-        SimObject starTrackerFOV2 = createStarTrackerFOV(tempPosition, tempq, 1.0f, M_PI/8, colorST);
+        tempq = SimObject::computeRotation(QVector3D(scSim.st.gs_head2[0], scSim.st.gs_head2[1], scSim.st.gs_head2[2]));
+        tempPosition = QVector3D(scSim.st.r_B_head2[0], scSim.st.r_B_head2[1], scSim.st.r_B_head2[2]) * scScale;
+        SimObject &starTrackerFOV2 = nextSimObject(spacecraft.simObjects, childIndex);
+        if(isRebuilt) {
+            starTrackerFOV2 = createStarTrackerFOV(tempPosition, tempq, 1.0f, M_PI/8, colorST);
+        }
+        starTrackerFOV2.position = tempPosition;
+        starTrackerFOV2.quaternion = tempq;
         starTrackerFOV2.scaleFactor = stFovScaleFactor;
-        spacecraft.simObjects.push_back(starTrackerFOV2);
-        
-    }
     
-    m_simObjects.push_back(spacecraft);
-    
-    m_preferredCameraTarget = m_simObjects.length() - 1;
+    }
     
-    emit simDataUpdated();
+    scene.preferredCameraTarget = scene.simObjects.length() - 1;
+    if (scSim.celestialObject != CELESTIAL_SUN) {
+        scene.lightPosition = QVector3D(scSim.sHatN[0], scSim.sHatN[1], scSim.sHatN[2]).normalized() * (float)AU;
+    } else {
+        scene.lightPosition = QVector3D(0., 0., 0.);
+    }
+    scene.mu = scSim.mu;
+    for(i = 0; i < 3; i++) {
+        scene.sHatN[i] = scSim.sHatN[i];
+        scene.sHatB[i] = scSim.sHatB[i];
+    }
 }
 
 void AdcsSimDataManager::updateReturnData()
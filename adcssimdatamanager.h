@@ -21,15 +21,191 @@
 
 #include "simdatamanager.h"
 #include "TcpSerializeClient.hpp"
+#include "ShmSerializeClient.hpp"
+#include "TcpJsonClient.hpp"
+#include "UdpSerializeClient.hpp"
+#include "RecordingPlayer.hpp"
+#include "TelemetryRecorder.hpp"
+#include "FrameInterpolator.hpp"
+#include "SampleHistory.hpp"
+#include "LatencyHistogram.hpp"
+#include "TripleBuffer.hpp"
+#include "EphemerisCache.hpp"
 #include "SpacecraftSimDefinitions.h"
 
-#include <QTimerEvent>
 #include <boost/asio.hpp>
+#include <boost/atomic.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <QColor>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QList>
 
 extern "C" {
 #include "utilities/linearAlgebra.h"
 }
 
+// Transports of a connection, selected by the prefix of its address
+typedef enum {
+    TRANSPORT_TCP,              // Boost archives over TCP
+    TRANSPORT_SHARED_MEMORY,    // Boost archives through a shared memory ring
+    TRANSPORT_JSON,             // Newline-delimited JSON over TCP
+    TRANSPORT_UDP,              // Boost archives multicast over UDP, receive only
+    MAX_TRANSPORT
+} Transport_t;
+
+// Stages of a frame from the simulation to the screen, each measured from
+// the end of the previous one
+typedef enum {
+    LATENCY_NETWORK,    // Published by the simulation to read from the socket
+    LATENCY_DECODE,     // Read to deserialized
+    LATENCY_HANDOVER,   // Deserialized to picked up by the GUI thread
+    LATENCY_SCENE,      // Requesting the scene of a display update to it being built
+    LATENCY_PRESENT,    // Scene objects built to the frame swapped on screen
+    LATENCY_TOTAL,      // Published to on screen, for the newest frame shown
+    MAX_LATENCY_STAGE
+} LatencyStage_t;
+
+// Toggleable objects that change which objects the scene is made of
+typedef enum {
+    TOGGLE_FIXED_AXES,
+    TOGGLE_INERTIAL_AXES,
+    TOGGLE_SPACECRAFT_ORBIT,
+    TOGGLE_CELESTIAL_ORBITS,
+    TOGGLE_BODY_AXES,
+    TOGGLE_HILL_AXES,
+    TOGGLE_VELOCITY_AXES,
+    TOGGLE_SUN_DIRECTION,
+    TOGGLE_EARTH_DIRECTION,
+    TOGGLE_MAGNETIC_FIELD,
+    TOGGLE_CSS_FIELD_OF_VIEW,
+    TOGGLE_CSS_NORMALS,
+    TOGGLE_RW_PYRAMID,
+    TOGGLE_TR_PYRAMID,
+    TOGGLE_ST_NORMALS,
+    TOGGLE_ST_FIELD_OF_VIEW,
+    MAX_SCENE_TOGGLE
+} SceneToggle_t;
+
+// What the scene objects were built from. While it stays the same the
+// objects are kept and only their transforms and parameters are updated.
+struct SceneLayout
+{
+    SceneLayout()
+        : generation(0)
+        , celestialObject(CELESTIAL_EARTH)
+        , acsThrusters(0)
+        , dvThrusters(0)
+        , reactionWheels(0)
+    {
+        for(int i = 0; i < MAX_SCENE_TOGGLE; i++) {
+            isShown[i] = false;
+        }
+    }
+
+    // Of the data source, 0 before the objects were built
+    unsigned long generation;
+    CelestialObject_t celestialObject;
+    size_t acsThrusters;
+    size_t dvThrusters;
+    size_t reactionWheels;
+    // The toggleable objects as they were, and the ones shown by
+    // SceneToggle_t so they are not looked up by name every frame
+    toggleableObjectMap toggleableObjects;
+    bool isShown[MAX_SCENE_TOGGLE];
+};
+
+// What a scene is built from, handed from the GUI thread to the scene thread
+struct SceneRequest
+{
+    SceneRequest()
+        : isSpacecraftTarget(false)
+        , layoutGeneration(0)
+        , isMeasured(false)
+        , publishTime(0)
+        , requestTime(0.0)
+    {
+
+    }
+
+    SpacecraftSim scSim;
+    toggleableObjectMap toggleableObjects;
+    bool isSpacecraftTarget;
+    // Changes with every data source, which has the scene built anew
+    unsigned long layoutGeneration;
+    // Display updates of connections count in the diagnostics. Publish time
+    // of the newest frame received in milliseconds since epoch and the time
+    // the scene was requested.
+    bool isMeasured;
+    long publishTime;
+    double requestTime;
+};
+
+// A scene built on the scene thread. Every buffer between the threads keeps
+// its own objects and layout, so they are updated in place like before.
+struct AdcsScene : public SceneSnapshot
+{
+    AdcsScene()
+        : mu(0.0)
+        , isMeasured(false)
+        , publishTime(0)
+        , requestTime(0.0)
+        , buildTime(0.0)
+    {
+        for(int i = 0; i < 3; i++) {
+            sHatN[i] = 0.0;
+            sHatB[i] = 0.0;
+        }
+    }
+
+    SceneLayout layout;
+    // Derived from the frame while building, handed back to the docks
+    double mu;
+    double sHatN[3];
+    double sHatB[3];
+    // Of the request, and the time the scene was built
+    bool isMeasured;
+    long publishTime;
+    double requestTime;
+    double buildTime;
+};
+
+// One diagnostics interval of a connection. Latencies are in milliseconds,
+// the network stage and the total compare clocks of the simulation's host
+// and this one. The display delay is not part of the total, it comes on top.
+struct PipelineDiagnostics
+{
+    PipelineDiagnostics()
+        : interval(0.0)
+        , framesPerSecond(0.0)
+        , displayedPerSecond(0.0)
+        , bytesPerSecond(0.0)
+        , framesReceived(0)
+        , framesDisplayed(0)
+        , framesDropped(0)
+    {
+
+    }
+
+    LatencyHistogram stages[MAX_LATENCY_STAGE];
+    // Seconds covered
+    double interval;
+    double framesPerSecond;
+    // Display updates presented per second
+    double displayedPerSecond;
+    // Not known for shared memory
+    double bytesPerSecond;
+    // Since the connection was opened
+    unsigned long framesReceived;
+    unsigned long framesDisplayed;
+    // Frames lost, corrupt or replaced by a newer one before the GUI thread
+    // saw them, since the connection was opened
+    unsigned long framesDropped;
+};
+
 class AdcsSimDataManager : public SimDataManager
 {
     Q_OBJECT
@@ -42,13 +218,50 @@ public:
     virtual bool closeConnection();
     virtual bool openFile(QString filename);
     virtual bool closeFile();
+    // Compression requested from the simulation on the next TCP connection
+    void setCompression(Compression_t codec);
+    // SimField_t mask of the fields shown outside the scene, the fields the
+    // scene needs are added before subscribing to them
+    void setDisplayFields(unsigned int fields);
+    // Seconds the displayed state of a connection trails the newest frame,
+    // frames in between are interpolated at the display rate
+    void setDisplayDelay(double seconds);
+    double getDisplayDelay();
+    // Seconds a stalled connection is dead-reckoned past its newest frame
+    // while motion prediction is on
+    void setMaxPrediction(double seconds);
+    double getMaxPrediction();
+    bool isMotionPredicted();
 
     // Methods for dispersing data loaded in
-    virtual QVector3D getLightPosition();
-
     SpacecraftSim *getSpacecraftSim() {
         return &m_scSim;
     }
+
+    // Latencies and rates of the last complete diagnostics interval
+    PipelineDiagnostics getDiagnostics();
+    // Appends every diagnostics interval to filename until stopped, as JSON
+    // lines if it ends in .json and as CSV otherwise
+    bool startDiagnosticsLog(QString filename);
+    void stopDiagnosticsLog();
+    bool isDiagnosticsLogging();
+    // Link diagnostics of TCP and JSON connections, empty for other sources
+    FrameStatistics getFrameStatistics();
+    // Simulation seconds covered by the open recording
+    double getPlaybackDuration();
+    // Records every frame received from connections into segments named
+    // after filename until stopped, independent of the display rate. A
+    // filename ending in .jsonl captures the lines of a JSON connection as
+    // received instead.
+    bool startRecording(QString filename);
+    void stopRecording();
+    bool isRecording();
+    RecorderStatistics getRecorderStatistics();
+    // Simulation steps after time since, oldest first, from the samples
+    // frames carry when the simulation batches its steps. Shows plots what
+    // happened between frames. Returns false if the history no longer
+    // reaches back to since.
+    bool getSamples(double since, std::vector<SpacecraftSample> &samples);
 //    SpacecraftSimVisualization *getSpacecraftSimVisualization()
 //    {
 //        return &m_scSimVisualization;
@@ -59,6 +272,15 @@ signals:
     void setOnOffLegendTR(bool);
     void setOnOffDefaults(CelestialObject_t);
     void simConnected();
+    // The number of reaction wheels or thrusters changed, e.g. because they
+    // were not subscribed to before
+    void componentsChanged();
+    // Emitted from the network thread, connected queued to processInboundData
+    void inboundDataReady();
+    // A diagnostics interval of the connection completed
+    void diagnosticsUpdated();
+    // Emitted from the scene thread, connected queued to presentScene
+    void sceneReady();
 
 public slots:
     // Set the simulation time
@@ -69,6 +291,11 @@ public slots:
 //    void setAdcsState(ADCSState_t);
 //    void setThrustingControlMode(int);
     void setPlaySpeed(double value);
+    // Propagates the orbit and attitude of a stalled connection instead of
+    // freezing them
+    void setMotionPrediction(bool enabled);
+    // The scene built last is on screen, connected to the scene widget
+    void framePresented();
 //    void setGravityGradientTorque(int);
 //    void setReactionWheelJitter(int);
 //    void setGravityPerturbModel(int);
@@ -86,22 +313,138 @@ public slots:
 //    void setEarthMagField(EarthMagFieldModel_t);
 //    void setNewManeuver(double, double);
 
+private slots:
+    void processInboundData();
+    void presentScene();
+
 protected:
-    virtual void timerEvent(QTimerEvent *event);
+    // Polls the shared memory transport and advances file playback
+    void timerEvent(QTimerEvent *event);
 
 private:
-    void updateSimObjects();
+    void requestScene(bool isMeasured);
+    void runSceneThread();
+    void updateSimObjects(SceneRequest &request, AdcsScene &scene);
+    bool isSceneLayoutChanged(const SceneRequest &request, const SceneLayout &layout);
+    void updateAxes(QVector<SimObject> &simObjects, int &index, bool isCreated, QQuaternion rotation,
+                    float scaleFactor, QVector4D xColor, QVector4D yColor, QVector4D zColor);
     long generateTimeStamp();
     void updateReturnData();
+    void handleClientUpdate();
+    void handleFrame(const SpacecraftSim &frame);
+    bool isTransportConnected();
+    void resetDiagnostics();
+    void recordFrameLatency(double receiveTime, double decodeTime);
+    void updateDiagnostics();
+    void writeDiagnosticsLog();
+    void updateFieldSubscription();
+    void updateFrameRateLimit();
+    void updateDisplay();
+    void advancePlayback();
+    bool loadRecordedFrame(size_t index);
+    bool showRecordedTime(double time);
 
 private:
+    // Addresses of these forms select the shared memory, JSON and UDP transports
+    static const char *shmAddressPrefix;
+    static const char *jsonAddressPrefix;
+    static const char *udpAddressPrefix;
+    // Poll period of the shared memory, JSON and UDP transports in milliseconds
+    static const int pollInterval = 5;
+    // Frame period of file playback in milliseconds
+    static const int playbackInterval = 20;
+    // Period at which the interpolated state of a connection is displayed
+    static const int displayInterval = 16;
+    // Period of the connection diagnostics in milliseconds
+    static const int diagnosticsInterval = 1000;
+
     TcpSerializeClient<SpacecraftSim, SpacecraftSim> m_client;
+    ShmSerializeClient<SpacecraftSim, SpacecraftSim> m_shmClient;
+    TcpJsonClient<SpacecraftSim, SpacecraftSim> m_jsonClient;
+    // A socket joins its multicast group once, so the client is created
+    // for every connection
+    boost::asio::io_service m_udpIoService;
+    boost::scoped_ptr<UdpSerializeClient<SpacecraftSim> > m_udpClient;
+    SpacecraftSim m_udpFrame;
+    long m_udpArrivalTime;
+    Transport_t m_transport;
+    int m_pollTimerId;
+    int m_displayTimerId;
+    int m_diagnosticsTimerId;
     bool m_isConnected;
-    int m_connectionTimerId;
+    // Set while a queued processInboundData call is outstanding
+    boost::atomic<bool> m_isUpdatePending;
+    // Set once a frame of the current connection carried samples
+    boost::atomic<bool> m_isSampling;
+    RecordingPlayer<SpacecraftSim> m_recording;
+    TelemetryRecorder<SpacecraftSim> m_recorder;
+    int m_playbackTimerId;
+    QElapsedTimer m_playbackClock;
+    // Seconds since the first recorded frame
+    double m_playbackTime;
+    size_t m_playbackFrame;
+    // Holds the frames around the displayed time, m_scSim is sampled from it
+    FrameInterpolator<SpacecraftSim> m_interpolator;
+    // Samples of every frame received or played back, unlike the
+    // interpolator not limited to the frames around the displayed time
+    SampleHistory<SpacecraftSample> m_sampleHistory;
+    // Newest frame of the connection
+    SpacecraftSim m_inboundFrame;
+    double m_maxPrediction;
+    bool m_isMotionPredicted;
+    SpacecraftSim m_recordedFrame;
     SpacecraftSim m_scSim;
     SpacecraftSim m_scSimVisualization;
     double   realTimeSpeedUpFactor;
     bool receivedNewData;
+    unsigned int m_displayFields;
+    size_t m_numReactionWheels;
+    size_t m_numThrusters;
+    // Changed for every new data source
+    unsigned long m_layoutGeneration;
+    // Colors of the reaction wheel and torque rod legends
+    QList<QColor> m_legendPalette;
+
+    // Scenes are built on the scene thread from the newest request and
+    // handed back through m_scenes, m_scene points to its read buffer
+    boost::scoped_ptr<boost::thread> m_sceneThread;
+    boost::mutex m_sceneMutex;
+    boost::condition_variable m_sceneCondition;
+    // Guarded by m_sceneMutex
+    SceneRequest m_sceneRequest;
+    bool m_hasSceneRequest;
+    bool m_shouldStopScenes;
+    // Used by the scene thread
+    SceneRequest m_buildRequest;
+    // Scene published last, the writer never gets it back as its next buffer
+    const AdcsScene *m_builtScene;
+    // States of the moons, planets and the Sun around the spacecraft
+    EphemerisCache m_ephemeris;
+    TripleBuffer<AdcsScene> m_scenes;
+    // Set while a queued presentScene call is outstanding
+    boost::atomic<bool> m_isScenePending;
+
+    // Stages of the current diagnostics interval
+    LatencyHistogram m_latency[MAX_LATENCY_STAGE];
+    PipelineDiagnostics m_diagnostics;
+    QElapsedTimer m_diagnosticsClock;
+    // Counters since the connection was opened and their values at the
+    // start of the interval
+    unsigned long m_framesProcessed;
+    unsigned long m_framesDisplayed;
+    unsigned long m_intervalFrames;
+    unsigned long m_intervalDisplayed;
+    boost::uint64_t m_intervalBytes;
+    // Frames the shared memory ring skipped before the connection
+    unsigned long m_skippedAtOpen;
+    // Publish time in milliseconds since epoch of the newest frame pushed to
+    // the interpolator, and of the one in the scene waiting to be presented
+    long m_newestPublishTime;
+    long m_scenePublishTime;
+    // Time the scene waiting to be presented was built, 0 if there is none
+    double m_sceneBuildTime;
+    QFile m_diagnosticsLog;
+    bool m_isJsonLog;
 };
 
 #endif // ADCSSIMDATAMANAGER_H
@@ -0,0 +1,111 @@
+/*
+ ISC License
+
+ Copyright (c) 2016-2017, Autonomous Vehicle Systems Lab, University of Colorado at Boulder
+
+ Permission to use, copy, modify, and/or distribute this software for any
+ purpose with or without fee is hereby granted, provided that the above
+ copyright notice and this permission notice appear in all copies.
+
+ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+//
+// BoundedQueue.hpp
+//
+// University of Colorado, Autonomous Vehicle Systems (AVS) Lab
+// Unpublished Copyright (c) 2012-2015 University of Colorado, All Rights Reserved
+//
+
+#ifndef BOUNDED_QUEUE_HPP
+#define BOUNDED_QUEUE_HPP
+
+#include <boost/atomic.hpp>
+#include <vector>
+
+// Lock free queue of a fixed number of slots from one writer thread to one
+// reader thread. The slots are allocated up front and reused, so filling a
+// slot by assignment does not allocate once the slots have held values of
+// the same size. The writer never waits: when the queue is full writeSlot()
+// returns 0 and it is up to the writer to drop the value.
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity = 0)
+        : m_slots(capacity + 1)
+        , m_head(0)
+        , m_tail(0)
+    {
+
+    }
+
+    // Changes the capacity and empties the queue, only while neither side
+    // is using it
+    void reset(size_t capacity)
+    {
+        std::vector<T>(capacity + 1).swap(m_slots);
+        m_head.store(0);
+        m_tail.store(0);
+    }
+
+    size_t capacity() const { return m_slots.size() - 1; }
+    // Number of queued values, exact only on the reader or writer side
+    size_t size() const
+    {
+        size_t tail = m_tail.load(boost::memory_order_acquire);
+        size_t head = m_head.load(boost::memory_order_acquire);
+        return (tail + m_slots.size() - head) % m_slots.size();
+    }
+
+    // Writer side, fill the slot and push() it
+    T *writeSlot()
+    {
+        size_t tail = m_tail.load(boost::memory_order_relaxed);
+        if(next(tail) == m_head.load(boost::memory_order_acquire)) {
+            return 0;
+        }
+        return &m_slots[tail];
+    }
+    void push()
+    {
+        m_tail.store(next(m_tail.load(boost::memory_order_relaxed)), boost::memory_order_release);
+    }
+
+    // Reader side, use the slot and pop() it, 0 if the queue is empty
+    T *readSlot()
+    {
+        size_t head = m_head.load(boost::memory_order_relaxed);
+        if(head == m_tail.load(boost::memory_order_acquire)) {
+            return 0;
+        }
+        return &m_slots[head];
+    }
+    void pop()
+    {
+        m_head.store(next(m_head.load(boost::memory_order_relaxed)), boost::memory_order_release);
+    }
+
+private:
+    // One slot always stays empty to tell a full queue from an empty one
+    std::vector<T> m_slots;
+    // Next slot to read, only written by the reader
+    boost::atomic<size_t> m_head;
+    // Keep the indexes of both sides on separate cache lines
+    char m_padding[64];
+    // Next slot to write, only written by the writer
+    boost::atomic<size_t> m_tail;
+
+    size_t next(size_t index) const { return index + 1 < m_slots.size() ? index + 1 : 0; }
+
+    BoundedQueue(const BoundedQueue &);
+    BoundedQueue &operator=(const BoundedQueue &);
+};
+
+#endif // BOUNDED_QUEUE_HPP
@@ -0,0 +1,107 @@
+/*
+ ISC License
+
+ Copyright (c) 2016-2017, Autonomous Vehicle Systems Lab, University of Colorado at Boulder
+
+ Permission to use, copy, modify, and/or distribute this software for any
+ purpose with or without fee is hereby granted, provided that the above
+ copyright notice and this permission notice appear in all copies.
+
+ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+//
+// Crc32c.hpp
+//
+// University of Colorado, Autonomous Vehicle Systems (AVS) Lab
+// Unpublished Copyright (c) 2012-2015 University of Colorado, All Rights Reserved
+//
+
+#ifndef CRC32C_HPP
+#define CRC32C_HPP
+
+#include <boost/cstdint.hpp>
+#include <cstddef>
+#include <cstring>
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+// CRC32C (Castagnoli), the checksum used by iSCSI and SCTP. Compilers
+// targeting SSE4.2 use the crc32 instruction, otherwise a slicing-by-8 table
+// is used, still well below the cost of deserializing the frame it checks.
+
+class Crc32cTable
+{
+public:
+    static const Crc32cTable &instance()
+    {
+        static const Crc32cTable table;
+        return table;
+    }
+    boost::uint32_t entries[8][256];
+
+private:
+    Crc32cTable()
+    {
+        for(boost::uint32_t i = 0; i < 256; i++) {
+            boost::uint32_t crc = i;
+            for(int bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ (0x82f63b78 & (0u - (crc & 1)));
+            }
+            entries[0][i] = crc;
+        }
+        for(int slice = 1; slice < 8; slice++) {
+            for(int i = 0; i < 256; i++) {
+                boost::uint32_t previous = entries[slice - 1][i];
+                entries[slice][i] = (previous >> 8) ^ entries[0][previous & 0xff];
+            }
+        }
+    }
+};
+
+// Continues crc over size bytes, start with crc = 0
+inline boost::uint32_t crc32c(const void *data, size_t size, boost::uint32_t crc = 0)
+{
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    crc = ~crc;
+#if defined(__SSE4_2__)
+    while(size >= 8) {
+        boost::uint64_t word;
+        std::memcpy(&word, bytes, 8);
+        crc = (boost::uint32_t)_mm_crc32_u64(crc, word);
+        bytes += 8;
+        size -= 8;
+    }
+    while(size > 0) {
+        crc = _mm_crc32_u8(crc, *bytes++);
+        size--;
+    }
+#else
+    const Crc32cTable &table = Crc32cTable::instance();
+    while(size >= 8) {
+        boost::uint32_t low = crc ^ ((boost::uint32_t)bytes[0] | ((boost::uint32_t)bytes[1] << 8)
+            | ((boost::uint32_t)bytes[2] << 16) | ((boost::uint32_t)bytes[3] << 24));
+        crc = table.entries[7][low & 0xff] ^ table.entries[6][(low >> 8) & 0xff]
+            ^ table.entries[5][(low >> 16) & 0xff] ^ table.entries[4][low >> 24]
+            ^ table.entries[3][bytes[4]] ^ table.entries[2][bytes[5]]
+            ^ table.entries[1][bytes[6]] ^ table.entries[0][bytes[7]];
+        bytes += 8;
+        size -= 8;
+    }
+    while(size > 0) {
+        crc = (crc >> 8) ^ table.entries[0][(crc ^ *bytes++) & 0xff];
+        size--;
+    }
+#endif
+    return ~crc;
+}
+
+#endif // CRC32C_HPP
@@ -0,0 +1,75 @@
+/*
+ ISC License
+
+ Copyright (c) 2016-2017, Autonomous Vehicle Systems Lab, University of Colorado at Boulder
+
+ Permission to use, copy, modify, and/or distribute this software for any
+ purpose with or without fee is hereby granted, provided that the above
+ copyright notice and this permission notice appear in all copies.
+
+ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+//
+// FieldSubscription.hpp
+//
+// University of Colorado, Autonomous Vehicle Systems (AVS) Lab
+// Unpublished Copyright (c) 2012-2015 University of Colorado, All Rights Reserved
+//
+
+#ifndef FIELD_SUBSCRIPTION_HPP
+#define FIELD_SUBSCRIPTION_HPP
+
+#include <boost/cstdint.hpp>
+#include <boost/serialization/access.hpp>
+
+// A field mask selects which parts of a frame a subscriber receives. The
+// meaning of the bits is up to the frame type, all bits set means the whole
+// frame and is sent as a plain archive.
+#define FIELD_MASK_ALL 0xffffffffu
+
+// Serializes the parts of t selected by fieldMask. Frame types that can be
+// split provide an overload found through argument dependent lookup, all
+// other types are always serialized whole.
+template <typename Archive, typename T>
+void serializeFrameFields(Archive &ar, T &t, boost::uint32_t fieldMask)
+{
+    ar & t;
+}
+
+// Archive wrapper of a partial frame. The mask is written ahead of the
+// fields so the reader knows which fields follow; fields that are not in
+// the archive keep their previous value in the object loaded into.
+template <typename T>
+class FieldMaskedFrame
+{
+public:
+    FieldMaskedFrame(T &data, boost::uint32_t fieldMask)
+        : m_data(data)
+        , m_fieldMask(fieldMask)
+    {
+
+    }
+
+    boost::uint32_t fieldMask() const { return m_fieldMask; }
+
+private:
+    T &m_data;
+    boost::uint32_t m_fieldMask;
+
+    friend class boost::serialization::access;
+    template <class Archive>
+    void serialize(Archive &ar, const unsigned int version)
+    {
+        ar & m_fieldMask;
+        serializeFrameFields(ar, m_data, m_fieldMask);
+    }
+};
+
+#endif // FIELD_SUBSCRIPTION_HPP
@@ -0,0 +1,284 @@
+/*
+ ISC License
+
+ Copyright (c) 2016-2017, Autonomous Vehicle Systems Lab, University of Colorado at Boulder
+
+ Permission to use, copy, modify, and/or distribute this software for any
+ purpose with or without fee is hereby granted, provided that the above
+ copyright notice and this permission notice appear in all copies.
+
+ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+//
+// FrameCompression.hpp
+//
+// University of Colorado, Autonomous Vehicle Systems (AVS) Lab
+// Unpublished Copyright (c) 2012-2015 University of Colorado, All Rights Reserved
+//
+
+#ifndef FRAME_COMPRESSION_HPP
+#define FRAME_COMPRESSION_HPP
+
+#include "FrameDelta.hpp"
+
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef USE_LZ4
+#include <lz4.h>
+#endif
+#ifdef USE_ZSTD
+#include <zstd.h>
+#include <zdict.h>
+#endif
+
+// Optional per-frame compression of the serialized payloads. Each codec is
+// only available when the build enables it (USE_LZ4, USE_ZSTD), values are
+// bit flags so a set of codecs can be advertised in the handshake.
+// A compressed payload is the uncompressed size as uint32 followed by the
+// codec's output.
+typedef enum {
+    COMPRESSION_NONE = 0x00,
+    COMPRESSION_LZ4  = 0x01, /*!< fast, moderate ratio */
+    COMPRESSION_ZSTD = 0x02  /*!< slower, better ratio */
+} Compression_t;
+
+// Payloads claiming to inflate beyond this are rejected
+#define COMPRESSION_MAX_FRAME_SIZE (64 * 1024 * 1024)
+// zstd level used for frames, low levels keep up with the simulation rate
+#define COMPRESSION_ZSTD_LEVEL 3
+
+// Bitmask of the codecs compiled in
+inline int availableCompressions()
+{
+    int codecs = COMPRESSION_NONE;
+#ifdef USE_LZ4
+    codecs |= COMPRESSION_LZ4;
+#endif
+#ifdef USE_ZSTD
+    codecs |= COMPRESSION_ZSTD;
+#endif
+    return codecs;
+}
+
+inline const char *compressionName(Compression_t codec)
+{
+    switch(codec) {
+        case COMPRESSION_LZ4:
+            return "LZ4";
+        case COMPRESSION_ZSTD:
+            return "zstd";
+        default:
+            return "none";
+    }
+}
+
+// Identifies a dictionary in the handshake so both ends can tell whether they
+// were given the same one. 0 stands for no dictionary.
+inline boost::uint32_t compressionDictionaryId(const std::string &dictionary)
+{
+    if(dictionary.empty()) {
+        return 0;
+    }
+    // FNV-1a
+    boost::uint32_t hash = 2166136261u;
+    for(size_t i = 0; i < dictionary.size(); i++) {
+        hash ^= (unsigned char)dictionary[i];
+        hash *= 16777619u;
+    }
+    return hash ? hash : 1;
+}
+
+// Builds a dictionary of at most capacity bytes from typical frames. With
+// zstd the dictionary is trained, otherwise (or if training fails on too few
+// samples) the newest frame is used as raw content, which works for both
+// codecs since consecutive frames share most of their bytes.
+inline bool trainCompressionDictionary(const std::vector<std::string> &samples, size_t capacity, std::string &dictionary)
+{
+    dictionary.clear();
+    if(samples.empty() || capacity == 0) {
+        return false;
+    }
+#ifdef USE_ZSTD
+    std::string sampleBuffer;
+    std::vector<size_t> sampleSizes;
+    for(size_t i = 0; i < samples.size(); i++) {
+        sampleBuffer.append(samples[i]);
+        sampleSizes.push_back(samples[i].size());
+    }
+    dictionary.resize(capacity);
+    size_t trainedSize = ZDICT_trainFromBuffer(&dictionary[0], capacity, sampleBuffer.data(),
+        &sampleSizes[0], (unsigned)sampleSizes.size());
+    if(!ZDICT_isError(trainedSize)) {
+        dictionary.resize(trainedSize);
+        return true;
+    }
+    std::cout << "Dictionary training failed (" << ZDICT_getErrorName(trainedSize) << "), using raw frame content" << std::endl;
+#endif
+    const std::string &newest = samples.back();
+    // LZ4 only looks at the last 64 KB of a dictionary, keep the tail
+    size_t size = newest.size() < capacity ? newest.size() : capacity;
+    dictionary.assign(newest, newest.size() - size, size);
+    return true;
+}
+
+// Compresses and decompresses payloads of one connection. Codec contexts and
+// the digested dictionary are kept between frames.
+class FrameCompressor
+{
+public:
+    FrameCompressor()
+#ifdef USE_ZSTD
+        : m_compressContext(0)
+        , m_decompressContext(0)
+        , m_compressDictionary(0)
+        , m_decompressDictionary(0)
+#endif
+    {
+
+    }
+    ~FrameCompressor()
+    {
+        setDictionary(boost::shared_ptr<const std::string>());
+#ifdef USE_ZSTD
+        ZSTD_freeCCtx(m_compressContext);
+        ZSTD_freeDCtx(m_decompressContext);
+#endif
+    }
+
+    // Both ends must use the same dictionary, an empty pointer removes it
+    void setDictionary(boost::shared_ptr<const std::string> dictionary)
+    {
+#ifdef USE_ZSTD
+        ZSTD_freeCDict(m_compressDictionary);
+        ZSTD_freeDDict(m_decompressDictionary);
+        m_compressDictionary = 0;
+        m_decompressDictionary = 0;
+        if(dictionary && !dictionary->empty()) {
+            m_compressDictionary = ZSTD_createCDict(dictionary->data(), dictionary->size(), COMPRESSION_ZSTD_LEVEL);
+            m_decompressDictionary = ZSTD_createDDict(dictionary->data(), dictionary->size());
+        }
+#endif
+        m_dictionary = dictionary && !dictionary->empty() ? dictionary : boost::shared_ptr<const std::string>();
+    }
+    boost::uint32_t dictionaryId() { return m_dictionary ? compressionDictionaryId(*m_dictionary) : 0; }
+
+    // Replaces output with the compressed payload, the dictionary is used if
+    // useDictionary is set. Returns false if the codec is not available.
+    bool compress(Compression_t codec, bool useDictionary, const char *data, size_t size, std::string &output)
+    {
+        output.clear();
+        appendUint32(output, (boost::uint32_t)size);
+        switch(codec) {
+#ifdef USE_LZ4
+            case COMPRESSION_LZ4: {
+                const std::string *dictionary = useDictionary ? m_dictionary.get() : 0;
+                int bound = LZ4_compressBound((int)size);
+                output.resize(4 + bound);
+                int written = 0;
+                if(dictionary) {
+                    LZ4_resetStream(&m_lz4Stream);
+                    LZ4_loadDict(&m_lz4Stream, dictionary->data(), (int)dictionary->size());
+                    written = LZ4_compress_fast_continue(&m_lz4Stream, data, &output[4], (int)size, bound, 1);
+                } else {
+                    written = LZ4_compress_default(data, &output[4], (int)size, bound);
+                }
+                if(written <= 0) {
+                    return false;
+                }
+                output.resize(4 + written);
+                return true;
+            }
+#endif
+#ifdef USE_ZSTD
+            case COMPRESSION_ZSTD: {
+                if(!m_compressContext) {
+                    m_compressContext = ZSTD_createCCtx();
+                }
+                size_t bound = ZSTD_compressBound(size);
+                output.resize(4 + bound);
+                size_t written = useDictionary && m_compressDictionary
+                    ? ZSTD_compress_usingCDict(m_compressContext, &output[4], bound, data, size, m_compressDictionary)
+                    : ZSTD_compressCCtx(m_compressContext, &output[4], bound, data, size, COMPRESSION_ZSTD_LEVEL);
+                if(ZSTD_isError(written)) {
+                    std::cout << "Error in " << __FUNCTION__ << ": " << ZSTD_getErrorName(written) << std::endl;
+                    return false;
+                }
+                output.resize(4 + written);
+                return true;
+            }
+#endif
+            default:
+                return false;
+        }
+    }
+
+    // Replaces output with the payload compressed by compress, returns false
+    // if it is malformed or the codec is not available
+    bool decompress(Compression_t codec, bool useDictionary, const char *data, size_t size, std::string &output)
+    {
+        if(size < 4) {
+            return false;
+        }
+        size_t frameSize = readUint32(data);
+        if(frameSize > COMPRESSION_MAX_FRAME_SIZE) {
+            return false;
+        }
+        output.resize(frameSize);
+        if(frameSize == 0) {
+            return true;
+        }
+        switch(codec) {
+#ifdef USE_LZ4
+            case COMPRESSION_LZ4: {
+                const std::string *dictionary = useDictionary ? m_dictionary.get() : 0;
+                int read = dictionary
+                    ? LZ4_decompress_safe_usingDict(data + 4, &output[0], (int)(size - 4), (int)frameSize,
+                        dictionary->data(), (int)dictionary->size())
+                    : LZ4_decompress_safe(data + 4, &output[0], (int)(size - 4), (int)frameSize);
+                return read == (int)frameSize;
+            }
+#endif
+#ifdef USE_ZSTD
+            case COMPRESSION_ZSTD: {
+                if(!m_decompressContext) {
+                    m_decompressContext = ZSTD_createDCtx();
+                }
+                size_t read = useDictionary && m_decompressDictionary
+                    ? ZSTD_decompress_usingDDict(m_decompressContext, &output[0], frameSize, data + 4, size - 4, m_decompressDictionary)
+                    : ZSTD_decompressDCtx(m_decompressContext, &output[0], frameSize, data + 4, size - 4);
+                return !ZSTD_isError(read) && read == frameSize;
+            }
+#endif
+            default:
+                return false;
+        }
+    }
+
+private:
+    boost::shared_ptr<const std::string> m_dictionary;
+#ifdef USE_LZ4
+    LZ4_stream_t m_lz4Stream;
+#endif
+#ifdef USE_ZSTD
+    ZSTD_CCtx *m_compressContext;
+    ZSTD_DCtx *m_decompressContext;
+    ZSTD_CDict *m_compressDictionary;
+    ZSTD_DDict *m_decompressDictionary;
+#endif
+
+    FrameCompressor(const FrameCompressor &);
+    FrameCompressor &operator=(const FrameCompressor &);
+};
+
+#endif // FRAME_COMPRESSION_HPP
@@ -0,0 +1,144 @@
+/*
+ ISC License
+
+ Copyright (c) 2016-2017, Autonomous Vehicle Systems Lab, University of Colorado at Boulder
+
+ Permission to use, copy, modify, and/or distribute this software for any
+ purpose with or without fee is hereby granted, provided that the above
+ copyright notice and this permission notice appear in all copies.
+
+ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+//
+// FrameDelta.hpp
+//
+// University of Colorado, Autonomous Vehicle Systems (AVS) Lab
+// Unpublished Copyright (c) 2012-2015 University of Colorado, All Rights Reserved
+//
+
+#ifndef FRAME_DELTA_HPP
+#define FRAME_DELTA_HPP
+
+#include <boost/cstdint.hpp>
+#include <cstring>
+#include <string>
+
+// Frame deltas describe a serialized frame as the byte ranges that differ from
+// the previous frame. Layout, all integers little endian:
+//   uint32 frame size
+//   repeated: uint32 offset, uint32 length, <length> bytes of the new frame
+// Most of a SpacecraftSim archive is static over a run so only a few short
+// runs (time, states, wheel speeds) remain per frame.
+
+// Equal bytes shorter than a run header are copied instead of starting a new run
+#define FRAME_DELTA_MERGE_GAP 8
+
+inline void appendUint32(std::string &buffer, boost::uint32_t value)
+{
+    char bytes[4];
+    bytes[0] = (char)(value & 0xff);
+    bytes[1] = (char)((value >> 8) & 0xff);
+    bytes[2] = (char)((value >> 16) & 0xff);
+    bytes[3] = (char)((value >> 24) & 0xff);
+    buffer.append(bytes, 4);
+}
+
+inline boost::uint32_t readUint32(const char *bytes)
+{
+    const unsigned char *b = reinterpret_cast<const unsigned char *>(bytes);
+    return (boost::uint32_t)b[0] | ((boost::uint32_t)b[1] << 8)
+        | ((boost::uint32_t)b[2] << 16) | ((boost::uint32_t)b[3] << 24);
+}
+
+inline void writeUint32(char *bytes, boost::uint32_t value)
+{
+    bytes[0] = (char)(value & 0xff);
+    bytes[1] = (char)((value >> 8) & 0xff);
+    bytes[2] = (char)((value >> 16) & 0xff);
+    bytes[3] = (char)((value >> 24) & 0xff);
+}
+
+inline void writeUint64(char *bytes, boost::uint64_t value)
+{
+    writeUint32(bytes, (boost::uint32_t)(value & 0xffffffff));
+    writeUint32(bytes + 4, (boost::uint32_t)(value >> 32));
+}
+
+inline boost::uint64_t readUint64(const char *bytes)
+{
+    return (boost::uint64_t)readUint32(bytes) | ((boost::uint64_t)readUint32(bytes + 4) << 32);
+}
+
+// Appends the delta turning reference into frame to delta
+inline void encodeFrameDelta(const std::string &reference, const std::string &frame, std::string &delta)
+{
+    size_t frameSize = frame.size();
+    size_t commonSize = reference.size() < frameSize ? reference.size() : frameSize;
+    appendUint32(delta, (boost::uint32_t)frameSize);
+
+    size_t i = 0;
+    while(i < frameSize) {
+        // Skip bytes that have not changed
+        while(i < commonSize && reference[i] == frame[i]) {
+            i++;
+        }
+        if(i >= frameSize) {
+            break;
+        }
+        // Extend the run until enough unchanged bytes follow it
+        size_t start = i;
+        size_t lastChanged = i;
+        while(i < frameSize) {
+            if(i < commonSize && reference[i] == frame[i]) {
+                if(i - lastChanged > FRAME_DELTA_MERGE_GAP) {
+                    break;
+                }
+            } else {
+                lastChanged = i;
+            }
+            i++;
+        }
+        size_t length = lastChanged + 1 - start;
+        appendUint32(delta, (boost::uint32_t)start);
+        appendUint32(delta, (boost::uint32_t)length);
+        delta.append(frame, start, length);
+        i = lastChanged + 1;
+    }
+}
+
+// Rebuilds a frame from its reference and a delta, returns false if the delta
+// is malformed
+inline bool applyFrameDelta(const std::string &reference, const char *delta, size_t deltaSize, std::string &frame)
+{
+    if(deltaSize < 4) {
+        return false;
+    }
+    size_t frameSize = readUint32(delta);
+    frame.assign(reference, 0, frameSize < reference.size() ? frameSize : reference.size());
+    frame.resize(frameSize);
+
+    size_t position = 4;
+    while(position < deltaSize) {
+        if(deltaSize - position < 8) {
+            return false;
+        }
+        size_t offset = readUint32(delta + position);
+        size_t length = readUint32(delta + position + 4);
+        position += 8;
+        if(length > deltaSize - position || offset > frameSize || length > frameSize - offset) {
+            return false;
+        }
+        std::memcpy(&frame[offset], delta + position, length);
+        position += length;
+    }
+    return true;
+}
+
+#endif // FRAME_DELTA_HPP
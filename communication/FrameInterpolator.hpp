@@ -0,0 +1,342 @@
+/*
+ ISC License
+
+ Copyright (c) 2016-2017, Autonomous Vehicle Systems Lab, University of Colorado at Boulder
+
+ Permission to use, copy, modify, and/or distribute this software for any
+ purpose with or without fee is hereby granted, provided that the above
+ copyright notice and this permission notice appear in all copies.
+
+ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+//
+// FrameInterpolator.hpp
+//
+// University of Colorado, Autonomous Vehicle Systems (AVS) Lab
+// Unpublished Copyright (c) 2012-2015 University of Colorado, All Rights Reserved
+//
+
+#ifndef FRAME_INTERPOLATOR_HPP
+#define FRAME_INTERPOLATOR_HPP
+
+#include "SerializeArchive.hpp"
+
+#include <cmath>
+#include <vector>
+
+// Writes the state between frames a and b to out, alpha runs from 0 at a to
+// 1 at b and dt is the simulation time from a to b. A dt of 0 blends two
+// states of the same time. Frame types that can be interpolated provide an
+// overload found through argument dependent lookup, all other types step
+// from one frame to the next.
+template <typename T>
+void interpolateFrame(const T &a, const T &b, double alpha, double dt, T &out)
+{
+    out = alpha < 1.0 ? a : b;
+}
+
+// Predicts the state dt simulation seconds after frame into out. Returns
+// false for frame types without a predictor, overloads are found like the
+// ones of interpolateFrame.
+template <typename T>
+bool extrapolateFrame(const T &frame, double dt, T &out)
+{
+    return false;
+}
+
+// Keeps the last few frames of a stream so they can be sampled at any time
+// in between, which decouples the display rate from the frame rate.
+//
+// Live streams are sampled by wall clock time: a playout clock runs at the
+// rate simulation time advanced over the recent frames and trails the newest
+// frame by a configurable delay, so there normally is a frame on both sides
+// of the sampled time. The clock is slewed towards that target instead of
+// following the arrival jitter of single frames. Recordings, whose frames
+// are all at hand, are sampled directly by simulation time.
+//
+// When a stream stalls for longer than the delay the playout clock can run
+// past the newest frame for a limited time, the state shown there is
+// predicted with extrapolateFrame. The next frame does not make the display
+// jump back, it blends from the prediction to the frames over a short time.
+template <typename T>
+class FrameInterpolator
+{
+public:
+    FrameInterpolator()
+        : m_first(0)
+        , m_count(0)
+        , m_delay(0.1)
+        , m_maxPrediction(0.0)
+        , m_rate(0.0)
+        , m_rateTime(0.0)
+        , m_rateWallTime(0.0)
+        , m_isPlaying(false)
+        , m_playoutTime(0.0)
+        , m_playoutWallTime(0.0)
+        , m_isSampled(false)
+        , m_isChanged(false)
+        , m_sampledTime(0.0)
+        , m_isPredicting(false)
+        , m_isBlending(false)
+        , m_blendTime(0.0)
+        , m_blendWallTime(0.0)
+    {
+        m_entries.resize(defaultHistorySize);
+    }
+
+    // Wall clock seconds the playout trails the newest frame
+    void setDelay(double seconds) { m_delay = seconds > 0.0 ? seconds : 0.0; }
+    double delay() { return m_delay; }
+    // Wall clock seconds the playout may run past the newest frame, 0 holds
+    // the newest frame when the stream stalls
+    void setMaxPrediction(double seconds) { m_maxPrediction = seconds > 0.0 ? seconds : 0.0; }
+    double maxPrediction() { return m_maxPrediction; }
+
+    void setHistorySize(size_t frames)
+    {
+        clear();
+        m_entries.resize(frames > 2 ? frames : 2);
+    }
+
+    void clear()
+    {
+        m_first = 0;
+        m_count = 0;
+        m_rate = 0.0;
+        m_isPlaying = false;
+        m_isSampled = false;
+        m_isPredicting = false;
+        m_isBlending = false;
+    }
+
+    bool isEmpty() { return m_count == 0; }
+    size_t frameCount() { return m_count; }
+    // Only valid if not empty
+    const T &newestFrame() { return entry(m_count - 1).frame; }
+    // True while the state shown is predicted past the newest frame
+    bool isPredicting() { return m_isPredicting; }
+
+    // Adds a frame received at wallTime seconds. A frame at the time of the
+    // newest one replaces it, a frame older than that means the simulation
+    // was restarted and starts a new history.
+    void push(const T &frame, double wallTime)
+    {
+        double time = frameSimTime(frame);
+        if(m_count > 0) {
+            Entry &newest = entry(m_count - 1);
+            if(time == newest.time) {
+                newest.frame = frame;
+                newest.wallTime = wallTime;
+                m_isChanged = true;
+                return;
+            }
+            if(time < newest.time) {
+                clear();
+            } else {
+                updateRate(time, wallTime);
+            }
+        }
+        if(m_count == 0) {
+            m_rateTime = time;
+            m_rateWallTime = wallTime;
+        }
+        if(m_isPredicting) {
+            // Blend from the state shown towards the frames
+            m_blendFrame = m_prediction;
+            m_blendTime = m_sampledTime;
+            m_blendWallTime = wallTime;
+            m_isBlending = true;
+            m_isPredicting = false;
+        }
+        if(m_count == m_entries.size()) {
+            m_first = (m_first + 1) % m_entries.size();
+            m_count--;
+        }
+        Entry &added = entry(m_count);
+        added.frame = frame;
+        added.time = time;
+        added.wallTime = wallTime;
+        m_count++;
+        m_isChanged = true;
+    }
+
+    // Samples a live stream at wallTime seconds, returns false if out would
+    // not change since the last sample
+    bool sample(double wallTime, T &out)
+    {
+        if(m_count == 0) {
+            return false;
+        }
+        advancePlayout(wallTime);
+        const Entry &newest = entry(m_count - 1);
+        bool isPredicting = m_playoutTime > newest.time;
+        if(!isPredicting && !m_isBlending) {
+            m_isPredicting = false;
+            return sampleAt(m_playoutTime, out);
+        }
+        if(!m_isChanged && m_isSampled && m_playoutTime == m_sampledTime && !m_isBlending) {
+            return false;
+        }
+
+        T &state = m_isBlending ? m_state : out;
+        if(!isPredicting) {
+            interpolate(m_playoutTime, state);
+        } else if(!extrapolateFrame(newest.frame, m_playoutTime - newest.time, state)) {
+            state = newest.frame;
+        }
+        if(m_isBlending) {
+            // Wall clock seconds from a prediction back to the frames
+            const double blendDuration = 0.25;
+            double weight = (wallTime - m_blendWallTime) / blendDuration;
+            if(weight >= 1.0) {
+                m_isBlending = false;
+                out = m_state;
+            } else {
+                if(!extrapolateFrame(m_blendFrame, m_playoutTime - m_blendTime, m_blendState)) {
+                    m_blendState = m_blendFrame;
+                }
+                weight = weight > 0.0 ? weight * weight * (3.0 - 2.0 * weight) : 0.0;
+                interpolateFrame(m_blendState, m_state, weight, 0.0, out);
+            }
+        }
+        m_isPredicting = isPredicting;
+        if(isPredicting) {
+            // Where a blend starts if the next frame arrives now
+            m_prediction = out;
+        }
+        m_sampledTime = m_playoutTime;
+        m_isSampled = true;
+        m_isChanged = false;
+        return true;
+    }
+
+    // Samples at simulation time, clamped to the frames held. Returns false
+    // if out would not change since the last sample.
+    bool sampleAt(double time, T &out)
+    {
+        if(m_count == 0 || (!m_isChanged && m_isSampled && time == m_sampledTime)) {
+            return false;
+        }
+        interpolate(time, out);
+        m_sampledTime = time;
+        m_isSampled = true;
+        m_isChanged = false;
+        return true;
+    }
+
+private:
+    enum { defaultHistorySize = 4 };
+
+    struct Entry
+    {
+        T frame;
+        double time;
+        double wallTime;
+    };
+
+    // Ring of the newest frames, oldest first
+    std::vector<Entry> m_entries;
+    size_t m_first;
+    size_t m_count;
+
+    double m_delay;
+    double m_maxPrediction;
+    // Simulation seconds per wall clock second and the frame it was last
+    // measured from
+    double m_rate;
+    double m_rateTime;
+    double m_rateWallTime;
+    bool m_isPlaying;
+    double m_playoutTime;
+    double m_playoutWallTime;
+
+    bool m_isSampled;
+    bool m_isChanged;
+    double m_sampledTime;
+
+    bool m_isPredicting;
+    // Last state shown while predicting
+    T m_prediction;
+    bool m_isBlending;
+    // State shown when the blend started and its times
+    T m_blendFrame;
+    double m_blendTime;
+    double m_blendWallTime;
+    // Scratch states of a blend
+    T m_blendState;
+    T m_state;
+
+    Entry &entry(size_t index) { return m_entries[(m_first + index) % m_entries.size()]; }
+
+    // Measures the rate over a wall clock interval long enough that frames
+    // arriving in bursts, e.g. after a stall, do not skew it
+    void updateRate(double time, double wallTime)
+    {
+        // Minimum wall clock seconds of a rate measurement
+        const double rateInterval = 0.5;
+        // Weight of a new measurement in the rate estimate
+        const double rateSmoothing = 0.2;
+        double elapsed = wallTime - m_rateWallTime;
+        if(elapsed <= 0.0 || (m_rate > 0.0 && elapsed < rateInterval)) {
+            return;
+        }
+        double rate = (time - m_rateTime) / elapsed;
+        m_rate = m_rate > 0.0 ? m_rate + rateSmoothing * (rate - m_rate) : rate;
+        m_rateTime = time;
+        m_rateWallTime = wallTime;
+    }
+
+    void advancePlayout(double wallTime)
+    {
+        const Entry &oldest = entry(0);
+        const Entry &newest = entry(m_count - 1);
+        double target = newest.time + (wallTime - newest.wallTime - m_delay) * m_rate;
+        if(!m_isPlaying || target - m_playoutTime > newest.time - oldest.time) {
+            // First sample, or the stream jumped ahead
+            m_playoutTime = target;
+            m_isPlaying = true;
+        } else {
+            // Fraction of the offset from the target removed per sample
+            const double clockCorrection = 0.05;
+            double step = (wallTime - m_playoutWallTime) * m_rate;
+            double corrected = step + clockCorrection * (target - m_playoutTime - step);
+            // A clock ahead of its target slows down but never runs backwards
+            m_playoutTime += corrected > 0.5 * step ? corrected : 0.5 * step;
+        }
+        m_playoutWallTime = wallTime;
+        double latest = newest.time + m_maxPrediction * m_rate;
+        if(m_playoutTime < oldest.time) {
+            m_playoutTime = oldest.time;
+        } else if(m_playoutTime > latest) {
+            m_playoutTime = latest;
+        }
+    }
+
+    // Frame at or state between the frames held at time, clamped to them
+    void interpolate(double time, T &out)
+    {
+        size_t next = 0;
+        while(next < m_count && entry(next).time <= time) {
+            next++;
+        }
+        if(next == 0) {
+            out = entry(0).frame;
+        } else if(next == m_count) {
+            out = entry(m_count - 1).frame;
+        } else {
+            const Entry &a = entry(next - 1);
+            const Entry &b = entry(next);
+            double dt = b.time - a.time;
+            interpolateFrame(a.frame, b.frame, (time - a.time) / dt, dt, out);
+        }
+    }
+};
+
+#endif // FRAME_INTERPOLATOR_HPP
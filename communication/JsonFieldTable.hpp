@@ -0,0 +1,608 @@
+/*
+ ISC License
+
+ Copyright (c) 2016-2017, Autonomous Vehicle Systems Lab, University of Colorado at Boulder
+
+ Permission to use, copy, modify, and/or distribute this software for any
+ purpose with or without fee is hereby granted, provided that the above
+ copyright notice and this permission notice appear in all copies.
+
+ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+//
+// JsonFieldTable.hpp
+//
+// University of Colorado, Autonomous Vehicle Systems (AVS) Lab
+// Unpublished Copyright (c) 2012-2015 University of Colorado, All Rights Reserved
+//
+
+#ifndef JSON_FIELD_TABLE_HPP
+#define JSON_FIELD_TABLE_HPP
+
+#include "JsonSax.hpp"
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/serialization/nvp.hpp>
+#include <boost/serialization/serialization.hpp>
+#include <boost/serialization/version.hpp>
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+class JsonFieldTable;
+
+typedef enum {
+    JSON_FIELD_NUMBER,          // Arithmetic or enum value, or an array of them of any rank
+    JSON_FIELD_STRING,          // std::string
+    JSON_FIELD_OBJECT,          // Class with a serialize function
+    JSON_FIELD_OBJECT_ARRAY,    // Fixed size array of such classes
+    JSON_FIELD_VECTOR,          // std::vector of such classes
+    JSON_FIELD_NUMBER_VECTOR    // std::vector of arithmetic values
+} JsonFieldKind_t;
+
+// Where and how one named member is stored, relative to the start of the
+// object it belongs to
+struct JsonField
+{
+    std::string name;
+    JsonFieldKind_t kind;
+    size_t offset;
+    // Elements of number and object arrays, arrays of higher rank are
+    // flattened; 1 otherwise
+    size_t count;
+    // Bytes from one element to the next
+    size_t stride;
+    void (*setNumber)(char *element, double value);
+    double (*getNumber)(const char *element);
+    // Members of objects and of the elements of object arrays and vectors
+    const JsonFieldTable *table;
+    size_t (*vectorSize)(const char *vector);
+    // Grows the vector if index is past its end
+    char *(*vectorElement)(char *vector, size_t index);
+    void (*vectorResize)(char *vector, size_t size);
+};
+
+template <typename T>
+const JsonFieldTable &jsonFieldTable();
+
+template <typename T>
+void setJsonValue(T &t, double value, std::false_type)
+{
+    t = static_cast<T>(value);
+}
+
+template <typename T>
+void setJsonValue(T &t, double value, std::true_type)
+{
+    t = static_cast<T>(static_cast<int>(value));
+}
+
+inline void setJsonValue(bool &t, double value, std::false_type)
+{
+    t = value != 0.0;
+}
+
+template <typename T>
+void setJsonNumber(char *element, double value)
+{
+    setJsonValue(*reinterpret_cast<T *>(element), value, typename std::is_enum<T>::type());
+}
+
+template <typename T>
+double getJsonNumber(const char *element)
+{
+    return static_cast<double>(*reinterpret_cast<const T *>(element));
+}
+
+template <typename T>
+size_t jsonVectorSize(const char *vector)
+{
+    return reinterpret_cast<const std::vector<T> *>(vector)->size();
+}
+
+template <typename T>
+char *jsonVectorElement(char *vector, size_t index)
+{
+    std::vector<T> &v = *reinterpret_cast<std::vector<T> *>(vector);
+    if(index >= v.size()) {
+        v.resize(index + 1);
+    }
+    return reinterpret_cast<char *>(&v[index]);
+}
+
+template <typename T>
+void jsonVectorResize(char *vector, size_t size)
+{
+    reinterpret_cast<std::vector<T> *>(vector)->resize(size);
+}
+
+// Stands in for a boost archive to list the members a serialize function
+// names with BOOST_SERIALIZATION_NVP, together with where they are stored in
+// the object passed to it. Unnamed items, e.g. make_array() of raw telemetry
+// bytes, have no JSON key and are left out.
+class JsonFieldTableBuilder
+{
+public:
+    JsonFieldTableBuilder(std::vector<JsonField> &fields, const char *object)
+        : m_fields(fields)
+        , m_object(object)
+    {
+
+    }
+
+    template <typename T>
+    JsonFieldTableBuilder &operator&(const boost::serialization::nvp<T> &nvp)
+    {
+        add(nvp.name(), nvp.value());
+        return *this;
+    }
+
+    template <typename T>
+    JsonFieldTableBuilder &operator&(const T &)
+    {
+        return *this;
+    }
+
+private:
+    std::vector<JsonField> &m_fields;
+    const char *m_object;
+
+    JsonField &addField(const char *name, JsonFieldKind_t kind, const void *value)
+    {
+        JsonField field;
+        // Names like oe.a of free serialize functions keep the member name
+        const char *dot = std::strrchr(name, '.');
+        field.name = dot ? dot + 1 : name;
+        field.kind = kind;
+        field.offset = reinterpret_cast<const char *>(value) - m_object;
+        field.count = 1;
+        field.stride = 0;
+        field.setNumber = 0;
+        field.getNumber = 0;
+        field.table = 0;
+        field.vectorSize = 0;
+        field.vectorElement = 0;
+        field.vectorResize = 0;
+        m_fields.push_back(field);
+        return m_fields.back();
+    }
+
+    template <typename T>
+    void add(const char *name, T &value)
+    {
+        typedef typename std::remove_all_extents<T>::type Element;
+        add(name, value, std::integral_constant<bool,
+            std::is_arithmetic<Element>::value || std::is_enum<Element>::value>());
+    }
+
+    template <typename T>
+    void add(const char *name, T &value, std::true_type)
+    {
+        typedef typename std::remove_all_extents<T>::type Element;
+        JsonField &field = addField(name, JSON_FIELD_NUMBER, &value);
+        field.count = sizeof(T) / sizeof(Element);
+        field.stride = sizeof(Element);
+        field.setNumber = &setJsonNumber<Element>;
+        field.getNumber = &getJsonNumber<Element>;
+    }
+
+    template <typename T>
+    void add(const char *name, T &value, std::false_type)
+    {
+        typedef typename std::remove_all_extents<T>::type Element;
+        JsonField &field = addField(name, std::is_array<T>::value ? JSON_FIELD_OBJECT_ARRAY : JSON_FIELD_OBJECT, &value);
+        field.count = sizeof(T) / sizeof(Element);
+        field.stride = sizeof(Element);
+        field.table = &jsonFieldTable<Element>();
+    }
+
+    void add(const char *name, std::string &value)
+    {
+        addField(name, JSON_FIELD_STRING, &value);
+    }
+
+    template <typename T>
+    void add(const char *name, std::vector<T> &value)
+    {
+        JsonField &field = addField(name, std::is_arithmetic<T>::value ? JSON_FIELD_NUMBER_VECTOR : JSON_FIELD_VECTOR, &value);
+        addElements<T>(field, typename std::is_arithmetic<T>::type());
+        field.vectorSize = &jsonVectorSize<T>;
+        field.vectorElement = &jsonVectorElement<T>;
+        field.vectorResize = &jsonVectorResize<T>;
+    }
+
+    template <typename T>
+    void addElements(JsonField &field, std::true_type)
+    {
+        field.setNumber = &setJsonNumber<T>;
+        field.getNumber = &getJsonNumber<T>;
+    }
+
+    template <typename T>
+    void addElements(JsonField &field, std::false_type)
+    {
+        field.table = &jsonFieldTable<T>();
+    }
+};
+
+// Members of a class as JSON keys, generated from its serialize function so
+// the boost archives and JSON always carry the same fields
+class JsonFieldTable
+{
+public:
+    template <typename T>
+    explicit JsonFieldTable(const T *)
+    {
+        boost::scoped_ptr<T> prototype(new T);
+        JsonFieldTableBuilder builder(m_fields, reinterpret_cast<const char *>(prototype.get()));
+        boost::serialization::serialize_adl(builder, *prototype, boost::serialization::version<T>::value);
+        for(size_t i = 0; i < m_fields.size(); i++) {
+            m_byName.push_back(i);
+        }
+        std::sort(m_byName.begin(), m_byName.end(), NameLess(m_fields));
+    }
+
+    // In the order of the serialize function
+    const std::vector<JsonField> &fields() const { return m_fields; }
+
+    // 0 if there is no field of that name
+    const JsonField *find(const char *name, size_t length) const
+    {
+        size_t first = 0;
+        size_t last = m_byName.size();
+        while(first < last) {
+            size_t middle = (first + last) / 2;
+            const JsonField &field = m_fields[m_byName[middle]];
+            int order = field.name.compare(0, std::string::npos, name, length);
+            if(order == 0) {
+                return &field;
+            }
+            if(order < 0) {
+                first = middle + 1;
+            } else {
+                last = middle;
+            }
+        }
+        return 0;
+    }
+
+private:
+    std::vector<JsonField> m_fields;
+    // Indexes into m_fields sorted by name
+    std::vector<size_t> m_byName;
+
+    struct NameLess
+    {
+        NameLess(const std::vector<JsonField> &fields) : m_fields(fields) {}
+        bool operator()(size_t a, size_t b) const { return m_fields[a].name < m_fields[b].name; }
+        const std::vector<JsonField> &m_fields;
+    };
+};
+
+// Built on first use, a class member of a type is described by the table of
+// that type
+template <typename T>
+const JsonFieldTable &jsonFieldTable()
+{
+    static const JsonFieldTable table(static_cast<const T *>(0));
+    return table;
+}
+
+// Decodes JSON documents into objects of type T through its field table.
+// Keys of the document update the members of the same name, all others keep
+// their value, so a sender may send only what changed. Unknown keys are
+// skipped, as are values that do not fit the member. Arrays fill number and
+// object arrays from the start and set the length of vectors, whose
+// existing elements are reused. Apart from growing vectors and strings
+// nothing is allocated.
+template <typename T>
+class JsonFrameDecoder
+{
+public:
+    JsonFrameDecoder()
+        : m_table(jsonFieldTable<T>())
+        , m_depth(0)
+        , m_skipDepth(0)
+        , m_field(0)
+        , m_isObject(false)
+    {
+
+    }
+
+    // data is modified while parsing, returns false if it does not hold a
+    // JSON object. frame may have been partially updated then.
+    bool decode(char *data, size_t size, T &frame)
+    {
+        m_frame = reinterpret_cast<char *>(&frame);
+        m_depth = 0;
+        m_skipDepth = 0;
+        m_field = 0;
+        m_isObject = false;
+        JsonSaxParser<JsonFrameDecoder> parser(*this);
+        return parser.parse(data, size) && m_isObject;
+    }
+
+    void startObject()
+    {
+        if(m_skipDepth > 0) {
+            m_skipDepth++;
+            return;
+        }
+        if(m_depth == 0) {
+            m_isObject = true;
+            pushObject(&m_table, m_frame);
+            return;
+        }
+        Level &level = m_levels[m_depth - 1];
+        if(level.array) {
+            const JsonField *array = level.array;
+            size_t index = level.index++;
+            if(array->kind == JSON_FIELD_VECTOR) {
+                pushObject(array->table, array->vectorElement(level.data, index));
+            } else if(array->kind == JSON_FIELD_OBJECT_ARRAY && index < array->count) {
+                pushObject(array->table, level.data + index * array->stride);
+            } else {
+                m_skipDepth = 1;
+            }
+            return;
+        }
+        const JsonField *field = takeField();
+        if(field && field->kind == JSON_FIELD_OBJECT) {
+            pushObject(field->table, level.data + field->offset);
+        } else {
+            m_skipDepth = 1;
+        }
+    }
+
+    void endObject()
+    {
+        if(m_skipDepth > 0) {
+            m_skipDepth--;
+            return;
+        }
+        m_depth--;
+    }
+
+    void startArray()
+    {
+        if(m_skipDepth > 0) {
+            m_skipDepth++;
+            return;
+        }
+        if(m_depth == 0) {
+            m_skipDepth = 1;
+            return;
+        }
+        Level &level = m_levels[m_depth - 1];
+        if(level.array) {
+            // Nested arrays of a number array of higher rank fill it in order
+            if(level.array->kind == JSON_FIELD_NUMBER) {
+                level.nesting++;
+            } else {
+                level.index++;
+                m_skipDepth = 1;
+            }
+            return;
+        }
+        const JsonField *field = takeField();
+        if(field && field->kind != JSON_FIELD_STRING && field->kind != JSON_FIELD_OBJECT) {
+            Level &array = m_levels[m_depth++];
+            array.table = 0;
+            array.array = field;
+            array.data = level.data + field->offset;
+            array.index = 0;
+            array.nesting = 0;
+        } else {
+            m_skipDepth = 1;
+        }
+    }
+
+    void endArray()
+    {
+        if(m_skipDepth > 0) {
+            m_skipDepth--;
+            return;
+        }
+        Level &level = m_levels[m_depth - 1];
+        if(level.nesting > 0) {
+            level.nesting--;
+            return;
+        }
+        if(level.array->kind == JSON_FIELD_VECTOR || level.array->kind == JSON_FIELD_NUMBER_VECTOR) {
+            level.array->vectorResize(level.data, level.index);
+        }
+        m_depth--;
+    }
+
+    void key(const char *s, size_t length)
+    {
+        if(m_skipDepth == 0) {
+            m_field = m_levels[m_depth - 1].table->find(s, length);
+        }
+    }
+
+    void number(double value)
+    {
+        if(m_skipDepth > 0 || m_depth == 0) {
+            return;
+        }
+        Level &level = m_levels[m_depth - 1];
+        if(level.array) {
+            size_t index = level.index++;
+            if(level.array->kind == JSON_FIELD_NUMBER && index < level.array->count) {
+                level.array->setNumber(level.data + index * level.array->stride, value);
+            } else if(level.array->kind == JSON_FIELD_NUMBER_VECTOR) {
+                level.array->setNumber(level.array->vectorElement(level.data, index), value);
+            }
+            return;
+        }
+        const JsonField *field = takeField();
+        if(field && field->kind == JSON_FIELD_NUMBER) {
+            field->setNumber(level.data + field->offset, value);
+        }
+    }
+
+    void boolean(bool value)
+    {
+        number(value ? 1.0 : 0.0);
+    }
+
+    void string(const char *s, size_t length)
+    {
+        if(m_skipDepth > 0 || m_depth == 0) {
+            return;
+        }
+        Level &level = m_levels[m_depth - 1];
+        if(level.array) {
+            level.index++;
+            return;
+        }
+        const JsonField *field = takeField();
+        if(field && field->kind == JSON_FIELD_STRING) {
+            reinterpret_cast<std::string *>(level.data + field->offset)->assign(s, length);
+        }
+    }
+
+    // Leaves the member as it is
+    void null()
+    {
+        if(m_skipDepth > 0 || m_depth == 0) {
+            return;
+        }
+        Level &level = m_levels[m_depth - 1];
+        if(level.array) {
+            level.index++;
+        } else {
+            takeField();
+        }
+    }
+
+private:
+    // An object being filled, or an array if array is set
+    struct Level
+    {
+        const JsonFieldTable *table;
+        const JsonField *array;
+        // The object, or the first element of the array
+        char *data;
+        // Next element of the array
+        size_t index;
+        // Open brackets within a number array
+        int nesting;
+    };
+
+    const JsonFieldTable &m_table;
+    char *m_frame;
+    Level m_levels[JsonSaxParser<JsonFrameDecoder>::maxDepth];
+    int m_depth;
+    // Containers opened since a value that is skipped started
+    int m_skipDepth;
+    // Member of the last key, 0 if unknown
+    const JsonField *m_field;
+    bool m_isObject;
+
+    void pushObject(const JsonFieldTable *table, char *object)
+    {
+        Level &level = m_levels[m_depth++];
+        level.table = table;
+        level.array = 0;
+        level.data = object;
+        level.index = 0;
+        level.nesting = 0;
+    }
+
+    const JsonField *takeField()
+    {
+        const JsonField *field = m_field;
+        m_field = 0;
+        return field;
+    }
+};
+
+inline void writeJsonObject(const JsonFieldTable &table, const char *object, std::string &out)
+{
+    out += '{';
+    const std::vector<JsonField> &fields = table.fields();
+    for(size_t i = 0; i < fields.size(); i++) {
+        const JsonField &field = fields[i];
+        const char *data = object + field.offset;
+        if(i > 0) {
+            out += ',';
+        }
+        appendJsonString(out, field.name.data(), field.name.size());
+        out += ':';
+        switch(field.kind) {
+            case JSON_FIELD_NUMBER:
+                if(field.count == 1) {
+                    appendJsonNumber(out, field.getNumber(data));
+                    break;
+                }
+                out += '[';
+                for(size_t j = 0; j < field.count; j++) {
+                    if(j > 0) {
+                        out += ',';
+                    }
+                    appendJsonNumber(out, field.getNumber(data + j * field.stride));
+                }
+                out += ']';
+                break;
+            case JSON_FIELD_NUMBER_VECTOR: {
+                size_t count = field.vectorSize(data);
+                out += '[';
+                for(size_t j = 0; j < count; j++) {
+                    if(j > 0) {
+                        out += ',';
+                    }
+                    appendJsonNumber(out, field.getNumber(field.vectorElement(const_cast<char *>(data), j)));
+                }
+                out += ']';
+                break;
+            }
+            case JSON_FIELD_STRING: {
+                const std::string &s = *reinterpret_cast<const std::string *>(data);
+                appendJsonString(out, s.data(), s.size());
+                break;
+            }
+            case JSON_FIELD_OBJECT:
+                writeJsonObject(*field.table, data, out);
+                break;
+            case JSON_FIELD_OBJECT_ARRAY:
+            case JSON_FIELD_VECTOR: {
+                bool isVector = field.kind == JSON_FIELD_VECTOR;
+                size_t count = isVector ? field.vectorSize(data) : field.count;
+                out += '[';
+                for(size_t j = 0; j < count; j++) {
+                    if(j > 0) {
+                        out += ',';
+                    }
+                    const char *element = isVector ? field.vectorElement(const_cast<char *>(data), j)
+                        : data + j * field.stride;
+                    writeJsonObject(*field.table, element, out);
+                }
+                out += ']';
+                break;
+            }
+        }
+    }
+    out += '}';
+}
+
+// Writes all members of frame as one line of JSON, without the newline.
+// out keeps its capacity so repeated calls do not allocate.
+template <typename T>
+void writeJsonFrame(const T &frame, std::string &out)
+{
+    out.clear();
+    writeJsonObject(jsonFieldTable<T>(), reinterpret_cast<const char *>(&frame), out);
+}
+
+#endif // JSON_FIELD_TABLE_HPP
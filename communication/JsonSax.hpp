@@ -0,0 +1,445 @@
+/*
+ ISC License
+
+ Copyright (c) 2016-2017, Autonomous Vehicle Systems Lab, University of Colorado at Boulder
+
+ Permission to use, copy, modify, and/or distribute this software for any
+ purpose with or without fee is hereby granted, provided that the above
+ copyright notice and this permission notice appear in all copies.
+
+ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+//
+// JsonSax.hpp
+//
+// University of Colorado, Autonomous Vehicle Systems (AVS) Lab
+// Unpublished Copyright (c) 2012-2015 University of Colorado, All Rights Reserved
+//
+
+#ifndef JSON_SAX_HPP
+#define JSON_SAX_HPP
+
+#include <boost/cstdint.hpp>
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+// Event based parser of one JSON document held in a mutable buffer, e.g. a
+// line of newline-delimited JSON. Nothing is allocated: strings are unescaped
+// in place and handed over as pointer and length, valid until the buffer
+// changes, and numbers are converted without the C library, whose decimal
+// point follows the locale Qt sets. The handler provides
+//
+//     void startObject();  void endObject();
+//     void startArray();   void endArray();
+//     void key(const char *s, size_t length);
+//     void string(const char *s, size_t length);
+//     void number(double value);
+//     void boolean(bool value);
+//     void null();
+//
+// parse() returns false for malformed documents and for nesting deeper than
+// maxDepth, the handler may have seen a part of the document by then.
+template <typename Handler>
+class JsonSaxParser
+{
+public:
+    enum { maxDepth = 64 };
+
+    explicit JsonSaxParser(Handler &handler)
+        : m_handler(handler)
+        , m_p(0)
+        , m_end(0)
+    {
+
+    }
+
+    bool parse(char *data, size_t size)
+    {
+        m_p = data;
+        m_end = data + size;
+        // Open containers, '{' or '['
+        char stack[maxDepth];
+        int depth = 0;
+        bool isValueExpected = true;
+        while(true) {
+            skipSpace();
+            if(isValueExpected) {
+                if(m_p == m_end) {
+                    return false;
+                }
+                char c = *m_p;
+                if(c == '{' || c == '[') {
+                    if(depth == maxDepth) {
+                        return false;
+                    }
+                    m_p++;
+                    stack[depth++] = c;
+                    c == '{' ? m_handler.startObject() : m_handler.startArray();
+                    skipSpace();
+                    if(m_p < m_end && *m_p == (c == '{' ? '}' : ']')) {
+                        m_p++;
+                        depth--;
+                        c == '{' ? m_handler.endObject() : m_handler.endArray();
+                        isValueExpected = false;
+                    } else if(c == '{' && !parseKey()) {
+                        return false;
+                    }
+                    continue;
+                }
+                if(!parseScalar()) {
+                    return false;
+                }
+                isValueExpected = false;
+                continue;
+            }
+            if(depth == 0) {
+                // Only white space may follow the document
+                return m_p == m_end;
+            }
+            if(m_p == m_end) {
+                return false;
+            }
+            char c = *m_p++;
+            if(c == ',') {
+                if(stack[depth - 1] == '{') {
+                    skipSpace();
+                    if(!parseKey()) {
+                        return false;
+                    }
+                }
+                isValueExpected = true;
+            } else if(c == '}' && stack[depth - 1] == '{') {
+                depth--;
+                m_handler.endObject();
+            } else if(c == ']' && stack[depth - 1] == '[') {
+                depth--;
+                m_handler.endArray();
+            } else {
+                return false;
+            }
+        }
+    }
+
+private:
+    Handler &m_handler;
+    char *m_p;
+    char *m_end;
+
+    void skipSpace()
+    {
+        while(m_p < m_end && (*m_p == ' ' || *m_p == '\t' || *m_p == '\n' || *m_p == '\r')) {
+            m_p++;
+        }
+    }
+
+    // A key and its colon, m_p is at the opening quote
+    bool parseKey()
+    {
+        char *s;
+        size_t length;
+        if(!parseString(s, length)) {
+            return false;
+        }
+        skipSpace();
+        if(m_p == m_end || *m_p != ':') {
+            return false;
+        }
+        m_p++;
+        m_handler.key(s, length);
+        return true;
+    }
+
+    bool parseScalar()
+    {
+        char c = *m_p;
+        if(c == '"') {
+            char *s;
+            size_t length;
+            if(!parseString(s, length)) {
+                return false;
+            }
+            m_handler.string(s, length);
+        } else if(c == 't') {
+            if(!parseLiteral("true")) {
+                return false;
+            }
+            m_handler.boolean(true);
+        } else if(c == 'f') {
+            if(!parseLiteral("false")) {
+                return false;
+            }
+            m_handler.boolean(false);
+        } else if(c == 'n') {
+            if(!parseLiteral("null")) {
+                return false;
+            }
+            m_handler.null();
+        } else {
+            double value;
+            if(!parseNumber(value)) {
+                return false;
+            }
+            m_handler.number(value);
+        }
+        return true;
+    }
+
+    bool parseLiteral(const char *literal)
+    {
+        for(; *literal; literal++, m_p++) {
+            if(m_p == m_end || *m_p != *literal) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static int hexValue(char c)
+    {
+        if(c >= '0' && c <= '9') {
+            return c - '0';
+        }
+        if(c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        }
+        if(c >= 'A' && c <= 'F') {
+            return c - 'A' + 10;
+        }
+        return -1;
+    }
+
+    bool parseHex4(boost::uint32_t &value)
+    {
+        if(m_end - m_p < 4) {
+            return false;
+        }
+        value = 0;
+        for(int i = 0; i < 4; i++) {
+            int digit = hexValue(*m_p++);
+            if(digit < 0) {
+                return false;
+            }
+            value = (value << 4) | digit;
+        }
+        return true;
+    }
+
+    // Unescapes the string at m_p in place, escapes never get shorter when
+    // decoded so the result always fits
+    bool parseString(char *&s, size_t &length)
+    {
+        if(m_p == m_end || *m_p != '"') {
+            return false;
+        }
+        m_p++;
+        s = m_p;
+        char *out = m_p;
+        while(true) {
+            if(m_p == m_end) {
+                return false;
+            }
+            char c = *m_p++;
+            if(c == '"') {
+                break;
+            }
+            if((unsigned char)c < 0x20) {
+                return false;
+            }
+            if(c != '\\') {
+                *out++ = c;
+                continue;
+            }
+            if(m_p == m_end) {
+                return false;
+            }
+            c = *m_p++;
+            switch(c) {
+                case '"': case '\\': case '/': *out++ = c; break;
+                case 'b': *out++ = '\b'; break;
+                case 'f': *out++ = '\f'; break;
+                case 'n': *out++ = '\n'; break;
+                case 'r': *out++ = '\r'; break;
+                case 't': *out++ = '\t'; break;
+                case 'u': {
+                    boost::uint32_t code;
+                    if(!parseHex4(code)) {
+                        return false;
+                    }
+                    if(code >= 0xd800 && code < 0xdc00) {
+                        // High surrogate, a low one has to follow
+                        boost::uint32_t low;
+                        if(m_end - m_p < 6 || m_p[0] != '\\' || m_p[1] != 'u') {
+                            return false;
+                        }
+                        m_p += 2;
+                        if(!parseHex4(low) || low < 0xdc00 || low >= 0xe000) {
+                            return false;
+                        }
+                        code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                    }
+                    // UTF-8
+                    if(code < 0x80) {
+                        *out++ = (char)code;
+                    } else if(code < 0x800) {
+                        *out++ = (char)(0xc0 | (code >> 6));
+                        *out++ = (char)(0x80 | (code & 0x3f));
+                    } else if(code < 0x10000) {
+                        *out++ = (char)(0xe0 | (code >> 12));
+                        *out++ = (char)(0x80 | ((code >> 6) & 0x3f));
+                        *out++ = (char)(0x80 | (code & 0x3f));
+                    } else {
+                        *out++ = (char)(0xf0 | (code >> 18));
+                        *out++ = (char)(0x80 | ((code >> 12) & 0x3f));
+                        *out++ = (char)(0x80 | ((code >> 6) & 0x3f));
+                        *out++ = (char)(0x80 | (code & 0x3f));
+                    }
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+        length = out - s;
+        return true;
+    }
+
+    // Up to 19 significant digits are kept. They are scaled in long double,
+    // which holds all of them where it is wider than double, so the result
+    // is the nearest double to the text except for rare double rounding.
+    bool parseNumber(double &value)
+    {
+        // Powers of ten that are exact even as doubles
+        static const long double powers[] = {
+            1e0L, 1e1L, 1e2L, 1e3L, 1e4L, 1e5L, 1e6L, 1e7L, 1e8L, 1e9L, 1e10L, 1e11L,
+            1e12L, 1e13L, 1e14L, 1e15L, 1e16L, 1e17L, 1e18L, 1e19L, 1e20L, 1e21L, 1e22L
+        };
+        bool isNegative = false;
+        if(m_p < m_end && *m_p == '-') {
+            isNegative = true;
+            m_p++;
+        }
+        if(m_p == m_end || *m_p < '0' || *m_p > '9') {
+            return false;
+        }
+        boost::uint64_t mantissa = 0;
+        int digits = 0;
+        int exponent = 0;
+        if(*m_p == '0') {
+            m_p++;
+        } else {
+            for(; m_p < m_end && *m_p >= '0' && *m_p <= '9'; m_p++) {
+                if(digits < 19) {
+                    mantissa = mantissa * 10 + (*m_p - '0');
+                    digits++;
+                } else {
+                    exponent++;
+                }
+            }
+        }
+        if(m_p < m_end && *m_p == '.') {
+            m_p++;
+            if(m_p == m_end || *m_p < '0' || *m_p > '9') {
+                return false;
+            }
+            for(; m_p < m_end && *m_p >= '0' && *m_p <= '9'; m_p++) {
+                if(digits < 19) {
+                    mantissa = mantissa * 10 + (*m_p - '0');
+                    // Leading zeros are not significant
+                    digits += mantissa > 0 ? 1 : 0;
+                    exponent--;
+                }
+            }
+        }
+        if(m_p < m_end && (*m_p == 'e' || *m_p == 'E')) {
+            m_p++;
+            bool isExponentNegative = false;
+            if(m_p < m_end && (*m_p == '+' || *m_p == '-')) {
+                isExponentNegative = *m_p == '-';
+                m_p++;
+            }
+            if(m_p == m_end || *m_p < '0' || *m_p > '9') {
+                return false;
+            }
+            int explicitExponent = 0;
+            for(; m_p < m_end && *m_p >= '0' && *m_p <= '9'; m_p++) {
+                if(explicitExponent < 10000) {
+                    explicitExponent = explicitExponent * 10 + (*m_p - '0');
+                }
+            }
+            exponent += isExponentNegative ? -explicitExponent : explicitExponent;
+        }
+        long double scaled = (long double)mantissa;
+        if(mantissa != 0) {
+            if(exponent >= 0 && exponent <= 22) {
+                scaled *= powers[exponent];
+            } else if(exponent < 0 && exponent >= -22) {
+                scaled /= powers[-exponent];
+            } else {
+                // Split so that neither factor over- or underflows early
+                scaled *= std::pow(10.0L, exponent / 2);
+                scaled *= std::pow(10.0L, exponent - exponent / 2);
+            }
+        }
+        value = (double)scaled;
+        if(isNegative) {
+            value = -value;
+        }
+        return true;
+    }
+};
+
+// Appends value in a form that reads back to the same double,
+// JSON has no representation of NaN and infinity so they become null
+inline void appendJsonNumber(std::string &out, double value)
+{
+    if(!(value - value == 0.0)) {
+        out += "null";
+        return;
+    }
+    char buffer[32];
+    // Integers, e.g. counters and time stamps, print without exponent
+    if(value == std::floor(value) && std::fabs(value) < 1e15) {
+        std::snprintf(buffer, sizeof(buffer), "%.0f", value);
+    } else {
+        std::snprintf(buffer, sizeof(buffer), "%.17g", value);
+    }
+    for(char *p = buffer; *p; p++) {
+        // The decimal point of the locale
+        if(*p == ',') {
+            *p = '.';
+        }
+    }
+    out += buffer;
+}
+
+inline void appendJsonString(std::string &out, const char *s, size_t length)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+    out += '"';
+    for(size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)s[i];
+        if(c == '"' || c == '\\') {
+            out += '\\';
+            out += (char)c;
+        } else if(c == '\n') {
+            out += "\\n";
+        } else if(c < 0x20) {
+            out += "\\u00";
+            out += hexDigits[c >> 4];
+            out += hexDigits[c & 0x0f];
+        } else {
+            out += (char)c;
+        }
+    }
+    out += '"';
+}
+
+#endif // JSON_SAX_HPP
@@ -0,0 +1,169 @@
+/*
+ ISC License
+
+ Copyright (c) 2016-2017, Autonomous Vehicle Systems Lab, University of Colorado at Boulder
+
+ Permission to use, copy, modify, and/or distribute this software for any
+ purpose with or without fee is hereby granted, provided that the above
+ copyright notice and this permission notice appear in all copies.
+
+ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+//
+// LatencyHistogram.hpp
+//
+// University of Colorado, Autonomous Vehicle Systems (AVS) Lab
+// Unpublished Copyright (c) 2012-2015 University of Colorado, All Rights Reserved
+//
+
+#ifndef LATENCY_HISTOGRAM_HPP
+#define LATENCY_HISTOGRAM_HPP
+
+#include <boost/cstdint.hpp>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+// Milliseconds since epoch with microsecond resolution. The same clock as
+// the millisecond timeStamp of frames, so both can be subtracted.
+inline double preciseTimeStamp()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count() / 1000.0;
+}
+
+// Histogram of durations in the manner of HdrHistogram. Values are counted
+// in microseconds; below 2 * subBucketCount every value has its own bucket,
+// above that every power of two is split into subBucketCount buckets. Any
+// percentile is then known to about 3% of its value, from a microsecond to
+// more than a day, in a fixed amount of memory and with constant time
+// recording.
+class LatencyHistogram
+{
+public:
+    LatencyHistogram()
+        : m_counts(bucketCount(), 0)
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        std::fill(m_counts.begin(), m_counts.end(), 0);
+        m_count = 0;
+        m_sum = 0.0;
+        m_min = 0;
+        m_max = 0;
+    }
+
+    // Negative durations, e.g. from clocks of two hosts that are not in
+    // sync, are counted as 0
+    void record(double milliseconds)
+    {
+        boost::uint64_t value = milliseconds > 0.0 ? (boost::uint64_t)(milliseconds * 1000.0 + 0.5) : 0;
+        m_counts[bucketIndex(value)]++;
+        m_sum += (double)value;
+        if(m_count == 0 || value < m_min) {
+            m_min = value;
+        }
+        if(value > m_max) {
+            m_max = value;
+        }
+        m_count++;
+    }
+
+    void add(const LatencyHistogram &other)
+    {
+        if(other.m_count == 0) {
+            return;
+        }
+        for(size_t i = 0; i < m_counts.size(); i++) {
+            m_counts[i] += other.m_counts[i];
+        }
+        if(m_count == 0 || other.m_min < m_min) {
+            m_min = other.m_min;
+        }
+        if(other.m_max > m_max) {
+            m_max = other.m_max;
+        }
+        m_count += other.m_count;
+        m_sum += other.m_sum;
+    }
+
+    // All in milliseconds, 0 while empty
+    boost::uint64_t count() const { return m_count; }
+    double mean() const { return m_count > 0 ? m_sum / m_count / 1000.0 : 0.0; }
+    double min() const { return m_min / 1000.0; }
+    double max() const { return m_max / 1000.0; }
+
+    // Smallest value that percent of the values are at or below
+    double percentile(double percent) const
+    {
+        if(m_count == 0) {
+            return 0.0;
+        }
+        boost::uint64_t rank = (boost::uint64_t)(percent / 100.0 * m_count + 0.5);
+        if(rank < 1) {
+            rank = 1;
+        }
+        boost::uint64_t seen = 0;
+        for(size_t i = 0; i < m_counts.size(); i++) {
+            seen += m_counts[i];
+            if(seen >= rank) {
+                // The exact extremes are known, the rest is the bucket middle
+                boost::uint64_t value = bucketValue(i);
+                value = value < m_min ? m_min : value;
+                value = value > m_max ? m_max : value;
+                return value / 1000.0;
+            }
+        }
+        return max();
+    }
+
+private:
+    enum { subBucketBits = 5, subBucketCount = 1 << subBucketBits, maxShift = 32 };
+
+    std::vector<boost::uint64_t> m_counts;
+    boost::uint64_t m_count;
+    double m_sum;
+    boost::uint64_t m_min;
+    boost::uint64_t m_max;
+
+    static size_t bucketCount() { return 2 * subBucketCount + maxShift * subBucketCount; }
+
+    static size_t bucketIndex(boost::uint64_t value)
+    {
+        if(value < 2 * subBucketCount) {
+            return (size_t)value;
+        }
+        // Shift that brings value into [subBucketCount, 2 * subBucketCount)
+        int shift = 1;
+        while((value >> shift) >= 2 * subBucketCount) {
+            shift++;
+        }
+        if(shift > maxShift) {
+            return bucketCount() - 1;
+        }
+        return 2 * subBucketCount + (shift - 1) * subBucketCount
+            + (size_t)((value >> shift) - subBucketCount);
+    }
+
+    static boost::uint64_t bucketValue(size_t index)
+    {
+        if(index < 2 * subBucketCount) {
+            return index;
+        }
+        int shift = (int)((index - 2 * subBucketCount) / subBucketCount) + 1;
+        boost::uint64_t subBucket = (index - 2 * subBucketCount) % subBucketCount + subBucketCount;
+        return (subBucket << shift) + ((boost::uint64_t)1 << (shift - 1));
+    }
+};
+
+#endif // LATENCY_HISTOGRAM_HPP
@@ -0,0 +1,138 @@
+/*
+ ISC License
+
+ Copyright (c) 2016-2017, Autonomous Vehicle Systems Lab, University of Colorado at Boulder
+
+ Permission to use, copy, modify, and/or distribute this software for any
+ purpose with or without fee is hereby granted, provided that the above
+ copyright notice and this permission notice appear in all copies.
+
+ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+//
+// SampleHistory.hpp
+//
+// University of Colorado, Autonomous Vehicle Systems (AVS) Lab
+// Unpublished Copyright (c) 2012-2015 University of Colorado, All Rights Reserved
+//
+
+#ifndef SAMPLE_HISTORY_HPP
+#define SAMPLE_HISTORY_HPP
+
+#include <boost/thread/mutex.hpp>
+#include <vector>
+
+// The newest samples of a stream in time order, filled by the thread that
+// receives frames and read by the ones that plot them. Frames carry the
+// samples taken since the frame before; samples at or before the newest one
+// held were already added and are skipped, so a frame that repeats the
+// samples of an earlier one adds nothing. A frame whose samples all lie
+// before the newest one means the simulation was restarted and starts a new
+// history. Samples provide their simulation time through an ADL overload of
+// sampleSimTime.
+template <typename T>
+class SampleHistory
+{
+public:
+    SampleHistory()
+        : m_first(0)
+        , m_count(0)
+    {
+        m_samples.resize(defaultCapacity);
+    }
+
+    void setCapacity(size_t samples)
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        m_samples.resize(samples > 1 ? samples : 1);
+        m_first = 0;
+        m_count = 0;
+    }
+
+    void clear()
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        m_first = 0;
+        m_count = 0;
+    }
+
+    size_t size()
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        return m_count;
+    }
+
+    // Returns the number of samples added
+    size_t append(const std::vector<T> &samples)
+    {
+        if(samples.empty()) {
+            return 0;
+        }
+        boost::mutex::scoped_lock lock(m_mutex);
+        size_t next = 0;
+        if(m_count > 0) {
+            double newest = sampleSimTime(sample(m_count - 1));
+            if(sampleSimTime(samples.back()) < newest) {
+                m_first = 0;
+                m_count = 0;
+            } else {
+                while(next < samples.size() && sampleSimTime(samples[next]) <= newest) {
+                    next++;
+                }
+            }
+        }
+        size_t added = samples.size() - next;
+        for(; next < samples.size(); next++) {
+            if(m_count == m_samples.size()) {
+                m_first = (m_first + 1) % m_samples.size();
+                m_count--;
+            }
+            // Assigned into the slot so its vectors keep their capacity
+            sample(m_count) = samples[next];
+            m_count++;
+        }
+        return added;
+    }
+
+    // Copies the samples after time to out, oldest first. Returns false if
+    // some of them were already overwritten, out then starts with the
+    // oldest sample held.
+    bool copySince(double time, std::vector<T> &out)
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        out.clear();
+        size_t first = m_count;
+        while(first > 0 && sampleSimTime(sample(first - 1)) > time) {
+            first--;
+        }
+        out.reserve(m_count - first);
+        for(size_t i = first; i < m_count; i++) {
+            out.push_back(sample(i));
+        }
+        return first > 0 || m_count < m_samples.size();
+    }
+
+private:
+    // A minute of a simulation stepping at 250 Hz
+    enum { defaultCapacity = 15000 };
+
+    boost::mutex m_mutex;
+    // Ring of the newest samples, oldest first, guarded by m_mutex
+    std::vector<T> m_samples;
+    size_t m_first;
+    size_t m_count;
+
+    T &sample(size_t index) { return m_samples[(m_first + index) % m_samples.size()]; }
+
+    SampleHistory(const SampleHistory &);
+    SampleHistory &operator=(const SampleHistory &);
+};
+
+#endif // SAMPLE_HISTORY_HPP
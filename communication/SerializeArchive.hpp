@@ -0,0 +1,134 @@
+/*
+ ISC License
+
+ Copyright (c) 2016-2017, Autonomous Vehicle Systems Lab, University of Colorado at Boulder
+
+ Permission to use, copy, modify, and/or distribute this software for any
+ purpose with or without fee is hereby granted, provided that the above
+ copyright notice and this permission notice appear in all copies.
+
+ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+//
+// SerializeArchive.hpp
+//
+// University of Colorado, Autonomous Vehicle Systems (AVS) Lab
+// Unpublished Copyright (c) 2012-2015 University of Colorado, All Rights Reserved
+//
+
+#ifndef SERIALIZE_ARCHIVE_HPP
+#define SERIALIZE_ARCHIVE_HPP
+
+#include <boost/archive/text_iarchive.hpp>
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <iostream>
+#include <streambuf>
+#include <string>
+
+// Archive formats that can be used to put a serialized object on the wire.
+// Values are bit flags so a set of supported formats can be advertised.
+typedef enum {
+    WIRE_FORMAT_TEXT   = 0x01,  /*!< boost text archive, portable across platforms */
+    WIRE_FORMAT_BINARY = 0x02   /*!< boost binary archive, both ends must share endianness and type sizes */
+} WireFormat_t;
+
+// Stream buffer reading from an existing block of memory so inbound data can
+// be deserialized in place instead of being copied into a std::string first
+class ArchiveReadBuffer : public std::streambuf
+{
+public:
+    ArchiveReadBuffer(const char *data, size_t size)
+    {
+        char *begin = const_cast<char *>(data);
+        setg(begin, begin, begin + size);
+    }
+};
+
+// Stream buffer appending to a std::string so the outbound buffer's capacity
+// is reused between frames
+class ArchiveWriteBuffer : public std::streambuf
+{
+public:
+    ArchiveWriteBuffer(std::string &buffer)
+        : m_buffer(buffer) {}
+
+protected:
+    virtual int_type overflow(int_type c)
+    {
+        if(!traits_type::eq_int_type(c, traits_type::eof())) {
+            m_buffer.push_back(traits_type::to_char_type(c));
+        }
+        return traits_type::not_eof(c);
+    }
+    virtual std::streamsize xsputn(const char *s, std::streamsize n)
+    {
+        m_buffer.append(s, (size_t)n);
+        return n;
+    }
+
+private:
+    std::string &m_buffer;
+};
+
+// Simulation time of a frame, written to the binary frame header and to the
+// index of recordings. Frame types can provide an overload found through
+// argument dependent lookup.
+template <typename T>
+double frameSimTime(const T &)
+{
+    return 0.0;
+}
+
+// Serializes t into buffer (replacing its contents) using the requested archive format
+template <typename T>
+bool serializeArchive(const T &t, WireFormat_t format, std::string &buffer)
+{
+    buffer.clear();
+    ArchiveWriteBuffer writeBuffer(buffer);
+    try {
+        if(format == WIRE_FORMAT_BINARY) {
+            boost::archive::binary_oarchive archive(writeBuffer);
+            archive & t;
+        } else {
+            std::ostream archiveStream(&writeBuffer);
+            boost::archive::text_oarchive archive(archiveStream);
+            archive & t;
+        }
+    } catch(boost::archive::archive_exception& e) {
+        std::cout << "Error occured: " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Deserializes t from a block of memory written by serializeArchive
+template <typename T>
+bool deserializeArchive(const char *data, size_t size, WireFormat_t format, T &t)
+{
+    ArchiveReadBuffer readBuffer(data, size);
+    try {
+        if(format == WIRE_FORMAT_BINARY) {
+            boost::archive::binary_iarchive archive(readBuffer);
+            archive >> t;
+        } else {
+            std::istream archiveStream(&readBuffer);
+            boost::archive::text_iarchive archive(archiveStream);
+            archive >> t;
+        }
+    } catch(boost::archive::archive_exception& e) {
+        std::cout << "Error occured: " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+#endif // SERIALIZE_ARCHIVE_HPP
@@ -0,0 +1,84 @@
+/*
+ ISC License
+
+ Copyright (c) 2016-2017, Autonomous Vehicle Systems Lab, University of Colorado at Boulder
+
+ Permission to use, copy, modify, and/or distribute this software for any
+ purpose with or without fee is hereby granted, provided that the above
+ copyright notice and this permission notice appear in all copies.
+
+ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+//
+// TripleBuffer.hpp
+//
+// University of Colorado, Autonomous Vehicle Systems (AVS) Lab
+// Unpublished Copyright (c) 2012-2015 University of Colorado, All Rights Reserved
+//
+
+#ifndef TRIPLE_BUFFER_HPP
+#define TRIPLE_BUFFER_HPP
+
+#include <boost/atomic.hpp>
+
+// Lock free hand over of the latest value from one writer thread to one
+// reader thread. The writer fills writeBuffer() and publishes it, the reader
+// calls update() and then uses readBuffer(). Neither side ever waits; values
+// published faster than the reader updates are overwritten, the reader always
+// sees the newest complete one.
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer()
+        : m_middle(1)
+        , m_write(0)
+        , m_read(2)
+    {
+
+    }
+
+    // Writer side
+    T &writeBuffer() { return m_buffers[m_write]; }
+    void publish()
+    {
+        // Swap the filled buffer with the middle one and mark it as new
+        int previous = m_middle.exchange(m_write | dirtyBit, boost::memory_order_acq_rel);
+        m_write = previous & indexMask;
+    }
+
+    // Reader side, returns false if nothing was published since the last update
+    bool update()
+    {
+        if(!(m_middle.load(boost::memory_order_relaxed) & dirtyBit)) {
+            return false;
+        }
+        int previous = m_middle.exchange(m_read, boost::memory_order_acq_rel);
+        m_read = previous & indexMask;
+        return true;
+    }
+    const T &readBuffer() const { return m_buffers[m_read]; }
+
+private:
+    enum { indexMask = 0x03, dirtyBit = 0x04 };
+
+    T m_buffers[3];
+    // Index of the buffer between writer and reader, plus the dirty bit
+    boost::atomic<int> m_middle;
+    // Only touched by the writer
+    int m_write;
+    // Only touched by the reader
+    int m_read;
+
+    TripleBuffer(const TripleBuffer &);
+    TripleBuffer &operator=(const TripleBuffer &);
+};
+
+#endif // TRIPLE_BUFFER_HPP
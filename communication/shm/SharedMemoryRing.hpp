@@ -0,0 +1,244 @@
+/*
+ ISC License
+
+ Copyright (c) 2016-2017, Autonomous Vehicle Systems Lab, University of Colorado at Boulder
+
+ Permission to use, copy, modify, and/or distribute this software for any
+ purpose with or without fee is hereby granted, provided that the above
+ copyright notice and this permission notice appear in all copies.
+
+ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+//
+// SharedMemoryRing.hpp
+//
+// University of Colorado, Autonomous Vehicle Systems (AVS) Lab
+// Unpublished Copyright (c) 2012-2015 University of Colorado, All Rights Reserved
+//
+
+#ifndef SHARED_MEMORY_RING_HPP
+#define SHARED_MEMORY_RING_HPP
+
+#include <boost/archive/basic_archive.hpp>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <cstring>
+#include <new>
+#include <string>
+
+// Layout of a shared memory segment used by the shm transports. The segment
+// holds a header followed by two rings, one carrying frames from the
+// simulation to the viewers (downlink) and one carrying the viewer's replies
+// back (uplink). All offsets are relative to the start of the segment so it
+// can be mapped at any address.
+#define SHM_SEGMENT_MAGIC 0x42534b53 /* "BSKS" */
+#define SHM_SEGMENT_VERSION 1
+
+struct ShmSegmentHeader
+{
+    boost::uint32_t magic;
+    boost::uint32_t version;
+    // Data layout of the writer, binary archives need a matching reader
+    boost::int32_t littleEndian;
+    boost::int32_t sizeOfInt;
+    boost::int32_t sizeOfLong;
+    boost::int32_t sizeOfDouble;
+    boost::int32_t archiveVersion;
+    boost::uint32_t downlinkOffset;
+    boost::uint32_t uplinkOffset;
+    boost::uint32_t segmentSize;
+};
+
+// Fills in the magic, version and the local data layout
+inline void initSegmentHeader(ShmSegmentHeader &header)
+{
+    boost::uint16_t endianTest = 1;
+    header.version = SHM_SEGMENT_VERSION;
+    header.littleEndian = *reinterpret_cast<unsigned char *>(&endianTest) == 1;
+    header.sizeOfInt = sizeof(int);
+    header.sizeOfLong = sizeof(long);
+    header.sizeOfDouble = sizeof(double);
+    header.archiveVersion = boost::archive::BOOST_ARCHIVE_VERSION();
+    // Readers of a segment treat it as initialized once the magic is set
+    boost::atomic_thread_fence(boost::memory_order_release);
+    header.magic = SHM_SEGMENT_MAGIC;
+}
+
+// Binary archives written by the creator of the segment are only readable
+// with the same data layout
+inline bool isBinaryCompatible(const ShmSegmentHeader &header)
+{
+    ShmSegmentHeader local;
+    initSegmentHeader(local);
+    return header.littleEndian == local.littleEndian
+        && header.sizeOfInt == local.sizeOfInt
+        && header.sizeOfLong == local.sizeOfLong
+        && header.sizeOfDouble == local.sizeOfDouble
+        && header.archiveVersion == local.archiveVersion;
+}
+
+struct ShmRingHeader
+{
+    boost::uint32_t slotCount;
+    boost::uint32_t slotSize;
+    // Sequence number of the newest complete frame, 0 before the first one
+    boost::atomic<boost::uint32_t> latest;
+};
+
+// Every slot is a seqlock: the writer sets sequence to 2 * frame - 1 while
+// copying the frame in and to 2 * frame once it is complete. A reader that
+// sees the same even value before and after copying the frame out has a
+// consistent copy.
+struct ShmSlotHeader
+{
+    boost::atomic<boost::uint32_t> sequence;
+    boost::uint32_t size;
+    boost::uint32_t flags;
+    boost::uint32_t reserved;
+};
+
+// View of one ring inside a mapped segment. Exactly one process writes to a
+// ring, any number may read from it.
+class SharedMemoryRing
+{
+public:
+    SharedMemoryRing()
+        : m_header(0)
+        , m_slots(0)
+        , m_sequence(0)
+        , m_lastRead(0)
+        , m_skipped(0)
+    {
+
+    }
+
+    static size_t requiredSize(boost::uint32_t slotCount, boost::uint32_t slotSize)
+    {
+        return sizeof(ShmRingHeader) + (size_t)slotCount * slotStride(slotSize);
+    }
+
+    // Formats a ring at memory, only done by the process creating the segment
+    void create(void *memory, boost::uint32_t slotCount, boost::uint32_t slotSize)
+    {
+        m_header = new(memory) ShmRingHeader;
+        m_header->slotCount = slotCount;
+        m_header->slotSize = slotSize;
+        m_header->latest.store(0);
+        m_slots = static_cast<char *>(memory) + sizeof(ShmRingHeader);
+        for(boost::uint32_t i = 0; i < slotCount; i++) {
+            ShmSlotHeader *slot = new(slotAt(i)) ShmSlotHeader;
+            slot->sequence.store(0);
+            slot->size = 0;
+            slot->flags = 0;
+        }
+        m_sequence = 0;
+        m_lastRead = 0;
+    }
+
+    // Attaches to a ring formatted by another process
+    void attach(void *memory)
+    {
+        m_header = static_cast<ShmRingHeader *>(memory);
+        m_slots = static_cast<char *>(memory) + sizeof(ShmRingHeader);
+        // Continue after the frames already in the ring
+        m_sequence = m_header->latest.load(boost::memory_order_acquire);
+        m_lastRead = 0;
+    }
+
+    void detach()
+    {
+        m_header = 0;
+        m_slots = 0;
+    }
+
+    bool isAttached() { return m_header != 0; }
+    // Frames the writer published that readLatest() never returned since
+    // they were superseded first, kept across attaches
+    unsigned long framesSkipped() { return m_skipped; }
+    boost::uint32_t slotSize() { return m_header ? m_header->slotSize : 0; }
+
+    // Publishes a frame, returns false if it does not fit a slot
+    bool write(const char *data, size_t size, boost::uint32_t flags)
+    {
+        if(!m_header || size > m_header->slotSize) {
+            return false;
+        }
+        boost::uint32_t sequence = ++m_sequence;
+        ShmSlotHeader *slot = slotAt(sequence % m_header->slotCount);
+        slot->sequence.store(2 * sequence - 1, boost::memory_order_relaxed);
+        boost::atomic_thread_fence(boost::memory_order_release);
+        std::memcpy(reinterpret_cast<char *>(slot) + sizeof(ShmSlotHeader), data, size);
+        slot->size = (boost::uint32_t)size;
+        slot->flags = flags;
+        slot->sequence.store(2 * sequence, boost::memory_order_release);
+        m_header->latest.store(sequence, boost::memory_order_release);
+        return true;
+    }
+
+    // Copies the newest frame into frame if it was not read before. The copy
+    // is taken before decoding since a torn archive could make the decoder
+    // allocate arbitrary amounts of memory.
+    bool readLatest(std::string &frame, boost::uint32_t &flags)
+    {
+        if(!m_header) {
+            return false;
+        }
+        for(int attempt = 0; attempt < maxReadAttempts; attempt++) {
+            boost::uint32_t latest = m_header->latest.load(boost::memory_order_acquire);
+            if(latest == 0 || latest == m_lastRead) {
+                return false;
+            }
+            ShmSlotHeader *slot = slotAt(latest % m_header->slotCount);
+            boost::uint32_t before = slot->sequence.load(boost::memory_order_acquire);
+            if(before != 2 * latest) {
+                // Already being overwritten by a newer frame
+                continue;
+            }
+            boost::uint32_t size = slot->size;
+            flags = slot->flags;
+            if(size > m_header->slotSize) {
+                continue;
+            }
+            frame.assign(reinterpret_cast<char *>(slot) + sizeof(ShmSlotHeader), size);
+            boost::atomic_thread_fence(boost::memory_order_acquire);
+            if(slot->sequence.load(boost::memory_order_relaxed) == before) {
+                if(m_lastRead != 0 && latest > m_lastRead + 1) {
+                    m_skipped += latest - m_lastRead - 1;
+                }
+                m_lastRead = latest;
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    enum { maxReadAttempts = 4 };
+
+    ShmRingHeader *m_header;
+    char *m_slots;
+    // Writer side
+    boost::uint32_t m_sequence;
+    // Reader side
+    boost::uint32_t m_lastRead;
+    unsigned long m_skipped;
+
+    static size_t slotStride(boost::uint32_t slotSize)
+    {
+        // Keep every slot header aligned for its atomic
+        return (sizeof(ShmSlotHeader) + slotSize + 63) & ~(size_t)63;
+    }
+    ShmSlotHeader *slotAt(boost::uint32_t index)
+    {
+        return reinterpret_cast<ShmSlotHeader *>(m_slots + (size_t)index * slotStride(m_header->slotSize));
+    }
+};
+
+#endif // SHARED_MEMORY_RING_HPP
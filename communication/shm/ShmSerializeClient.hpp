@@ -0,0 +1,240 @@
+/*
+ ISC License
+
+ Copyright (c) 2016-2017, Autonomous Vehicle Systems Lab, University of Colorado at Boulder
+
+ Permission to use, copy, modify, and/or distribute this software for any
+ purpose with or without fee is hereby granted, provided that the above
+ copyright notice and this permission notice appear in all copies.
+
+ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+//
+// ShmSerializeClient.hpp
+//
+// University of Colorado, Autonomous Vehicle Systems (AVS) Lab
+// Unpublished Copyright (c) 2012-2015 University of Colorado, All Rights Reserved
+//
+
+#ifndef SHM_SERIALIZE_CLIENT_HPP
+#define SHM_SERIALIZE_CLIENT_HPP
+
+#include "SharedMemoryRing.hpp"
+#include "SerializeArchive.hpp"
+
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <chrono>
+#include <iostream>
+
+// Shared memory counterpart of TcpSerializeClient. There is no thread and no
+// socket, the owner calls poll() as often as it wants to see new frames;
+// a poll without a new frame costs one atomic load.
+template <typename T1, typename T2>
+class ShmSerializeClient
+{
+public:
+    ShmSerializeClient();
+    ~ShmSerializeClient();
+
+    // Attaches to the segment created by ShmSerializeServer. If it does not
+    // exist yet poll() keeps trying, only returns false on an invalid name.
+    bool connect(std::string name);
+    bool isConnected();
+    bool close(void);
+
+    // Decodes the newest frame if there is one, returns true if
+    // getInboundData() changed
+    bool poll();
+
+    T1 getInboundData();
+    // Milliseconds since epoch at which the current frame was picked up
+    long getInboundArrivalTime();
+    // Frames overwritten in the ring before they were polled
+    unsigned long framesSkipped() { return m_downlink.framesSkipped(); }
+    void setOutboundData(T2 *data);
+
+private:
+    // A segment that has not published for this long is assumed to belong
+    // to a simulation that was restarted, the name is then attached again
+    enum { reattachTimeout = 2000 };
+
+    boost::scoped_ptr<boost::interprocess::shared_memory_object> m_memory;
+    boost::scoped_ptr<boost::interprocess::mapped_region> m_region;
+    std::string m_name;
+    SharedMemoryRing m_downlink;
+    SharedMemoryRing m_uplink;
+    bool m_isBinaryCompatible;
+    bool m_isNameSet;
+    long m_lastFrameTime;
+
+    std::string m_inboundFrame;
+    std::string m_outboundFrame;
+    T1 m_inboundData;
+    long m_arrivalTime;
+
+    bool attach();
+    void detach();
+    long now();
+};
+
+template <typename T1, typename T2>
+ShmSerializeClient<T1, T2>::ShmSerializeClient()
+    : m_isBinaryCompatible(false)
+    , m_isNameSet(false)
+    , m_lastFrameTime(0)
+    , m_arrivalTime(0)
+{
+
+}
+
+template <typename T1, typename T2>
+ShmSerializeClient<T1, T2>::~ShmSerializeClient()
+{
+    close();
+}
+
+template <typename T1, typename T2>
+bool ShmSerializeClient<T1, T2>::connect(std::string name)
+{
+    close();
+    if(name.empty()) {
+        return false;
+    }
+    m_name = name;
+    m_isNameSet = true;
+    attach();
+    return true;
+}
+
+template <typename T1, typename T2>
+bool ShmSerializeClient<T1, T2>::isConnected()
+{
+    return m_downlink.isAttached();
+}
+
+template <typename T1, typename T2>
+bool ShmSerializeClient<T1, T2>::close(void)
+{
+    detach();
+    m_isNameSet = false;
+    return true;
+}
+
+template <typename T1, typename T2>
+bool ShmSerializeClient<T1, T2>::poll()
+{
+    if(!m_isNameSet) {
+        return false;
+    }
+    if(!m_downlink.isAttached() || now() - m_lastFrameTime > reattachTimeout) {
+        if(!attach()) {
+            return false;
+        }
+    }
+
+    boost::uint32_t flags = 0;
+    if(!m_downlink.readLatest(m_inboundFrame, flags)) {
+        return false;
+    }
+    m_lastFrameTime = now();
+    WireFormat_t format = flags == WIRE_FORMAT_BINARY ? WIRE_FORMAT_BINARY : WIRE_FORMAT_TEXT;
+    if(format == WIRE_FORMAT_BINARY && !m_isBinaryCompatible) {
+        return false;
+    }
+    if(!deserializeArchive(m_inboundFrame.data(), m_inboundFrame.size(), format, m_inboundData)) {
+        return false;
+    }
+    m_arrivalTime = m_lastFrameTime;
+    return true;
+}
+
+template <typename T1, typename T2>
+T1 ShmSerializeClient<T1, T2>::getInboundData()
+{
+    return m_inboundData;
+}
+
+template <typename T1, typename T2>
+long ShmSerializeClient<T1, T2>::getInboundArrivalTime()
+{
+    return m_arrivalTime;
+}
+
+template <typename T1, typename T2>
+void ShmSerializeClient<T1, T2>::setOutboundData(T2 *data)
+{
+    // Fall back to text if the server could not read our binary archives
+    WireFormat_t format = m_isBinaryCompatible ? WIRE_FORMAT_BINARY : WIRE_FORMAT_TEXT;
+    if(!m_uplink.isAttached() || !serializeArchive(*data, format, m_outboundFrame)) {
+        return;
+    }
+    m_uplink.write(m_outboundFrame.data(), m_outboundFrame.size(), format);
+}
+
+template <typename T1, typename T2>
+bool ShmSerializeClient<T1, T2>::attach()
+{
+    using namespace boost::interprocess;
+    detach();
+    // Retry no faster than the reattach timeout
+    m_lastFrameTime = now();
+    try {
+        m_memory.reset(new shared_memory_object(open_only, m_name.c_str(), read_write));
+        m_region.reset(new mapped_region(*m_memory, read_write));
+    } catch(interprocess_exception &e) {
+        // The simulation has not created the segment yet
+        m_region.reset();
+        m_memory.reset();
+        return false;
+    }
+
+    char *base = static_cast<char *>(m_region->get_address());
+    ShmSegmentHeader *header = reinterpret_cast<ShmSegmentHeader *>(base);
+    boost::atomic_thread_fence(boost::memory_order_acquire);
+    if(m_region->get_size() < sizeof(ShmSegmentHeader) || header->magic == 0) {
+        // Created but not initialized yet
+        detach();
+        return false;
+    }
+    if(header->magic != SHM_SEGMENT_MAGIC || header->version != SHM_SEGMENT_VERSION
+            || header->segmentSize > m_region->get_size()) {
+        std::cout << "Shared memory " << m_name << " is not a simulation segment" << std::endl;
+        detach();
+        return false;
+    }
+    m_isBinaryCompatible = isBinaryCompatible(*header);
+    if(!m_isBinaryCompatible) {
+        std::cout << "Shared memory " << m_name << " uses a different data layout, only text archives can be read" << std::endl;
+    }
+    m_downlink.attach(base + header->downlinkOffset);
+    m_uplink.attach(base + header->uplinkOffset);
+    std::cout << "Attached to shared memory " << m_name << std::endl;
+    return true;
+}
+
+template <typename T1, typename T2>
+void ShmSerializeClient<T1, T2>::detach()
+{
+    m_downlink.detach();
+    m_uplink.detach();
+    m_region.reset();
+    m_memory.reset();
+}
+
+template <typename T1, typename T2>
+long ShmSerializeClient<T1, T2>::now()
+{
+    return (long)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+#endif // SHM_SERIALIZE_CLIENT_HPP
@@ -0,0 +1,164 @@
+/*
+ ISC License
+
+ Copyright (c) 2016-2017, Autonomous Vehicle Systems Lab, University of Colorado at Boulder
+
+ Permission to use, copy, modify, and/or distribute this software for any
+ purpose with or without fee is hereby granted, provided that the above
+ copyright notice and this permission notice appear in all copies.
+
+ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+//
+// ShmSerializeServer.hpp
+//
+// University of Colorado, Autonomous Vehicle Systems (AVS) Lab
+// Unpublished Copyright (c) 2012-2015 University of Colorado, All Rights Reserved
+//
+
+#ifndef SHM_SERIALIZE_SERVER_HPP
+#define SHM_SERIALIZE_SERVER_HPP
+
+#include "SharedMemoryRing.hpp"
+#include "SerializeArchive.hpp"
+
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <iostream>
+
+// Shared memory counterpart of TcpSerializeServer for a viewer on the same
+// host. Frames are serialized once and copied into a ring in a named shared
+// memory segment, viewers attach to it with ShmSerializeClient.
+template <typename T1, typename T2>
+class ShmSerializeServer
+{
+public:
+    ShmSerializeServer();
+    ~ShmSerializeServer();
+
+    // Creates the segment, replacing one left behind by a previous run
+    bool open(std::string name);
+    bool close(void);
+
+    void setOutboundData(T1 *data);
+    T2 getInboundData();
+
+    // Binary by default, viewers with a different data layout need text
+    void setWireFormat(WireFormat_t format) { m_wireFormat = format; }
+    // Largest archive that fits either ring, applies to the next open
+    void setSlotSize(boost::uint32_t bytes) { m_slotSize = bytes; }
+
+private:
+    enum { downlinkSlots = 4, uplinkSlots = 2 };
+
+    boost::scoped_ptr<boost::interprocess::shared_memory_object> m_memory;
+    boost::scoped_ptr<boost::interprocess::mapped_region> m_region;
+    std::string m_name;
+    SharedMemoryRing m_downlink;
+    SharedMemoryRing m_uplink;
+    WireFormat_t m_wireFormat;
+    boost::uint32_t m_slotSize;
+
+    std::string m_outboundFrame;
+    std::string m_inboundFrame;
+    T2 m_inboundData;
+};
+
+template <typename T1, typename T2>
+ShmSerializeServer<T1, T2>::ShmSerializeServer()
+    : m_wireFormat(WIRE_FORMAT_BINARY)
+    , m_slotSize(1 << 18)
+{
+
+}
+
+template <typename T1, typename T2>
+ShmSerializeServer<T1, T2>::~ShmSerializeServer()
+{
+    close();
+}
+
+template <typename T1, typename T2>
+bool ShmSerializeServer<T1, T2>::open(std::string name)
+{
+    using namespace boost::interprocess;
+    close();
+
+    size_t downlinkOffset = (sizeof(ShmSegmentHeader) + 63) & ~(size_t)63;
+    size_t uplinkOffset = (downlinkOffset + SharedMemoryRing::requiredSize(downlinkSlots, m_slotSize) + 63) & ~(size_t)63;
+    size_t segmentSize = uplinkOffset + SharedMemoryRing::requiredSize(uplinkSlots, m_slotSize);
+
+    try {
+        shared_memory_object::remove(name.c_str());
+        m_memory.reset(new shared_memory_object(create_only, name.c_str(), read_write));
+        m_memory->truncate((offset_t)segmentSize);
+        m_region.reset(new mapped_region(*m_memory, read_write));
+    } catch(interprocess_exception &e) {
+        std::cout << "Error in " << __FUNCTION__ << " (" << e.get_error_code() << ") " << e.what() << std::endl;
+        m_region.reset();
+        m_memory.reset();
+        return false;
+    }
+    m_name = name;
+
+    char *base = static_cast<char *>(m_region->get_address());
+    m_downlink.create(base + downlinkOffset, downlinkSlots, m_slotSize);
+    m_uplink.create(base + uplinkOffset, uplinkSlots, m_slotSize);
+    // The header is written last, clients check the magic before attaching
+    ShmSegmentHeader *header = new(base) ShmSegmentHeader;
+    header->downlinkOffset = (boost::uint32_t)downlinkOffset;
+    header->uplinkOffset = (boost::uint32_t)uplinkOffset;
+    header->segmentSize = (boost::uint32_t)segmentSize;
+    boost::atomic_thread_fence(boost::memory_order_release);
+    initSegmentHeader(*header);
+
+    std::cout << "Publishing frames to shared memory " << name << std::endl;
+    return true;
+}
+
+template <typename T1, typename T2>
+bool ShmSerializeServer<T1, T2>::close(void)
+{
+    if(m_memory) {
+        m_downlink.detach();
+        m_uplink.detach();
+        m_region.reset();
+        m_memory.reset();
+        // Clients keep their mapping, the name is free for the next run
+        boost::interprocess::shared_memory_object::remove(m_name.c_str());
+    }
+    return true;
+}
+
+template <typename T1, typename T2>
+void ShmSerializeServer<T1, T2>::setOutboundData(T1 *data)
+{
+    if(!m_downlink.isAttached() || !serializeArchive(*data, m_wireFormat, m_outboundFrame)) {
+        return;
+    }
+    if(!m_downlink.write(m_outboundFrame.data(), m_outboundFrame.size(), m_wireFormat)) {
+        std::cout << "Error in " << __FUNCTION__ << ": frame of " << m_outboundFrame.size()
+            << " bytes exceeds the slot size of " << m_downlink.slotSize() << std::endl;
+    }
+}
+
+template <typename T1, typename T2>
+T2 ShmSerializeServer<T1, T2>::getInboundData()
+{
+    boost::uint32_t flags = 0;
+    if(m_uplink.readLatest(m_inboundFrame, flags)) {
+        WireFormat_t format = flags == WIRE_FORMAT_BINARY ? WIRE_FORMAT_BINARY : WIRE_FORMAT_TEXT;
+        deserializeArchive(m_inboundFrame.data(), m_inboundFrame.size(), format, m_inboundData);
+    }
+    return m_inboundData;
+}
+
+#endif // SHM_SERIALIZE_SERVER_HPP
@@ -17,56 +17,135 @@
 
  */
 //
-//  TcpJSONClient.h
-//  Visualization
+// TcpJsonClient.hpp
 //
 // University of Colorado, Autonomous Vehicle Systems (AVS) Lab
 // Unpublished Copyright (c) 2012-2015 University of Colorado, All Rights Reserved
 //
 
-#ifndef TcpJSONClient_h
-#define TcpJSONClient_h
+#ifndef TCP_JSON_CLIENT_HPP
+#define TCP_JSON_CLIENT_HPP
 
-
-#include "TcpConnection.hpp"
+#include "TcpSerializeConnection.hpp"
+#include "JsonFieldTable.hpp"
+#include "LatencyHistogram.hpp"
 #include "requestTypeDefinitions.h"
 
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Receives frames as newline-delimited JSON, one object per line, so that
+// simulations written in any language can feed the viewer. Requests to the
+// server keep their framing: "0x", eight hex digits of payload length, two
+// digits of RequestType and the payload. SIM_CONFIG is sent on connect, after
+// which the server streams lines; the outbound data is sent as the JSON
+// payload of a SIM_UPDATE request whenever it is set.
+//
+// Lines are decoded straight into the members of T1 through its field table,
+// see JsonFrameDecoder, so a line may carry only the keys that changed.
+// Like the shared memory client it runs on the caller's thread, everything
+// happens in poll().
 template <typename T1, typename T2>
 class TcpJsonClient
 {
 public:
     TcpJsonClient();
     ~TcpJsonClient();
-    
+
     // Starts asynchronous connect, only returns false if an immediate error occurs
     bool connect(std::string ipAddress = "127.0.0.1", std::string portNum = "50000");
     // Check whether the client is connected
     bool isConnected();
-    
+
     virtual bool close(void);
-    // Calls any outstanding socket handlers (connect/read/write/etc). Used instead
-    // of run to control how often things are updated and to avoid unnecessary threads
-    void poll();
-    
+    // Calls any outstanding socket handlers and decodes the lines received
+    // since the last call, returns true if getInboundData() changed
+    bool poll();
+    // Called within poll() with every line decoded, including the ones a
+    // later line of the same poll() supersedes, e.g. to record them
+    void setFrameHandler(boost::function<void(const T1 &)> handler);
+
     T1 getInboundData();
+    // Milliseconds since epoch at which the newest line was received
+    long getInboundArrivalTime();
+    // Lines decoded and malformed since the connection was established,
+    // there are no sequence numbers so gaps and duplicates are not counted
+    FrameStatistics getFrameStatistics();
+    // Sent with the next poll(), a newer reply replaces one not sent yet
     void setOutboundData(T2 *data);
-    
+
+    // Writes every line received to filename, as received, until stopped,
+    // also across connections. This gives a capture that any server of this
+    // protocol can replay.
+    bool startCapture(const std::string &filename);
+    void stopCapture();
+    bool isCapturing();
+    // Lines and bytes written to the current capture
+    unsigned long capturedLines() { return m_capturedLines; }
+    boost::uint64_t capturedBytes() { return m_capturedBytes; }
+
 private:
+    // Bytes read at once and the longest line accepted, a longer one is
+    // skipped up to its newline
+    enum { readBufferSize = 64 * 1024, maxLineLength = 16 * 1024 * 1024 };
+    // Milliseconds between connection attempts
+    enum { reconnectDelay = 500 };
+
     boost::scoped_ptr<boost::asio::io_service> m_ioService;
-    boost::scoped_ptr<TcpConnection> m_connection;
+    boost::scoped_ptr<boost::asio::ip::tcp::socket> m_socket;
+    boost::scoped_ptr<boost::asio::deadline_timer> m_reconnectTimer;
+    boost::asio::ip::tcp::endpoint m_endpoint;
     std::string m_ipAddress;
     std::string m_portNum;
-    T1 m_inboundData;
-    T2 m_outboundData;
     bool m_isAttemptingConnection;
     bool m_shouldReconnect;
-    
+
+    std::vector<char> m_readBuffer;
+    // Start of a line whose end has not been received yet
+    std::vector<char> m_partialLine;
+    bool m_isSkippingLine;
+    JsonFrameDecoder<T1> m_decoder;
+    // Lines are decoded into m_decodedData, m_validData is the state after
+    // the last line decoded completely that a malformed line is rolled back
+    // to, m_inboundData the state after the last poll()
+    T1 m_decodedData;
+    T1 m_validData;
+    T1 m_inboundData;
+    bool m_isDecodedNewer;
+    boost::function<void(const T1 &)> m_frameHandler;
+    long m_arrivalTime;
+    FrameStatistics m_statistics;
+    std::ofstream m_capture;
+    unsigned long m_capturedLines;
+    boost::uint64_t m_capturedBytes;
+
+    std::string m_outboundJson;
+    std::string m_outboundRequest;
+    bool m_isOutboundPending;
+    bool m_isWriting;
+
+    void startConnect();
     void handleConnect(const boost::system::error_code &e);
-    void handleRead(const boost::system::error_code &e);
+    void handleReconnectTimer(const boost::system::error_code &e);
+    void handleRead(const boost::system::error_code &e, size_t size);
     void handleWrite(const boost::system::error_code &e);
+    void startRead();
+    void startWrite();
+    void receiveBytes(char *data, size_t size);
+    void decodeLine(char *line, size_t length);
     bool close(bool shouldReconnect);
     void reconnect();
-    std::string compileRequest(RequestType requestType, std::string requestPayload);
+    void compileRequest(RequestType requestType, const std::string &requestPayload, std::string &request);
     std::string intToZeroPadHexString(int integer, int width);
     std::string intToZeroPadString(int integer, int width);
 };
@@ -74,11 +153,20 @@ private:
 template <typename T1, typename T2>
 TcpJsonClient<T1, T2>::TcpJsonClient()
     : m_ioService(new boost::asio::io_service)
-    , m_connection(new TcpConnection(m_ioService.get()))
+    , m_socket(new boost::asio::ip::tcp::socket(*m_ioService))
+    , m_reconnectTimer(new boost::asio::deadline_timer(*m_ioService))
     , m_isAttemptingConnection(false)
     , m_shouldReconnect(false)
+    , m_readBuffer(readBufferSize)
+    , m_isSkippingLine(false)
+    , m_isDecodedNewer(false)
+    , m_arrivalTime(0)
+    , m_capturedLines(0)
+    , m_capturedBytes(0)
+    , m_isOutboundPending(false)
+    , m_isWriting(false)
 {
-    
+
 }
 
 template <typename T1, typename T2>
@@ -91,7 +179,7 @@ template <typename T1, typename T2>
 bool TcpJsonClient<T1, T2>::connect(std::string ipAddress, std::string portNum)
 {
     if(!m_isAttemptingConnection) {
-        if(m_connection->isOpen()) {
+        if(m_socket->is_open()) {
             close();
         }
         m_ipAddress = ipAddress;
@@ -99,17 +187,14 @@ bool TcpJsonClient<T1, T2>::connect(std::string ipAddress, std::string portNum)
         boost::system::error_code ec;
         boost::asio::ip::tcp::resolver resolver(*m_ioService);
         boost::asio::ip::tcp::resolver::query query(ipAddress, portNum);
-        boost::asio::ip::tcp::endpoint endpoint = *resolver.resolve(query, ec);
+        m_endpoint = *resolver.resolve(query, ec);
         if(ec) {
             // An error occurred
             std::cout << "Error in " << __FUNCTION__ << " (" << ec.value() << ") " << ec.message() << std::endl;
             m_isAttemptingConnection = false;
             return false;
         }
-        // Start an asynchronous connect operation
-        m_connection->stream()->async_connect(endpoint, boost::bind(&TcpJsonClient::handleConnect, this,
-                                                                    boost::asio::placeholders::error));
-        m_isAttemptingConnection = true;
+        startConnect();
         m_shouldReconnect = true;
         m_ioService->poll();
     }
@@ -119,7 +204,7 @@ bool TcpJsonClient<T1, T2>::connect(std::string ipAddress, std::string portNum)
 template <typename T1, typename T2>
 bool TcpJsonClient<T1, T2>::isConnected()
 {
-    return m_connection->isOpen() && !m_isAttemptingConnection;
+    return m_socket->is_open() && !m_isAttemptingConnection;
 }
 
 template <typename T1, typename T2>
@@ -129,11 +214,23 @@ bool TcpJsonClient<T1, T2>::close()
 }
 
 template <typename T1, typename T2>
-void TcpJsonClient<T1, T2>::poll()
+bool TcpJsonClient<T1, T2>::poll()
 {
-    if(m_connection->isOpen()) {
+    if(m_socket->is_open() || m_isAttemptingConnection) {
         m_ioService->poll();
     }
+    if(!m_isDecodedNewer) {
+        return false;
+    }
+    m_inboundData = m_decodedData;
+    m_isDecodedNewer = false;
+    return true;
+}
+
+template <typename T1, typename T2>
+void TcpJsonClient<T1, T2>::setFrameHandler(boost::function<void(const T1 &)> handler)
+{
+    m_frameHandler = handler;
 }
 
 template <typename T1, typename T2>
@@ -142,10 +239,69 @@ T1 TcpJsonClient<T1, T2>::getInboundData()
     return m_inboundData;
 }
 
+template <typename T1, typename T2>
+long TcpJsonClient<T1, T2>::getInboundArrivalTime()
+{
+    return m_arrivalTime;
+}
+
+template <typename T1, typename T2>
+FrameStatistics TcpJsonClient<T1, T2>::getFrameStatistics()
+{
+    return m_statistics;
+}
+
 template <typename T1, typename T2>
 void TcpJsonClient<T1, T2>::setOutboundData(T2 *data)
 {
-    m_outboundData = *data;
+    writeJsonFrame(*data, m_outboundJson);
+    m_isOutboundPending = true;
+    startWrite();
+}
+
+template <typename T1, typename T2>
+bool TcpJsonClient<T1, T2>::startCapture(const std::string &filename)
+{
+    stopCapture();
+    m_capture.open(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if(!m_capture.is_open()) {
+        std::cout << "Error in " << __FUNCTION__ << ": could not open " << filename << std::endl;
+        return false;
+    }
+    m_capturedLines = 0;
+    m_capturedBytes = 0;
+    return true;
+}
+
+template <typename T1, typename T2>
+void TcpJsonClient<T1, T2>::stopCapture()
+{
+    if(m_capture.is_open()) {
+        m_capture.close();
+    }
+}
+
+template <typename T1, typename T2>
+bool TcpJsonClient<T1, T2>::isCapturing()
+{
+    return m_capture.is_open();
+}
+
+template <typename T1, typename T2>
+void TcpJsonClient<T1, T2>::startConnect()
+{
+    // Start an asynchronous connect operation
+    m_socket->async_connect(m_endpoint, boost::bind(&TcpJsonClient::handleConnect, this,
+        boost::asio::placeholders::error));
+    m_isAttemptingConnection = true;
+}
+
+template <typename T1, typename T2>
+void TcpJsonClient<T1, T2>::handleReconnectTimer(const boost::system::error_code &ec)
+{
+    if(!ec && m_shouldReconnect) {
+        startConnect();
+    }
 }
 
 template <typename T1, typename T2>
@@ -155,19 +311,23 @@ void TcpJsonClient<T1, T2>::handleConnect(const boost::system::error_code &ec)
         m_isAttemptingConnection = false;
         // Successfully established a connection
         std::cout << "Successfully established a connection" << std::endl;
-//        m_connection->receiveData(m_inboundData, boost::bind(&TcpJsonClient::handleRead, this, boost::asio::placeholders::error));
-        std::string requestString (this->compileRequest(SIM_CONFIG, ""));
-        this->setOutboundData(&requestString);
-        m_connection->sendData(m_outboundData, boost::bind(&TcpJsonClient::handleWrite, this, boost::asio::placeholders::error));
-        //m_ioService->poll();
+        boost::system::error_code optionError;
+        m_socket->set_option(boost::asio::ip::tcp::no_delay(true), optionError);
+        // The counters and the line state start over with the connection
+        m_statistics = FrameStatistics();
+        m_partialLine.clear();
+        m_isSkippingLine = false;
+        m_isWriting = false;
+        // Ask for the configuration, the server starts streaming after it
+        compileRequest(SIM_CONFIG, "", m_outboundRequest);
+        m_isWriting = true;
+        boost::asio::async_write(*m_socket, boost::asio::buffer(m_outboundRequest),
+            boost::bind(&TcpJsonClient::handleWrite, this, boost::asio::placeholders::error));
+        startRead();
     } else {
-        // Catch most common errors and replace error message with a nicer message
-#ifdef WIN32
-        if(ec.value() == 10061) {
-#else
-        if(ec.value() == 61) {
-#endif
-            std::cout << "Server not responding." << std::endl;
+        // A server that is not running yet is retried quietly
+        if(ec == boost::asio::error::connection_refused) {
+//            std::cout << "Server not responding." << std::endl;
         } else {
             // An error occurred
             std::cout << "Error in " << __FUNCTION__ << " (" << ec.value() << ") " << ec.message() << std::endl;
@@ -177,20 +337,26 @@ void TcpJsonClient<T1, T2>::handleConnect(const boost::system::error_code &ec)
 }
 
 template <typename T1, typename T2>
-void TcpJsonClient<T1, T2>::handleRead(const boost::system::error_code &ec)
+void TcpJsonClient<T1, T2>::handleRead(const boost::system::error_code &ec, size_t size)
 {
     if(!ec) {
-        // Received data, send reply
-        std::string requestString (this->compileRequest(SIM_UPDATE, ""));
-        this->setOutboundData(&requestString);
-        m_connection->sendData(m_outboundData, boost::bind(&TcpJsonClient::handleWrite, this, boost::asio::placeholders::error));
-        std::cout << "In " << __FUNCTION__ << " Success" << std::endl;
+        double receiveTime = preciseTimeStamp();
+        unsigned long decoded = m_statistics.framesDecoded;
+        m_statistics.receiveTime = receiveTime;
+        receiveBytes(&m_readBuffer[0], size);
+        if(m_statistics.framesDecoded != decoded) {
+            m_statistics.decodeTime = preciseTimeStamp();
+            m_arrivalTime = (long)std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+        }
+        startRead();
     } else {
         // Catch most common errors and replace error message with a nicer message
         if(ec == boost::asio::error::eof || ec.value() == 10054) {
             std::cout << "Connection closed by server" << std::endl;
-        } else if(ec == boost::asio::error::invalid_argument) {
-            // An error occured while trying to read the data
+        } else if(ec == boost::asio::error::operation_aborted) {
+            // Closed on purpose
+            return;
         } else {
             // An error occured
             std::cout << "Error in " << __FUNCTION__ << " (" << ec.value() << ") " << ec.message() << std::endl;
@@ -202,19 +368,110 @@ void TcpJsonClient<T1, T2>::handleRead(const boost::system::error_code &ec)
 template <typename T1, typename T2>
 void TcpJsonClient<T1, T2>::handleWrite(const boost::system::error_code &ec)
 {
+    m_isWriting = false;
     if(!ec) {
-        // Reply sent, start listening
-        m_connection->receiveData(m_inboundData, boost::bind(&TcpJsonClient::handleRead, this, boost::asio::placeholders::error));
-        std::cout << "In " << __FUNCTION__ << " Success" << std::endl;
-    } else {
-        // Catch most common errors and replace error message with a nicer message
-        if(ec == boost::asio::error::eof || ec.value() == 10054) {
-            std::cout << "Connection closed by server" << std::endl;
+        startWrite();
+    } else if(ec != boost::asio::error::operation_aborted) {
+        std::cout << "Error in " << __FUNCTION__ << " (" << ec.value() << ") " << ec.message() << std::endl;
+        reconnect();
+    }
+}
+
+template <typename T1, typename T2>
+void TcpJsonClient<T1, T2>::startRead()
+{
+    m_socket->async_read_some(boost::asio::buffer(m_readBuffer),
+        boost::bind(&TcpJsonClient::handleRead, this,
+            boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+}
+
+template <typename T1, typename T2>
+void TcpJsonClient<T1, T2>::startWrite()
+{
+    if(m_isWriting || !m_isOutboundPending || !isConnected()) {
+        return;
+    }
+    compileRequest(SIM_UPDATE, m_outboundJson, m_outboundRequest);
+    m_isOutboundPending = false;
+    m_isWriting = true;
+    boost::asio::async_write(*m_socket, boost::asio::buffer(m_outboundRequest),
+        boost::bind(&TcpJsonClient::handleWrite, this, boost::asio::placeholders::error));
+}
+
+// Splits data into lines. Lines that arrived whole are decoded where they
+// are, only the ends of reads are copied to be completed by the next one.
+template <typename T1, typename T2>
+void TcpJsonClient<T1, T2>::receiveBytes(char *data, size_t size)
+{
+    m_statistics.bytesReceived += size;
+    char *end = data + size;
+    while(data < end) {
+        char *newline = static_cast<char *>(std::memchr(data, '\n', end - data));
+        if(!newline) {
+            if(m_isSkippingLine) {
+                return;
+            }
+            if(m_partialLine.size() + (end - data) > maxLineLength) {
+                std::cout << "Error in " << __FUNCTION__ << ": line longer than " << maxLineLength << " bytes" << std::endl;
+                m_statistics.corruptFrames++;
+                m_partialLine.clear();
+                m_isSkippingLine = true;
+                return;
+            }
+            m_partialLine.insert(m_partialLine.end(), data, end);
+            return;
+        }
+        if(m_isSkippingLine) {
+            m_isSkippingLine = false;
+        } else if(m_partialLine.empty()) {
+            decodeLine(data, newline - data);
         } else {
-            // An error occured
-            std::cout << "Error in " << __FUNCTION__ << " (" << ec.value() << ") " << ec.message() << std::endl;
+            m_partialLine.insert(m_partialLine.end(), data, newline);
+            decodeLine(&m_partialLine[0], m_partialLine.size());
+            m_partialLine.clear();
         }
-        reconnect();
+        data = newline + 1;
+    }
+}
+
+template <typename T1, typename T2>
+void TcpJsonClient<T1, T2>::decodeLine(char *line, size_t length)
+{
+    if(length > 0 && line[length - 1] == '\r') {
+        length--;
+    }
+    if(length == 0) {
+        // Blank lines keep the connection alive
+        return;
+    }
+    // Captured before decoding, which unescapes strings in place
+    if(m_capture.is_open()) {
+        m_capture.write(line, length);
+        m_capture.put('\n');
+        if(!m_capture) {
+            std::cout << "Error in " << __FUNCTION__ << ": could not write the capture" << std::endl;
+            m_capture.close();
+        } else {
+            m_capturedLines++;
+            m_capturedBytes += length + 1;
+        }
+    }
+    m_statistics.framesReceived++;
+    if(!m_decoder.decode(line, length, m_decodedData)) {
+        // A partly applied line must not be shown. The lines before it stay,
+        // they may have carried the only update of some fields.
+        m_statistics.corruptFrames++;
+        m_decodedData = m_validData;
+        return;
+    }
+    // Assigned in place, the vectors keep their capacity
+    m_validData = m_decodedData;
+    m_statistics.framesDecoded++;
+    m_statistics.archiveSize = length;
+    m_statistics.lastSimTime = frameSimTime(m_decodedData);
+    m_isDecodedNewer = true;
+    if(m_frameHandler) {
+        m_frameHandler(m_decodedData);
     }
 }
 
@@ -223,40 +480,48 @@ bool TcpJsonClient<T1, T2>::close(bool shouldReconnect)
 {
     m_shouldReconnect = shouldReconnect;
     m_isAttemptingConnection = false;
+    m_isWriting = false;
     if(shouldReconnect) {
         // If we are reconnecting only close socket
-        return m_connection->close();
+        boost::system::error_code ec;
+        m_socket->close(ec);
+        return !ec;
     } else {
-        // Reset the connection to null first since it depends on the io_service
-        m_connection.reset();
+        // Reset the socket and timer to null first since they depend on the io_service
+        m_socket.reset();
+        m_reconnectTimer.reset();
         m_ioService->stop();
         m_ioService.reset(new boost::asio::io_service);
-        // Now that the io_service has been reset, reset the connection
-        m_connection.reset(new TcpConnection(m_ioService.get()));
+        // Now that the io_service has been reset, reset the socket and timer
+        m_socket.reset(new boost::asio::ip::tcp::socket(*m_ioService));
+        m_reconnectTimer.reset(new boost::asio::deadline_timer(*m_ioService));
         return true;
     }
 }
 
+// Retries after a delay, from within a handler connecting right away would
+// recurse for as long as the server refuses
 template <typename T1, typename T2>
 void TcpJsonClient<T1, T2>::reconnect()
 {
     if(m_shouldReconnect) {
-        std::cout << "Attempting to reconnect..." << std::endl;
+//        std::cout << "Attempting to reconnect..." << std::endl;
         close(true);
-        connect(m_ipAddress, m_portNum);
+        m_isAttemptingConnection = true;
+        m_reconnectTimer->expires_from_now(boost::posix_time::milliseconds((long)reconnectDelay));
+        m_reconnectTimer->async_wait(boost::bind(&TcpJsonClient::handleReconnectTimer, this,
+            boost::asio::placeholders::error));
     } else {
         close(false);
     }
 }
-    
+
 template <typename T1, typename T2>
-std::string TcpJsonClient<T1, T2>::compileRequest(RequestType requestType, std::string requestPayload)
+void TcpJsonClient<T1, T2>::compileRequest(RequestType requestType, const std::string &requestPayload, std::string &request)
 {
-    std::string compiledRequest = "";
-    compiledRequest.append(intToZeroPadHexString(requestPayload.size(), 8));
-    compiledRequest.append(intToZeroPadString(requestType, 2));
-    compiledRequest.append(requestPayload);
-    return compiledRequest;
+    request = intToZeroPadHexString((int)requestPayload.size(), 8);
+    request.append(intToZeroPadString(requestType, 2));
+    request.append(requestPayload);
 }
 
 template <typename T1, typename T2>
@@ -268,7 +533,7 @@ std::string TcpJsonClient<T1, T2>::intToZeroPadHexString(int integer, int width)
     << std::hex << integer;
     return stream.str();
 }
-    
+
 template <typename T1, typename T2>
 std::string TcpJsonClient<T1, T2>::intToZeroPadString(int integer, int width)
 {
@@ -277,4 +542,5 @@ std::string TcpJsonClient<T1, T2>::intToZeroPadString(int integer, int width)
     << integer;
     return stream.str();
 }
-#endif /* TcpJSONClient_h */
+
+#endif // TCP_JSON_CLIENT_HPP
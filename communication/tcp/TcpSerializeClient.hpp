@@ -27,6 +27,12 @@
 #define TCP_SERIALIZE_CLIENT_HPP
 
 #include "TcpSerializeConnection.hpp"
+#include "TripleBuffer.hpp"
+
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <chrono>
 
 template <typename T1, typename T2>
 class TcpSerializeClient
@@ -44,34 +50,124 @@ public:
     // Calls any outstanding socket handlers (connect/read/write/etc). Used instead
     // of run to control how often things are updated and to avoid unnecessary threads
     void poll();
+    // Runs the io_service on its own thread from the next connect on, poll()
+    // then does nothing and the update handler is called on that thread
+    void setThreaded(bool threaded);
+    // Called after every received frame and connection change. With a
+    // network thread this must only hand the notification over to the caller's
+    // thread (e.g. a queued signal).
+    void setUpdateHandler(boost::function<void()> handler);
+    // Called with every received frame before it is handed over, on the
+    // network thread if there is one. Unlike getInboundData() it sees frames
+    // that are superseded before the caller picks them up, e.g. to record
+    // them; it must not block.
+    void setFrameHandler(boost::function<void(const T1 &)> handler);
 
+    // Newest frame received, safe to call from one thread while the network
+    // thread is running
     T1 getInboundData();
+    // Milliseconds since epoch at which the frame last returned by
+    // getInboundData() was received
+    long getInboundArrivalTime();
+    // Gap, duplicate and checksum counters as of the frame last returned by
+    // getInboundData(), only counted once the binary header is negotiated
+    FrameStatistics getFrameStatistics();
+    // Reply sent with the following frames, called from the same thread as getInboundData()
     void setOutboundData(T2 *data);
 
+    // Bitmask of WireFormat_t values offered to the server. Text is always
+    // supported, binary is used when the server supports it as well.
+    void setWireFormats(int formats);
+    WireFormat_t wireFormat();
+    // Allows the server to send deltas between keyframes
+    void setDeltaFrames(bool enabled);
+    // Allows the server to push frames without waiting for a reply per
+    // frame. Replies are then only sent when setOutboundData has new data.
+    void setStreaming(bool enabled);
+    // Asks the server to compress frames with codec, frames stay
+    // uncompressed if the server does not support it. Takes effect on the
+    // next connect.
+    void setCompression(Compression_t codec);
+    Compression_t compression();
+    // Must be the dictionary the server was given, otherwise it is not used
+    void setCompressionDictionary(boost::shared_ptr<const std::string> dictionary);
+    // Fields of T1 the server should send, see FieldMaskedFrame. Can be
+    // changed at any time from the caller's thread; fields left out keep
+    // their last received value.
+    void setFieldMask(boost::uint32_t fieldMask);
+    // Frames per second this end can display and decode, a streaming server
+    // then skips the frames produced faster than that instead of sending
+    // them. 0 takes every frame. Can be changed like the field mask.
+    void setMaxFrameRate(double framesPerSecond);
+
 private:
+    struct InboundSnapshot {
+        InboundSnapshot() : arrivalTime(0) {}
+        T1 data;
+        long arrivalTime;
+        FrameStatistics statistics;
+    };
+
     boost::scoped_ptr<boost::asio::io_service> m_ioService;
+    boost::scoped_ptr<boost::asio::io_service::work> m_work;
+    boost::scoped_ptr<boost::thread> m_thread;
     boost::scoped_ptr<TcpSerializeConnection> m_connection;
     std::string m_ipAddress;
     std::string m_portNum;
+    // Decoded in place by the connection, only touched by the network side
     T1 m_inboundData;
-    T2 m_outboundData;
+    // Hand over between the network side and the caller
+    TripleBuffer<InboundSnapshot> m_inboundSnapshots;
+    TripleBuffer<T2> m_outboundSnapshots;
+    boost::function<void()> m_updateHandler;
+    boost::function<void(const T1 &)> m_frameHandler;
+    bool m_isThreaded;
+    boost::atomic<bool> m_isConnected;
+    boost::atomic<bool> m_isStreaming;
     bool m_isAttemptingConnection;
     bool m_shouldReconnect;
+    int m_supportedFormats;
+    int m_supportedFeatures;
+    Compression_t m_compression;
+    boost::shared_ptr<const std::string> m_compressionDictionary;
+    boost::atomic<boost::uint32_t> m_fieldMask;
+    // Microseconds between frames, see TcpSerializeConnection::setMinFrameInterval
+    boost::atomic<boost::uint32_t> m_minFrameInterval;
+    // Cleared when the server turns out not to understand handshakes
+    bool m_shouldNegotiate;
+    // Only used in streaming mode, reads and writes are then issued independently
+    bool m_isWriting;
 
     void handleConnect(const boost::system::error_code &e);
     void handleRead(const boost::system::error_code &e);
     void handleWrite(const boost::system::error_code &e);
+    void handleStreamWrite(const boost::system::error_code &e);
+    void startStreamWrite();
 
     bool close(bool shouldReconnect);
     void reconnect();
+    bool isNetworkThread();
+    void publishInboundData();
+    void notifyUpdate();
 };
 
 template <typename T1, typename T2>
 TcpSerializeClient<T1, T2>::TcpSerializeClient()
     : m_ioService(new boost::asio::io_service)
     , m_connection(new TcpSerializeConnection(m_ioService.get()))
+    , m_isThreaded(false)
+    , m_isConnected(false)
+    , m_isStreaming(false)
     , m_isAttemptingConnection(false)
     , m_shouldReconnect(false)
+    , m_supportedFormats(WIRE_FORMAT_TEXT | WIRE_FORMAT_BINARY)
+    , m_supportedFeatures(FEATURE_DELTA_FRAMES | FEATURE_STREAMING | FEATURE_BINARY_HEADER | FEATURE_FIELD_MASK
+        | FEATURE_FRAME_RATE)
+    , m_compression(COMPRESSION_NONE)
+    , m_fieldMask(FIELD_MASK_ALL)
+    , m_minFrameInterval(0)
+    , m_shouldNegotiate(true)
+    , m_isWriting(false)
 {
 
 }
@@ -85,6 +181,10 @@ TcpSerializeClient<T1, T2>::~TcpSerializeClient()
 template <typename T1, typename T2>
 bool TcpSerializeClient<T1, T2>::connect(std::string ipAddress, std::string portNum)
 {
+    if(m_thread && !isNetworkThread()) {
+        // Stop the network thread before touching the connection
+        close();
+    }
     if(!m_isAttemptingConnection) {
         if(m_connection->isOpen()) {
             close();
@@ -106,7 +206,12 @@ bool TcpSerializeClient<T1, T2>::connect(std::string ipAddress, std::string port
             boost::asio::placeholders::error));
         m_isAttemptingConnection = true;
         m_shouldReconnect = true;
-        m_ioService->poll();
+        if(m_isThreaded && !m_thread) {
+            m_work.reset(new boost::asio::io_service::work(*m_ioService));
+            m_thread.reset(new boost::thread(boost::bind(&boost::asio::io_service::run, m_ioService.get())));
+        } else if(!m_thread) {
+            m_ioService->poll();
+        }
     }
     return true;
 }
@@ -114,7 +219,7 @@ bool TcpSerializeClient<T1, T2>::connect(std::string ipAddress, std::string port
 template <typename T1, typename T2>
 bool TcpSerializeClient<T1, T2>::isConnected()
 {
-    return m_connection->isOpen() && !m_isAttemptingConnection;
+    return m_isConnected;
 }
 
 template <typename T1, typename T2>
@@ -126,21 +231,131 @@ bool TcpSerializeClient<T1, T2>::close()
 template <typename T1, typename T2>
 void TcpSerializeClient<T1, T2>::poll()
 {
-    if(m_connection->isOpen()) {
+    if(!m_thread && m_connection->isOpen()) {
         m_ioService->poll();
     }
 }
 
+template <typename T1, typename T2>
+void TcpSerializeClient<T1, T2>::setThreaded(bool threaded)
+{
+    m_isThreaded = threaded;
+}
+
+template <typename T1, typename T2>
+void TcpSerializeClient<T1, T2>::setUpdateHandler(boost::function<void()> handler)
+{
+    m_updateHandler = handler;
+}
+
+template <typename T1, typename T2>
+void TcpSerializeClient<T1, T2>::setFrameHandler(boost::function<void(const T1 &)> handler)
+{
+    m_frameHandler = handler;
+}
+
 template <typename T1, typename T2>
 T1 TcpSerializeClient<T1, T2>::getInboundData()
 {
-    return m_inboundData;
+    m_inboundSnapshots.update();
+    return m_inboundSnapshots.readBuffer().data;
+}
+
+template <typename T1, typename T2>
+long TcpSerializeClient<T1, T2>::getInboundArrivalTime()
+{
+    return m_inboundSnapshots.readBuffer().arrivalTime;
+}
+
+template <typename T1, typename T2>
+FrameStatistics TcpSerializeClient<T1, T2>::getFrameStatistics()
+{
+    return m_inboundSnapshots.readBuffer().statistics;
 }
 
 template <typename T1, typename T2>
 void TcpSerializeClient<T1, T2>::setOutboundData(T2 *data)
 {
-    m_outboundData = *data;
+    m_outboundSnapshots.writeBuffer() = *data;
+    m_outboundSnapshots.publish();
+    // In streaming mode nothing else would trigger the reply
+    if(m_isStreaming) {
+        m_ioService->post(boost::bind(&TcpSerializeClient::startStreamWrite, this));
+    }
+}
+
+template <typename T1, typename T2>
+void TcpSerializeClient<T1, T2>::setWireFormats(int formats)
+{
+    m_supportedFormats = formats | WIRE_FORMAT_TEXT;
+    m_shouldNegotiate = true;
+}
+
+template <typename T1, typename T2>
+WireFormat_t TcpSerializeClient<T1, T2>::wireFormat()
+{
+    return m_connection->wireFormat();
+}
+
+template <typename T1, typename T2>
+void TcpSerializeClient<T1, T2>::setDeltaFrames(bool enabled)
+{
+    if(enabled) {
+        m_supportedFeatures |= FEATURE_DELTA_FRAMES;
+    } else {
+        m_supportedFeatures &= ~FEATURE_DELTA_FRAMES;
+    }
+}
+
+template <typename T1, typename T2>
+void TcpSerializeClient<T1, T2>::setStreaming(bool enabled)
+{
+    if(enabled) {
+        m_supportedFeatures |= FEATURE_STREAMING;
+    } else {
+        m_supportedFeatures &= ~FEATURE_STREAMING;
+    }
+}
+
+template <typename T1, typename T2>
+void TcpSerializeClient<T1, T2>::setCompression(Compression_t codec)
+{
+    if(codec != COMPRESSION_NONE && !(availableCompressions() & codec)) {
+        std::cout << "Error in " << __FUNCTION__ << ": " << compressionName(codec) << " support was not built in" << std::endl;
+        codec = COMPRESSION_NONE;
+    }
+    m_compression = codec;
+    m_shouldNegotiate = true;
+}
+
+template <typename T1, typename T2>
+Compression_t TcpSerializeClient<T1, T2>::compression()
+{
+    return m_connection->compression();
+}
+
+template <typename T1, typename T2>
+void TcpSerializeClient<T1, T2>::setCompressionDictionary(boost::shared_ptr<const std::string> dictionary)
+{
+    m_compressionDictionary = dictionary;
+}
+
+template <typename T1, typename T2>
+void TcpSerializeClient<T1, T2>::setFieldMask(boost::uint32_t fieldMask)
+{
+    // Request/response mode picks the change up with the next reply
+    if(m_fieldMask.exchange(fieldMask) != fieldMask && m_isStreaming) {
+        m_ioService->post(boost::bind(&TcpSerializeClient::startStreamWrite, this));
+    }
+}
+
+template <typename T1, typename T2>
+void TcpSerializeClient<T1, T2>::setMaxFrameRate(double framesPerSecond)
+{
+    boost::uint32_t interval = framesPerSecond > 0.0 ? (boost::uint32_t)(1000000.0 / framesPerSecond + 0.5) : 0;
+    if(m_minFrameInterval.exchange(interval) != interval && m_isStreaming) {
+        m_ioService->post(boost::bind(&TcpSerializeClient::startStreamWrite, this));
+    }
 }
 
 template <typename T1, typename T2>
@@ -148,10 +363,17 @@ void TcpSerializeClient<T1, T2>::handleConnect(const boost::system::error_code &
 {
     if(!ec) {
         m_isAttemptingConnection = false;
+        m_isConnected = true;
         // Successfully established a connection
         std::cout << "Successfully established a connection" << std::endl;
+        // Small acks and deltas must not wait for Nagle's algorithm
+        boost::system::error_code optionError;
+        m_connection->stream()->set_option(boost::asio::ip::tcp::no_delay(true), optionError);
         m_connection->receiveData(m_inboundData, boost::bind(&TcpSerializeClient::handleRead, this, boost::asio::placeholders::error));
-        m_ioService->poll();
+        notifyUpdate();
+        if(!m_thread) {
+            m_ioService->poll();
+        }
     } else {
         // Catch most common errors and replace error message with a nicer message
 #ifdef WIN32
@@ -172,8 +394,33 @@ template <typename T1, typename T2>
 void TcpSerializeClient<T1, T2>::handleRead(const boost::system::error_code &ec)
 {
     if(!ec) {
-        // Received data, send reply
-        m_connection->sendData(m_outboundData, boost::bind(&TcpSerializeClient::handleWrite, this, boost::asio::placeholders::error));
+        publishInboundData();
+        m_connection->setFieldMask(m_fieldMask);
+        m_connection->setMinFrameInterval(m_minFrameInterval);
+        if(m_connection->features() & FEATURE_STREAMING) {
+            // Keep reading, replies and acks are written independently
+            m_isStreaming = true;
+            m_connection->receiveData(m_inboundData, boost::bind(&TcpSerializeClient::handleRead, this, boost::asio::placeholders::error));
+            startStreamWrite();
+        } else if(m_shouldNegotiate && ((m_supportedFormats & WIRE_FORMAT_BINARY) || m_supportedFeatures || m_compression)
+                && m_connection->negotiationState() == NEGOTIATION_NONE) {
+            // First frame received, reply with a handshake instead of data
+            m_connection->setSupportedFormats(m_supportedFormats);
+            m_connection->setSupportedFeatures(m_supportedFeatures);
+            m_connection->setSupportedCompressions(m_compression);
+            m_connection->setPreferredCompression(m_compression);
+            m_connection->setCompressionDictionary(m_compressionDictionary);
+            m_connection->sendHandshake(boost::bind(&TcpSerializeClient::handleWrite, this, boost::asio::placeholders::error));
+        } else if(m_connection->isSubscriptionDue()) {
+            // Subscription changed, it replaces this reply
+            m_connection->sendSubscription(boost::bind(&TcpSerializeClient::handleWrite, this, boost::asio::placeholders::error));
+        } else if(m_connection->isFrameRateDue()) {
+            m_connection->sendFrameRate(boost::bind(&TcpSerializeClient::handleWrite, this, boost::asio::placeholders::error));
+        } else {
+            // Received data, send the newest reply
+            m_outboundSnapshots.update();
+            m_connection->sendData(m_outboundSnapshots.readBuffer(), boost::bind(&TcpSerializeClient::handleWrite, this, boost::asio::placeholders::error));
+        }
     } else {
         // Catch most common errors and replace error message with a nicer message
         if(ec == boost::asio::error::eof || ec.value() == 10054) {
@@ -206,15 +453,65 @@ void TcpSerializeClient<T1, T2>::handleWrite(const boost::system::error_code &ec
     }
 }
 
+template <typename T1, typename T2>
+void TcpSerializeClient<T1, T2>::handleStreamWrite(const boost::system::error_code &ec)
+{
+    m_isWriting = false;
+    if(!ec) {
+        startStreamWrite();
+    } else if(ec != boost::asio::error::operation_aborted) {
+        // The read side handles reconnecting
+        std::cout << "Error in " << __FUNCTION__ << " (" << ec.value() << ") " << ec.message() << std::endl;
+        m_connection->close();
+    }
+}
+
+// Writes at most one message at a time: an ack if one is due, then a changed
+// subscription or frame rate and otherwise the newest outbound data if it
+// changed since it was last sent
+template <typename T1, typename T2>
+void TcpSerializeClient<T1, T2>::startStreamWrite()
+{
+    if(m_isWriting || !m_connection || !m_connection->isOpen()
+            || !(m_connection->features() & FEATURE_STREAMING)) {
+        return;
+    }
+    m_connection->setFieldMask(m_fieldMask);
+    m_connection->setMinFrameInterval(m_minFrameInterval);
+    if(m_connection->isAckDue()) {
+        m_isWriting = true;
+        m_connection->sendAck(boost::bind(&TcpSerializeClient::handleStreamWrite, this, boost::asio::placeholders::error));
+    } else if(m_connection->isSubscriptionDue()) {
+        m_isWriting = true;
+        m_connection->sendSubscription(boost::bind(&TcpSerializeClient::handleStreamWrite, this, boost::asio::placeholders::error));
+    } else if(m_connection->isFrameRateDue()) {
+        m_isWriting = true;
+        m_connection->sendFrameRate(boost::bind(&TcpSerializeClient::handleStreamWrite, this, boost::asio::placeholders::error));
+    } else if(m_outboundSnapshots.update()) {
+        m_isWriting = true;
+        m_connection->sendData(m_outboundSnapshots.readBuffer(), boost::bind(&TcpSerializeClient::handleStreamWrite, this, boost::asio::placeholders::error));
+    }
+}
+
 template <typename T1, typename T2>
 bool TcpSerializeClient<T1, T2>::close(bool shouldReconnect)
 {
     m_shouldReconnect = shouldReconnect;
     m_isAttemptingConnection = false;
-    if(shouldReconnect) {
-        // If we are reconnecting only close socket
+    m_isConnected = false;
+    m_isStreaming = false;
+    m_isWriting = false;
+    if(shouldReconnect || isNetworkThread()) {
+        // If we are reconnecting only close socket. The network thread
+        // cannot join itself, the owner stops it with the next close.
         return m_connection->close();
     } else {
+        if(m_thread) {
+            m_work.reset();
+            m_ioService->stop();
+            m_thread->join();
+            m_thread.reset();
+        }
         // Reset the connection to null first since it depends on the io_service
         m_connection.reset();
         m_ioService->stop();
@@ -228,6 +525,12 @@ bool TcpSerializeClient<T1, T2>::close(bool shouldReconnect)
 template <typename T1, typename T2>
 void TcpSerializeClient<T1, T2>::reconnect()
 {
+    if(m_connection->negotiationState() == NEGOTIATION_REQUESTED) {
+        // Servers without format negotiation drop the connection when they
+        // receive a handshake, stay with text archives from now on
+        std::cout << "Server does not support format negotiation, using text archives" << std::endl;
+        m_shouldNegotiate = false;
+    }
     if(m_shouldReconnect) {
 //        std::cout << "Attempting to reconnect..." << std::endl;
         close(true);
@@ -235,6 +538,41 @@ void TcpSerializeClient<T1, T2>::reconnect()
     } else {
         close(false);
     }
+    notifyUpdate();
+}
+
+template <typename T1, typename T2>
+bool TcpSerializeClient<T1, T2>::isNetworkThread()
+{
+    return m_thread && boost::this_thread::get_id() == m_thread->get_id();
+}
+
+template <typename T1, typename T2>
+void TcpSerializeClient<T1, T2>::publishInboundData()
+{
+    // Acks, duplicates and deltas that failed to decode leave the last
+    // frame in place, republishing it would make it look newly arrived
+    if(!m_connection->isNewFrame()) {
+        return;
+    }
+    if(m_frameHandler) {
+        m_frameHandler(m_inboundData);
+    }
+    InboundSnapshot &snapshot = m_inboundSnapshots.writeBuffer();
+    snapshot.data = m_inboundData;
+    snapshot.arrivalTime = (long)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    snapshot.statistics = m_connection->statistics();
+    m_inboundSnapshots.publish();
+    notifyUpdate();
+}
+
+template <typename T1, typename T2>
+void TcpSerializeClient<T1, T2>::notifyUpdate()
+{
+    if(m_updateHandler) {
+        m_updateHandler();
+    }
 }
 
 #endif // TCP_SERIALIZE_CLIENT_HPP
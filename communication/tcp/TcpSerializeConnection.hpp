@@ -27,51 +27,738 @@
 #define TCP_SERIALIZE_CONNECTION_HPP
 
 #include "basicIoDevice.hpp"
+#include "SerializeArchive.hpp"
+#include "FrameDelta.hpp"
+#include "FrameCompression.hpp"
+#include "Crc32c.hpp"
+#include "FieldSubscription.hpp"
+#include "LatencyHistogram.hpp"
 
 #include <boost/tuple/tuple.hpp>
-#include <boost/archive/text_iarchive.hpp>
-#include <boost/archive/text_oarchive.hpp>
+#include <boost/archive/basic_archive.hpp>
+#include <boost/serialization/nvp.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+// Optional protocol features, negotiated as a bitmask in the handshake
+typedef enum {
+    FEATURE_DELTA_FRAMES = 0x01, /*!< data frames may be sent as deltas against the previous frame */
+    FEATURE_STREAMING    = 0x02, /*!< server frames are pushed without waiting for replies, see sendAck */
+    FEATURE_BINARY_HEADER = 0x04, /*!< binary header with message sequence, sim time and CRC32C */
+    FEATURE_FIELD_MASK   = 0x08, /*!< the receiver of data frames subscribes to a subset of the fields */
+    FEATURE_FRAME_RATE   = 0x10  /*!< the receiver of streamed data frames limits the rate they are sent at */
+} ConnectionFeature_t;
+
+// Counters of the inbound messages of a connection, only kept while the
+// binary header is in use. Kept across reconnects.
+struct FrameStatistics
+{
+    FrameStatistics()
+        : framesReceived(0)
+        , sequenceGaps(0)
+        , duplicateFrames(0)
+        , corruptFrames(0)
+        , lastSimTime(0.0)
+        , fieldMask(FIELD_MASK_ALL)
+        , archiveSize(0)
+        , framesDecoded(0)
+        , bytesReceived(0)
+        , receiveTime(0.0)
+        , decodeTime(0.0)
+    {
+
+    }
+
+    unsigned long framesReceived;
+    unsigned long sequenceGaps;     /*!< messages missing between two received ones */
+    unsigned long duplicateFrames;  /*!< messages received again, they are skipped */
+    unsigned long corruptFrames;    /*!< header or payload failed the checksum */
+    double lastSimTime;
+    // Kept with any header: subscription and size of the last data frame
+    // before delta encoding and compression
+    boost::uint32_t fieldMask;
+    size_t archiveSize;
+    // Kept with any header: data frames decoded and their payload bytes as
+    // received, and when the last one was received and decoded (see
+    // preciseTimeStamp)
+    unsigned long framesDecoded;
+    boost::uint64_t bytesReceived;
+    double receiveTime;
+    double decodeTime;
+};
+
+// Description of one end of a connection, exchanged once after connecting so
+// both ends can agree on the archive format used for the data frames
+class SerializeHandshake
+{
+public:
+    SerializeHandshake()
+        : protocolVersion(4)
+        , supportedFormats(WIRE_FORMAT_TEXT)
+        , selectedFormat(WIRE_FORMAT_TEXT)
+        , supportedFeatures(0)
+        , selectedFeatures(0)
+        , littleEndian(1)
+        , sizeOfInt(sizeof(int))
+        , sizeOfLong(sizeof(long))
+        , sizeOfDouble(sizeof(double))
+        , archiveVersion(boost::archive::BOOST_ARCHIVE_VERSION())
+        , supportedCompressions(COMPRESSION_NONE)
+        , preferredCompression(COMPRESSION_NONE)
+        , selectedCompression(COMPRESSION_NONE)
+        , dictionaryId(0)
+        , fieldMask(FIELD_MASK_ALL)
+        , minFrameInterval(0)
+    {
+        boost::uint16_t endianTest = 1;
+        littleEndian = *reinterpret_cast<unsigned char *>(&endianTest) == 1;
+    }
+
+    int protocolVersion;
+    int supportedFormats;
+    int selectedFormat;
+    int supportedFeatures;
+    int selectedFeatures;
+    int littleEndian;
+    int sizeOfInt;
+    int sizeOfLong;
+    int sizeOfDouble;
+    int archiveVersion;
+    // Since protocol version 2
+    int supportedCompressions;
+    int preferredCompression;
+    int selectedCompression;
+    boost::uint32_t dictionaryId;
+    // Since protocol version 3, fields the end wants in its inbound data frames
+    boost::uint32_t fieldMask;
+    // Since protocol version 4, microseconds the end wants between two of
+    // its inbound data frames, 0 for as fast as they are produced
+    boost::uint32_t minFrameInterval;
+
+    // Binary archives are only readable by a peer with the same data layout
+    bool isBinaryCompatible(const SerializeHandshake &other) const
+    {
+        return littleEndian == other.littleEndian
+            && sizeOfInt == other.sizeOfInt
+            && sizeOfLong == other.sizeOfLong
+            && sizeOfDouble == other.sizeOfDouble
+            && archiveVersion == other.archiveVersion;
+    }
+
+private:
+    friend class boost::serialization::access;
+    template <class Archive>
+    void serialize(Archive &ar, const unsigned int version)
+    {
+        ar & BOOST_SERIALIZATION_NVP(protocolVersion);
+        ar & BOOST_SERIALIZATION_NVP(supportedFormats);
+        ar & BOOST_SERIALIZATION_NVP(selectedFormat);
+        ar & BOOST_SERIALIZATION_NVP(supportedFeatures);
+        ar & BOOST_SERIALIZATION_NVP(selectedFeatures);
+        ar & BOOST_SERIALIZATION_NVP(littleEndian);
+        ar & BOOST_SERIALIZATION_NVP(sizeOfInt);
+        ar & BOOST_SERIALIZATION_NVP(sizeOfLong);
+        ar & BOOST_SERIALIZATION_NVP(sizeOfDouble);
+        ar & BOOST_SERIALIZATION_NVP(archiveVersion);
+        // Older peers stop reading before these and never send them
+        if(protocolVersion >= 2) {
+            ar & BOOST_SERIALIZATION_NVP(supportedCompressions);
+            ar & BOOST_SERIALIZATION_NVP(preferredCompression);
+            ar & BOOST_SERIALIZATION_NVP(selectedCompression);
+            ar & BOOST_SERIALIZATION_NVP(dictionaryId);
+        }
+        if(protocolVersion >= 3) {
+            ar & BOOST_SERIALIZATION_NVP(fieldMask);
+        }
+        if(protocolVersion >= 4) {
+            ar & BOOST_SERIALIZATION_NVP(minFrameInterval);
+        }
+    }
+};
+
+// Format negotiation progress of a connection
+typedef enum {
+    NEGOTIATION_NONE,       /*!< nothing exchanged yet, frames are sent with the legacy header */
+    NEGOTIATION_REQUESTED,  /*!< local handshake sent, waiting for the peer's handshake */
+    NEGOTIATION_COMPLETE    /*!< both handshakes exchanged, m_wireFormat is in use */
+} NegotiationState_t;
 
 class TcpSerializeConnection
     : public BasicIoObject_t<boost::asio::ip::tcp::socket>
 {
 public:
     TcpSerializeConnection(boost::asio::io_service *io_service)
+        : m_supportedFormats(WIRE_FORMAT_TEXT | WIRE_FORMAT_BINARY)
+        , m_wireFormat(WIRE_FORMAT_TEXT)
+        , m_negotiation(NEGOTIATION_NONE)
+        , m_supportedFeatures(FEATURE_DELTA_FRAMES | FEATURE_STREAMING | FEATURE_BINARY_HEADER)
+        , m_features(0)
+        , m_supportedCompressions(COMPRESSION_NONE)
+        , m_preferredCompression(COMPRESSION_NONE)
+        , m_compression(COMPRESSION_NONE)
+        , m_useDictionary(false)
+        , m_fieldMask(FIELD_MASK_ALL)
+        , m_sentFieldMask(FIELD_MASK_ALL)
+        , m_remoteFieldMask(FIELD_MASK_ALL)
+        , m_minFrameInterval(0)
+        , m_sentMinFrameInterval(0)
+        , m_remoteMinFrameInterval(0)
+        , m_keyframeInterval(defaultKeyframeInterval)
+        , m_ackWindow(defaultAckWindow)
     {
+        resetFrameState();
         m_stream.reset(new boost::asio::ip::tcp::socket(*io_service));
     }
     virtual ~TcpSerializeConnection() {}
 
+    virtual bool close(void);
+
     template <typename T, typename Handler>
     int receiveData(T &t, Handler handler);
 
     template <typename T, typename Handler>
     int sendData(const T &t, Handler handler);
 
+    // Sends an archive that was already serialized in wireFormat(). The
+    // archive is only referenced, so one archive can be sent to any number
+    // of connections, and must not change afterwards. isFieldMasked marks
+    // an archive of a FieldMaskedFrame, see remoteFieldMask().
+    template <typename Handler>
+    int sendArchive(boost::shared_ptr<const std::string> archive, Handler handler, double simTime = 0.0,
+        bool isFieldMasked = false);
+
+    // Sends the local handshake, the peer answers with its own handshake
+    // ahead of the next data frame
+    template <typename Handler>
+    int sendHandshake(Handler handler);
+
+    // Acknowledges all data frames received so far. With FEATURE_STREAMING
+    // the receiver acks every ackInterval frames and the sender stops once
+    // ackWindow frames are unacknowledged. An inbound ack completes
+    // receiveData without touching the data.
+    template <typename Handler>
+    int sendAck(Handler handler);
+    bool isAckDue();
+    bool canSendFrame();
+    // Number of frames that may be sent ahead of the last ack
+    void setAckWindow(int frames) { m_ackWindow = frames > 2 * ackInterval ? frames : 2 * ackInterval; }
+
+    // Bitmask of WireFormat_t values this end is willing to use
+    void setSupportedFormats(int formats) { m_supportedFormats = formats | WIRE_FORMAT_TEXT; }
+    WireFormat_t wireFormat() { return m_wireFormat; }
+    // Bitmask of ConnectionFeature_t values this end is willing to use
+    void setSupportedFeatures(int features) { m_supportedFeatures = features; }
+    int features() { return m_features; }
+    // Number of delta frames sent between two keyframes
+    void setKeyframeInterval(int frames) { m_keyframeInterval = frames > 0 ? frames : 1; }
+    NegotiationState_t negotiationState() { return m_negotiation; }
+
+    // Bitmask of Compression_t values this end accepts and the codec it
+    // would like to use. The end answering the handshake picks the
+    // initiator's preference if both support it, then its own, otherwise
+    // frames stay uncompressed. Must be set before negotiation.
+    void setSupportedCompressions(int codecs) { m_supportedCompressions = codecs & availableCompressions(); }
+    void setPreferredCompression(Compression_t codec) { m_preferredCompression = codec; }
+    // Only used when the peer reports the same dictionary
+    void setCompressionDictionary(boost::shared_ptr<const std::string> dictionary) { m_compressor.setDictionary(dictionary); }
+    Compression_t compression() { return m_compression; }
+
+    // Fields this end wants in its inbound data frames. The mask goes out
+    // with the handshake and, when it changes later on, with sendSubscription.
+    void setFieldMask(boost::uint32_t fieldMask) { m_fieldMask = fieldMask; }
+    bool isSubscriptionDue();
+    template <typename Handler>
+    int sendSubscription(Handler handler);
+    // Fields the peer subscribed to, FIELD_MASK_ALL unless FEATURE_FIELD_MASK
+    // was negotiated. Outbound archives for any other mask are expected to
+    // be FieldMaskedFrame archives. An inbound subscription completes
+    // receiveData without touching the data.
+    boost::uint32_t remoteFieldMask() { return m_remoteFieldMask; }
+
+    // Microseconds this end wants between two inbound data frames, so a
+    // streaming sender skips frames it produces faster than that. Goes out
+    // like the field mask, with the handshake and later with sendFrameRate.
+    void setMinFrameInterval(boost::uint32_t microseconds) { m_minFrameInterval = microseconds; }
+    bool isFrameRateDue();
+    template <typename Handler>
+    int sendFrameRate(Handler handler);
+    // Interval the peer asked for, 0 unless FEATURE_FRAME_RATE was
+    // negotiated. An inbound request completes receiveData without touching
+    // the data.
+    boost::uint32_t remoteMinFrameInterval() { return m_remoteMinFrameInterval; }
+
+    const FrameStatistics &statistics() { return m_statistics; }
+    // Whether the last completed receiveData decoded a new data frame, as
+    // opposed to an ack, subscription, duplicate or skipped frame
+    bool isNewFrame() { return m_isNewFrame; }
+
     boost::asio::ip::tcp::socket *stream() { return m_stream.get(); }
 
 private:
     // The size of the fixed length header
     enum { headerLength = 8 };
+    // Header layout is a message type character, two hex digits of flags and
+    // five hex digits of payload length. Peers that predate format negotiation
+    // send the payload length as eight space padded hex digits instead.
+    enum { headerFlagsLength = 2, headerSizeLength = 5, maxPayloadSize = 0xfffff };
+    // With FEATURE_BINARY_HEADER every message but the handshake starts with
+    // a binary header instead, all integers little endian:
+    //    0 uint32 magic         "\xb5BSK", never a valid text header
+    //    4 uint8  version
+    //    5 uint8  message type
+    //    6 uint16 flags
+    //    8 uint64 message sequence, counting from 1 after negotiation
+    //   16 double sim time of a data frame
+    //   24 uint32 payload length
+    //   28 uint32 CRC32C of the payload
+    //   32 uint32 CRC32C of the header bytes before it
+    // The first headerLength bytes are read as for the text header, the
+    // magic then tells whether the rest of the binary header follows.
+    enum { binaryHeaderLength = 36, binaryHeaderVersion = 1, maxBinaryPayloadSize = 0x4000000 };
+    static const boost::uint32_t binaryHeaderMagic = 0x4b5342b5;
+    enum { messageData = 'S', messageHandshake = 'H', messageAck = 'A', messageSubscribe = 'M', messageFrameRate = 'R' };
+    enum { flagBinary = 0x01, flagDelta = 0x02, flagKeyframeRequest = 0x04, flagLz4 = 0x08, flagZstd = 0x10,
+        flagFieldMask = 0x20 };
+    enum { defaultKeyframeInterval = 100, sequenceLength = 4 };
+    enum { ackInterval = 8, defaultAckWindow = 32 };
 
     // Outbound header
     std::string m_outputHeader;
     // Inbound header
-    char m_inboundHeader[headerLength];
+    char m_inboundHeader[binaryHeaderLength];
+    char m_inboundType;
+    int m_inboundFlags;
+    // Binary header state
+    bool m_isBinaryHeader;
+    bool m_isDuplicate;
+    bool m_isNewFrame;
+    boost::uint32_t m_inboundPayloadCrc;
+    boost::uint64_t m_inboundMessageSequence;
+    boost::uint64_t m_outboundMessageSequence;
+    FrameStatistics m_statistics;
+
+    int m_supportedFormats;
+    WireFormat_t m_wireFormat;
+    NegotiationState_t m_negotiation;
+    SerializeHandshake m_handshake;
+    int m_supportedFeatures;
+    int m_features;
+
+    // Compression state, the whole data payload (sequence, delta or
+    // archive) is compressed when it gets smaller that way
+    int m_supportedCompressions;
+    Compression_t m_preferredCompression;
+    Compression_t m_compression;
+    bool m_useDictionary;
+    FrameCompressor m_compressor;
+    std::string m_compressionInput;
+    std::string m_compressedFrame;
+    std::string m_decompressedFrame;
+
+    // Subscription state for FEATURE_FIELD_MASK
+    boost::uint32_t m_fieldMask;
+    boost::uint32_t m_sentFieldMask;
+    boost::uint32_t m_remoteFieldMask;
+    // Rate limit state for FEATURE_FRAME_RATE
+    boost::uint32_t m_minFrameInterval;
+    boost::uint32_t m_sentMinFrameInterval;
+    boost::uint32_t m_remoteMinFrameInterval;
 
+    // Delta frame state. With FEATURE_DELTA_FRAMES or FEATURE_STREAMING every
+    // data payload starts with a sequence number followed by either a full
+    // archive (keyframe) or a FrameDelta against the previous frame in the
+    // same direction.
+    int m_keyframeInterval;
+    int m_framesSinceKeyframe;
+    boost::uint32_t m_outboundSequence;
+    boost::uint32_t m_inboundSequence;
+    // Flow control state for FEATURE_STREAMING
+    int m_ackWindow;
+    boost::uint32_t m_receivedSequence;
+    boost::uint32_t m_sentAckSequence;
+    boost::uint32_t m_ackedSequence;
+    bool m_sendKeyframe;
+    bool m_keyframeRequested;
+    // Archives are shared with the caller (sendArchive) or owned by the
+    // connection (sendData), either way they stay alive until the next frame
+    // has been encoded against them
+    boost::shared_ptr<const std::string> m_outboundFrame;
+    boost::shared_ptr<const std::string> m_outboundReference;
+    boost::shared_ptr<std::string> m_serializedFrames[2];
+    std::string m_inboundFrame;
+    std::string m_inboundReference;
+
+    void resetFrameState();
+    bool hasSequence() { return (m_features & (FEATURE_DELTA_FRAMES | FEATURE_STREAMING)) != 0; }
+    int encodeFrame(bool &appendFrame);
+    bool decodeFrame(const char *data, size_t size, bool &hasData);
+    int compressFrame(const std::string &archive, bool appendFrame);
+    bool useBinaryHeader(char type);
+    bool formatHeader(char type, int flags, std::vector<boost::asio::const_buffer> &buffers, double simTime = 0.0);
+    bool parseHeader(size_t &size);
+    bool parseBinaryHeader(size_t &size);
+    void prepareHandshake(const SerializeHandshake *remote);
+
+    template <typename Handler>
+    int writeHandshake(const SerializeHandshake *remote, boost::tuple<Handler> handler);
+    template <typename Handler>
+    void handleWriteHandshake(const boost::system::error_code &e, boost::tuple<Handler> handler);
     template <typename T, typename Handler>
     void handleReadHeader(const boost::system::error_code &e, T &t, boost::tuple<Handler> handler);
     template <typename T, typename Handler>
+    void handleReadBinaryHeader(const boost::system::error_code &e, T &t, boost::tuple<Handler> handler);
+    template <typename T, typename Handler>
+    void readPayload(size_t size, T &t, boost::tuple<Handler> handler);
+    template <typename T, typename Handler>
     void handleReadData(const boost::system::error_code &e, T &t, boost::tuple<Handler> handler);
 };
 
+inline bool TcpSerializeConnection::close(void)
+{
+    m_negotiation = NEGOTIATION_NONE;
+    m_wireFormat = WIRE_FORMAT_TEXT;
+    m_features = 0;
+    m_compression = COMPRESSION_NONE;
+    m_useDictionary = false;
+    m_sentFieldMask = FIELD_MASK_ALL;
+    m_remoteFieldMask = FIELD_MASK_ALL;
+    m_sentMinFrameInterval = 0;
+    m_remoteMinFrameInterval = 0;
+    resetFrameState();
+    return BasicIoObject_t<boost::asio::ip::tcp::socket>::close();
+}
+
+inline void TcpSerializeConnection::resetFrameState()
+{
+    m_framesSinceKeyframe = 0;
+    m_outboundSequence = 0;
+    m_inboundSequence = 0;
+    m_sendKeyframe = true;
+    m_keyframeRequested = false;
+    m_receivedSequence = 0;
+    m_sentAckSequence = 0;
+    m_ackedSequence = 0;
+    m_isBinaryHeader = false;
+    m_isDuplicate = false;
+    m_isNewFrame = false;
+    m_inboundMessageSequence = 0;
+    m_outboundMessageSequence = 0;
+    m_outboundReference.reset();
+    m_inboundReference.clear();
+}
+
+inline bool TcpSerializeConnection::isAckDue()
+{
+    return (m_features & FEATURE_STREAMING)
+        && (m_keyframeRequested || m_receivedSequence - m_sentAckSequence >= (boost::uint32_t)ackInterval);
+}
+
+inline bool TcpSerializeConnection::isSubscriptionDue()
+{
+    return m_negotiation == NEGOTIATION_COMPLETE && (m_features & FEATURE_FIELD_MASK)
+        && m_fieldMask != m_sentFieldMask;
+}
+
+inline bool TcpSerializeConnection::isFrameRateDue()
+{
+    return m_negotiation == NEGOTIATION_COMPLETE && (m_features & FEATURE_FRAME_RATE)
+        && m_minFrameInterval != m_sentMinFrameInterval;
+}
+
+inline bool TcpSerializeConnection::canSendFrame()
+{
+    return !(m_features & FEATURE_STREAMING)
+        || m_outboundSequence - m_ackedSequence < (boost::uint32_t)m_ackWindow;
+}
+
+// Turns the archive in m_outboundFrame into the outbound payload, either as
+// a keyframe or as a delta against the previously sent frame. m_outboundBuffer
+// receives the sequence number and delta, appendFrame is set if the archive
+// itself has to follow it. Returns the header flags describing the payload.
+inline int TcpSerializeConnection::encodeFrame(bool &appendFrame)
+{
+    int flags = 0;
+    m_outboundBuffer.clear();
+    appendUint32(m_outboundBuffer, ++m_outboundSequence);
+
+    const std::string &frame = *m_outboundFrame;
+    bool keyframe = m_sendKeyframe || m_framesSinceKeyframe >= m_keyframeInterval
+        || !(m_features & FEATURE_DELTA_FRAMES) || !m_outboundReference;
+    if(!keyframe) {
+        encodeFrameDelta(*m_outboundReference, frame, m_outboundBuffer);
+        // A delta that is not smaller than the frame itself is pointless
+        keyframe = m_outboundBuffer.size() >= frame.size() + sequenceLength;
+    }
+    appendFrame = keyframe;
+    if(keyframe) {
+        m_outboundBuffer.resize(sequenceLength);
+        m_framesSinceKeyframe = 0;
+        m_sendKeyframe = false;
+    } else {
+        flags |= flagDelta;
+        m_framesSinceKeyframe++;
+    }
+    if(m_keyframeRequested) {
+        flags |= flagKeyframeRequest;
+        m_keyframeRequested = false;
+    }
+    m_outboundReference = m_outboundFrame;
+    return flags;
+}
+
+// Compresses the payload made of m_outboundBuffer and, if appendFrame is
+// set, the archive into m_compressedFrame. Returns the header flag of the
+// codec or 0 if the payload is sent as is.
+inline int TcpSerializeConnection::compressFrame(const std::string &archive, bool appendFrame)
+{
+    if(m_compression == COMPRESSION_NONE) {
+        return 0;
+    }
+    const std::string *input = &m_outboundBuffer;
+    if(appendFrame) {
+        m_compressionInput.assign(m_outboundBuffer);
+        m_compressionInput.append(archive);
+        input = &m_compressionInput;
+    }
+    if(!m_compressor.compress(m_compression, m_useDictionary, input->data(), input->size(), m_compressedFrame)
+            || m_compressedFrame.size() >= input->size()) {
+        return 0;
+    }
+    return m_compression == COMPRESSION_LZ4 ? flagLz4 : flagZstd;
+}
+
+// Rebuilds the archive of an inbound payload into m_inboundReference.
+// hasData is false if a delta could not be applied, in which case a keyframe
+// is requested from the peer and the frame is skipped.
+inline bool TcpSerializeConnection::decodeFrame(const char *data, size_t size, bool &hasData)
+{
+    hasData = false;
+    if(size < sequenceLength) {
+        return false;
+    }
+    boost::uint32_t sequence = readUint32(data);
+    m_receivedSequence = sequence;
+    const char *payload = data + sequenceLength;
+    size_t payloadSize = size - sequenceLength;
+
+    if(m_inboundFlags & flagKeyframeRequest) {
+        m_sendKeyframe = true;
+    }
+    if(m_inboundFlags & flagDelta) {
+        if(m_inboundReference.empty() || sequence != m_inboundSequence + 1
+                || !applyFrameDelta(m_inboundReference, payload, payloadSize, m_inboundFrame)) {
+            std::cout << "Missing reference for delta frame " << sequence << ", requesting keyframe" << std::endl;
+            m_inboundReference.clear();
+            m_keyframeRequested = true;
+            return true;
+        }
+        m_inboundReference.swap(m_inboundFrame);
+    } else {
+        m_inboundReference.assign(payload, payloadSize);
+    }
+    m_inboundSequence = sequence;
+    hasData = true;
+    return true;
+}
+
+inline bool TcpSerializeConnection::useBinaryHeader(char type)
+{
+    // Handshakes keep the text header, the peer may not be negotiated yet
+    return type != messageHandshake && m_negotiation == NEGOTIATION_COMPLETE
+        && (m_features & FEATURE_BINARY_HEADER);
+}
+
+// Builds the outbound header for the payload in buffers[1...] and stores it
+// in buffers[0]. Until the peer is known to understand the typed header the
+// legacy length only header is used.
+inline bool TcpSerializeConnection::formatHeader(char type, int flags, std::vector<boost::asio::const_buffer> &buffers, double simTime)
+{
+    size_t size = 0;
+    for(size_t i = 1; i < buffers.size(); i++) {
+        size += boost::asio::buffer_size(buffers[i]);
+    }
+
+    if(useBinaryHeader(type)) {
+        if(size > maxBinaryPayloadSize) {
+            return false;
+        }
+        boost::uint32_t payloadCrc = 0;
+        for(size_t i = 1; i < buffers.size(); i++) {
+            payloadCrc = crc32c(boost::asio::buffer_cast<const char *>(buffers[i]),
+                boost::asio::buffer_size(buffers[i]), payloadCrc);
+        }
+        boost::uint64_t simTimeBits = 0;
+        std::memcpy(&simTimeBits, &simTime, sizeof(simTimeBits));
+        m_outputHeader.resize(binaryHeaderLength);
+        char *header = &m_outputHeader[0];
+        writeUint32(header, binaryHeaderMagic);
+        header[4] = (char)binaryHeaderVersion;
+        header[5] = type;
+        header[6] = (char)(flags & 0xff);
+        header[7] = (char)((flags >> 8) & 0xff);
+        writeUint64(header + 8, ++m_outboundMessageSequence);
+        writeUint64(header + 16, simTimeBits);
+        writeUint32(header + 24, (boost::uint32_t)size);
+        writeUint32(header + 28, payloadCrc);
+        writeUint32(header + 32, crc32c(header, 32));
+        buffers[0] = boost::asio::buffer(m_outputHeader);
+        return true;
+    }
+
+    std::ostringstream headerStream;
+    if(m_negotiation == NEGOTIATION_COMPLETE || type == messageHandshake) {
+        if(size > maxPayloadSize) {
+            return false;
+        }
+        headerStream << type << std::hex << std::setfill('0')
+            << std::setw(headerFlagsLength) << flags
+            << std::setw(headerSizeLength) << size;
+    } else {
+        headerStream << std::setw(headerLength) << std::hex << size;
+    }
+    if(!headerStream || headerStream.str().size() != headerLength) {
+        return false;
+    }
+    m_outputHeader = headerStream.str();
+    buffers[0] = boost::asio::buffer(m_outputHeader);
+    return true;
+}
+
+// Parses length hex digits, leading spaces are allowed
+inline bool parseHexField(const char *text, size_t length, size_t &value)
+{
+    value = 0;
+    size_t i = 0;
+    while(i < length && text[i] == ' ') {
+        i++;
+    }
+    if(i == length) {
+        return false;
+    }
+    for(; i < length; i++) {
+        char c = text[i];
+        int digit;
+        if(c >= '0' && c <= '9') {
+            digit = c - '0';
+        } else if(c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        } else if(c >= 'A' && c <= 'F') {
+            digit = c - 'A' + 10;
+        } else {
+            return false;
+        }
+        value = (value << 4) | (size_t)digit;
+    }
+    return true;
+}
+
+inline bool TcpSerializeConnection::parseHeader(size_t &size)
+{
+    m_isBinaryHeader = false;
+    m_isDuplicate = false;
+    m_isNewFrame = false;
+    m_inboundType = m_inboundHeader[0];
+    if(m_inboundType == messageData || m_inboundType == messageHandshake || m_inboundType == messageAck
+            || m_inboundType == messageSubscribe || m_inboundType == messageFrameRate) {
+        size_t flags = 0;
+        if(!parseHexField(m_inboundHeader + 1, headerFlagsLength, flags)
+                || !parseHexField(m_inboundHeader + 1 + headerFlagsLength, headerSizeLength, size)) {
+            return false;
+        }
+        m_inboundFlags = (int)flags;
+        return true;
+    }
+    // Legacy header, always a text archive
+    m_inboundType = messageData;
+    m_inboundFlags = 0;
+    return parseHexField(m_inboundHeader, headerLength, size) && size <= maxBinaryPayloadSize;
+}
+
+// Validates the complete binary header and updates the sequence counters.
+// A header failing its checksum leaves the stream position unknown, the
+// connection has to be dropped.
+inline bool TcpSerializeConnection::parseBinaryHeader(size_t &size)
+{
+    const char *header = m_inboundHeader;
+    if(readUint32(header + 32) != crc32c(header, 32) || (unsigned char)header[4] != binaryHeaderVersion) {
+        m_statistics.corruptFrames++;
+        return false;
+    }
+    m_isBinaryHeader = true;
+    m_inboundType = header[5];
+    m_inboundFlags = (unsigned char)header[6] | ((unsigned char)header[7] << 8);
+    boost::uint64_t sequence = readUint64(header + 8);
+    boost::uint64_t simTimeBits = readUint64(header + 16);
+    size = readUint32(header + 24);
+    m_inboundPayloadCrc = readUint32(header + 28);
+    if(size > maxBinaryPayloadSize) {
+        m_statistics.corruptFrames++;
+        return false;
+    }
+
+    m_isDuplicate = sequence <= m_inboundMessageSequence;
+    if(m_isDuplicate) {
+        m_statistics.duplicateFrames++;
+    } else {
+        m_statistics.sequenceGaps += (unsigned long)(sequence - m_inboundMessageSequence - 1);
+        m_inboundMessageSequence = sequence;
+    }
+    if(m_inboundType == messageData) {
+        std::memcpy(&m_statistics.lastSimTime, &simTimeBits, sizeof(simTimeBits));
+    }
+    return true;
+}
+
+// Fills in the local handshake. When the remote handshake is known the
+// format used from now on is selected here, binary is only chosen if both
+// ends support it and share the same data layout.
+inline void TcpSerializeConnection::prepareHandshake(const SerializeHandshake *remote)
+{
+    m_handshake = SerializeHandshake();
+    m_handshake.supportedFormats = m_supportedFormats;
+    m_handshake.supportedFeatures = m_supportedFeatures;
+    m_handshake.supportedCompressions = m_supportedCompressions;
+    m_handshake.preferredCompression = m_preferredCompression;
+    m_handshake.dictionaryId = m_compressor.dictionaryId();
+    m_handshake.fieldMask = m_fieldMask;
+    m_handshake.minFrameInterval = m_minFrameInterval;
+    if(remote) {
+        if((m_supportedFormats & remote->supportedFormats & WIRE_FORMAT_BINARY)
+                && m_handshake.isBinaryCompatible(*remote)) {
+            m_wireFormat = WIRE_FORMAT_BINARY;
+        } else {
+            m_wireFormat = WIRE_FORMAT_TEXT;
+        }
+        m_features = m_supportedFeatures & remote->supportedFeatures;
+        int commonCompressions = m_supportedCompressions & remote->supportedCompressions;
+        if(remote->preferredCompression & commonCompressions) {
+            m_compression = (Compression_t)remote->preferredCompression;
+        } else if(m_preferredCompression & commonCompressions) {
+            m_compression = m_preferredCompression;
+        } else {
+            m_compression = COMPRESSION_NONE;
+        }
+        m_useDictionary = m_handshake.dictionaryId != 0 && m_handshake.dictionaryId == remote->dictionaryId;
+        m_remoteFieldMask = (m_features & FEATURE_FIELD_MASK) ? remote->fieldMask : FIELD_MASK_ALL;
+        m_sentFieldMask = m_fieldMask;
+        m_remoteMinFrameInterval = (m_features & FEATURE_FRAME_RATE) ? remote->minFrameInterval : 0;
+        m_sentMinFrameInterval = m_minFrameInterval;
+        m_handshake.selectedFormat = m_wireFormat;
+        m_handshake.selectedFeatures = m_features;
+        m_handshake.selectedCompression = m_compression;
+    }
+}
+
 template <typename T, typename Handler>
 int TcpSerializeConnection::receiveData(T &t, Handler handler)
 {
     // Issue a read operation to read exactly the number of bytes in a header
     void(TcpSerializeConnection::*f)(const boost::system::error_code&, T&, boost::tuple<Handler>) =
         &TcpSerializeConnection::handleReadHeader<T, Handler>;
-    boost::asio::async_read(*m_stream.get(), boost::asio::buffer(m_inboundHeader),
+    boost::asio::async_read(*m_stream.get(), boost::asio::buffer(m_inboundHeader, headerLength),
         boost::bind(f, this, boost::asio::placeholders::error, boost::ref(t), boost::make_tuple(handler)));
     return 0;
 }
@@ -79,37 +766,153 @@ int TcpSerializeConnection::receiveData(T &t, Handler handler)
 template <typename T, typename Handler>
 int TcpSerializeConnection::sendData(const T &t, Handler handler)
 {
-    // Serialize the data first so we know how large it is
-    std::ostringstream archiveStream;
-    boost::archive::text_oarchive archive(archiveStream);
-    try {
-        archive & t;
-    } catch(boost::archive::archive_exception& e) {
-        std::cout << "Error occured: " << e.what() << std::endl;
-        boost::system::error_code error(boost::asio::error::invalid_argument);
+    // The previous write is done, only the delta reference is still needed.
+    // Serialize into whichever buffer is not that reference.
+    m_outboundFrame.reset();
+    boost::shared_ptr<std::string> &frame = m_serializedFrames[0] == m_outboundReference
+        ? m_serializedFrames[1] : m_serializedFrames[0];
+    if(!frame || !frame.unique()) {
+        frame.reset(new std::string);
+    }
+    if(!serializeArchive(t, m_wireFormat, *frame)) {
         return 1;
     }
-    m_outboundBuffer = archiveStream.str();
+    return sendArchive(boost::shared_ptr<const std::string>(frame), handler, frameSimTime(t));
+}
+
+template <typename Handler>
+int TcpSerializeConnection::sendArchive(boost::shared_ptr<const std::string> archive, Handler handler, double simTime,
+    bool isFieldMasked)
+{
+    int flags = m_wireFormat == WIRE_FORMAT_BINARY ? flagBinary : 0;
+    if(isFieldMasked) {
+        flags |= flagFieldMask;
+    }
+    m_outboundFrame = archive;
+    bool appendFrame = true;
+    if(hasSequence()) {
+        flags |= encodeFrame(appendFrame);
+    } else {
+        m_outboundBuffer.clear();
+    }
+    int compressionFlag = compressFrame(*archive, appendFrame);
+    flags |= compressionFlag;
+
+    // Write the header, sequence or delta and the archive straight from the
+    // shared buffer, m_outboundFrame keeps it alive until the write is done
+    std::vector<boost::asio::const_buffer> buffers(1);
+    if(compressionFlag) {
+        buffers.push_back(boost::asio::buffer(m_compressedFrame));
+    } else {
+        if(!m_outboundBuffer.empty()) {
+            buffers.push_back(boost::asio::buffer(m_outboundBuffer));
+        }
+        if(appendFrame) {
+            buffers.push_back(boost::asio::buffer(*archive));
+        }
+    }
 
     // Format the header
-    std::ostringstream headerStream;
-    headerStream << std::setw(headerLength) << std::hex << m_outboundBuffer.size();
-    if(!headerStream || headerStream.str().size() != headerLength) {
+    if(!formatHeader(messageData, flags, buffers, simTime)) {
         // Something went wrong
         boost::system::error_code error(boost::asio::error::invalid_argument);
         m_stream->get_io_service().post(boost::bind(handler, error));
         return 1;
     }
-    m_outputHeader = headerStream.str();
+    boost::asio::async_write(*m_stream.get(), buffers, handler);
+    return 0;
+}
 
-    // Write the serialized data to the socket
-    std::vector<boost::asio::const_buffer> buffers;
-    buffers.push_back(boost::asio::buffer(m_outputHeader));
+template <typename Handler>
+int TcpSerializeConnection::sendHandshake(Handler handler)
+{
+    m_negotiation = NEGOTIATION_REQUESTED;
+    return writeHandshake(0, boost::make_tuple(handler));
+}
+
+template <typename Handler>
+int TcpSerializeConnection::sendAck(Handler handler)
+{
+    int flags = 0;
+    if(m_keyframeRequested) {
+        flags |= flagKeyframeRequest;
+        m_keyframeRequested = false;
+    }
+    m_outboundBuffer.clear();
+    appendUint32(m_outboundBuffer, m_receivedSequence);
+    m_sentAckSequence = m_receivedSequence;
+    std::vector<boost::asio::const_buffer> buffers(1);
+    buffers.push_back(boost::asio::buffer(m_outboundBuffer));
+    if(!formatHeader(messageAck, flags, buffers)) {
+        boost::system::error_code error(boost::asio::error::invalid_argument);
+        m_stream->get_io_service().post(boost::bind(handler, error));
+        return 1;
+    }
+    boost::asio::async_write(*m_stream.get(), buffers, handler);
+    return 0;
+}
+
+template <typename Handler>
+int TcpSerializeConnection::sendSubscription(Handler handler)
+{
+    m_outboundBuffer.clear();
+    appendUint32(m_outboundBuffer, m_fieldMask);
+    m_sentFieldMask = m_fieldMask;
+    std::vector<boost::asio::const_buffer> buffers(1);
     buffers.push_back(boost::asio::buffer(m_outboundBuffer));
+    if(!formatHeader(messageSubscribe, 0, buffers)) {
+        boost::system::error_code error(boost::asio::error::invalid_argument);
+        m_stream->get_io_service().post(boost::bind(handler, error));
+        return 1;
+    }
+    boost::asio::async_write(*m_stream.get(), buffers, handler);
+    return 0;
+}
+
+template <typename Handler>
+int TcpSerializeConnection::sendFrameRate(Handler handler)
+{
+    m_outboundBuffer.clear();
+    appendUint32(m_outboundBuffer, m_minFrameInterval);
+    m_sentMinFrameInterval = m_minFrameInterval;
+    std::vector<boost::asio::const_buffer> buffers(1);
+    buffers.push_back(boost::asio::buffer(m_outboundBuffer));
+    if(!formatHeader(messageFrameRate, 0, buffers)) {
+        boost::system::error_code error(boost::asio::error::invalid_argument);
+        m_stream->get_io_service().post(boost::bind(handler, error));
+        return 1;
+    }
     boost::asio::async_write(*m_stream.get(), buffers, handler);
     return 0;
 }
 
+template <typename Handler>
+int TcpSerializeConnection::writeHandshake(const SerializeHandshake *remote, boost::tuple<Handler> handler)
+{
+    void(TcpSerializeConnection::*f)(const boost::system::error_code&, boost::tuple<Handler>) =
+        &TcpSerializeConnection::handleWriteHandshake<Handler>;
+
+    // Handshakes are always text archives so any peer can read them
+    prepareHandshake(remote);
+    std::vector<boost::asio::const_buffer> buffers(1);
+    bool isSerialized = serializeArchive(m_handshake, WIRE_FORMAT_TEXT, m_outboundBuffer);
+    buffers.push_back(boost::asio::buffer(m_outboundBuffer));
+    if(!isSerialized || !formatHeader(messageHandshake, 0, buffers)) {
+        boost::system::error_code error(boost::asio::error::invalid_argument);
+        m_stream->get_io_service().post(boost::bind(f, this, error, handler));
+        return 1;
+    }
+    boost::asio::async_write(*m_stream.get(), buffers,
+        boost::bind(f, this, boost::asio::placeholders::error, handler));
+    return 0;
+}
+
+template <typename Handler>
+void TcpSerializeConnection::handleWriteHandshake(const boost::system::error_code &e, boost::tuple<Handler> handler)
+{
+    boost::get<0>(handler)(e);
+}
+
 // Handle a completed read of a message header. The handler is passed using
 // a tuple since boost::bind seems to have trouble binding a function object
 // created using boost::bind as a parameter
@@ -118,46 +921,189 @@ void TcpSerializeConnection::handleReadHeader(const boost::system::error_code &e
 {
     if(e) {
         boost::get<0>(handler)(e);
+    } else if(readUint32(m_inboundHeader) == binaryHeaderMagic) {
+        // Read the rest of the binary header
+        void(TcpSerializeConnection::*f)(const boost::system::error_code&, T&, boost::tuple<Handler>) =
+            &TcpSerializeConnection::handleReadBinaryHeader<T, Handler>;
+        boost::asio::async_read(*m_stream.get(), boost::asio::buffer(m_inboundHeader + headerLength, binaryHeaderLength - headerLength),
+            boost::bind(f, this, boost::asio::placeholders::error, boost::ref(t), handler));
     } else {
         // Determine the length of the serialized data
-        std::istringstream is(std::string(m_inboundHeader, headerLength));
         size_t inboundDataSize = 0;
         
-        if(!(is >> std::hex >> inboundDataSize)) {
+        if(!parseHeader(inboundDataSize) || inboundDataSize == 0) {
             // Header doesn't seem to be valid
             boost::system::error_code error(boost::asio::error::invalid_argument);
             boost::get<0>(handler)(error);
             return;
         }
+        readPayload(inboundDataSize, t, handler);
+    }
+}
 
-        // Start an asynchronous call to receive data
-        m_inboundBuffer.resize(inboundDataSize);
-        void(TcpSerializeConnection::*f)(const boost::system::error_code&, T&, boost::tuple<Handler>) = 
-            &TcpSerializeConnection::handleReadData<T, Handler>;
-        boost::asio::async_read(*m_stream.get(), boost::asio::buffer(m_inboundBuffer),
-            boost::bind(f, this, boost::asio::placeholders::error, boost::ref(t), handler));
+template <typename T, typename Handler>
+void TcpSerializeConnection::handleReadBinaryHeader(const boost::system::error_code &e, T &t, boost::tuple<Handler> handler)
+{
+    size_t inboundDataSize = 0;
+    if(e) {
+        boost::get<0>(handler)(e);
+    } else if(!parseBinaryHeader(inboundDataSize) || inboundDataSize == 0) {
+        std::cout << "Corrupt frame header, dropping the connection" << std::endl;
+        boost::system::error_code error(boost::asio::error::invalid_argument);
+        boost::get<0>(handler)(error);
+    } else {
+        readPayload(inboundDataSize, t, handler);
     }
 }
 
+template <typename T, typename Handler>
+void TcpSerializeConnection::readPayload(size_t size, T &t, boost::tuple<Handler> handler)
+{
+    // Start an asynchronous call to receive data, the buffer keeps its
+    // capacity between frames
+    m_inboundBuffer.resize(size);
+    void(TcpSerializeConnection::*f)(const boost::system::error_code&, T&, boost::tuple<Handler>) = 
+        &TcpSerializeConnection::handleReadData<T, Handler>;
+    boost::asio::async_read(*m_stream.get(), boost::asio::buffer(m_inboundBuffer),
+        boost::bind(f, this, boost::asio::placeholders::error, boost::ref(t), handler));
+}
+
 // Handle a completed read of a message
 template <typename T, typename Handler>
 void TcpSerializeConnection::handleReadData(const boost::system::error_code &e, T &t, boost::tuple<Handler> handler)
 {
+    if(!e && m_isBinaryHeader
+            && crc32c(&m_inboundBuffer[0], m_inboundBuffer.size()) != m_inboundPayloadCrc) {
+        m_statistics.corruptFrames++;
+        if(m_inboundType != messageData) {
+            boost::system::error_code error(boost::asio::error::invalid_argument);
+            boost::get<0>(handler)(error);
+            return;
+        }
+        // The header was intact so the stream is still in sync, skip the
+        // frame and restart the delta chain from a keyframe
+        std::cout << "Corrupt frame " << m_inboundMessageSequence << ", requesting keyframe" << std::endl;
+        m_inboundReference.clear();
+        m_keyframeRequested = true;
+        boost::get<0>(handler)(e);
+        return;
+    }
     if(e) {
         boost::get<0>(handler)(e);
+    } else if(m_isDuplicate) {
+        // Already received, the caller keeps the current data
+        boost::get<0>(handler)(e);
+    } else if(m_inboundType == messageHandshake) {
+        SerializeHandshake remote;
+        if(!deserializeArchive(&m_inboundBuffer[0], m_inboundBuffer.size(), WIRE_FORMAT_TEXT, remote)) {
+            boost::system::error_code error(boost::asio::error::invalid_argument);
+            boost::get<0>(handler)(error);
+            return;
+        }
+        if(m_negotiation == NEGOTIATION_REQUESTED) {
+            // Answer to our own handshake, the peer has made the selection
+            m_wireFormat = remote.selectedFormat == WIRE_FORMAT_BINARY ? WIRE_FORMAT_BINARY : WIRE_FORMAT_TEXT;
+            m_features = remote.selectedFeatures & m_supportedFeatures;
+            m_compression = (remote.selectedCompression & m_supportedCompressions)
+                ? (Compression_t)remote.selectedCompression : COMPRESSION_NONE;
+            m_useDictionary = m_compressor.dictionaryId() != 0 && m_compressor.dictionaryId() == remote.dictionaryId;
+            m_remoteFieldMask = (m_features & FEATURE_FIELD_MASK) ? remote.fieldMask : FIELD_MASK_ALL;
+            m_sentFieldMask = m_handshake.fieldMask;
+            m_remoteMinFrameInterval = (m_features & FEATURE_FRAME_RATE) ? remote.minFrameInterval : 0;
+            m_sentMinFrameInterval = m_handshake.minFrameInterval;
+            m_negotiation = NEGOTIATION_COMPLETE;
+            // The data frame follows the handshake
+            receiveData(t, boost::get<0>(handler));
+        } else {
+            // The peer asked for negotiation, select the format and answer
+            // before the caller sends its next data frame
+            m_negotiation = NEGOTIATION_COMPLETE;
+            writeHandshake(&remote, handler);
+        }
+    } else if(m_inboundType == messageAck) {
+        if(m_inboundBuffer.size() != sequenceLength) {
+            boost::system::error_code error(boost::asio::error::invalid_argument);
+            boost::get<0>(handler)(error);
+            return;
+        }
+        m_ackedSequence = readUint32(&m_inboundBuffer[0]);
+        if(m_inboundFlags & flagKeyframeRequest) {
+            m_sendKeyframe = true;
+        }
+        boost::get<0>(handler)(e);
+    } else if(m_inboundType == messageSubscribe) {
+        if(m_inboundBuffer.size() != sizeof(boost::uint32_t)) {
+            boost::system::error_code error(boost::asio::error::invalid_argument);
+            boost::get<0>(handler)(error);
+            return;
+        }
+        // Deltas against a frame with other fields would not be smaller
+        m_remoteFieldMask = readUint32(&m_inboundBuffer[0]);
+        m_sendKeyframe = true;
+        boost::get<0>(handler)(e);
+    } else if(m_inboundType == messageFrameRate) {
+        if(m_inboundBuffer.size() != sizeof(boost::uint32_t)) {
+            boost::system::error_code error(boost::asio::error::invalid_argument);
+            boost::get<0>(handler)(error);
+            return;
+        }
+        m_remoteMinFrameInterval = readUint32(&m_inboundBuffer[0]);
+        boost::get<0>(handler)(e);
     } else {
-        std::string archiveData(&m_inboundBuffer[0], m_inboundBuffer.size());
-        std::istringstream archiveStream(archiveData);
+        if(m_isBinaryHeader) {
+            m_statistics.framesReceived++;
+        }
+        m_statistics.receiveTime = preciseTimeStamp();
+        m_statistics.bytesReceived += m_inboundBuffer.size();
         // Extract the data structure from the data just received
-        try {
-            boost::archive::text_iarchive archive(archiveStream);
-            archive >> t;
-        } catch(boost::archive::archive_exception& e) {
-            std::cout << "Error occured: " << e.what() << std::endl;
+        WireFormat_t format = (m_inboundFlags & flagBinary) ? WIRE_FORMAT_BINARY : WIRE_FORMAT_TEXT;
+        const char *archiveData = &m_inboundBuffer[0];
+        size_t archiveSize = m_inboundBuffer.size();
+        if(m_inboundFlags & (flagLz4 | flagZstd)) {
+            Compression_t codec = (m_inboundFlags & flagLz4) ? COMPRESSION_LZ4 : COMPRESSION_ZSTD;
+            if(!m_compressor.decompress(codec, m_useDictionary, archiveData, archiveSize, m_decompressedFrame)
+                    || m_decompressedFrame.empty()) {
+                std::cout << "Error in " << __FUNCTION__ << ": could not decompress " << compressionName(codec) << " frame" << std::endl;
+                boost::system::error_code error(boost::asio::error::invalid_argument);
+                boost::get<0>(handler)(error);
+                return;
+            }
+            archiveData = m_decompressedFrame.data();
+            archiveSize = m_decompressedFrame.size();
+        }
+        if(hasSequence()) {
+            bool hasData = false;
+            if(!decodeFrame(archiveData, archiveSize, hasData)) {
+                boost::system::error_code error(boost::asio::error::invalid_argument);
+                boost::get<0>(handler)(error);
+                return;
+            }
+            if(!hasData) {
+                // Nothing to extract, the caller keeps the previous data
+                boost::get<0>(handler)(e);
+                return;
+            }
+            archiveData = m_inboundReference.data();
+            archiveSize = m_inboundReference.size();
+        }
+        bool isDeserialized;
+        if(m_inboundFlags & flagFieldMask) {
+            FieldMaskedFrame<T> frame(t, FIELD_MASK_ALL);
+            isDeserialized = deserializeArchive(archiveData, archiveSize, format, frame);
+            m_statistics.fieldMask = frame.fieldMask();
+        } else {
+            isDeserialized = deserializeArchive(archiveData, archiveSize, format, t);
+            m_statistics.fieldMask = FIELD_MASK_ALL;
+        }
+        if(!isDeserialized) {
             boost::system::error_code error(boost::asio::error::invalid_argument);
             boost::get<0>(handler)(error);
             return;
         }
+        m_statistics.archiveSize = archiveSize;
+        m_statistics.framesDecoded++;
+        m_statistics.decodeTime = preciseTimeStamp();
+        m_isNewFrame = true;
         // Inform caller that the data has been received ok
         boost::get<0>(handler)(e);
     }
@@ -31,10 +31,40 @@
 #include <boost/bind.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/thread/locks.hpp>
+#include <boost/atomic.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include <iostream>
+#include <algorithm>
+#include <map>
+#include <vector>
 
 #include "TcpSerializeConnection.hpp"
 
+// What happens to a streaming client that cannot keep up with setOutboundData
+typedef enum {
+    SLOW_CONSUMER_DROP,       /*!< frames are skipped, the client gets the newest frame once it is ready */
+    SLOW_CONSUMER_DISCONNECT  /*!< as drop, but the client is closed once it falls too far behind */
+} SlowConsumerPolicy_t;
+
+// Clients sharing one field subscription and wire format, and the size of
+// the archive of the newest frame they are sent
+struct FieldSubscriptionInfo
+{
+    FieldSubscriptionInfo()
+        : fieldMask(FIELD_MASK_ALL)
+        , format(WIRE_FORMAT_TEXT)
+        , clients(0)
+        , archiveSize(0)
+    {
+
+    }
+
+    boost::uint32_t fieldMask;
+    WireFormat_t format;
+    int clients;
+    size_t archiveSize;
+};
+
 template <typename T1, typename T2>
 class TcpSerializeServer
 {
@@ -48,25 +78,124 @@ public:
     void setOutboundData(T1 *data);
     T2 getInboundData();
 
+    // Bitmask of WireFormat_t values accepted from clients that negotiate,
+    // clients that do not negotiate always receive text archives
+    void setWireFormats(int formats);
+    // Number of delta frames sent between two keyframes, 0 always sends
+    // full frames
+    void setKeyframeInterval(int frames);
+    // Pushes every new outbound frame to clients that support streaming
+    // instead of waiting for their reply to the previous frame
+    void setStreaming(bool enabled);
+    // Number of frames a streaming client may fall behind its last ack
+    void setAckWindow(int frames);
+    // With SLOW_CONSUMER_DISCONNECT a streaming client is closed once
+    // maxLag frames were produced since the last frame it was sent
+    void setSlowConsumerPolicy(SlowConsumerPolicy_t policy, int maxLag = 100);
+    // Bitmask of Compression_t values clients may ask for, none by default.
+    // Compression runs per connection since it follows the delta encoding.
+    void setCompressions(int codecs);
+    // Used by clients reporting the same dictionary, applies to new connections
+    void setCompressionDictionary(boost::shared_ptr<const std::string> dictionary);
+    // Subscriptions of the connected clients. Frames are serialized once per
+    // distinct subscription; clients that do not subscribe get whole frames.
+    std::vector<FieldSubscriptionInfo> getSubscriptions();
+
 private:
+    // Wire format and field subscription an archive is serialized for
+    struct ArchiveKey {
+        ArchiveKey(WireFormat_t format = WIRE_FORMAT_TEXT, boost::uint32_t fieldMask = FIELD_MASK_ALL)
+            : format(format), fieldMask(fieldMask) {}
+        bool operator==(const ArchiveKey &other) const { return format == other.format && fieldMask == other.fieldMask; }
+        WireFormat_t format;
+        boost::uint32_t fieldMask;
+    };
+    struct OutboundArchive {
+        ArchiveKey key;
+        boost::shared_ptr<const std::string> archive;
+    };
+    // Newest outbound frame. Each archive is serialized once per wire format
+    // and subscription, outside of m_mutex, and shared by every connection
+    // using that combination.
+    struct OutboundFrame {
+        OutboundFrame() : generation(0), simTime(0.0) {}
+        unsigned long generation;
+        double simTime;
+        boost::shared_ptr<const T1> data;
+        std::vector<OutboundArchive> archives;
+    };
+    // Per connection state
+    struct ClientState {
+        ClientState() : isWriting(false), sentGeneration(0), isPaced(false), inboundData(new T2()) {}
+        bool isWriting;
+        unsigned long sentGeneration;
+        // Pacing of clients that limit their frame rate: when the last frame
+        // went out, and whether the timer for the next one is running
+        boost::posix_time::ptime sentTime;
+        bool isPaced;
+        boost::shared_ptr<boost::asio::deadline_timer> paceTimer;
+        ArchiveKey archiveKey;
+        // Replies are decoded here and copied to m_inboundData under m_mutex.
+        // The pending read handler holds a reference too, so the buffer
+        // outlives the client if it is dropped while a read is in flight.
+        boost::shared_ptr<T2> inboundData;
+    };
+    typedef std::map<boost::shared_ptr<TcpSerializeConnection>, ClientState> ClientMap;
+
     boost::scoped_ptr<boost::asio::ip::tcp::acceptor> m_acceptor;
     boost::scoped_ptr<boost::asio::io_service> m_ioService;
     boost::scoped_ptr<boost::thread> m_thread;
     boost::mutex m_mutex;
 
-    T1 m_outboundData;
+    OutboundFrame m_frame;
     T2 m_inboundData;
+    int m_supportedFormats;
+    int m_keyframeInterval;
+    bool m_isStreaming;
+    int m_ackWindow;
+    SlowConsumerPolicy_t m_slowConsumerPolicy;
+    unsigned long m_maxLag;
+    int m_compressions;
+    boost::shared_ptr<const std::string> m_compressionDictionary;
+    ClientMap m_clients;
+    // Archives setOutboundData serializes ahead of time
+    std::vector<ArchiveKey> m_archivesInUse;
 
     void handleAccept(const boost::system::error_code &e, boost::shared_ptr<TcpSerializeConnection> connection);
     void handleWrite(const boost::system::error_code &e, boost::shared_ptr<TcpSerializeConnection> connection);
-    void handleRead(const boost::system::error_code &e, boost::shared_ptr<TcpSerializeConnection> connection);
+    void handleRead(const boost::system::error_code &e, boost::shared_ptr<TcpSerializeConnection> connection,
+                    boost::shared_ptr<T2> inboundData);
+
+    void startStream(boost::shared_ptr<TcpSerializeConnection> connection);
+    void writeStream(boost::shared_ptr<TcpSerializeConnection> connection);
+    void flushStreams();
+    void handleStreamWrite(const boost::system::error_code &e, boost::shared_ptr<TcpSerializeConnection> connection);
+    void handleStreamRead(const boost::system::error_code &e, boost::shared_ptr<TcpSerializeConnection> connection,
+                          boost::shared_ptr<T2> inboundData);
+    void handlePaceTimer(const boost::system::error_code &e, boost::shared_ptr<TcpSerializeConnection> connection);
+    bool isPaced(boost::shared_ptr<TcpSerializeConnection> connection, ClientState &state);
+
+    static boost::shared_ptr<const std::string> serializeFrame(const T1 &data, const ArchiveKey &key);
+    boost::shared_ptr<const std::string> getArchive(boost::shared_ptr<TcpSerializeConnection> connection, ClientState &state);
+    void updateArchivesInUse();
+    void sendFrame(boost::shared_ptr<TcpSerializeConnection> connection, ClientState &state);
+    void receiveFrame(boost::shared_ptr<TcpSerializeConnection> connection, bool isStreaming);
+    void reportError(const boost::system::error_code &e, boost::shared_ptr<TcpSerializeConnection> connection);
+    void dropClient(boost::shared_ptr<TcpSerializeConnection> connection);
 };
 
 template <typename T1, typename T2>
 TcpSerializeServer<T1, T2>::TcpSerializeServer()
     : m_ioService(new boost::asio::io_service)
+    , m_supportedFormats(WIRE_FORMAT_TEXT | WIRE_FORMAT_BINARY)
+    , m_keyframeInterval(100)
+    , m_isStreaming(true)
+    , m_ackWindow(32)
+    , m_slowConsumerPolicy(SLOW_CONSUMER_DROP)
+    , m_maxLag(100)
+    , m_compressions(COMPRESSION_NONE)
 {
-
+    m_frame.data.reset(new T1());
 }
 
 template <typename T1, typename T2>
@@ -146,6 +275,16 @@ bool TcpSerializeServer<T1, T2>::close(void)
         m_thread->join();
         m_ioService->reset();
         m_thread.reset();
+        // Handlers still queued own their connection and read buffer and
+        // find no client state once they run
+        for(typename ClientMap::iterator it = m_clients.begin(); it != m_clients.end(); ++it) {
+            if(it->second.paceTimer) {
+                it->second.paceTimer->cancel();
+            }
+            it->first->close();
+        }
+        m_clients.clear();
+        updateArchivesInUse();
     }
 
     return true;
@@ -154,11 +293,36 @@ bool TcpSerializeServer<T1, T2>::close(void)
 template <typename T1, typename T2>
 void TcpSerializeServer<T1, T2>::setOutboundData(T1 *data)
 {
+    // Serialize before taking the lock, connections only ever reference the result
+    OutboundFrame frame;
+    frame.data.reset(new T1(*data));
+    frame.simTime = frameSimTime(*data);
+    std::vector<ArchiveKey> archivesInUse;
     if(m_thread) {
         boost::lock_guard<boost::mutex> guard(m_mutex);
-        m_outboundData = *data;
+        archivesInUse = m_archivesInUse;
     } else {
-        m_outboundData = *data;
+        archivesInUse = m_archivesInUse;
+    }
+    for(size_t i = 0; i < archivesInUse.size(); i++) {
+        OutboundArchive archive;
+        archive.key = archivesInUse[i];
+        archive.archive = serializeFrame(*frame.data, archive.key);
+        if(archive.archive) {
+            frame.archives.push_back(archive);
+        }
+    }
+
+    if(m_thread) {
+        boost::lock_guard<boost::mutex> guard(m_mutex);
+        frame.generation = m_frame.generation + 1;
+        m_frame = frame;
+        if(!m_clients.empty()) {
+            m_ioService->post(boost::bind(&TcpSerializeServer::flushStreams, this));
+        }
+    } else {
+        frame.generation = m_frame.generation + 1;
+        m_frame = frame;
     }
 }
 
@@ -173,6 +337,84 @@ T2 TcpSerializeServer<T1, T2>::getInboundData()
     }
 }
 
+template <typename T1, typename T2>
+void TcpSerializeServer<T1, T2>::setWireFormats(int formats)
+{
+    boost::lock_guard<boost::mutex> guard(m_mutex);
+    m_supportedFormats = formats;
+}
+
+template <typename T1, typename T2>
+void TcpSerializeServer<T1, T2>::setKeyframeInterval(int frames)
+{
+    boost::lock_guard<boost::mutex> guard(m_mutex);
+    m_keyframeInterval = frames;
+}
+
+template <typename T1, typename T2>
+void TcpSerializeServer<T1, T2>::setStreaming(bool enabled)
+{
+    boost::lock_guard<boost::mutex> guard(m_mutex);
+    m_isStreaming = enabled;
+}
+
+template <typename T1, typename T2>
+void TcpSerializeServer<T1, T2>::setAckWindow(int frames)
+{
+    boost::lock_guard<boost::mutex> guard(m_mutex);
+    m_ackWindow = frames;
+}
+
+template <typename T1, typename T2>
+void TcpSerializeServer<T1, T2>::setSlowConsumerPolicy(SlowConsumerPolicy_t policy, int maxLag)
+{
+    boost::lock_guard<boost::mutex> guard(m_mutex);
+    m_slowConsumerPolicy = policy;
+    m_maxLag = maxLag > 1 ? maxLag : 1;
+}
+
+template <typename T1, typename T2>
+void TcpSerializeServer<T1, T2>::setCompressions(int codecs)
+{
+    boost::lock_guard<boost::mutex> guard(m_mutex);
+    m_compressions = codecs;
+}
+
+template <typename T1, typename T2>
+void TcpSerializeServer<T1, T2>::setCompressionDictionary(boost::shared_ptr<const std::string> dictionary)
+{
+    boost::lock_guard<boost::mutex> guard(m_mutex);
+    m_compressionDictionary = dictionary;
+}
+
+template <typename T1, typename T2>
+std::vector<FieldSubscriptionInfo> TcpSerializeServer<T1, T2>::getSubscriptions()
+{
+    boost::lock_guard<boost::mutex> guard(m_mutex);
+    std::vector<FieldSubscriptionInfo> subscriptions;
+    for(typename ClientMap::iterator it = m_clients.begin(); it != m_clients.end(); ++it) {
+        const ArchiveKey &key = it->second.archiveKey;
+        size_t i = 0;
+        while(i < subscriptions.size() && !(subscriptions[i].format == key.format
+                && subscriptions[i].fieldMask == key.fieldMask)) {
+            i++;
+        }
+        if(i == subscriptions.size()) {
+            FieldSubscriptionInfo subscription;
+            subscription.fieldMask = key.fieldMask;
+            subscription.format = key.format;
+            for(size_t j = 0; j < m_frame.archives.size(); j++) {
+                if(m_frame.archives[j].key == key) {
+                    subscription.archiveSize = m_frame.archives[j].archive->size();
+                }
+            }
+            subscriptions.push_back(subscription);
+        }
+        subscriptions[i].clients++;
+    }
+    return subscriptions;
+}
+
 template <typename T1, typename T2>
 void TcpSerializeServer<T1, T2>::handleAccept(const boost::system::error_code &ec, boost::shared_ptr<TcpSerializeConnection> connection)
 {
@@ -180,8 +422,22 @@ void TcpSerializeServer<T1, T2>::handleAccept(const boost::system::error_code &e
     if(!ec) {
         // Successfully accepted a new connection
         std::cout << "Successfully accepted a connection " << connection.get() <<  std::endl;
-        connection->sendData(m_outboundData, boost::bind(&TcpSerializeServer::handleWrite, this,
-            boost::asio::placeholders::error, connection));
+        // Small acks and deltas must not wait for Nagle's algorithm
+        boost::system::error_code optionError;
+        connection->stream()->set_option(boost::asio::ip::tcp::no_delay(true), optionError);
+        connection->setSupportedFormats(m_supportedFormats);
+        connection->setSupportedFeatures((m_keyframeInterval > 0 ? FEATURE_DELTA_FRAMES : 0)
+            | (m_isStreaming ? FEATURE_STREAMING : 0) | FEATURE_BINARY_HEADER | FEATURE_FIELD_MASK | FEATURE_FRAME_RATE);
+        connection->setKeyframeInterval(m_keyframeInterval);
+        connection->setAckWindow(m_ackWindow);
+        connection->setSupportedCompressions(m_compressions);
+        connection->setCompressionDictionary(m_compressionDictionary);
+        ClientState &state = m_clients[connection];
+        state.sentGeneration = m_frame.generation;
+        // New clients start with whole text archives until they negotiate
+        updateArchivesInUse();
+        connection->sendArchive(getArchive(connection, state), boost::bind(&TcpSerializeServer::handleWrite, this,
+            boost::asio::placeholders::error, connection), m_frame.simTime);
     } else {
         if(ec == boost::asio::error::operation_aborted) {
             return;
@@ -203,54 +459,298 @@ void TcpSerializeServer<T1, T2>::handleWrite(const boost::system::error_code &ec
     if(!ec) {
         //std::cout << "Data sent to: " << connection.get() << std::endl;
         // Data sent, start listening for reply
-        connection->receiveData(m_inboundData, boost::bind(&TcpSerializeServer::handleRead, this,
-            boost::asio::placeholders::error, connection));
+        receiveFrame(connection, false);
     } else {
-        // Catch most common errors and replace error message with a nicer message
-#ifdef WIN32
-        if(ec.value() == 10054) {
-#else
-        if(ec.value() == 2) {
-#endif
-            std::cout << "Connection closed by client " << connection.get() << std::endl;
-        } else {
-            // An error occured
-            if(ec == boost::asio::error::operation_aborted) {
-                return;
-            } else {
-                std::cout << "Error in " << __FUNCTION__ << " (" << ec.value() << ") " << ec.message() << std::endl;
-            }
-        }
-        connection->close();
+        reportError(ec, connection);
     }
 }
 
 template <typename T1, typename T2>
-void TcpSerializeServer<T1, T2>::handleRead(const boost::system::error_code &ec, boost::shared_ptr<TcpSerializeConnection> connection)
+void TcpSerializeServer<T1, T2>::handleRead(const boost::system::error_code &ec, boost::shared_ptr<TcpSerializeConnection> connection,
+                                            boost::shared_ptr<T2> inboundData)
 {
     boost::lock_guard<boost::mutex> guard(m_mutex);
+    typename ClientMap::iterator it = m_clients.find(connection);
+    if(it == m_clients.end()) {
+        return;
+    }
     if(!ec) {
         //std::cout << "Data received from: " << connection.get() << std::endl;
+        m_inboundData = *inboundData;
+        if(connection->features() & FEATURE_STREAMING) {
+            // Negotiation just finished, switch this client to streaming
+            startStream(connection);
+            return;
+        }
         // Reply received, send more data
-        connection->sendData(m_outboundData, boost::bind(&TcpSerializeServer::handleWrite, this,
-            boost::asio::placeholders::error, connection));
+        sendFrame(connection, it->second);
+    } else {
+        reportError(ec, connection);
+    }
+}
+
+// Called with m_mutex held. The read and write sides of a streaming
+// connection run independently from here on.
+template <typename T1, typename T2>
+void TcpSerializeServer<T1, T2>::startStream(boost::shared_ptr<TcpSerializeConnection> connection)
+{
+    ClientState &state = m_clients[connection];
+    state.isWriting = false;
+    // Send the current frame straight away
+    state.sentGeneration = m_frame.generation - 1;
+    receiveFrame(connection, true);
+    writeStream(connection);
+}
+
+// Called with m_mutex held. Sends the newest frame if the connection is idle,
+// has not seen it yet, is within its ack window and its frame rate limit.
+// Frames produced while the connection is busy are skipped, the slow consumer
+// policy decides whether it is closed instead. Frames skipped for the rate
+// limit are not held against it.
+template <typename T1, typename T2>
+void TcpSerializeServer<T1, T2>::writeStream(boost::shared_ptr<TcpSerializeConnection> connection)
+{
+    typename ClientMap::iterator it = m_clients.find(connection);
+    if(it == m_clients.end() || !(connection->features() & FEATURE_STREAMING)) {
+        return;
+    }
+    ClientState &state = it->second;
+    if(state.sentGeneration == m_frame.generation) {
+        return;
+    }
+    if(state.isWriting || !connection->canSendFrame()) {
+        if(m_slowConsumerPolicy == SLOW_CONSUMER_DISCONNECT
+                && m_frame.generation - state.sentGeneration > m_maxLag) {
+            std::cout << "Closing slow client " << connection.get() << ", "
+                << m_frame.generation - state.sentGeneration << " frames behind" << std::endl;
+            dropClient(connection);
+        }
+        return;
+    }
+    if(isPaced(connection, state)) {
+        return;
+    }
+    state.isWriting = true;
+    sendFrame(connection, state);
+}
+
+// Called with m_mutex held. Returns true if the connection has to wait for
+// its next frame, the pace timer then sends the newest frame at that time.
+template <typename T1, typename T2>
+bool TcpSerializeServer<T1, T2>::isPaced(boost::shared_ptr<TcpSerializeConnection> connection, ClientState &state)
+{
+    if(state.isPaced) {
+        return true;
+    }
+    if(connection->remoteMinFrameInterval() == 0) {
+        return false;
+    }
+    boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+    boost::posix_time::time_duration interval = boost::posix_time::microseconds(connection->remoteMinFrameInterval());
+    boost::posix_time::time_duration wait = state.sentTime.is_not_a_date_time()
+        ? boost::posix_time::time_duration() : state.sentTime + interval - now;
+    // A wait longer than the interval means the clock was set back
+    if(wait <= boost::posix_time::time_duration() || wait > interval) {
+        state.sentTime = now;
+        return false;
+    }
+    if(!state.paceTimer) {
+        state.paceTimer.reset(new boost::asio::deadline_timer(*m_ioService));
+    }
+    state.paceTimer->expires_from_now(wait);
+    state.paceTimer->async_wait(boost::bind(&TcpSerializeServer::handlePaceTimer, this,
+        boost::asio::placeholders::error, connection));
+    state.isPaced = true;
+    return true;
+}
+
+template <typename T1, typename T2>
+void TcpSerializeServer<T1, T2>::handlePaceTimer(const boost::system::error_code &ec, boost::shared_ptr<TcpSerializeConnection> connection)
+{
+    boost::lock_guard<boost::mutex> guard(m_mutex);
+    typename ClientMap::iterator it = m_clients.find(connection);
+    if(ec || it == m_clients.end()) {
+        return;
+    }
+    it->second.isPaced = false;
+    writeStream(connection);
+}
+
+template <typename T1, typename T2>
+void TcpSerializeServer<T1, T2>::flushStreams()
+{
+    boost::lock_guard<boost::mutex> guard(m_mutex);
+    typename ClientMap::iterator it = m_clients.begin();
+    while(it != m_clients.end()) {
+        // writeStream may drop the client, step past it first
+        boost::shared_ptr<TcpSerializeConnection> connection = (it++)->first;
+        writeStream(connection);
+    }
+}
+
+template <typename T1, typename T2>
+void TcpSerializeServer<T1, T2>::handleStreamWrite(const boost::system::error_code &ec, boost::shared_ptr<TcpSerializeConnection> connection)
+{
+    boost::lock_guard<boost::mutex> guard(m_mutex);
+    if(!ec) {
+        typename ClientMap::iterator it = m_clients.find(connection);
+        if(it != m_clients.end()) {
+            it->second.isWriting = false;
+            writeStream(connection);
+        }
+    } else {
+        reportError(ec, connection);
+    }
+}
+
+template <typename T1, typename T2>
+void TcpSerializeServer<T1, T2>::handleStreamRead(const boost::system::error_code &ec, boost::shared_ptr<TcpSerializeConnection> connection,
+                                                  boost::shared_ptr<T2> inboundData)
+{
+    boost::lock_guard<boost::mutex> guard(m_mutex);
+    typename ClientMap::iterator it = m_clients.find(connection);
+    if(it == m_clients.end()) {
+        return;
+    }
+    if(!ec) {
+        // Either a viewer command or an ack that may have opened the window
+        m_inboundData = *inboundData;
+        writeStream(connection);
+        receiveFrame(connection, true);
+    } else {
+        reportError(ec, connection);
+    }
+}
+
+// Serializes data as a whole frame or, for a subscription, as a
+// FieldMaskedFrame. Returns an empty pointer if serialization failed.
+template <typename T1, typename T2>
+boost::shared_ptr<const std::string> TcpSerializeServer<T1, T2>::serializeFrame(const T1 &data, const ArchiveKey &key)
+{
+    boost::shared_ptr<std::string> archive(new std::string);
+    bool isSerialized;
+    if(key.fieldMask == FIELD_MASK_ALL) {
+        isSerialized = serializeArchive(data, key.format, *archive);
+    } else {
+        // Saving never modifies the frame
+        FieldMaskedFrame<T1> frame(const_cast<T1 &>(data), key.fieldMask);
+        isSerialized = serializeArchive(frame, key.format, *archive);
+    }
+    if(!isSerialized) {
+        return boost::shared_ptr<const std::string>();
+    }
+    return archive;
+}
+
+// Called with m_mutex held. Returns the archive of the newest frame in the
+// connection's format and subscription, serializing it here only if
+// setOutboundData did not.
+template <typename T1, typename T2>
+boost::shared_ptr<const std::string> TcpSerializeServer<T1, T2>::getArchive(boost::shared_ptr<TcpSerializeConnection> connection,
+    ClientState &state)
+{
+    ArchiveKey key(connection->wireFormat(), connection->remoteFieldMask());
+    if(!(key == state.archiveKey)) {
+        state.archiveKey = key;
+        // Stop serializing the previous subscription if nobody else uses it
+        updateArchivesInUse();
+    }
+    for(size_t i = 0; i < m_frame.archives.size(); i++) {
+        if(m_frame.archives[i].key == key) {
+            return m_frame.archives[i].archive;
+        }
+    }
+    OutboundArchive archive;
+    archive.key = key;
+    archive.archive = serializeFrame(*m_frame.data, key);
+    if(!archive.archive) {
+        archive.archive.reset(new std::string);
+    }
+    m_frame.archives.push_back(archive);
+    return archive.archive;
+}
+
+// Called with m_mutex held
+template <typename T1, typename T2>
+void TcpSerializeServer<T1, T2>::sendFrame(boost::shared_ptr<TcpSerializeConnection> connection, ClientState &state)
+{
+    state.sentGeneration = m_frame.generation;
+    boost::shared_ptr<const std::string> archive = getArchive(connection, state);
+    bool isFieldMasked = state.archiveKey.fieldMask != FIELD_MASK_ALL;
+    if(connection->features() & FEATURE_STREAMING) {
+        connection->sendArchive(archive, boost::bind(&TcpSerializeServer::handleStreamWrite, this,
+            boost::asio::placeholders::error, connection), m_frame.simTime, isFieldMasked);
+    } else {
+        connection->sendArchive(archive, boost::bind(&TcpSerializeServer::handleWrite, this,
+            boost::asio::placeholders::error, connection), m_frame.simTime, isFieldMasked);
+    }
+}
+
+// Called with m_mutex held
+template <typename T1, typename T2>
+void TcpSerializeServer<T1, T2>::receiveFrame(boost::shared_ptr<TcpSerializeConnection> connection, bool isStreaming)
+{
+    typename ClientMap::iterator it = m_clients.find(connection);
+    if(it == m_clients.end()) {
+        return;
+    }
+    boost::shared_ptr<T2> inboundData = it->second.inboundData;
+    if(isStreaming) {
+        connection->receiveData(*inboundData, boost::bind(&TcpSerializeServer::handleStreamRead, this,
+            boost::asio::placeholders::error, connection, inboundData));
     } else {
-        // Catch most common errors and replace error message with a nicer message
+        connection->receiveData(*inboundData, boost::bind(&TcpSerializeServer::handleRead, this,
+            boost::asio::placeholders::error, connection, inboundData));
+    }
+}
+
+// Called with m_mutex held
+template <typename T1, typename T2>
+void TcpSerializeServer<T1, T2>::reportError(const boost::system::error_code &ec, boost::shared_ptr<TcpSerializeConnection> connection)
+{
+    if(ec == boost::asio::error::operation_aborted || m_clients.find(connection) == m_clients.end()) {
+        // Already closed from the other direction
+        return;
+    }
+    // Catch most common errors and replace error message with a nicer message
 #ifdef WIN32
-        if(ec.value() == 10054) {
+    if(ec.value() == 10054) {
 #else
-        if(ec.value() == 2) {
+    if(ec.value() == 2) {
 #endif
-            std::cout << "Connection closed by client " << connection.get() << std::endl;
-        } else {
-            // An error occured
-            if(ec == boost::asio::error::operation_aborted) {
-                return;
-            } else {
-                std::cout << "Error in " << __FUNCTION__ << " (" << ec.value() << ") " << ec.message() << std::endl;
-            }
+        std::cout << "Connection closed by client " << connection.get() << std::endl;
+    } else {
+        // An error occured
+        std::cout << "Error in " << __FUNCTION__ << " (" << ec.value() << ") " << ec.message() << std::endl;
+    }
+    dropClient(connection);
+}
+
+// Called with m_mutex held
+template <typename T1, typename T2>
+void TcpSerializeServer<T1, T2>::dropClient(boost::shared_ptr<TcpSerializeConnection> connection)
+{
+    typename ClientMap::iterator it = m_clients.find(connection);
+    if(it != m_clients.end() && it->second.paceTimer) {
+        it->second.paceTimer->cancel();
+    }
+    m_clients.erase(connection);
+    connection->close();
+    // Stop serializing archives nobody uses anymore
+    updateArchivesInUse();
+}
+
+// Called with m_mutex held. Only archives some client currently uses are
+// serialized ahead of time, getArchive serializes any other one on demand.
+template <typename T1, typename T2>
+void TcpSerializeServer<T1, T2>::updateArchivesInUse()
+{
+    m_archivesInUse.clear();
+    for(typename ClientMap::iterator it = m_clients.begin(); it != m_clients.end(); ++it) {
+        const ArchiveKey &key = it->second.archiveKey;
+        if(std::find(m_archivesInUse.begin(), m_archivesInUse.end(), key) == m_archivesInUse.end()) {
+            m_archivesInUse.push_back(key);
         }
-        connection->close();
     }
 }
 
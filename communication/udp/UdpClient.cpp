@@ -25,9 +25,14 @@
 
 #include "UdpClient.hpp"
 
+#ifndef UDP_RECEIVE_BUFFER_SIZE
+#define UDP_RECEIVE_BUFFER_SIZE (1 << 20)
+#endif
+
 UdpClient::UdpClient(boost::asio::io_service *ioService)
 {
     m_stream.reset(new boost::asio::ip::udp::socket(*ioService));
+    m_inboundBuffer.resize(STREAM_BUFFER_SIZE);
 }
 
 int UdpClient::connect(std::string multicastAddress, std::string portNum, std::string ipAddress)
@@ -68,6 +73,9 @@ int UdpClient::connect(std::string multicastAddress, std::string portNum, std::s
         std::cout << "Error in " << __FUNCTION__ << " (" << ec.value() << ") " << ec.message() << std::endl;
         return 1;
     }
+    // A frame arrives as a burst of fragments, give the socket room to hold
+    // a few frames while the owner is not polling. Not fatal if refused.
+    m_stream->set_option(boost::asio::socket_base::receive_buffer_size(UDP_RECEIVE_BUFFER_SIZE), ec);
 
     m_stream->async_receive_from(
         boost::asio::buffer(m_inboundBuffer),
@@ -89,6 +97,7 @@ bool UdpClient::receiveData(std::vector<char> &data)
 void UdpClient::handleAsyncReceiveFrom(const boost::system::error_code &ec, size_t bytesReceived)
 {
     if(!ec) {
+        handleDatagram(&m_inboundBuffer[0], bytesReceived);
         m_stream->async_receive_from(
             boost::asio::buffer(m_inboundBuffer),
             m_senderEndpoint,
@@ -41,6 +41,10 @@ public:
 
     virtual bool receiveData(std::vector<char> &data);
 
+protected:
+    // Called for every datagram received while the io_service is polled
+    virtual void handleDatagram(const char *data, size_t size) {}
+
 private:
     virtual void handleAsyncReceiveFrom(const boost::system::error_code &error, size_t bytesReceived);
     boost::asio::ip::udp::endpoint m_senderEndpoint;
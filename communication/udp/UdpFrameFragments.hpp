@@ -0,0 +1,204 @@
+/*
+ ISC License
+
+ Copyright (c) 2016-2017, Autonomous Vehicle Systems Lab, University of Colorado at Boulder
+
+ Permission to use, copy, modify, and/or distribute this software for any
+ purpose with or without fee is hereby granted, provided that the above
+ copyright notice and this permission notice appear in all copies.
+
+ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+//
+// UdpFrameFragments.hpp
+//
+// University of Colorado, Autonomous Vehicle Systems (AVS) Lab
+// Unpublished Copyright (c) 2012-2015 University of Colorado, All Rights Reserved
+//
+
+#ifndef UDP_FRAME_FRAGMENTS_HPP
+#define UDP_FRAME_FRAGMENTS_HPP
+
+#include "FrameDelta.hpp"
+
+#include <boost/cstdint.hpp>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Serialized frames are split into datagrams that fit a typical Ethernet MTU.
+// Every datagram starts with a fixed header, all integers little endian:
+//   uint32 frame sequence, uint32 frame size, uint32 fragment index,
+//   uint32 fragment count, uint32 flags (WireFormat_t of the archive)
+// followed by at most UDP_FRAGMENT_PAYLOAD_SIZE bytes of the frame.
+#ifndef UDP_FRAGMENT_PAYLOAD_SIZE
+#define UDP_FRAGMENT_PAYLOAD_SIZE 1400
+#endif
+
+#define UDP_FRAGMENT_HEADER_SIZE 20
+
+// Largest frame a receiver reassembles, larger frame sizes in a header are
+// treated as corrupt rather than allocated
+#ifndef UDP_MAX_FRAME_SIZE
+#define UDP_MAX_FRAME_SIZE (16 * 1024 * 1024)
+#endif
+
+// A sequence this many frames behind the newest one means the publisher
+// restarted its count, closer ones are just late datagrams
+#ifndef UDP_SEQUENCE_RESTART_WINDOW
+#define UDP_SEQUENCE_RESTART_WINDOW 64
+#endif
+
+inline void formatFragmentHeader(std::string &header, boost::uint32_t sequence, boost::uint32_t frameSize,
+    boost::uint32_t index, boost::uint32_t count, boost::uint32_t flags)
+{
+    header.clear();
+    appendUint32(header, sequence);
+    appendUint32(header, frameSize);
+    appendUint32(header, index);
+    appendUint32(header, count);
+    appendUint32(header, flags);
+}
+
+// Rebuilds frames from fragments. Only the newest frame is of interest:
+// a fragment of a newer frame abandons the one in progress, fragments of
+// slightly older frames are ignored and a lost fragment simply loses its
+// frame. A sequence far behind the newest one starts over, since the
+// publisher restarted.
+class FrameReassembler
+{
+public:
+    FrameReassembler()
+        : m_hasFrame(false)
+        , m_isNewFrame(false)
+        , m_frameSequence(0)
+        , m_frameFlags(0)
+        , m_isAssembling(false)
+        , m_sequence(0)
+        , m_flags(0)
+        , m_fragmentsReceived(0)
+        , m_framesCompleted(0)
+        , m_framesLost(0)
+    {
+
+    }
+
+    // Returns true if the datagram completed a frame
+    bool addFragment(const char *data, size_t size)
+    {
+        if(size < UDP_FRAGMENT_HEADER_SIZE) {
+            return false;
+        }
+        boost::uint32_t sequence = readUint32(data);
+        boost::uint32_t frameSize = readUint32(data + 4);
+        boost::uint32_t index = readUint32(data + 8);
+        boost::uint32_t count = readUint32(data + 12);
+        boost::uint32_t flags = readUint32(data + 16);
+        const char *payload = data + UDP_FRAGMENT_HEADER_SIZE;
+        size_t payloadSize = size - UDP_FRAGMENT_HEADER_SIZE;
+
+        if(frameSize > UDP_MAX_FRAME_SIZE) {
+            return false;
+        }
+        size_t expectedCount = (frameSize + UDP_FRAGMENT_PAYLOAD_SIZE - 1) / UDP_FRAGMENT_PAYLOAD_SIZE;
+        if(count == 0 || count != expectedCount || index >= count) {
+            return false;
+        }
+        size_t offset = (size_t)index * UDP_FRAGMENT_PAYLOAD_SIZE;
+        size_t expectedSize = index + 1 < count ? UDP_FRAGMENT_PAYLOAD_SIZE : frameSize - offset;
+        if(payloadSize != expectedSize) {
+            return false;
+        }
+
+        // Sequence numbers wrap, compare them by their signed distance
+        if((m_hasFrame && (boost::int32_t)(m_frameSequence - sequence) > UDP_SEQUENCE_RESTART_WINDOW)
+                || (m_isAssembling && (boost::int32_t)(m_sequence - sequence) > UDP_SEQUENCE_RESTART_WINDOW)) {
+            if(m_isAssembling) {
+                m_framesLost++;
+            }
+            m_hasFrame = false;
+            m_isAssembling = false;
+        }
+        if(m_hasFrame && (boost::int32_t)(sequence - m_frameSequence) <= 0) {
+            return false;
+        }
+        if(m_isAssembling && sequence != m_sequence) {
+            if((boost::int32_t)(sequence - m_sequence) < 0) {
+                return false;
+            }
+            // A newer frame started before the current one was complete
+            m_framesLost++;
+            m_isAssembling = false;
+        }
+        if(!m_isAssembling) {
+            m_isAssembling = true;
+            m_sequence = sequence;
+            m_flags = flags;
+            m_buffer.resize(frameSize);
+            m_received.assign(count, false);
+            m_fragmentsReceived = 0;
+        }
+        if(m_received[index]) {
+            return false;
+        }
+        m_received[index] = true;
+        m_fragmentsReceived++;
+        std::memcpy(&m_buffer[offset], payload, payloadSize);
+
+        if(m_fragmentsReceived < m_received.size()) {
+            return false;
+        }
+        m_isAssembling = false;
+        m_frame.swap(m_buffer);
+        m_frameSequence = m_sequence;
+        m_frameFlags = m_flags;
+        m_hasFrame = true;
+        m_isNewFrame = true;
+        m_framesCompleted++;
+        return true;
+    }
+
+    // Hands out the newest complete frame once, returns false if there is no
+    // frame newer than the last one taken
+    bool takeFrame(const std::string *&frame, int &flags)
+    {
+        if(!m_isNewFrame) {
+            return false;
+        }
+        m_isNewFrame = false;
+        frame = &m_frame;
+        flags = (int)m_frameFlags;
+        return true;
+    }
+
+    unsigned long framesCompleted() { return m_framesCompleted; }
+    unsigned long framesLost() { return m_framesLost; }
+
+private:
+    // Newest complete frame
+    std::string m_frame;
+    bool m_hasFrame;
+    bool m_isNewFrame;
+    boost::uint32_t m_frameSequence;
+    boost::uint32_t m_frameFlags;
+
+    // Frame being assembled
+    bool m_isAssembling;
+    boost::uint32_t m_sequence;
+    boost::uint32_t m_flags;
+    std::string m_buffer;
+    std::vector<bool> m_received;
+    size_t m_fragmentsReceived;
+
+    unsigned long m_framesCompleted;
+    unsigned long m_framesLost;
+};
+
+#endif // UDP_FRAME_FRAGMENTS_HPP
@@ -27,11 +27,13 @@
 #define UDP_SERIALIZE_CLIENT_H
 
 #include "UdpClient.hpp"
+#include "UdpFrameFragments.hpp"
+#include "SerializeArchive.hpp"
 
 #include <iostream>
-#include <sstream>
-#include <boost/archive/text_iarchive.hpp>
 
+// Receives frames published by UdpSerializeServer. Only the newest complete
+// frame is kept, frames that lose a fragment are skipped.
 template <typename T>
 class UdpSerializeClient
     : public UdpClient
@@ -39,35 +41,47 @@ class UdpSerializeClient
 public:
     UdpSerializeClient(boost::asio::io_service *ioService);
 
+    // Polls the socket and extracts the newest complete frame into data.
+    // Returns 0 if data was updated, 1 if no new frame arrived since the last call.
     int getData(T *data);
+
+    unsigned long framesReceived() { return m_reassembler.framesCompleted(); }
+    unsigned long framesLost() { return m_reassembler.framesLost(); }
+
+protected:
+    virtual void handleDatagram(const char *data, size_t size);
+
+private:
+    FrameReassembler m_reassembler;
 };
 
 template <typename T>
-UdpSerializeClient::UdpSerializeClient(boost::asio::io_service *ioService)
+UdpSerializeClient<T>::UdpSerializeClient(boost::asio::io_service *ioService)
     : UdpClient(ioService)
 {
 }
 
 template <typename T>
-int UdpSerializeClient::receiveSpacecraftSimData(T *data)
+int UdpSerializeClient<T>::getData(T *data)
 {
-    m_stream->get_io_service().poll()
-    if(m_inboundBuffer.empty()) {
-        std::cout << "Received nothing" << std::endl;
-    } else {
-        std::string s(&m_inboundBuffer[0]);
-        std::istringstream archiveStream(s, std::istringstream::binary | std::istringstream::in);
-        try {
-            boost::archive::text_iarchive archive(archiveStream);
-            archive >> *data;
-        } catch(boost::archive::archive_exception e) {
-            std::cout << "Error occured: " << e.what() << std::endl;
-            return 1;
-        }
-
-        std::cout << "Received: " << archiveStream.str() << std::endl;
+    m_stream->get_io_service().poll();
+
+    const std::string *frame = 0;
+    int flags = 0;
+    if(!m_reassembler.takeFrame(frame, flags)) {
+        return 1;
+    }
+    WireFormat_t format = flags == WIRE_FORMAT_BINARY ? WIRE_FORMAT_BINARY : WIRE_FORMAT_TEXT;
+    if(!deserializeArchive(frame->data(), frame->size(), format, *data)) {
+        return 1;
     }
     return 0;
 }
 
-#endif
\ No newline at end of file
+template <typename T>
+void UdpSerializeClient<T>::handleDatagram(const char *data, size_t size)
+{
+    m_reassembler.addFragment(data, size);
+}
+
+#endif
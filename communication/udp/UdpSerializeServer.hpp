@@ -27,11 +27,14 @@
 #define UDP_SERIALIZE_SERVER_H
 
 #include "UdpServer.hpp"
+#include "UdpFrameFragments.hpp"
+#include "SerializeArchive.hpp"
 
 #include <iostream>
-#include <sstream>
-#include <boost/archive/text_oarchive.hpp>
 
+// Publishes serialized frames to a multicast group. Each frame is split into
+// fragments (see UdpFrameFragments.hpp), so the cost of sending does not
+// depend on the number of viewers that joined the group.
 template <typename T>
 class UdpSerializeServer
     : public UdpServer
@@ -40,11 +43,23 @@ public:
     UdpSerializeServer(boost::asio::io_service *ioService);
 
     int sendData(T *data);
+
+    // Binary archives are smaller and faster, but every receiver must share
+    // the sender's data layout since there is no handshake on multicast
+    void setWireFormat(WireFormat_t format) { m_wireFormat = format; }
+
+private:
+    WireFormat_t m_wireFormat;
+    boost::uint32_t m_sequence;
+    std::string m_frame;
+    std::string m_fragmentHeader;
 };
 
 template <typename T>
 UdpSerializeServer<T>::UdpSerializeServer(boost::asio::io_service *ioService)
     : UdpServer(ioService)
+    , m_wireFormat(WIRE_FORMAT_BINARY)
+    , m_sequence(0)
 {
 }
 
@@ -52,22 +67,31 @@ template <typename T>
 int UdpSerializeServer<T>::sendData(T *data)
 {
     // Serialize the data
-    std::ostringstream archiveStream;
-    boost::archive::text_oarchive archive(archiveStream);
-    archive << const_cast<const SpacecraftSim &>(*data);
-    unsigned int dataSize = archiveStream.str().length();
-    if(dataSize > STREAM_BUFFER_SIZE) {
-        std::cout << "Error in " << __FUNCTION__ << ": data exceeds stream buffer size" << std::endl;
+    if(!serializeArchive(*data, m_wireFormat, m_frame)) {
         return 1;
     }
-    m_outboundBuffer = archiveStream.str();
-
-    //std::cout << "Sending data" << std::endl;
-    std::cout << "Sending: " << m_outboundBuffer << std::endl;
+    size_t frameSize = m_frame.size();
+    if(frameSize > UDP_MAX_FRAME_SIZE) {
+        std::cout << "Error in " << __FUNCTION__ << " frame of " << frameSize << " bytes is too large" << std::endl;
+        return 1;
+    }
+    size_t count = (frameSize + UDP_FRAGMENT_PAYLOAD_SIZE - 1) / UDP_FRAGMENT_PAYLOAD_SIZE;
+    m_sequence++;
 
-    setNewBuffer();
-    asyncSendTo();
+    for(size_t index = 0; index < count; index++) {
+        size_t offset = index * UDP_FRAGMENT_PAYLOAD_SIZE;
+        size_t length = frameSize - offset < UDP_FRAGMENT_PAYLOAD_SIZE ? frameSize - offset : UDP_FRAGMENT_PAYLOAD_SIZE;
+        formatFragmentHeader(m_fragmentHeader, m_sequence, (boost::uint32_t)frameSize,
+            (boost::uint32_t)index, (boost::uint32_t)count, (boost::uint32_t)m_wireFormat);
+        std::vector<boost::asio::const_buffer> buffers;
+        buffers.push_back(boost::asio::buffer(m_fragmentHeader));
+        buffers.push_back(boost::asio::buffer(m_frame.data() + offset, length));
+        if(!sendDatagram(buffers)) {
+            // The rest of the frame is useless to the receivers
+            return 1;
+        }
+    }
     return 0;
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -57,12 +57,7 @@ int UdpServer::startBroadcast(std::string multicastAddress, std::string portNum)
         std::cout << "Error in " << __FUNCTION__ << " (" << ec.value() << ") " << ec.message() << std::endl;
         return 1;
     }
-
-    m_stream->async_send_to(
-        boost::asio::buffer(m_outboundBuffer),
-        m_endpoint,
-        boost::bind(&UdpServer::handleAsyncSendTo, this,
-                    boost::asio::placeholders::error));
+    m_isNewBuffer = false;
 
     return 0;
 }
@@ -78,6 +73,17 @@ bool UdpServer::sendData(std::string data)
     return true;
 }
 
+bool UdpServer::sendDatagram(const std::vector<boost::asio::const_buffer> &buffers)
+{
+    boost::system::error_code ec;
+    m_stream->send_to(buffers, m_endpoint, 0, ec);
+    if(ec) {
+        std::cout << "Error in " << __FUNCTION__ << " (" << ec.value() << ") " << ec.message() << std::endl;
+        return false;
+    }
+    return true;
+}
+
 void UdpServer::asyncSendTo()
 {
     m_stream->async_send_to(
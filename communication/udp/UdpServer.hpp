@@ -40,6 +40,9 @@ public:
     virtual bool sendData(std::string data);
 
 protected:
+    // Sends one datagram made of several buffers right away, used for
+    // fragments that must not wait for each other
+    bool sendDatagram(const std::vector<boost::asio::const_buffer> &buffers);
     void setNewBuffer() {
         m_isNewBuffer = true;
     }
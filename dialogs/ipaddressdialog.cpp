@@ -24,6 +24,15 @@ IpAddressDialog::IpAddressDialog(QWidget *parent) :
     ui(new Ui::IpAddressDialog)
 {
     ui->setupUi(this);
+    // Only offer the codecs this build supports
+    ui->compression->addItem("None", COMPRESSION_NONE);
+    if(availableCompressions() & COMPRESSION_LZ4) {
+        ui->compression->addItem("LZ4 (fast)", COMPRESSION_LZ4);
+    }
+    if(availableCompressions() & COMPRESSION_ZSTD) {
+        ui->compression->addItem("zstd (smallest)", COMPRESSION_ZSTD);
+    }
+    ui->compression->setEnabled(ui->compression->count() > 1);
 }
 
 IpAddressDialog::~IpAddressDialog()
@@ -40,3 +49,8 @@ QString IpAddressDialog::getPort()
 {
     return ui->port->text();
 }
+
+Compression_t IpAddressDialog::getCompression()
+{
+    return (Compression_t)ui->compression->currentData().toInt();
+}
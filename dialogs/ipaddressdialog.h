@@ -20,6 +20,7 @@
 #define IPADDRESSDIALOG_H
 
 #include <QDialog>
+#include "FrameCompression.hpp"
 
 namespace Ui
 {
@@ -36,6 +37,7 @@ public:
 
     QString getIpAddress();
     QString getPort();
+    Compression_t getCompression();
 
 private:
     Ui::IpAddressDialog *ui;
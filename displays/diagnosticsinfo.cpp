@@ -0,0 +1,90 @@
+/*
+ ISC License
+
+ Copyright (c) 2016-2017, Autonomous Vehicle Systems Lab, University of Colorado at Boulder
+
+ Permission to use, copy, modify, and/or distribute this software for any
+ purpose with or without fee is hereby granted, provided that the above
+ copyright notice and this permission notice appear in all copies.
+
+ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+#include "diagnosticsinfo.h"
+#include "ui_diagnosticsinfo.h"
+
+#include <QHeaderView>
+
+DiagnosticsInfo::DiagnosticsInfo(QWidget *parent) :
+    QDockWidget(parent)
+    , ui(new Ui::DiagnosticsInfo)
+{
+    ui->setupUi(this);
+    QStringList columns;
+    columns << "Mean" << "p50" << "p99" << "Max";
+    QStringList rows;
+    rows << "Network" << "Decode" << "Handover" << "Scene" << "Present" << "Total";
+    ui->latencyTable->setColumnCount(columns.size());
+    ui->latencyTable->setRowCount(MAX_LATENCY_STAGE);
+    ui->latencyTable->setHorizontalHeaderLabels(columns);
+    ui->latencyTable->setVerticalHeaderLabels(rows);
+    ui->latencyTable->horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
+    for(int i = 0; i < MAX_LATENCY_STAGE; i++) {
+        for(int j = 0; j < columns.size(); j++) {
+            QTableWidgetItem *item = new QTableWidgetItem("-");
+            item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+            ui->latencyTable->setItem(i, j, item);
+        }
+    }
+}
+
+DiagnosticsInfo::~DiagnosticsInfo()
+{
+    delete ui;
+}
+
+void DiagnosticsInfo::saveSettings(QSettings *settings)
+{
+    settings->beginGroup("diagnosticsInfo");
+    settings->setValue("geometry", saveGeometry());
+    settings->setValue("floating", isFloating());
+    settings->setValue("pos", pos());
+    settings->setValue("size", size());
+    settings->endGroup();
+}
+
+void DiagnosticsInfo::loadSettings(QSettings *settings)
+{
+    settings->beginGroup("diagnosticsInfo");
+    restoreGeometry(settings->value("geometry").toByteArray());
+    setFloating(settings->value("floating").toBool());
+    move(settings->value("pos", pos()).toPoint());
+    resize(settings->value("size", size()).toSize());
+    settings->endGroup();
+}
+
+void DiagnosticsInfo::updateDiagnostics(AdcsSimDataManager *simDataManager)
+{
+    PipelineDiagnostics diagnostics = simDataManager->getDiagnostics();
+    if(diagnostics.interval <= 0.0) {
+        ui->rates->setText("Not connected");
+    } else {
+        ui->rates->setText(QString("Received: %1 frames/s, %2 kB/s\nDisplayed: %3 frames/s\nDropped: %4 of %5 frames")
+            .arg(diagnostics.framesPerSecond, 0, 'f', 1).arg(diagnostics.bytesPerSecond / 1024.0, 0, 'f', 1)
+            .arg(diagnostics.displayedPerSecond, 0, 'f', 1)
+            .arg(diagnostics.framesDropped).arg(diagnostics.framesReceived));
+    }
+    for(int i = 0; i < MAX_LATENCY_STAGE; i++) {
+        const LatencyHistogram &histogram = diagnostics.stages[i];
+        double values[4] = { histogram.mean(), histogram.percentile(50.0), histogram.percentile(99.0), histogram.max() };
+        for(int j = 0; j < 4; j++) {
+            ui->latencyTable->item(i, j)->setText(histogram.count() > 0 ? QString::number(values[j], 'f', 2) : QString("-"));
+        }
+    }
+}
@@ -16,31 +16,31 @@
  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
  */
-//
-//  jsonParser.hpp
-//  Visualization
-//
-//  Created by Patrick Kenneally on 8/9/16.
-//
-//
-
-#ifndef jsonParser_hpp
-#define jsonParser_hpp
-
-#include <stdio.h>
-#include <iostream>
-#include <boost/property_tree/ptree.hpp>
-
-class JsonParser {
-    
+#ifndef DIAGNOSTICSINFO_H
+#define DIAGNOSTICSINFO_H
+
+#include <QDockWidget>
+#include <QSettings>
+#include "adcssimdatamanager.h"
+
+namespace Ui {
+class DiagnosticsInfo;
+}
+
+// Latency per pipeline stage, rates and drops of the connection
+class DiagnosticsInfo : public QDockWidget
+{
+    Q_OBJECT
+
 public:
-    JsonParser();
-    ~JsonParser();
-    std::string parseToJson();
-    void parseFromJson();
-    
+    explicit DiagnosticsInfo(QWidget *parent = 0);
+    ~DiagnosticsInfo();
+    void saveSettings(QSettings *settings);
+    void loadSettings(QSettings *settings);
+    void updateDiagnostics(AdcsSimDataManager *simDataManager);
+
 private:
-    boost::property_tree::ptree root;
+    Ui::DiagnosticsInfo *ui;
 };
 
-#endif /* jsonParser_hpp */
+#endif // DIAGNOSTICSINFO_H
@@ -40,6 +40,7 @@ PlaybackControls::PlaybackControls(QWidget *parent)
     , m_rawPlaySpeedPrev(1.0)
     , m_playSpeedPrev(1.0)
     , m_isSettingPlaySpeed(false)
+    , m_mode(PLAYBACK_STREAM)
     //, m_initialPlaySpeed(1.0)
 {
     ui->setupUi(this);
@@ -111,9 +112,8 @@ PlaybackControls::PlaybackControls(QWidget *parent)
     ui->slowerLabel->hide();
     ui->fasterLabel->hide();
 
-    //@TODO: Currently the playbackcontrols are configured for streaming (i.e. time editing, and go to
-    // beginning and end buttons are disabled). If the option to play from a file becomes available this
-    // needs to be updated to properly handle those inputs.
+    // Start out configured for streaming (i.e. time editing, and go to beginning and end buttons
+    // are disabled), the time controls are enabled by setMode(PLAYBACK_FILE) once a recording is opened.
     setMode(PLAYBACK_STREAM);
     
     // Necessary to avoid weird things happening when Visualization is paused, closed and reopened
@@ -147,6 +147,11 @@ void PlaybackControls::loadSettings(QSettings *settings)
 //    settings->endGroup();
 }
 
+QDateTime PlaybackControls::j2000ToDateTime(double sec)
+{
+    return QDateTime(QDate(2000, 1, 1), QTime(12, 0), Qt::UTC).addMSecs(qRound64(sec * 1000.0));
+}
+
 void PlaybackControls::setDateTimeBounds(QDateTime timeInitial, QDateTime timeFinal)
 {
     if(timeInitial > timeFinal) {
@@ -182,7 +187,7 @@ void PlaybackControls::setDateTimeBounds(double jd0, double timeFinalSec)
 
 void PlaybackControls::setCurrentDateTime(double sec)
 {
-    setCurrentDateTime(seconds2QDateTime(sec));
+    setCurrentDateTime(j2000ToDateTime(sec));
 }
 
 void PlaybackControls::setCurrentDateTime(QDateTime time)
@@ -215,17 +220,24 @@ void PlaybackControls::setCurrentDateTime(QDateTime time)
     m_rawPlaySpeedPrev = rawPlaySpeed;
 
     // Update time
-//    m_dateTime = time;
-//    // Update slider
-//    double x0 = qDateTime2Seconds(m_dateTimeInitial);
-//    double x1 = qDateTime2Seconds(m_dateTimeFinal);
-//    double xi = qDateTime2Seconds(time);
-//    double y0 = (double)ui->timeSlider->minimum();
-//    double y1 = (double)ui->timeSlider->maximum();
-//    double yi = linearInterp(x0, x1, y0, y1, xi);
-//    ui->timeSlider->setValue(qRound(yi));
-//    // Update the time edit box
-//    ui->dateTimeEdit->setDateTime(time);
+    m_dateTime = time;
+    if(m_mode != PLAYBACK_FILE) {
+        return;
+    }
+    // Update slider, unless the user is dragging it
+    if(!ui->timeSlider->isSliderDown() && m_dateTimeFinal > m_dateTimeInitial) {
+        double x0 = qDateTime2Seconds(m_dateTimeInitial);
+        double x1 = qDateTime2Seconds(m_dateTimeFinal);
+        double xi = qDateTime2Seconds(time);
+        double y0 = (double)ui->timeSlider->minimum();
+        double y1 = (double)ui->timeSlider->maximum();
+        double yi = linearInterp(x0, x1, y0, y1, xi);
+        ui->timeSlider->setValue(qRound(yi));
+    }
+    // Update the time edit box, unless the user is editing it
+    if(!ui->dateTimeEdit->hasFocus()) {
+        ui->dateTimeEdit->setDateTime(time);
+    }
 }
 
 void PlaybackControls::setPlaySpeed(double value)
@@ -265,11 +277,19 @@ void PlaybackControls::setPlaySpeed(double value)
 
 void PlaybackControls::setMode(mode_t mode)
 {
+    m_mode = mode;
     bool enable = mode == PLAYBACK_FILE;
     ui->timeSlider->setEnabled(enable);
-    ui->dateTimeEdit->setReadOnly(enable);
+    ui->timeSlider->setVisible(enable);
+    ui->dateTimeEdit->setReadOnly(!enable);
+    ui->dateTimeEdit->setVisible(enable);
     ui->goToBeginningButton->setEnabled(enable);
+    ui->goToBeginningButton->setVisible(enable);
     ui->goToEndButton->setEnabled(enable);
+    ui->goToEndButton->setVisible(enable);
+    ui->actionGoToEnd->setVisible(enable);
+    ui->playPauseButton->setVisible(enable);
+    ui->actionPlayPause->setVisible(enable);
 }
 
 void PlaybackControls::requestPlayPause()
@@ -332,7 +352,7 @@ void PlaybackControls::requestDateTimeEnd()
 void PlaybackControls::requestDateTime(QDateTime time)
 {
     emit dateTimeRequested(time);
-    emit dateTimeRequested(m_dateTimeInitial.msecsTo(time) * 1000.0);
+    emit dateTimeRequested(m_dateTimeInitial.msecsTo(time) / 1000.0);
 }
 
 void PlaybackControls::timeSliderMoved(int value)
@@ -418,12 +438,12 @@ void PlaybackControls::updateTimeSliderMaximum(double maxSec)
 
 QDateTime PlaybackControls::seconds2QDateTime(double s)
 {
-    return m_dateTimeInitial.addSecs(s);
+    return m_dateTimeInitial.addMSecs(qRound64(s * 1000.0));
 }
 
 double PlaybackControls::qDateTime2Seconds(QDateTime time)
 {
-    int temp = m_dateTimeInitial.msecsTo(time);
+    qint64 temp = m_dateTimeInitial.msecsTo(time);
     return temp / 1000.0;
 }
 
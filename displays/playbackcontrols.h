@@ -47,6 +47,8 @@ public:
     void setDateTimeBounds(QDateTime timeInitial, QDateTime timeFinal);
     void setDateTimeBounds(QDateTime timeInitial, double timeFinalSec);
     void setDateTimeBounds(double jd0, double timeFinalSec);
+    // Converts seconds past J2000 as kept by the simulation
+    static QDateTime j2000ToDateTime(double sec);
     void saveSettings (QSettings *settings);
     void loadSettings (QSettings *settings);
 
@@ -58,6 +60,7 @@ signals:
     void estPlaySpeedUpdated(double);
 
 public slots:
+    // sec is in seconds past J2000
     void setCurrentDateTime(double sec);
     void setCurrentDateTime(QDateTime time);
     void setPlaySpeed(double value);
@@ -107,6 +110,7 @@ private:
     // Value of time multiplier when time toggle pressed
     double m_playSpeedPrev;
     bool m_isSettingPlaySpeed;
+    mode_t m_mode;
 
     void updateTimeSliderMaximum(double maxSec);
 
@@ -19,6 +19,7 @@
 #include "startrackerinfo.h"
 #include "ui_startrackerinfo.h"
 #include "projectMacros.h"
+#include "EphemerisCache.hpp"
 
 extern "C"
 {
@@ -266,10 +267,12 @@ void StarTrackerInfo::updateST(AdcsSimDataManager *simDataManager)
     switch(celestBody) {
         case CELESTIAL_EARTH:
             break;
-        case CELESTIAL_MARS:
+        case CELESTIAL_MARS: {
+            boost::mutex::scoped_lock lock(EphemerisCache::spiceMutex());
             pxform_c("MARSIAU", "J2000", scSim->ics.ET0 + scSim->time, inertialCelestialBodytoJ2000);
             m33MultM33(inertialCelestialBodytoJ2000, NB, NB);
             break;
+        }
         default:
             printf("WARNING: un-implemented celestial object in Star Tracker View.\n");
             break;
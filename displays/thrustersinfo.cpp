@@ -39,6 +39,7 @@ ThrustersInfo::ThrustersInfo(QWidget *parent, AdcsSimDataManager *simData)
 //    m_button(new QPushButton(this)),
 //    m_label (new QLabel(this)),
     , m_legend (new QProgressBar(this))
+    , m_sampledTime(0.0)
 {
     m_simDataManager = simData;
     this->ui->setupUi(this);
@@ -270,6 +271,38 @@ void ThrustersInfo::showLevelContextMenu(const QPoint &pos)
     menu->exec(ui->ACS_ThrustersGroup->mapToGlobal(pos));
 }
 
+// Counts the simulation steps since the last update in which each ACS
+// thruster fired, from the samples of simulations that batch their steps.
+// Pulses shorter than the display period are invisible in the displayed
+// state alone. steps is 0 if there are no samples.
+void ThrustersInfo::updateFiredSteps(AdcsSimDataManager *simDataManager, std::vector<int> &firedSteps, int &steps)
+{
+    SpacecraftSim *scSim = simDataManager->getSpacecraftSim();
+    firedSteps.assign(scSim->acsThrusters.size(), 0);
+    steps = 0;
+    if (scSim->time < m_sampledTime) {
+        // The simulation was restarted
+        m_sampledTime = scSim->time;
+    }
+    std::vector<SpacecraftSample> samples;
+    simDataManager->getSamples(m_sampledTime, samples);
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        // The history runs ahead of the displayed state by the display delay
+        if (samples[i].time > scSim->time) {
+            break;
+        }
+        steps++;
+        for (size_t j = 0; j < firedSteps.size() && j < samples[i].thrusterLevel.size(); j++)
+        {
+            if (samples[i].thrusterLevel[j] > 0.0) {
+                firedSteps[j]++;
+            }
+        }
+    }
+    m_sampledTime = scSim->time;
+}
+
 void ThrustersInfo::updateThrusters(AdcsSimDataManager *simDataManager)
 {
     AdcsSimDataManager *adcsSimDataManager = dynamic_cast<AdcsSimDataManager *>(simDataManager);
@@ -294,6 +327,10 @@ void ThrustersInfo::updateThrusters(AdcsSimDataManager *simDataManager)
         }
         ui->thrustBar->hide();
 
+        std::vector<int> firedSteps;
+        int steps = 0;
+        updateFiredSteps(adcsSimDataManager, firedSteps, steps);
+
         char outString[256] = "";
         QFont f("Arial",8);
         std::vector<Thruster>::iterator itTh;
@@ -319,10 +356,20 @@ void ThrustersInfo::updateThrusters(AdcsSimDataManager *simDataManager)
                 }
                 acsList1[i]->setText(tr("%1%").arg(outString));
                 acsList1[i]->setText("ON");
+            } else if (firedSteps[i] > 0) {
+                // Pulsed between two display updates
+                acsList2[i]->setPercent(0);
+                acsList1[i]->setText("PULSE");
             } else {
                 acsList2[i]->setPercent(0);
                 acsList1[i]->setText("OFF");
             }
+            if (steps > 0) {
+                acsList1[i]->setToolTip(tr("Fired in %1 of %2 simulation steps since the last update")
+                    .arg(firedSteps[i]).arg(steps));
+            } else {
+                acsList1[i]->setToolTip("");
+            }
         }
         // THRUSTING MANEUVER
         //        if (scSim->DVThrusterManeuverDuration>0 && scSim->time<(scSim->DVThrusterManeuverDuration + scSim->DVThrusterManeuverStartTime))
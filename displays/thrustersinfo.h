@@ -64,6 +64,7 @@ public slots:
 
 private:
     void resetUiElements();
+    void updateFiredSteps(AdcsSimDataManager *simDataManager, std::vector<int> &firedSteps, int &steps);
 
 private:
     Ui::ThrustersInfo *ui;
@@ -82,6 +83,8 @@ private:
     QPushButton *m_button;
     QLabel *m_label;
     QProgressBar *m_legend;
+    // Simulation time up to which samples were shown
+    double m_sampledTime;
     
 };
 
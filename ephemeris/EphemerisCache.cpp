@@ -0,0 +1,282 @@
+/*
+ ISC License
+
+ Copyright (c) 2016-2017, Autonomous Vehicle Systems Lab, University of Colorado at Boulder
+
+ Permission to use, copy, modify, and/or distribute this software for any
+ purpose with or without fee is hereby granted, provided that the above
+ copyright notice and this permission notice appear in all copies.
+
+ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+//
+// EphemerisCache.cpp
+//
+// University of Colorado, Autonomous Vehicle Systems (AVS) Lab
+// Unpublished Copyright (c) 2012-2015 University of Colorado, All Rights Reserved
+//
+
+#include "EphemerisCache.hpp"
+
+#include <boost/bind.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+extern "C" {
+#include "SpiceUsr.h"
+}
+
+EphemerisCache::EphemerisCache()
+    : m_generation(0)
+    , m_isRequested(false)
+    , m_requestedStart(0.0)
+    , m_requestGeneration(0)
+    , m_requestStart(0.0)
+    , m_hasRequest(false)
+    , m_shouldStop(false)
+    , m_reportedGeneration(0)
+{
+    m_thread.reset(new boost::thread(boost::bind(&EphemerisCache::run, this)));
+}
+
+EphemerisCache::~EphemerisCache()
+{
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        m_shouldStop = true;
+    }
+    m_condition.notify_one();
+    m_thread->join();
+}
+
+boost::mutex &EphemerisCache::spiceMutex()
+{
+    static boost::mutex mutex;
+    return mutex;
+}
+
+void EphemerisCache::setBodies(const std::vector<EphemerisBody> &bodies)
+{
+    bool isChanged = bodies.size() != m_bodies.size();
+    for(size_t i = 0; i < bodies.size() && !isChanged; i++) {
+        isChanged = bodies[i].target != m_bodies[i].target
+            || bodies[i].frame != m_bodies[i].frame
+            || bodies[i].observer != m_bodies[i].observer
+            || bodies[i].step != m_bodies[i].step;
+    }
+    if(!isChanged) {
+        return;
+    }
+    m_bodies = bodies;
+    // Tables of the previous bodies are no longer used when they arrive
+    m_generation++;
+    m_isRequested = false;
+}
+
+void EphemerisCache::state(size_t body, double et, double state[6])
+{
+    if(body >= m_bodies.size()) {
+        std::cout << "Error in " << __FUNCTION__ << ": no body " << body << std::endl;
+        for(int i = 0; i < 6; i++) {
+            state[i] = 0.0;
+        }
+        return;
+    }
+    const EphemerisBody &queried = m_bodies[body];
+
+    m_tables.update();
+    const Tables &tables = m_tables.readBuffer();
+    bool isCovered = false;
+    if(tables.generation == m_generation && et >= tables.starts[body]) {
+        size_t count = tables.states[body].size() / 6;
+        isCovered = count > 1 && et <= tables.starts[body] + (count - 1) * queried.step;
+    }
+    if(isCovered) {
+        interpolate(tables.states[body], tables.starts[body], queried.step, et, state);
+    } else {
+        boost::mutex::scoped_lock lock(spiceMutex());
+        double lightTime;
+        spkez_c(queried.target, et, queried.frame.c_str(), "NONE", queried.observer, state, &lightTime);
+    }
+
+    // Keep et in the middle half of the window so the tables are ready
+    // before it leaves them, playing forward as well as backward
+    if(!m_isRequested || et < m_requestedStart + windowDuration / 4.0
+       || et > m_requestedStart + windowDuration * 3.0 / 4.0) {
+        request(et - windowDuration / 2.0);
+    }
+}
+
+std::vector<EphemerisAccuracy> EphemerisCache::accuracy()
+{
+    m_tables.update();
+    const Tables &tables = m_tables.readBuffer();
+    if(tables.generation != m_generation) {
+        return std::vector<EphemerisAccuracy>();
+    }
+    return tables.accuracy;
+}
+
+void EphemerisCache::request(double start)
+{
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        m_requestBodies = m_bodies;
+        m_requestGeneration = m_generation;
+        m_requestStart = start;
+        m_hasRequest = true;
+    }
+    m_condition.notify_one();
+    m_isRequested = true;
+    m_requestedStart = start;
+}
+
+void EphemerisCache::run()
+{
+    std::vector<EphemerisBody> bodies;
+    while(true) {
+        Tables &tables = m_tables.writeBuffer();
+        {
+            boost::mutex::scoped_lock lock(m_mutex);
+            while(!m_hasRequest && !m_shouldStop) {
+                m_condition.wait(lock);
+            }
+            if(m_shouldStop) {
+                return;
+            }
+            bodies = m_requestBodies;
+            tables.generation = m_requestGeneration;
+            tables.start = m_requestStart;
+            m_hasRequest = false;
+        }
+        sample(bodies, tables);
+        unsigned long generation = tables.generation;
+        if(generation != m_reportedGeneration) {
+            for(size_t i = 0; i < tables.accuracy.size(); i++) {
+                const EphemerisAccuracy &accuracy = tables.accuracy[i];
+                std::cout << "Ephemeris of " << accuracy.target << " relative to " << accuracy.observer
+                          << " cached to within " << accuracy.positionError << " km, "
+                          << accuracy.velocityError << " km/s" << std::endl;
+            }
+            m_reportedGeneration = generation;
+        }
+        m_tables.publish();
+    }
+}
+
+// Samples the window from the first time the kernels cover up to the next
+// time they do not, states is empty if that leaves less than two samples
+void EphemerisCache::sample(const std::vector<EphemerisBody> &bodies, Tables &tables)
+{
+    double exact[6];
+    double interpolated[6];
+
+    tables.starts.resize(bodies.size());
+    tables.states.resize(bodies.size());
+    tables.accuracy.resize(bodies.size());
+    for(size_t b = 0; b < bodies.size(); b++) {
+        const EphemerisBody &body = bodies[b];
+        std::vector<double> &states = tables.states[b];
+        size_t windowCount = (size_t)ceil(windowDuration / body.step) + 1;
+        size_t count = 0;
+        tables.starts[b] = tables.start;
+        states.resize(windowCount * 6);
+        for(size_t i = 0; i < windowCount; i++) {
+            if(sampleState(body, tables.start + i * body.step, &states[count * 6])) {
+                if(count == 0) {
+                    tables.starts[b] = tables.start + i * body.step;
+                }
+                count++;
+            } else if(count > 0) {
+                break;
+            }
+        }
+        if(count < 2) {
+            count = 0;
+        }
+        states.resize(count * 6);
+
+        EphemerisAccuracy &accuracy = tables.accuracy[b];
+        accuracy = EphemerisAccuracy();
+        accuracy.target = body.target;
+        accuracy.observer = body.observer;
+        size_t stride = count > accuracySamples ? (count - 1) / accuracySamples : 1;
+        for(size_t i = 0; i + 1 < count; i += stride) {
+            double et = tables.starts[b] + (i + 0.5) * body.step;
+            if(!sampleState(body, et, exact)) {
+                continue;
+            }
+            interpolate(states, tables.starts[b], body.step, et, interpolated);
+            double positionError = 0.0;
+            double velocityError = 0.0;
+            for(int k = 0; k < 3; k++) {
+                positionError += (interpolated[k] - exact[k]) * (interpolated[k] - exact[k]);
+                velocityError += (interpolated[k + 3] - exact[k + 3]) * (interpolated[k + 3] - exact[k + 3]);
+            }
+            accuracy.positionError = std::max(accuracy.positionError, sqrt(positionError));
+            accuracy.velocityError = std::max(accuracy.velocityError, sqrt(velocityError));
+        }
+    }
+}
+
+// State of body at et as spkez_c computes it, false where the loaded kernels
+// do not cover et. SPICE errors are returned instead of aborting and are not
+// printed, as every time outside the coverage of a kernel is one.
+bool EphemerisCache::sampleState(const EphemerisBody &body, double et, double state[6])
+{
+    char action[32];
+    char devices[128];
+    double lightTime;
+
+    // Locked per call so direct queries of the other thread do not wait for
+    // a whole table, and see the error handling they set
+    boost::mutex::scoped_lock lock(spiceMutex());
+    erract_c("GET", sizeof(action), action);
+    errprt_c("GET", sizeof(devices), devices);
+    erract_c("SET", 0, (SpiceChar *)"RETURN");
+    errprt_c("SET", 0, (SpiceChar *)"NONE");
+    spkez_c(body.target, et, body.frame.c_str(), "NONE", body.observer, state, &lightTime);
+    bool isFailed = failed_c();
+    if(isFailed) {
+        reset_c();
+    }
+    errprt_c("SET", 0, devices);
+    erract_c("SET", 0, action);
+    return !isFailed;
+}
+
+// Cubic Hermite interpolation of the position from the positions and
+// velocities at both ends of the step, the velocity is its derivative
+void EphemerisCache::interpolate(const std::vector<double> &states, double start, double step, double et, double state[6])
+{
+    size_t count = states.size() / 6;
+    double x = (et - start) / step;
+    size_t i = x > 0.0 ? (size_t)x : 0;
+    if(i > count - 2) {
+        i = count - 2;
+    }
+    double s = x - i;
+    double s2 = s * s;
+    double s3 = s2 * s;
+    double h00 = 2.0 * s3 - 3.0 * s2 + 1.0;
+    double h10 = s3 - 2.0 * s2 + s;
+    double h01 = -2.0 * s3 + 3.0 * s2;
+    double h11 = s3 - s2;
+    double d00 = 6.0 * s2 - 6.0 * s;
+    double d10 = 3.0 * s2 - 4.0 * s + 1.0;
+    double d11 = 3.0 * s2 - 2.0 * s;
+    const double *a = &states[i * 6];
+    const double *b = &states[(i + 1) * 6];
+    for(int k = 0; k < 3; k++) {
+        state[k] = h00 * a[k] + h10 * step * a[k + 3] + h01 * b[k] + h11 * step * b[k + 3];
+        state[k + 3] = d00 * (a[k] - b[k]) / step + d10 * a[k + 3] + d11 * b[k + 3];
+    }
+}
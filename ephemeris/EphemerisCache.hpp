@@ -0,0 +1,160 @@
+/*
+ ISC License
+
+ Copyright (c) 2016-2017, Autonomous Vehicle Systems Lab, University of Colorado at Boulder
+
+ Permission to use, copy, modify, and/or distribute this software for any
+ purpose with or without fee is hereby granted, provided that the above
+ copyright notice and this permission notice appear in all copies.
+
+ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+//
+// EphemerisCache.hpp
+//
+// University of Colorado, Autonomous Vehicle Systems (AVS) Lab
+// Unpublished Copyright (c) 2012-2015 University of Colorado, All Rights Reserved
+//
+
+#ifndef EPHEMERIS_CACHE_HPP
+#define EPHEMERIS_CACHE_HPP
+
+#include "TripleBuffer.hpp"
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <string>
+#include <vector>
+
+// State of target relative to observer in frame, as spkez_c computes it
+// without aberration corrections
+struct EphemerisBody
+{
+    EphemerisBody(int target, const char *frame, int observer, double step)
+        : target(target)
+        , frame(frame)
+        , observer(observer)
+        , step(step)
+    {
+
+    }
+
+    int target;
+    std::string frame;
+    int observer;
+    // Seconds between the samples of the tables, short against the period
+    // of the body's orbit
+    double step;
+};
+
+// Largest differences between the tables of a body and spkez_c in km and
+// km/s, measured halfway between samples where the interpolation is worst
+struct EphemerisAccuracy
+{
+    EphemerisAccuracy()
+        : target(0)
+        , observer(0)
+        , positionError(0.0)
+        , velocityError(0.0)
+    {
+
+    }
+
+    int target;
+    int observer;
+    double positionError;
+    double velocityError;
+};
+
+// Serves the states of a few bodies from tables sampled from SPICE on a
+// worker thread. The tables cover a window of ephemeris time around the time
+// queried last and move along with it, ahead of the queries, clipped to the
+// part of the window the loaded kernels cover. Between samples
+// the states are cubic Hermite interpolated from the positions and
+// velocities, so a query costs a few multiplications and takes no lock. Times
+// the tables do not cover yet, e.g. right after a seek, are computed with
+// spkez_c directly.
+class EphemerisCache
+{
+public:
+    EphemerisCache();
+    ~EphemerisCache();
+
+    // Bodies queried by their index in bodies, tables of other bodies are
+    // dropped
+    void setBodies(const std::vector<EphemerisBody> &bodies);
+    // State of a body at ephemeris time et in km and km/s. Only to be called
+    // from one thread.
+    void state(size_t body, double et, double state[6]);
+    // Accuracy of the tables in use by body, empty while there are none.
+    // Only to be called from the thread calling state().
+    std::vector<EphemerisAccuracy> accuracy();
+
+    // CSPICE is not thread safe, every call into it has to hold this mutex
+    static boost::mutex &spiceMutex();
+
+private:
+    // Seconds of ephemeris time covered by the tables
+    static const int windowDuration = 7*86400;
+    // Intervals between samples the accuracy is measured in per body
+    static const int accuracySamples = 32;
+
+    struct Tables
+    {
+        Tables()
+            : generation(0)
+            , start(0.0)
+        {
+
+        }
+
+        // Of the bodies the tables were sampled for
+        unsigned long generation;
+        // Of the window
+        double start;
+        // Of the states of each body, at a whole number of steps from start
+        std::vector<double> starts;
+        // States of each body every step seconds from its start
+        std::vector<std::vector<double> > states;
+        std::vector<EphemerisAccuracy> accuracy;
+    };
+
+    // Used by the querying thread
+    std::vector<EphemerisBody> m_bodies;
+    unsigned long m_generation;
+    bool m_isRequested;
+    double m_requestedStart;
+
+    TripleBuffer<Tables> m_tables;
+    boost::scoped_ptr<boost::thread> m_thread;
+    boost::mutex m_mutex;
+    boost::condition_variable m_condition;
+    // Guarded by m_mutex
+    std::vector<EphemerisBody> m_requestBodies;
+    unsigned long m_requestGeneration;
+    double m_requestStart;
+    bool m_hasRequest;
+    bool m_shouldStop;
+    // Generation accuracy was last reported for, used by the worker thread
+    unsigned long m_reportedGeneration;
+
+    void request(double start);
+    void run();
+    void sample(const std::vector<EphemerisBody> &bodies, Tables &tables);
+    static bool sampleState(const EphemerisBody &body, double et, double state[6]);
+    static void interpolate(const std::vector<double> &states, double start, double step, double et, double state[6]);
+
+    EphemerisCache(const EphemerisCache &);
+    EphemerisCache &operator=(const EphemerisCache &);
+};
+
+#endif // EPHEMERIS_CACHE_HPP
@@ -21,10 +21,10 @@
 FadingLineStrip::FadingLineStrip(int maxPoints)
     : LineStrip(maxPoints)
 {
-    m_lineMesh->textureFile = ":/resources/images/fadex.png";
+    setTextureFile(":/resources/images/fadex.png");
 
     // Set the buffers to dynamic so that its buffer gets updated
-    setTextureCoordBufferUsage(QOpenGLBuffer::StreamDraw);
+    setTextureCoordBufferUsage(QOpenGLBuffer::DynamicDraw);
 }
 
 FadingLineStrip::~FadingLineStrip()
@@ -32,6 +32,11 @@
 class FieldOfViewUpdateParameters : public GeometryUpdateParameters
 {
 public:
+    virtual bool isSameAs(const GeometryUpdateParameters &other) const {
+        const FieldOfViewUpdateParameters *p = dynamic_cast<const FieldOfViewUpdateParameters*>(&other);
+        return p && p->angle == angle;
+    }
+
     float angle;
 };
 
@@ -20,19 +20,39 @@
 #include "geometrymanager.h"
 
 #include <iostream>
+#include <QAtomicInt>
 
 #ifndef M_PI
 #define M_PI 3.141592653589793
 #endif
 
+int GeometryUpdateParameters::nextRevision()
+{
+    static QAtomicInt lastRevision(0);
+    return lastRevision.fetchAndAddRelaxed(1) + 1;
+}
+
+Geometry::BufferSet::BufferSet()
+    : vertexBuffer(QOpenGLBuffer::VertexBuffer)
+    , normalBuffer(QOpenGLBuffer::VertexBuffer)
+    , textureCoordBuffer(QOpenGLBuffer::VertexBuffer)
+    , indexBuffer(QOpenGLBuffer::IndexBuffer)
+    , revision(0)
+    , vertexLength(0)
+    , indexLength(0)
+    , isChanged(false)
+{
+
+}
+
 Geometry::Geometry()
     : m_rootNode(new Node)
-    , m_vertexBuffer(QOpenGLBuffer::VertexBuffer)
     , m_vertexBufferUsage(QOpenGLBuffer::StaticDraw)
     , m_normalBufferUsage(QOpenGLBuffer::StaticDraw)
     , m_textureCoordBufferUsage(QOpenGLBuffer::StaticDraw)
-    , m_indexBuffer(QOpenGLBuffer::IndexBuffer)
     , m_indexBufferUsage(QOpenGLBuffer::StaticDraw)
+    , m_drawBuffers(&m_buffers)
+    , m_drawParameters(0)
     , m_isOpenGLInitialized(false)
     , m_boundingRadii(-1.0f)
 {
@@ -100,12 +120,35 @@ bool Geometry::load(QString pathToFile)
 
 bool Geometry::initialize(QOpenGLShaderProgram *program)
 {
-    if(!createBuffers(program)) {
+    if(!createBuffers(program, m_buffers)) {
         return false;
     }
     return true;
 }
 
+void Geometry::applyUpdate(GeometryUpdateParameters *parameters)
+{
+    m_drawParameters = parameters;
+    if(!parameters) {
+        m_drawBuffers = &m_buffers;
+        return;
+    }
+    QSharedPointer<BufferSet> &buffers = m_nodeBuffers[parameters->node];
+    if(buffers.isNull()) {
+        buffers = QSharedPointer<BufferSet>(new BufferSet);
+    }
+    m_drawBuffers = buffers.data();
+    // The update() of another node may have grown the arrays, and with them
+    // the meshes drawn from the buffers
+    if(buffers->revision == parameters->revision && buffers->vertexLength == m_vertices.length()
+       && buffers->indexLength == m_indices.length()) {
+        return;
+    }
+    update(parameters);
+    buffers->revision = parameters->revision;
+    buffers->isChanged = true;
+}
+
 void Geometry::draw(GeometryManager *geometryManager, QOpenGLShaderProgram *program,
                     QMatrix4x4 cameraMatrix, QMatrix4x4 objectMatrix, float scaleFactor)
 {
@@ -113,22 +156,33 @@ void Geometry::draw(GeometryManager *geometryManager, QOpenGLShaderProgram *prog
         initializeOpenGLFunctions();
         m_isOpenGLInitialized = true;
     }
-    m_vao.bind();
-    updateBuffers(program);
-    if(m_indexBuffer.bind()) {
-        drawNode(geometryManager, program, m_rootNode.data(), cameraMatrix, objectMatrix, scaleFactor);
-        m_indexBuffer.release();
+    BufferSet &buffers = *m_drawBuffers;
+    // Buffers of a node are created the first time it is drawn
+    if(buffers.vao.isCreated() || createBuffers(program, buffers)) {
+        buffers.vao.bind();
+        updateBuffers(program, buffers);
+        program->setUniformValue("textureTransform", QVector2D(1.0f, 0.0f));
+        prepareDraw(program, m_drawParameters);
+        if(buffers.indexBuffer.bind()) {
+            drawNode(geometryManager, program, m_rootNode.data(), cameraMatrix, objectMatrix, scaleFactor);
+            buffers.indexBuffer.release();
+        }
+        buffers.vao.release();
+    } else {
+        std::cout << "Error in " << __FUNCTION__ << ": could not create buffers" << std::endl;
     }
-    m_vao.release();
+    m_drawBuffers = &m_buffers;
+    m_drawParameters = 0;
 }
 
 void Geometry::cleanup()
 {
-    m_vao.destroy();
-    m_vertexBuffer.destroy();
-    m_normalBuffer.destroy();
-    m_textureCoordBuffer.destroy();
-    m_indexBuffer.destroy();
+    destroyBuffers(m_buffers);
+    foreach(QSharedPointer<BufferSet> buffers, m_nodeBuffers) {
+        destroyBuffers(*buffers);
+    }
+    m_nodeBuffers.clear();
+    m_drawBuffers = &m_buffers;
 }
 
 QSet<QString> Geometry::textureFiles()
@@ -812,16 +866,16 @@ void Geometry::defineRectangularPlane(QSharedPointer<Mesh> mesh, float y1, float
     }
 }
 
-bool Geometry::createBuffers(QOpenGLShaderProgram *program)
+bool Geometry::createBuffers(QOpenGLShaderProgram *program, BufferSet &buffers)
 {
-    if(m_vao.create()) {
-        m_vao.bind();
+    if(buffers.vao.create()) {
+        buffers.vao.bind();
         
-        if(m_vertexBuffer.create()) {
-            m_vertexBuffer.setUsagePattern(m_vertexBufferUsage);
-            if(m_vertexBuffer.bind()) {
-                m_vertexBuffer.allocate(m_vertices.constData(),
-                                        m_vertices.length() * sizeof(QVector3D));
+        if(buffers.vertexBuffer.create()) {
+            buffers.vertexBuffer.setUsagePattern(m_vertexBufferUsage);
+            if(buffers.vertexBuffer.bind()) {
+                buffers.vertexBuffer.allocate(m_vertices.constData(),
+                                              m_vertices.length() * sizeof(QVector3D));
                 program->enableAttributeArray(0);
                 program->setAttributeBuffer(0, GL_FLOAT, 0, 3);
             } else {
@@ -831,11 +885,11 @@ bool Geometry::createBuffers(QOpenGLShaderProgram *program)
             return false;
         }
 
-        if(m_normalBuffer.create()) {
-            m_normalBuffer.setUsagePattern(m_normalBufferUsage);
-            if(m_normalBuffer.bind()) {
-                m_normalBuffer.allocate(m_normals.constData(),
-                                        m_normals.length() * sizeof(QVector3D));
+        if(buffers.normalBuffer.create()) {
+            buffers.normalBuffer.setUsagePattern(m_normalBufferUsage);
+            if(buffers.normalBuffer.bind()) {
+                buffers.normalBuffer.allocate(m_normals.constData(),
+                                              m_normals.length() * sizeof(QVector3D));
                 program->enableAttributeArray(1);
                 program->setAttributeBuffer(1, GL_FLOAT, 0, 3);
             } else {
@@ -845,11 +899,11 @@ bool Geometry::createBuffers(QOpenGLShaderProgram *program)
             return false;
         }
         
-        if(m_textureCoordBuffer.create()) {
-            m_textureCoordBuffer.setUsagePattern(m_textureCoordBufferUsage);
-            if(m_textureCoordBuffer.bind()) {
-                m_textureCoordBuffer.allocate(m_textureCoords.constData(),
-                                              m_textureCoords.length() * sizeof(QVector2D));
+        if(buffers.textureCoordBuffer.create()) {
+            buffers.textureCoordBuffer.setUsagePattern(m_textureCoordBufferUsage);
+            if(buffers.textureCoordBuffer.bind()) {
+                buffers.textureCoordBuffer.allocate(m_textureCoords.constData(),
+                                                    m_textureCoords.length() * sizeof(QVector2D));
                 program->enableAttributeArray(2);
                 program->setAttributeBuffer(2, GL_FLOAT, 0, 2);
             } else {
@@ -859,11 +913,11 @@ bool Geometry::createBuffers(QOpenGLShaderProgram *program)
             return false;
         }
 
-        if(m_indexBuffer.create()) {
-            m_indexBuffer.setUsagePattern(m_indexBufferUsage);
-            if(m_indexBuffer.bind()) {
-                m_indexBuffer.allocate(m_indices.constData(),
-                                       m_indices.length() * sizeof(unsigned int));
+        if(buffers.indexBuffer.create()) {
+            buffers.indexBuffer.setUsagePattern(m_indexBufferUsage);
+            if(buffers.indexBuffer.bind()) {
+                buffers.indexBuffer.allocate(m_indices.constData(),
+                                             m_indices.length() * sizeof(unsigned int));
             } else {
                 return false;
             }
@@ -871,52 +925,114 @@ bool Geometry::createBuffers(QOpenGLShaderProgram *program)
             return false;
         }
 
-        m_vao.release();
+        buffers.vao.release();
     } else {
         return false;
     }
+    buffers.vertexLength = m_vertices.length();
+    buffers.indexLength = m_indices.length();
+    buffers.isChanged = false;
     return true;
 }
 
-void Geometry::updateBuffers(QOpenGLShaderProgram *program)
+void Geometry::updateBuffers(QOpenGLShaderProgram *, BufferSet &buffers)
 {
-    if(m_vertexBufferUsage == QOpenGLBuffer::DynamicDraw
+    if(!buffers.isChanged) {
+        return;
+    }
+    buffers.isChanged = false;
+
+    // Grown arrays are allocated anew, static buffers included
+    bool isResized = buffers.vertexLength != m_vertices.length() || buffers.indexLength != m_indices.length();
+    buffers.vertexLength = m_vertices.length();
+    buffers.indexLength = m_indices.length();
+
+    if(isResized || m_vertexBufferUsage == QOpenGLBuffer::DynamicDraw
             || m_vertexBufferUsage == QOpenGLBuffer::StreamDraw) {
-        if(m_vertexBuffer.bind()) {
-            m_vertexBuffer.write(0, m_vertices.constData(),
-                                 m_vertices.length() * sizeof(QVector3D));
-            m_vertexBuffer.release();
+        if(buffers.vertexBuffer.bind()) {
+            if(isResized) {
+                buffers.vertexBuffer.allocate(m_vertices.constData(),
+                                              m_vertices.length() * sizeof(QVector3D));
+            } else {
+                buffers.vertexBuffer.write(0, m_vertices.constData(),
+                                           m_vertices.length() * sizeof(QVector3D));
+            }
+            buffers.vertexBuffer.release();
         }
     }
 
-    if(m_normalBufferUsage == QOpenGLBuffer::DynamicDraw
+    if(isResized || m_normalBufferUsage == QOpenGLBuffer::DynamicDraw
             || m_normalBufferUsage == QOpenGLBuffer::StreamDraw) {
-        if(m_normalBuffer.bind()) {
-            m_normalBuffer.write(0, m_normals.constData(),
-                                 m_normals.length() * sizeof(QVector3D));
-            m_normalBuffer.release();
+        if(buffers.normalBuffer.bind()) {
+            if(isResized) {
+                buffers.normalBuffer.allocate(m_normals.constData(),
+                                              m_normals.length() * sizeof(QVector3D));
+            } else {
+                buffers.normalBuffer.write(0, m_normals.constData(),
+                                           m_normals.length() * sizeof(QVector3D));
+            }
+            buffers.normalBuffer.release();
         }
     }
 
-    if(m_textureCoordBufferUsage == QOpenGLBuffer::DynamicDraw
+    if(isResized || m_textureCoordBufferUsage == QOpenGLBuffer::DynamicDraw
             || m_textureCoordBufferUsage == QOpenGLBuffer::StreamDraw) {
-        if(m_textureCoordBuffer.bind()) {
-            m_textureCoordBuffer.write(0, m_textureCoords.constData(),
-                                       m_textureCoords.length() * sizeof(QVector2D));
-            m_textureCoordBuffer.release();
+        if(buffers.textureCoordBuffer.bind()) {
+            if(isResized) {
+                buffers.textureCoordBuffer.allocate(m_textureCoords.constData(),
+                                                    m_textureCoords.length() * sizeof(QVector2D));
+            } else {
+                buffers.textureCoordBuffer.write(0, m_textureCoords.constData(),
+                                                 m_textureCoords.length() * sizeof(QVector2D));
+            }
+            buffers.textureCoordBuffer.release();
         }
     }
 
-    if(m_indexBufferUsage == QOpenGLBuffer::DynamicDraw
+    if(isResized || m_indexBufferUsage == QOpenGLBuffer::DynamicDraw
             || m_indexBufferUsage == QOpenGLBuffer::StreamDraw) {
-        if(m_indexBuffer.bind()) {
-            m_indexBuffer.write(0, m_indices.constData(),
-                                m_indices.length() * sizeof(unsigned int));
-            m_indexBuffer.release();
+        if(buffers.indexBuffer.bind()) {
+            if(isResized) {
+                buffers.indexBuffer.allocate(m_indices.constData(),
+                                             m_indices.length() * sizeof(unsigned int));
+            } else {
+                buffers.indexBuffer.write(0, m_indices.constData(),
+                                          m_indices.length() * sizeof(unsigned int));
+            }
+            buffers.indexBuffer.release();
         }
     }
 }
 
+void Geometry::writeVertices(QSharedPointer<Mesh> mesh, const QVector<QVector3D> &vertices,
+                             const QVector<QVector2D> &textureCoords)
+{
+    int count = qMin(qMin(vertices.size(), textureCoords.size()), (int)mesh->vertexCount);
+    if(m_drawBuffers->vertexBuffer.bind()) {
+        m_drawBuffers->vertexBuffer.write(mesh->vertexOffset * sizeof(QVector3D), vertices.constData(),
+                                          count * sizeof(QVector3D));
+        m_drawBuffers->vertexBuffer.release();
+    }
+    if(m_drawBuffers->textureCoordBuffer.bind()) {
+        m_drawBuffers->textureCoordBuffer.write(mesh->vertexOffset * sizeof(QVector2D), textureCoords.constData(),
+                                                count * sizeof(QVector2D));
+        m_drawBuffers->textureCoordBuffer.release();
+    }
+}
+
+void Geometry::destroyBuffers(BufferSet &buffers)
+{
+    buffers.vao.destroy();
+    buffers.vertexBuffer.destroy();
+    buffers.normalBuffer.destroy();
+    buffers.textureCoordBuffer.destroy();
+    buffers.indexBuffer.destroy();
+    buffers.revision = 0;
+    buffers.vertexLength = 0;
+    buffers.indexLength = 0;
+    buffers.isChanged = false;
+}
+
 void Geometry::drawNode(GeometryManager *geometryManager, QOpenGLShaderProgram *program, Geometry::Node *node,
                         QMatrix4x4 cameraMatrix, QMatrix4x4 objectMatrix, float scaleFactor)
 {
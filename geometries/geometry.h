@@ -25,6 +25,7 @@
 #include <QVector4D>
 #include <QMatrix4x4>
 #include <QSharedPointer>
+#include <QHash>
 #include <QOpenGLVertexArrayObject>
 #include <QOpenGLShaderProgram>
 #include <QOpenGLBuffer>
@@ -36,10 +37,35 @@
 
 class GeometryManager;
 
-// Class to be inherited by children of Geometry in order to pass in dynamic parameters
+// Class to be inherited by children of Geometry in order to pass in dynamic parameters.
+// Scene objects keep their parameters from frame to frame, markChanged() must
+// be called after modifying them so the geometry applies them again.
 class GeometryUpdateParameters
 {
 public:
+    GeometryUpdateParameters()
+        : node(0)
+        , revision(nextRevision()) {}
+    virtual ~GeometryUpdateParameters() {}
+
+    void markChanged() {
+        revision = nextRevision();
+    }
+    // Whether other holds the same values, so that the buffers built from
+    // one fit the other. Scenes carry the revision over when they do.
+    virtual bool isSameAs(const GeometryUpdateParameters &) const {
+        return false;
+    }
+
+    // Scene object the parameters belong to, the same in every scene buffer
+    // of an unchanged layout. Geometries keep buffers on the GPU per node.
+    int node;
+    // Identifies the values, changes with every markChanged(). Parameters
+    // with the same values may share it, see isSameAs().
+    int revision;
+
+private:
+    static int nextRevision();
 };
 
 class Geometry : public QOpenGLFunctions_2_1
@@ -87,9 +113,12 @@ public:
 
     bool initialize(QOpenGLShaderProgram *program);
     bool isInitialized() {
-        return m_vao.isCreated();
+        return m_buffers.vao.isCreated();
     }
     virtual void update(GeometryUpdateParameters *) {}
+    // Selects the buffers of the parameters' node for the next draw() and
+    // calls update() unless they already hold the parameters' revision
+    void applyUpdate(GeometryUpdateParameters *parameters);
     void draw(GeometryManager *geometryManager, QOpenGLShaderProgram *program,
               QMatrix4x4 cameraMatrix, QMatrix4x4 objectMatrix, float scaleFactor);
     void cleanup();
@@ -122,6 +151,14 @@ protected:
             QVector4D diffuseColor, QVector4D specularColor,
             float shininess);
 
+    // Called by draw() with the parameters applied, for what is set on every
+    // draw rather than kept in the buffers
+    virtual void prepareDraw(QOpenGLShaderProgram *, GeometryUpdateParameters *) {}
+    // Writes vertices and texture coordinates of the mesh to the buffers
+    // drawn, for the few changing with every draw. Only from prepareDraw().
+    void writeVertices(QSharedPointer<Mesh> mesh, const QVector<QVector3D> &vertices,
+                       const QVector<QVector2D> &textureCoords);
+
     // Allocates (if requested) the buffers for the number of vertices and indices specified
     // if already allocated, adjusts numVertices and numIndices to avoid buffer overrun
     void allocate(bool isAllocate, QSharedPointer<Mesh> mesh, int &numVertices, int &numIndices);
@@ -202,19 +239,41 @@ private:
     QVector<QSharedPointer<Mesh> > m_meshes;
     QSharedPointer<Node> m_rootNode;
 
-    QOpenGLVertexArrayObject m_vao;
-    QOpenGLBuffer m_vertexBuffer;
+    // Vertex array and buffers on the GPU
+    struct BufferSet {
+        BufferSet();
+
+        QOpenGLVertexArrayObject vao;
+        QOpenGLBuffer vertexBuffer;
+        QOpenGLBuffer normalBuffer;
+        QOpenGLBuffer textureCoordBuffer;
+        QOpenGLBuffer indexBuffer;
+        // Of the parameters written to the dynamic buffers, 0 before any
+        int revision;
+        // Lengths of the arrays the buffers were allocated for
+        int vertexLength;
+        int indexLength;
+        bool isChanged;
+    };
+
     QOpenGLBuffer::UsagePattern m_vertexBufferUsage;
-    QOpenGLBuffer m_normalBuffer;
     QOpenGLBuffer::UsagePattern m_normalBufferUsage;
-    QOpenGLBuffer m_textureCoordBuffer;
     QOpenGLBuffer::UsagePattern m_textureCoordBufferUsage;
-    QOpenGLBuffer m_indexBuffer;
     QOpenGLBuffer::UsagePattern m_indexBufferUsage;
+    // Buffers of objects drawn without parameters
+    BufferSet m_buffers;
+    // Buffers of each node drawn with parameters, so nodes sharing the
+    // geometry and the scene buffers of one node do not overwrite each
+    // other's and the dynamic buffers are only written after they changed
+    QHash<int, QSharedPointer<BufferSet> > m_nodeBuffers;
+    // Selected by applyUpdate()
+    BufferSet *m_drawBuffers;
+    GeometryUpdateParameters *m_drawParameters;
 
     bool m_isOpenGLInitialized;
-    bool createBuffers(QOpenGLShaderProgram *program);
-    void updateBuffers(QOpenGLShaderProgram *program);
+    bool createBuffers(QOpenGLShaderProgram *program, BufferSet &buffers);
+    void updateBuffers(QOpenGLShaderProgram *program, BufferSet &buffers);
+    void destroyBuffers(BufferSet &buffers);
     void drawNode(GeometryManager *geometryManager, QOpenGLShaderProgram *program,
                   Node *node, QMatrix4x4 cameraMatrix, QMatrix4x4 objectMatrix, float scaleFactor);
 
@@ -173,7 +173,7 @@ void GeometryManager::drawGeometry(QString name, QOpenGLShaderProgram *program,
             origDefault = m_geometries[name]->getDefaultMaterial();
             m_geometries[name]->setDefaultMaterial(defaultMaterialOverride);
         }
-        m_geometries[name]->update(parameters.data());
+        m_geometries[name]->applyUpdate(parameters.data());
         m_geometries[name]->draw(this, program, cameraMatrix, objectMatrix, scaleFactor);
         if(!defaultMaterialOverride.isNull()) {
             m_geometries[name]->setDefaultMaterial(origDefault);
@@ -20,20 +20,33 @@
 
 LineStrip::LineStrip(int maxPoints)
     : m_lineMesh(new Mesh)
+    , m_anchorMesh(new Mesh)
+    , m_drawnLineMesh(new Mesh)
+    , m_drawnAnchorMesh(new Mesh)
     , m_maxPoints(maxPoints)
 {
     QSharedPointer<Node> rootNode = getRootNode();
 
+    // Two lines from the anchor, to the first and from the last point drawn.
+    // Defined first so that the points come last and may grow.
     QVector<QVector3D> points;
+    points.resize(4);
+    defineLine(m_anchorMesh, points);
+    m_anchorMesh->name = "LineStripAnchor";
+    m_anchorMesh->primitiveType = GL_LINES;
     points.resize(maxPoints);
     defineLine(m_lineMesh, points);
     m_lineMesh->name = "LineStrip";
 
-    rootNode->meshes.push_back(m_lineMesh);
+    *m_drawnLineMesh = *m_lineMesh;
+    *m_drawnAnchorMesh = *m_anchorMesh;
+    m_drawnAnchorMesh->indexCount = 0;
+    rootNode->meshes.push_back(m_drawnLineMesh);
+    rootNode->meshes.push_back(m_drawnAnchorMesh);
 
-    // Set the buffers to dynamic so that its buffer gets updated
-    setVertexBufferUsage(QOpenGLBuffer::StreamDraw);
-    setIndexBufferUsage(QOpenGLBuffer::StreamDraw);
+    // Set the buffers to dynamic so that its buffer gets updated, the
+    // anchor lines are written on every draw
+    setVertexBufferUsage(QOpenGLBuffer::DynamicDraw);
 }
 
 LineStrip::~LineStrip()
@@ -48,3 +61,54 @@ void LineStrip::update(GeometryUpdateParameters *parameters)
         defineLine(m_lineMesh, p->linePoints, QMatrix4x4(), true);
     }
 }
+
+void LineStrip::prepareDraw(QOpenGLShaderProgram *program, GeometryUpdateParameters *parameters)
+{
+    LineStripUpdateParameters *p = (LineStripUpdateParameters *)parameters;
+    *m_drawnLineMesh = *m_lineMesh;
+    *m_drawnAnchorMesh = *m_anchorMesh;
+    m_drawnAnchorMesh->indexCount = 0;
+    if(!p || p->linePoints.isEmpty()) {
+        return;
+    }
+
+    int count = qMin(p->linePoints.size(), (int)m_lineMesh->vertexCount);
+    int first = qBound(0, p->firstPoint, count - 1);
+    int last = p->lastPoint < 0 ? count - 1 : qMin(p->lastPoint, count - 1);
+    m_drawnLineMesh->indexOffset = m_lineMesh->indexOffset + qMin(first, last);
+    m_drawnLineMesh->indexCount = qAbs(last - first) + 1;
+
+    // defineLine() gave point i the texture coordinate i / (count - 1),
+    // moved here to run from 0 at the first point drawn to 1 at the last
+    if(first != last) {
+        program->setUniformValue("textureTransform",
+                                 QVector2D((float)(count - 1) / (last - first), -(float)first / (last - first)));
+    }
+
+    if(p->hasAnchor) {
+        float firstCoord = count > 1 ? (float)first / (count - 1) : 0.0f;
+        float lastCoord = count > 1 ? (float)last / (count - 1) : 0.0f;
+        QVector<QVector3D> vertices;
+        vertices.resize(4);
+        vertices[0] = p->anchor;
+        vertices[1] = p->linePoints.at(first);
+        vertices[2] = p->linePoints.at(last);
+        vertices[3] = p->anchor;
+        QVector<QVector2D> textureCoords;
+        textureCoords.resize(4);
+        textureCoords[0] = QVector2D(firstCoord, 0);
+        textureCoords[1] = QVector2D(firstCoord, 0);
+        textureCoords[2] = QVector2D(lastCoord, 0);
+        textureCoords[3] = QVector2D(lastCoord, 0);
+        writeVertices(m_anchorMesh, vertices, textureCoords);
+        m_drawnAnchorMesh->indexCount = p->isAnchorClosing ? 4 : 2;
+    }
+}
+
+void LineStrip::setTextureFile(QString textureFile)
+{
+    m_lineMesh->textureFile = textureFile;
+    m_anchorMesh->textureFile = textureFile;
+    m_drawnLineMesh->textureFile = textureFile;
+    m_drawnAnchorMesh->textureFile = textureFile;
+}
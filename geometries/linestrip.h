@@ -24,7 +24,29 @@
 class LineStripUpdateParameters : public GeometryUpdateParameters
 {
 public:
+    LineStripUpdateParameters()
+        : firstPoint(0)
+        , lastPoint(-1)
+        , hasAnchor(false)
+        , isAnchorClosing(false) {}
+
+    // Only the points are kept in the buffers, the rest is set on every draw
+    // and changes without markChanged()
+    virtual bool isSameAs(const GeometryUpdateParameters &other) const {
+        const LineStripUpdateParameters *p = dynamic_cast<const LineStripUpdateParameters*>(&other);
+        return p && p->linePoints == linePoints;
+    }
+
     QVector<QVector3D> linePoints;
+    // Points drawn, backwards when lastPoint comes first; the texture runs
+    // from the first to the last. A lastPoint of -1 is the last of linePoints.
+    int firstPoint;
+    int lastPoint;
+    // Point joined to the first point drawn, and to the last with
+    // isAnchorClosing
+    bool hasAnchor;
+    bool isAnchorClosing;
+    QVector3D anchor;
 };
 
 class LineStrip : public Geometry
@@ -37,7 +59,15 @@ public:
     void setVertexData(QVector<QVector3D> data);
 
 protected:
+    virtual void prepareDraw(QOpenGLShaderProgram *program, GeometryUpdateParameters *parameters);
+    void setTextureFile(QString textureFile);
+
+    // Meshes the points and the anchor lines are allocated for, the drawn
+    // ones cover the part of them drawn
     QSharedPointer<Mesh> m_lineMesh;
+    QSharedPointer<Mesh> m_anchorMesh;
+    QSharedPointer<Mesh> m_drawnLineMesh;
+    QSharedPointer<Mesh> m_drawnAnchorMesh;
     int m_maxPoints;
 };
 
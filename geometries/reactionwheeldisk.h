@@ -24,6 +24,11 @@
 class ReactionWheelDiskUpdateParameters : public GeometryUpdateParameters
 {
     public:
+        virtual bool isSameAs(const GeometryUpdateParameters &other) const {
+            const ReactionWheelDiskUpdateParameters *p = dynamic_cast<const ReactionWheelDiskUpdateParameters*>(&other);
+            return p && p->flag == flag;
+        }
+
         bool flag; // flag to know if the velocity is positive (1) or negative (0)
 };
 
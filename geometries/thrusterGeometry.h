@@ -24,6 +24,11 @@
 class ThrusterGeometryUpdateParameters : public GeometryUpdateParameters
 {
 public:
+    virtual bool isSameAs(const GeometryUpdateParameters &other) const {
+        const ThrusterGeometryUpdateParameters *p = dynamic_cast<const ThrusterGeometryUpdateParameters*>(&other);
+        return p && p->length == length && p->plumeDiameter == plumeDiameter;
+    }
+
     float length;
     float plumeDiameter;
 };
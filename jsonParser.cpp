@@ -1,54 +0,0 @@
-/*
- ISC License
-
- Copyright (c) 2016-2017, Autonomous Vehicle Systems Lab, University of Colorado at Boulder
-
- Permission to use, copy, modify, and/or distribute this software for any
- purpose with or without fee is hereby granted, provided that the above
- copyright notice and this permission notice appear in all copies.
-
- THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
- WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
- MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
- ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
- WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
- ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
- OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
-
- */
-//
-//  jsonParser.cpp
-//  Visualization
-//
-//  Created by Patrick Kenneally on 8/9/16.
-//
-//
-
-#include "jsonParser.hpp"
-#include <boost/property_tree/json_parser.hpp>
-
-namespace pt = boost::property_tree;
-
-JsonParser::JsonParser()
-{
-    // Create a root
-    this->root;
-    
-}
-
-JsonParser::~JsonParser()
-{
-    
-}
-
-std::string JsonParser::parseToJson()
-{
-    std::string jsonString;
-    
-    return jsonString;
-}
-
-void JsonParser::parseFromJson()
-{
-    
-}
\ No newline at end of file
@@ -45,6 +45,8 @@ MainWindow::MainWindow()
     // NOTE: Change the next line to implement an individual simulation data manager
     , m_simDataManager(new AdcsSimDataManager(this))
     , m_connectionStatus(new QLabel(this))
+    , m_linkStatus(new QLabel(this))
+    , m_recordStatus(new QLabel(this))
     , m_modelsDisplayInfo (new ModelsDisplayInfo(this))
     , m_orbitElementsInfo (new OrbitElementsInfo(this))
     , m_reactionWheelsInfo (new ReactionWheelsInfo(this, m_simDataManager))
@@ -59,6 +61,7 @@ MainWindow::MainWindow()
     , m_iruInfo(new IruInfo(this))
     , m_tamInfo(new TamInfo(this))
     , m_starTrackerInfo(new StarTrackerInfo(this))
+    , m_diagnosticsInfo(new DiagnosticsInfo(this))
     , m_cameraTargetCombo(new QComboBox(this))
     , m_cameraModeCombo(new QComboBox(this))
     , m_zoomSpeedLabel(new QLabel(this))
@@ -102,6 +105,8 @@ MainWindow::MainWindow()
     connect(m_simDataManager, SIGNAL(setOnOffLegendRW(bool)), this, SLOT(openLegendRW(bool)));
     connect(m_simDataManager, SIGNAL(simConnected()), m_reactionWheelsInfo, SLOT(configureLayout()));
     connect(m_simDataManager, SIGNAL(simConnected()), m_thrustersInfo, SLOT(configureLayout()));
+    connect(m_simDataManager, SIGNAL(componentsChanged()), m_reactionWheelsInfo, SLOT(configureLayout()));
+    connect(m_simDataManager, SIGNAL(componentsChanged()), m_thrustersInfo, SLOT(configureLayout()));
 //    connect(m_simDataManager, SIGNAL(setOnOffLegendTR(bool)), m_torqueRodInfo, SLOT(setOnOffLegendTR(bool)));
 //    connect(m_simDataManager, SIGNAL(setOnOffLegendTR(bool)), this, SLOT(openLegendTR(bool)));
 //    connect(m_simDataManager, SIGNAL(setOnOffDefaults(CelestialObject_t)), this, SLOT(setOnOffDefaults(CelestialObject_t)));
@@ -164,6 +169,12 @@ MainWindow::MainWindow()
     connect(ui->actionSimTime, SIGNAL(toggled(bool)),m_simTimeInfo, SLOT(setVisible(bool)));
     ui->actionSimTime->setChecked(true);
     m_simTimeInfo->hide();
+
+    addDockWidget(Qt::LeftDockWidgetArea, m_diagnosticsInfo);
+    connect(ui->actionDiagnostics, SIGNAL(toggled(bool)), m_diagnosticsInfo, SLOT(setVisible(bool)));
+    connect(m_simDataManager, SIGNAL(diagnosticsUpdated()), this, SLOT(updateDiagnostics()));
+    ui->actionDiagnostics->setChecked(false);
+    m_diagnosticsInfo->hide();
     
     addDockWidget(Qt::RightDockWidgetArea, m_thrustersInfo);
     connect(ui->actionThrusters, SIGNAL(toggled(bool)), m_thrustersInfo, SLOT(setVisible(bool)));
@@ -216,13 +227,26 @@ MainWindow::MainWindow()
     setWindowStyle(ui->actionDarkStyle);
 
     // Add source information to the status bar
+    ui->statusBar->addPermanentWidget(m_recordStatus);
+    ui->statusBar->addPermanentWidget(m_linkStatus);
     ui->statusBar->addPermanentWidget(m_connectionStatus);
     m_connectionStatus->setText("Source: None");
+    m_linkStatus->hide();
+    m_recordStatus->hide();
     connect(m_simDataManager, SIGNAL(showMessage(QString)), ui->statusBar, SLOT(showMessage(QString)));
     connect(m_simDataManager, SIGNAL(showMessage(QString, int)), ui->statusBar, SLOT(showMessage(QString, int)));
     
     loadSettings();
 
+    // Only subscribe to the telemetry of visible docks
+    QList<QDockWidget *> infoDocks;
+    infoDocks << m_thrustersInfo << m_reactionWheelsInfo << m_cssInfo << m_iruInfo << m_podInfo
+        << m_starTrackerInfo << m_torqueRodInfo << m_totalPowerInfo;
+    for(int i = 0; i < infoDocks.size(); i++) {
+        connect(infoDocks[i], SIGNAL(visibilityChanged(bool)), this, SLOT(updateFieldSubscription()));
+    }
+    updateFieldSubscription();
+
     simDataUpdated();
     
 }
@@ -383,7 +407,7 @@ void MainWindow::simDataUpdated()
     // so just remove excess and rename things as necessary
     int selectedTargetIndex = m_cameraTargetCombo->currentIndex();
     QString selectedTargetName = m_cameraTargetCombo->currentText();
-    QVector<SimObject> simObjects = m_simDataManager->getSimObjects();
+    const QVector<SimObject> &simObjects = m_simDataManager->getSimObjects();
     for(int i = m_cameraTargetCombo->count(); i >= simObjects.size(); i--) {
         m_cameraTargetCombo->removeItem(i); // remove excess items fins que nomes quedi el nombre d'obj del SimObject
     }
@@ -427,6 +451,137 @@ void MainWindow::simDataUpdated()
 //    m_playbackControls->setDateTimeBounds(scSim->ics.JD0);
     m_playbackControls->setCurrentDateTime(scSim->spiceTime.J2000Current);
     m_playbackControls->setPlaySpeed(scSim->realTimeSpeedUpFactor);
+    updateLinkStatus();
+    updateRecordStatus();
+}
+
+void MainWindow::updateLinkStatus()
+{
+    FrameStatistics statistics = m_simDataManager->getFrameStatistics();
+    QString text = QString("Frame: %1 kB").arg(statistics.archiveSize / 1024.0, 0, 'f', 1);
+    if(statistics.framesReceived > 0) {
+        text += QString("  Gaps: %1  Duplicates: %2  Corrupt: %3")
+            .arg(statistics.sequenceGaps).arg(statistics.duplicateFrames).arg(statistics.corruptFrames);
+    }
+    // Only touch the label when the text changed, this runs for every frame
+    if(text == m_linkStatus->text() && m_linkStatus->isVisible() == (statistics.archiveSize > 0)) {
+        return;
+    }
+    m_linkStatus->setVisible(statistics.archiveSize > 0);
+    m_linkStatus->setText(text);
+    QString subscription = statistics.fieldMask == FIELD_MASK_ALL ? QString("all fields")
+        : QString("fields 0x%1").arg(statistics.fieldMask, 2, 16, QChar('0'));
+    m_linkStatus->setToolTip(QString("Subscription: %1\nFrames with the binary header: %2")
+        .arg(subscription).arg(statistics.framesReceived));
+}
+
+void MainWindow::toggleRecording(bool enabled)
+{
+    if(enabled == m_simDataManager->isRecording()) {
+        return;
+    }
+    if(!enabled) {
+        m_simDataManager->stopRecording();
+        ui->statusBar->showMessage("Recording stopped", 5000);
+        updateRecordStatus();
+        return;
+    }
+    QString filename = QFileDialog::getSaveFileName(this, tr("Record Connection"), QDir::currentPath(),
+        tr("Recordings (*.bskrec);;JSON Captures (*.jsonl)"));
+    if(filename.isEmpty() || !m_simDataManager->startRecording(filename)) {
+        ui->actionRecord->setChecked(false);
+        return;
+    }
+    ui->statusBar->showMessage("Recording to " + filename, 5000);
+    updateRecordStatus();
+}
+
+void MainWindow::toggleDiagnosticsLog(bool enabled)
+{
+    if(enabled == m_simDataManager->isDiagnosticsLogging()) {
+        return;
+    }
+    if(!enabled) {
+        m_simDataManager->stopDiagnosticsLog();
+        ui->statusBar->showMessage("Diagnostics log stopped", 5000);
+        return;
+    }
+    QString filename = QFileDialog::getSaveFileName(this, tr("Log Diagnostics"), QDir::currentPath(),
+        tr("CSV Files (*.csv);;JSON Lines (*.json)"));
+    if(filename.isEmpty() || !m_simDataManager->startDiagnosticsLog(filename)) {
+        ui->actionLog_Diagnostics->setChecked(false);
+        return;
+    }
+    ui->statusBar->showMessage("Logging diagnostics to " + filename, 5000);
+}
+
+// Called once per diagnostics interval of a connection
+void MainWindow::updateDiagnostics()
+{
+    if(ui->actionLog_Diagnostics->isChecked() && !m_simDataManager->isDiagnosticsLogging()) {
+        // The log stopped on a write error
+        ui->actionLog_Diagnostics->setChecked(false);
+    }
+    if(m_diagnosticsInfo->isVisible()) {
+        m_diagnosticsInfo->updateDiagnostics(m_simDataManager);
+    }
+}
+
+void MainWindow::updateRecordStatus()
+{
+    RecorderStatistics statistics = m_simDataManager->getRecorderStatistics();
+    if(!m_simDataManager->isRecording()) {
+        if(ui->actionRecord->isChecked()) {
+            // The recorder stopped on a write error
+            ui->actionRecord->setChecked(false);
+            ui->statusBar->showMessage(QString("Recording stopped after %1 frames, could not write")
+                .arg(statistics.framesRecorded), 10000);
+        }
+        m_recordStatus->hide();
+        return;
+    }
+    QString text = QString("Rec: %1 frames  Backlog: %2  Dropped: %3")
+        .arg(statistics.framesRecorded).arg(statistics.backlog).arg(statistics.framesDropped);
+    // Only touch the label when the text changed, this runs for every frame
+    if(text == m_recordStatus->text() && m_recordStatus->isVisible()) {
+        return;
+    }
+    m_recordStatus->setVisible(true);
+    m_recordStatus->setText(text);
+    m_recordStatus->setToolTip(QString("Segment: %1\nWritten: %2 MB\nQueue: %3 frames")
+        .arg(statistics.segment).arg(statistics.bytesWritten / (1024.0 * 1024.0), 0, 'f', 1)
+        .arg(statistics.capacity));
+}
+
+// Subscribes to the telemetry of the docks that are currently shown
+void MainWindow::updateFieldSubscription()
+{
+    unsigned int fields = 0;
+    if(m_thrustersInfo->isVisible()) {
+        fields |= SIM_FIELD_THRUSTERS;
+    }
+    if(m_reactionWheelsInfo->isVisible()) {
+        fields |= SIM_FIELD_REACTION_WHEELS;
+    }
+    if(m_cssInfo->isVisible()) {
+        fields |= SIM_FIELD_CSS;
+    }
+    if(m_iruInfo->isVisible()) {
+        fields |= SIM_FIELD_IRU;
+    }
+    if(m_podInfo->isVisible()) {
+        fields |= SIM_FIELD_POD;
+    }
+    if(m_starTrackerInfo->isVisible()) {
+        fields |= SIM_FIELD_STAR_TRACKER;
+    }
+    if(m_torqueRodInfo->isVisible()) {
+        fields |= SIM_FIELD_TORQUE_RODS;
+    }
+    if(m_totalPowerInfo->isVisible()) {
+        fields |= SIM_FIELD_REACTION_WHEELS | SIM_FIELD_TORQUE_RODS | SIM_FIELD_STAR_TRACKER;
+    }
+    m_simDataManager->setDisplayFields(fields);
 }
 
 void MainWindow::setWindowStyle(QAction *action)
@@ -457,10 +612,13 @@ void MainWindow::openConnection()
     if(dialog->exec()) {
         QString ipAddress = dialog->getIpAddress();
         QString port = dialog->getPort();
+        m_simDataManager->setCompression(dialog->getCompression());
         ui->statusBar->showMessage("Opening " + ipAddress + "::" + port + " and initializing geometries...");
         if(m_simDataManager->openConnection(ipAddress, port)) {
             m_connectionStatus->setText("Source: " + ipAddress + "::" + port);
             ui->actionClose_Connection->setEnabled(true);
+            ui->actionClose_File->setEnabled(false);
+            m_playbackControls->setMode(PlaybackControls::PLAYBACK_STREAM);
         }
         ui->statusBar->clearMessage();
     }
@@ -471,17 +629,26 @@ void MainWindow::closeConnection()
     if(m_simDataManager->closeConnection()) {
         ui->actionClose_Connection->setEnabled(false);
         m_connectionStatus->setText("Source: None");
+        m_linkStatus->hide();
     }
 }
 
 void MainWindow::openFile()
 {
-    QString filename = QFileDialog::getOpenFileName(this, tr("Open Simulation Data File"), QDir::currentPath());
+    QString filename = QFileDialog::getOpenFileName(this, tr("Open Simulation Data File"), QDir::currentPath(),
+        tr("Recordings (*.bskrec);;All Files (*)"));
     if(!filename.isEmpty()) {
         ui->statusBar->showMessage("Opening " + filename + " and initializing geometries...");
         if(m_simDataManager->openFile(filename)) {
             ui->actionClose_File->setEnabled(true);
+            ui->actionClose_Connection->setEnabled(false);
             m_connectionStatus->setText("Source: " + filename);
+            // The first recorded frame is shown once the file is open
+            SpacecraftSim *scSim = m_simDataManager->getSpacecraftSim();
+            m_playbackControls->setDateTimeBounds(PlaybackControls::j2000ToDateTime(scSim->spiceTime.J2000Current),
+                m_simDataManager->getPlaybackDuration());
+            m_playbackControls->setMode(PlaybackControls::PLAYBACK_FILE);
+            m_playbackControls->setCurrentDateTime(scSim->spiceTime.J2000Current);
         }
         ui->statusBar->clearMessage();
     }
@@ -492,6 +659,7 @@ void MainWindow::closeFile()
     if(m_simDataManager->closeFile()) {
         ui->actionClose_File->setEnabled(false);
         m_connectionStatus->setText("Source: None");
+        m_playbackControls->setMode(PlaybackControls::PLAYBACK_STREAM);
     }
 }
 
@@ -568,11 +736,13 @@ void MainWindow::createSceneWidget()
     ui->centralWidgetLayout->setStretch(0, 1);
     connect(ui->actionReset_Camera, SIGNAL(triggered()), m_sceneWidget, SLOT(resetAll()));
     connect(ui->actionWireframe, SIGNAL(toggled(bool)), m_sceneWidget, SLOT(setWireframe(bool)));
+    connect(ui->actionPredict_Motion, SIGNAL(toggled(bool)), m_simDataManager, SLOT(setMotionPrediction(bool)));
     connect(ui->actionCamera_Target, SIGNAL(toggled(bool)), m_sceneWidget, SLOT(setCameraTargetVisible(bool)));
 
     // Setup the simulation data manager
     connect(m_simDataManager, SIGNAL(simDataUpdated()), m_sceneWidget, SLOT(update()));
     connect(m_simDataManager, SIGNAL(simDataUpdated()), this, SLOT(simDataUpdated())); 
+    connect(m_sceneWidget, SIGNAL(frameSwapped()), m_simDataManager, SLOT(framePresented()));
     
     // Camera target combobox
     QLabel *label = new QLabel("Camera Target:");
@@ -702,6 +872,12 @@ void MainWindow::saveSettings()
     settings.setValue("wireframe", ui->actionWireframe->isChecked());
     settings.setValue("cameraTarget", ui->actionCamera_Target->isChecked());
     settings.endGroup();
+
+    settings.beginGroup("stream");
+    settings.setValue("displayDelay", m_simDataManager->getDisplayDelay());
+    settings.setValue("maxPrediction", m_simDataManager->getMaxPrediction());
+    settings.setValue("predictMotion", ui->actionPredict_Motion->isChecked());
+    settings.endGroup();
     
     m_modelsDisplayInfo->saveSettings(&settings);
     m_orbitElementsInfo->saveSettings(&settings);
@@ -717,6 +893,7 @@ void MainWindow::saveSettings()
     m_iruInfo->saveSettings(&settings);
     m_tamInfo->saveSettings(&settings);
     m_starTrackerInfo->saveSettings(&settings);
+    m_diagnosticsInfo->saveSettings(&settings);
     
     settings.beginGroup("view");
     settings.setValue("togWidget", ui->actionScene_Options->isChecked());
@@ -729,6 +906,7 @@ void MainWindow::saveSettings()
     settings.beginGroup("infoPanels");
     settings.setValue("simInfoDisplay",ui->actionSimInfo->isChecked());
     settings.setValue("simTime",ui->actionSimTime->isChecked());
+    settings.setValue("diagnostics",ui->actionDiagnostics->isChecked());
     settings.setValue("thrusters",ui->actionThrusters->isChecked());
     settings.setValue("TR",ui->actionTR->isChecked());
     settings.setValue("CSS",ui->actionCSS->isChecked());
@@ -787,11 +965,19 @@ void MainWindow::loadSettings()
     ui->actionWireframe->setChecked(settings.value("wireframe").toBool());
     ui->actionCamera_Target->setChecked(settings.value("cameraTarget").toBool());
     settings.endGroup();
+
+    settings.beginGroup("stream");
+    // Seconds the display trails a connection, enough for one or two frames
+    m_simDataManager->setDisplayDelay(settings.value("displayDelay", 0.1).toDouble());
+    m_simDataManager->setMaxPrediction(settings.value("maxPrediction", 0.5).toDouble());
+    ui->actionPredict_Motion->setChecked(settings.value("predictMotion").toBool());
+    settings.endGroup();
     
     
     settings.beginGroup("infoPanels");
     ui->actionSimInfo->setChecked(settings.value("simInfoDisplay").toBool());
     ui->actionSimTime->setChecked(settings.value("simTime").toBool());
+    ui->actionDiagnostics->setChecked(settings.value("diagnostics").toBool());
     ui->actionThrusters->setChecked(settings.value("thrusters").toBool());
     ui->actionTR->setChecked(settings.value("TR").toBool());
     ui->actionCSS->setChecked(settings.value("CSS").toBool());
@@ -829,6 +1015,7 @@ void MainWindow::loadSettings()
     m_iruInfo->loadSettings(&settings);
     m_tamInfo->loadSettings(&settings);
     m_starTrackerInfo->loadSettings(&settings);
+    m_diagnosticsInfo->loadSettings(&settings);
 
     settings.beginGroup("Toggleable Objects");
     QStringList childKeys = settings.childKeys();
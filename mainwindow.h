@@ -44,6 +44,7 @@
 #include "iruinfo.h"
 #include "taminfo.h"
 #include "startrackerinfo.h"
+#include "diagnosticsinfo.h"
 
 //#include "starcatalogparser.h"
 
@@ -89,6 +90,12 @@ protected slots:
     void openFile();
     void closeFile();
     void toggleFullScreen();
+    void updateLinkStatus();
+    void toggleRecording(bool enabled);
+    void updateRecordStatus();
+    void toggleDiagnosticsLog(bool enabled);
+    void updateDiagnostics();
+    void updateFieldSubscription();
 
 private:
     Ui::MainWindow *ui;
@@ -99,6 +106,10 @@ private:
     SceneWidget *m_sceneWidget;
     PlaybackControls *m_playbackControls;
     QLabel *m_connectionStatus;
+    // Frame size, subscription and gap/duplicate/checksum counters of the connection
+    QLabel *m_linkStatus;
+    // Frames, backlog and drops of the recorder
+    QLabel *m_recordStatus;
     ModelsDisplayInfo *m_modelsDisplayInfo;
     OrbitElementsInfo *m_orbitElementsInfo;
     ReactionWheelsInfo *m_reactionWheelsInfo;
@@ -113,6 +124,7 @@ private:
     IruInfo *m_iruInfo;
     TamInfo *m_tamInfo;
     StarTrackerInfo *m_starTrackerInfo;
+    DiagnosticsInfo *m_diagnosticsInfo;
     QComboBox *m_cameraTargetCombo;
     QComboBox *m_cameraModeCombo;
     QLabel *m_zoomSpeedLabel;
@@ -0,0 +1,181 @@
+/*
+ ISC License
+
+ Copyright (c) 2016-2017, Autonomous Vehicle Systems Lab, University of Colorado at Boulder
+
+ Permission to use, copy, modify, and/or distribute this software for any
+ purpose with or without fee is hereby granted, provided that the above
+ copyright notice and this permission notice appear in all copies.
+
+ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+//
+// RecordingPlayer.hpp
+//
+// University of Colorado, Autonomous Vehicle Systems (AVS) Lab
+// Unpublished Copyright (c) 2012-2015 University of Colorado, All Rights Reserved
+//
+
+#ifndef RECORDING_PLAYER_HPP
+#define RECORDING_PLAYER_HPP
+
+#include "TelemetryRecording.hpp"
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <string>
+
+// Plays back a recording for one consumer thread. The consumer tells the
+// player which frame it expects to show next with prefetch(); a worker thread
+// decodes that frame while the current one is displayed, so readFrame() of
+// the expected frame only copies it. Any other frame, e.g. after a seek, is
+// decoded on the calling thread, which costs at most a keyframe interval of
+// deltas.
+template <typename T>
+class RecordingPlayer
+{
+public:
+    RecordingPlayer()
+        : m_cursor(m_reader)
+        , m_prefetchCursor(m_reader)
+        , m_requested(0)
+        , m_hasRequest(false)
+        , m_prefetched(0)
+        , m_hasPrefetched(false)
+        , m_shouldStop(false)
+    {
+
+    }
+
+    ~RecordingPlayer()
+    {
+        close();
+    }
+
+    bool open(const std::string &filename)
+    {
+        close();
+        if(!m_reader.open(filename)) {
+            return false;
+        }
+        m_cursor.reset();
+        m_prefetchCursor.reset();
+        m_hasRequest = false;
+        m_hasPrefetched = false;
+        m_shouldStop = false;
+        m_thread.reset(new boost::thread(boost::bind(&RecordingPlayer::run, this)));
+        return true;
+    }
+
+    void close()
+    {
+        if(m_thread) {
+            {
+                boost::mutex::scoped_lock lock(m_mutex);
+                m_shouldStop = true;
+            }
+            m_condition.notify_one();
+            m_thread->join();
+            m_thread.reset();
+        }
+        m_reader.close();
+    }
+
+    bool isOpen() { return m_reader.isOpen(); }
+    size_t frameCount() { return m_reader.frameCount(); }
+    double frameTime(size_t index) { return m_reader.frameTime(index); }
+    double startTime() { return m_reader.startTime(); }
+    double endTime() { return m_reader.endTime(); }
+    size_t findFrame(double time) { return m_reader.findFrame(time); }
+
+    // Asks the worker to decode frame index ahead of readFrame(), a newer
+    // request replaces one not started yet
+    void prefetch(size_t index)
+    {
+        if(!m_thread || index >= m_reader.frameCount()) {
+            return;
+        }
+        {
+            boost::mutex::scoped_lock lock(m_mutex);
+            if(m_hasPrefetched && m_prefetched == index) {
+                return;
+            }
+            m_requested = index;
+            m_hasRequest = true;
+        }
+        m_condition.notify_one();
+    }
+
+    bool readFrame(size_t index, T &t)
+    {
+        {
+            boost::mutex::scoped_lock lock(m_mutex);
+            if(m_hasPrefetched && m_prefetched == index) {
+                t = m_prefetchedFrame;
+                return true;
+            }
+        }
+        return m_cursor.readFrame(index, t);
+    }
+
+private:
+    TelemetryRecordingReader m_reader;
+    // Used by the consumer thread
+    RecordingCursor m_cursor;
+    // Used by the worker thread
+    RecordingCursor m_prefetchCursor;
+    T m_decoded;
+
+    boost::scoped_ptr<boost::thread> m_thread;
+    boost::mutex m_mutex;
+    boost::condition_variable m_condition;
+    // Guarded by m_mutex
+    size_t m_requested;
+    bool m_hasRequest;
+    size_t m_prefetched;
+    bool m_hasPrefetched;
+    T m_prefetchedFrame;
+    bool m_shouldStop;
+
+    void run()
+    {
+        while(true) {
+            size_t index;
+            {
+                boost::mutex::scoped_lock lock(m_mutex);
+                while(!m_hasRequest && !m_shouldStop) {
+                    m_condition.wait(lock);
+                }
+                if(m_shouldStop) {
+                    return;
+                }
+                index = m_requested;
+                m_hasRequest = false;
+            }
+            // Decoded outside the lock so readFrame() of the previous frame
+            // does not wait for it
+            if(!m_prefetchCursor.readFrame(index, m_decoded)) {
+                continue;
+            }
+            boost::mutex::scoped_lock lock(m_mutex);
+            m_prefetchedFrame = m_decoded;
+            m_prefetched = index;
+            m_hasPrefetched = true;
+        }
+    }
+
+    RecordingPlayer(const RecordingPlayer &);
+    RecordingPlayer &operator=(const RecordingPlayer &);
+};
+
+#endif // RECORDING_PLAYER_HPP
@@ -0,0 +1,290 @@
+/*
+ ISC License
+
+ Copyright (c) 2016-2017, Autonomous Vehicle Systems Lab, University of Colorado at Boulder
+
+ Permission to use, copy, modify, and/or distribute this software for any
+ purpose with or without fee is hereby granted, provided that the above
+ copyright notice and this permission notice appear in all copies.
+
+ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+//
+// TelemetryRecorder.hpp
+//
+// University of Colorado, Autonomous Vehicle Systems (AVS) Lab
+// Unpublished Copyright (c) 2012-2015 University of Colorado, All Rights Reserved
+//
+
+#ifndef TELEMETRY_RECORDER_HPP
+#define TELEMETRY_RECORDER_HPP
+
+#include "TelemetryRecording.hpp"
+#include "BoundedQueue.hpp"
+
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <string>
+
+// Counters of a TelemetryRecorder, safe to read while recording
+struct RecorderStatistics
+{
+    RecorderStatistics()
+        : framesRecorded(0)
+        , framesDropped(0)
+        , backlog(0)
+        , capacity(0)
+        , bytesWritten(0)
+        , segment(0)
+    {
+
+    }
+
+    unsigned long framesRecorded;
+    // Frames that found the queue full
+    unsigned long framesDropped;
+    // Frames queued but not written yet
+    size_t backlog;
+    size_t capacity;
+    boost::uint64_t bytesWritten;
+    // Number of the segment being written, counting from 0
+    size_t segment;
+};
+
+// Records every frame passed to record() on a thread of its own. Frames are
+// copied into a preallocated BoundedQueue so the caller, usually a network
+// thread, never waits on the disk; if the disk falls behind by more than the
+// queue holds, frames are dropped and counted. The recorder thread writes
+// whatever is queued in one batch and then sleeps for a flush interval.
+//
+// A recording is split into segments of a fixed size named
+// <name>.<segment>.<extension>, which TelemetryRecordingReader opens together
+// as one recording. A new segment is also started when the simulation time
+// jumps backwards, e.g. after the simulation was restarted, so each run
+// replays on its own.
+template <typename T>
+class TelemetryRecorder
+{
+public:
+    TelemetryRecorder()
+        : m_queueCapacity(defaultQueueCapacity)
+        , m_segmentSize(defaultSegmentSize)
+        , m_maxSegments(0)
+        , m_isRecording(false)
+        , m_isAccepting(false)
+        , m_recordCalls(0)
+        , m_shouldStop(false)
+        , m_framesRecorded(0)
+        , m_framesDropped(0)
+        , m_bytesWritten(0)
+        , m_segment(0)
+    {
+
+    }
+
+    ~TelemetryRecorder()
+    {
+        stop();
+    }
+
+    // Frames the queue holds, takes effect on the next start
+    void setQueueCapacity(size_t frames) { m_queueCapacity = frames; }
+    // Size at which a new segment is started, takes effect on the next start
+    void setSegmentSize(boost::uint64_t bytes) { m_segmentSize = bytes; }
+    // Oldest segments are deleted beyond this count, 0 keeps all of them
+    void setMaxSegments(size_t count) { m_maxSegments = count; }
+
+    bool start(const std::string &filename)
+    {
+        stop();
+        m_filename = filename;
+        m_segment = 0;
+        m_segments.clear();
+        m_framesRecorded = 0;
+        m_framesDropped = 0;
+        m_bytesWritten = 0;
+        m_writer.setBufferSize(writeBufferSize);
+        if(!openSegment()) {
+            return false;
+        }
+        // No record() call is inside the queue while m_isAccepting is false
+        m_queue.reset(m_queueCapacity);
+        m_shouldStop = false;
+        m_isRecording = true;
+        m_thread.reset(new boost::thread(boost::bind(&TelemetryRecorder::run, this)));
+        m_isAccepting = true;
+        return true;
+    }
+
+    // Writes the frames still queued and closes the recording. Another
+    // thread may be calling record() meanwhile, frames it passes once this
+    // has started are dropped.
+    void stop()
+    {
+        if(!m_thread) {
+            return;
+        }
+        m_isAccepting = false;
+        // A record() call that saw m_isAccepting set finishes its push
+        while(m_recordCalls > 0) {
+            boost::this_thread::yield();
+        }
+        m_isRecording = false;
+        m_shouldStop = true;
+        m_thread->join();
+        m_thread.reset();
+        m_writer.close();
+    }
+
+    // Also false once writing failed, e.g. because the disk is full
+    bool isRecording() { return m_isRecording; }
+
+    // Queues a copy of frame, never blocks. Returns false if the frame was
+    // dropped because the recorder is not running or has fallen behind.
+    // Only one thread at a time may call this.
+    bool record(const T &frame)
+    {
+        // Counted before m_isAccepting is read, stop() clears the flag before
+        // it waits for the count, so one of the two sees the other
+        m_recordCalls++;
+        if(!m_isAccepting || !m_isRecording) {
+            m_recordCalls--;
+            return false;
+        }
+        T *slot = m_queue.writeSlot();
+        if(!slot) {
+            m_framesDropped++;
+            m_recordCalls--;
+            return false;
+        }
+        *slot = frame;
+        m_queue.push();
+        m_recordCalls--;
+        return true;
+    }
+
+    RecorderStatistics statistics()
+    {
+        RecorderStatistics statistics;
+        statistics.framesRecorded = m_framesRecorded;
+        statistics.framesDropped = m_framesDropped;
+        if(m_isRecording) {
+            statistics.backlog = m_queue.size();
+            statistics.capacity = m_queue.capacity();
+        }
+        statistics.bytesWritten = m_bytesWritten;
+        statistics.segment = m_segment;
+        return statistics;
+    }
+
+    // File name of a segment of the recording started as filename
+    static std::string segmentFilename(const std::string &filename, size_t segment)
+    {
+        return recordingSegmentFilename(filename, segment);
+    }
+
+private:
+    enum {
+        defaultQueueCapacity = 2048,
+        defaultSegmentSize = 1024 * 1024 * 1024,
+        writeBufferSize = 1024 * 1024,
+        // Milliseconds the recorder thread sleeps when the queue is empty
+        flushInterval = 20
+    };
+
+    std::string m_filename;
+    size_t m_queueCapacity;
+    boost::uint64_t m_segmentSize;
+    size_t m_maxSegments;
+    BoundedQueue<T> m_queue;
+    // Only used by the recorder thread while it runs
+    TelemetryRecordingWriter m_writer;
+    std::deque<std::string> m_segments;
+    boost::scoped_ptr<boost::thread> m_thread;
+    boost::atomic<bool> m_isRecording;
+    // Set between start() and stop(), record() only touches the queue then
+    boost::atomic<bool> m_isAccepting;
+    boost::atomic<int> m_recordCalls;
+    boost::atomic<bool> m_shouldStop;
+    boost::atomic<unsigned long> m_framesRecorded;
+    boost::atomic<unsigned long> m_framesDropped;
+    boost::atomic<boost::uint64_t> m_bytesWritten;
+    boost::atomic<size_t> m_segment;
+
+    void run()
+    {
+        while(true) {
+            // Read before draining so frames queued before stop() are written
+            bool shouldStop = m_shouldStop;
+            size_t written = 0;
+            while(T *frame = m_queue.readSlot()) {
+                writeFrame(*frame);
+                m_queue.pop();
+                written++;
+            }
+            if(written > 0) {
+                m_writer.flush();
+            } else if(shouldStop) {
+                break;
+            } else {
+                boost::this_thread::sleep_for(boost::chrono::milliseconds(flushInterval));
+            }
+        }
+    }
+
+    void writeFrame(const T &frame)
+    {
+        if(m_writer.frameCount() > 0 && (m_writer.size() >= m_segmentSize
+                || frameSimTime(frame) < m_writer.lastSimTime())) {
+            m_segment++;
+            if(!openSegment()) {
+                m_isRecording = false;
+            }
+        }
+        boost::uint64_t size = m_writer.size();
+        if(!m_writer.appendFrame(frame)) {
+            m_framesDropped++;
+            if(!m_writer.isOpen()) {
+                // Write error, frames still queued are dropped as well
+                m_isRecording = false;
+            }
+            return;
+        }
+        m_framesRecorded++;
+        m_bytesWritten += m_writer.size() - size;
+    }
+
+    bool openSegment()
+    {
+        m_writer.close();
+        std::string filename = segmentFilename(m_filename, m_segment);
+        if(!m_writer.open(filename, WIRE_FORMAT_BINARY, m_segmentSize)) {
+            return false;
+        }
+        m_segments.push_back(filename);
+        while(m_maxSegments > 0 && m_segments.size() > m_maxSegments) {
+            std::remove(m_segments.front().c_str());
+            std::remove(recordingIndexFilename(m_segments.front()).c_str());
+            m_segments.pop_front();
+        }
+        return true;
+    }
+
+    TelemetryRecorder(const TelemetryRecorder &);
+    TelemetryRecorder &operator=(const TelemetryRecorder &);
+};
+
+#endif // TELEMETRY_RECORDER_HPP
@@ -0,0 +1,850 @@
+/*
+ ISC License
+
+ Copyright (c) 2016-2017, Autonomous Vehicle Systems Lab, University of Colorado at Boulder
+
+ Permission to use, copy, modify, and/or distribute this software for any
+ purpose with or without fee is hereby granted, provided that the above
+ copyright notice and this permission notice appear in all copies.
+
+ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+//
+// TelemetryRecording.hpp
+//
+// University of Colorado, Autonomous Vehicle Systems (AVS) Lab
+// Unpublished Copyright (c) 2012-2015 University of Colorado, All Rights Reserved
+//
+
+#ifndef TELEMETRY_RECORDING_HPP
+#define TELEMETRY_RECORDING_HPP
+
+#include "SerializeArchive.hpp"
+#include "FrameDelta.hpp"
+#include "Crc32c.hpp"
+
+#include <boost/archive/basic_archive.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#endif
+
+// A recording is an append-only data file of serialized frames plus an index
+// file next to it (the data file name with RECORDING_INDEX_SUFFIX appended)
+// mapping the simulation time of every frame to its offset in the data file.
+// Both are mapped into memory when replayed, so opening a recording costs the
+// same regardless of its length and only the frames looked at are paged in.
+//
+// Data file:  RecordingFileHeader, then per frame a RecordingFrameHeader
+//             followed by the archive
+// Index file: RecordingIndexHeader, then one RecordingIndexEntry per frame
+//
+// Since version 2 only every keyframeInterval-th frame is stored whole, the
+// frames in between are stored as a FrameDelta against the frame before them
+// and flagged RECORDING_FRAME_DELTA. Any frame is rebuilt from the nearest
+// keyframe before it, see RecordingCursor.
+//
+// All headers are written in the layout of the recording host, like the
+// archives themselves; the data layout is kept in the file header.
+//
+// A long recording may be split into segments named <name>.<segment>.<ext>,
+// each a data and index file pair starting with a keyframe. The reader opens
+// the segments of a run together as one recording.
+#define RECORDING_FILE_MAGIC  0x42534b52 /* "BSKR" */
+#define RECORDING_FRAME_MAGIC 0x42534b46 /* "BSKF" */
+#define RECORDING_INDEX_MAGIC 0x42534b49 /* "BSKI" */
+#define RECORDING_VERSION 2
+#define RECORDING_FRAME_DELTA 0x01
+#define RECORDING_INDEX_SUFFIX ".idx"
+
+struct RecordingFileHeader
+{
+    boost::uint32_t magic;
+    boost::uint32_t version;
+    // Data layout of the recording host, binary archives need a matching reader
+    boost::int32_t littleEndian;
+    boost::int32_t sizeOfInt;
+    boost::int32_t sizeOfLong;
+    boost::int32_t sizeOfDouble;
+    boost::int32_t archiveVersion;
+    // WireFormat_t of the archives
+    boost::uint32_t format;
+};
+
+struct RecordingFrameHeader
+{
+    boost::uint32_t magic;
+    boost::uint32_t size;
+    double simTime;
+    boost::uint32_t crc;
+    // RECORDING_FRAME_DELTA, version 1 recordings only have keyframes
+    boost::uint32_t flags;
+};
+
+struct RecordingIndexHeader
+{
+    boost::uint32_t magic;
+    boost::uint32_t version;
+    boost::uint32_t entrySize;
+    boost::uint32_t reserved;
+};
+
+struct RecordingIndexEntry
+{
+    double simTime;
+    // Offset of the frame's RecordingFrameHeader in the data file
+    boost::uint64_t offset;
+};
+
+inline void initRecordingFileHeader(RecordingFileHeader &header, WireFormat_t format)
+{
+    boost::uint16_t endianTest = 1;
+    header.magic = RECORDING_FILE_MAGIC;
+    header.version = RECORDING_VERSION;
+    header.littleEndian = *reinterpret_cast<unsigned char *>(&endianTest) == 1;
+    header.sizeOfInt = sizeof(int);
+    header.sizeOfLong = sizeof(long);
+    header.sizeOfDouble = sizeof(double);
+    header.archiveVersion = boost::archive::BOOST_ARCHIVE_VERSION();
+    header.format = format;
+}
+
+// Text archives replay anywhere, binary archives and the headers themselves
+// only with the data layout they were written with
+inline bool isRecordingCompatible(const RecordingFileHeader &header)
+{
+    RecordingFileHeader local;
+    initRecordingFileHeader(local, WIRE_FORMAT_BINARY);
+    if(header.magic != RECORDING_FILE_MAGIC || header.version < 1 || header.version > RECORDING_VERSION) {
+        return false;
+    }
+    return header.littleEndian == local.littleEndian
+        && header.sizeOfDouble == local.sizeOfDouble
+        && (header.format == WIRE_FORMAT_TEXT
+            || (header.sizeOfInt == local.sizeOfInt
+                && header.sizeOfLong == local.sizeOfLong
+                && header.archiveVersion == local.archiveVersion));
+}
+
+inline std::string recordingIndexFilename(const std::string &filename)
+{
+    return filename + RECORDING_INDEX_SUFFIX;
+}
+
+// File name of a segment of the recording named filename
+inline std::string recordingSegmentFilename(const std::string &filename, size_t segment)
+{
+    char number[16];
+    std::sprintf(number, ".%03u", (unsigned int)segment);
+    size_t dot = filename.find_last_of('.');
+    size_t separator = filename.find_last_of("/\\");
+    if(dot == std::string::npos || (separator != std::string::npos && dot < separator)) {
+        return filename + number;
+    }
+    return filename.substr(0, dot) + number + filename.substr(dot);
+}
+
+// Inverse of recordingSegmentFilename, false if filename is not a segment
+inline bool parseRecordingSegmentFilename(const std::string &filename, std::string &recording, size_t &segment)
+{
+    size_t separator = filename.find_last_of("/\\");
+    size_t start = separator == std::string::npos ? 0 : separator + 1;
+    size_t end = filename.find_last_of('.');
+    if(end == std::string::npos || end < start) {
+        return false;
+    }
+    std::string extension = filename.substr(end);
+    size_t dot = filename.find_last_of('.', end - 1);
+    if(end == 0 || dot == std::string::npos || dot < start) {
+        // Segment of a recording named without an extension
+        dot = end;
+        end = filename.size();
+        extension.clear();
+    }
+    if(end - dot - 1 < 3 || filename.find_first_not_of("0123456789", dot + 1) < end) {
+        return false;
+    }
+    segment = (size_t)std::strtoul(filename.c_str() + dot + 1, 0, 10);
+    recording = filename.substr(0, dot) + extension;
+    return true;
+}
+
+// Writes a recording. Frames must be appended in order of simulation time,
+// the index is only searchable if it is sorted.
+class TelemetryRecordingWriter
+{
+public:
+    TelemetryRecordingWriter()
+        : m_dataFile(0)
+        , m_indexFile(0)
+        , m_format(WIRE_FORMAT_BINARY)
+        , m_bufferSize(0)
+        , m_keyframeInterval(defaultKeyframeInterval)
+        , m_reservedSize(0)
+        , m_offset(0)
+        , m_frameCount(0)
+        , m_framesSinceKeyframe(0)
+        , m_lastSimTime(0.0)
+    {
+
+    }
+
+    ~TelemetryRecordingWriter()
+    {
+        close();
+    }
+
+    // Size of the write buffer of the data file, frames are written to the
+    // file once it is full or on flush(). 0 keeps the C library default.
+    // Takes effect on the next open.
+    void setBufferSize(size_t bytes) { m_bufferSize = bytes; }
+    // Every interval-th frame is stored whole, 1 stores every frame whole.
+    // Seeking decodes up to interval - 1 deltas.
+    void setKeyframeInterval(size_t interval) { m_keyframeInterval = interval > 0 ? interval : 1; }
+
+    // Creates the data and index file, replacing existing ones. With a
+    // reservedSize the blocks of the data file are allocated up front, so
+    // appending frames does not allocate and a full disk shows at open(). The
+    // unused part is cut off by close(), a crashed writer leaves it zero
+    // filled which readers skip.
+    bool open(const std::string &filename, WireFormat_t format = WIRE_FORMAT_BINARY,
+        boost::uint64_t reservedSize = 0)
+    {
+        close();
+        m_dataFile = std::fopen(filename.c_str(), "wb");
+        m_indexFile = std::fopen(recordingIndexFilename(filename).c_str(), "wb");
+        if(!m_dataFile || !m_indexFile) {
+            std::cout << "Error in " << __FUNCTION__ << ": cannot create " << filename << std::endl;
+            close();
+            return false;
+        }
+        if(m_bufferSize > 0) {
+            std::setvbuf(m_dataFile, 0, _IOFBF, m_bufferSize);
+        }
+        m_filename = filename;
+        m_format = format;
+        RecordingFileHeader fileHeader;
+        initRecordingFileHeader(fileHeader, format);
+        RecordingIndexHeader indexHeader;
+        indexHeader.magic = RECORDING_INDEX_MAGIC;
+        indexHeader.version = RECORDING_VERSION;
+        indexHeader.entrySize = sizeof(RecordingIndexEntry);
+        indexHeader.reserved = 0;
+        if(std::fwrite(&fileHeader, sizeof(fileHeader), 1, m_dataFile) != 1
+            || std::fwrite(&indexHeader, sizeof(indexHeader), 1, m_indexFile) != 1) {
+            std::cout << "Error in " << __FUNCTION__ << ": cannot write " << filename << std::endl;
+            close();
+            return false;
+        }
+        m_offset = sizeof(fileHeader);
+        m_frameCount = 0;
+        m_framesSinceKeyframe = 0;
+        m_reference.clear();
+        m_lastSimTime = 0.0;
+        m_reservedSize = 0;
+        if(reservedSize > m_offset && allocate(reservedSize)) {
+            m_reservedSize = reservedSize;
+        }
+        return true;
+    }
+
+    bool isOpen() { return m_dataFile != 0; }
+    WireFormat_t format() { return m_format; }
+    size_t frameCount() { return m_frameCount; }
+    // Bytes of frames and headers written to the data file
+    boost::uint64_t size() { return m_offset; }
+    double lastSimTime() { return m_lastSimTime; }
+
+    // Appends an archive in the recording's format, stored as a delta
+    // against the previous one unless a keyframe is due
+    bool append(const std::string &archive, double simTime)
+    {
+        if(!m_dataFile) {
+            return false;
+        }
+        if(m_frameCount > 0 && simTime < m_lastSimTime) {
+            std::cout << "Error in " << __FUNCTION__ << ": frame at " << simTime
+                << " is older than the last recorded frame at " << m_lastSimTime << std::endl;
+            return false;
+        }
+        const std::string *payload = &archive;
+        boost::uint32_t flags = 0;
+        if(m_framesSinceKeyframe + 1 < m_keyframeInterval && m_frameCount > 0) {
+            m_delta.clear();
+            encodeFrameDelta(m_reference, archive, m_delta);
+            if(m_delta.size() < archive.size()) {
+                payload = &m_delta;
+                flags = RECORDING_FRAME_DELTA;
+            }
+        }
+        size_t size = payload->size();
+        RecordingFrameHeader header;
+        header.magic = RECORDING_FRAME_MAGIC;
+        header.size = (boost::uint32_t)size;
+        header.simTime = simTime;
+        header.crc = crc32c(payload->data(), size);
+        header.flags = flags;
+        RecordingIndexEntry entry;
+        entry.simTime = simTime;
+        entry.offset = m_offset;
+        // The index entry follows its frame so a crash can only leave frames
+        // without an entry, which the reader recovers by scanning
+        if(std::fwrite(&header, sizeof(header), 1, m_dataFile) != 1
+            || std::fwrite(payload->data(), 1, size, m_dataFile) != size
+            || std::fwrite(&entry, sizeof(entry), 1, m_indexFile) != 1) {
+            std::cout << "Error in " << __FUNCTION__ << ": write failed, closing the recording" << std::endl;
+            close();
+            return false;
+        }
+        m_offset += sizeof(header) + size;
+        m_frameCount++;
+        m_framesSinceKeyframe = (flags & RECORDING_FRAME_DELTA) ? m_framesSinceKeyframe + 1 : 0;
+        m_reference = archive;
+        m_lastSimTime = simTime;
+        return true;
+    }
+
+    template <typename T>
+    bool appendFrame(const T &t)
+    {
+        if(!serializeArchive(t, m_format, m_buffer)) {
+            return false;
+        }
+        return append(m_buffer, frameSimTime(t));
+    }
+
+    void flush()
+    {
+        if(m_dataFile) {
+            std::fflush(m_dataFile);
+            std::fflush(m_indexFile);
+        }
+    }
+
+    void close()
+    {
+        // Data first, see append
+        if(m_dataFile) {
+            std::fclose(m_dataFile);
+            m_dataFile = 0;
+            if(m_reservedSize > m_offset) {
+                boost::system::error_code ec;
+                boost::filesystem::resize_file(m_filename, m_offset, ec);
+            }
+            m_reservedSize = 0;
+        }
+        if(m_indexFile) {
+            std::fclose(m_indexFile);
+            m_indexFile = 0;
+        }
+    }
+
+private:
+    std::FILE *m_dataFile;
+    std::FILE *m_indexFile;
+    std::string m_filename;
+    WireFormat_t m_format;
+    size_t m_bufferSize;
+    size_t m_keyframeInterval;
+    boost::uint64_t m_reservedSize;
+    boost::uint64_t m_offset;
+    size_t m_frameCount;
+    size_t m_framesSinceKeyframe;
+    double m_lastSimTime;
+    std::string m_buffer;
+    // Archive of the previous frame and the delta against it
+    std::string m_reference;
+    std::string m_delta;
+
+    enum { defaultKeyframeInterval = 64 };
+
+    // Allocates the blocks of the first size bytes of the data file. Sizing
+    // the file alone would leave it sparse on most POSIX file systems; NTFS
+    // allocates the clusters when a file is extended.
+    bool allocate(boost::uint64_t size)
+    {
+        std::fflush(m_dataFile);
+#ifndef _WIN32
+        int error = posix_fallocate(fileno(m_dataFile), 0, (off_t)size);
+        if(error != 0) {
+            std::cout << "Error in " << __FUNCTION__ << ": cannot allocate " << size << " bytes for "
+                      << m_filename << " (" << std::strerror(error) << ")" << std::endl;
+            return false;
+        }
+        return true;
+#else
+        boost::system::error_code ec;
+        boost::filesystem::resize_file(m_filename, size, ec);
+        return !ec;
+#endif
+    }
+
+    TelemetryRecordingWriter(const TelemetryRecordingWriter &);
+    TelemetryRecordingWriter &operator=(const TelemetryRecordingWriter &);
+};
+
+// Reads one data file of a recording from memory mapped files. Frames are
+// looked up by simulation time with a binary search of the index; a missing
+// or short index (e.g. the recorder was killed) is completed by scanning the
+// frames it does not cover.
+class RecordingSegmentReader
+{
+public:
+    RecordingSegmentReader()
+        : m_data(0)
+        , m_dataSize(0)
+        , m_format(WIRE_FORMAT_BINARY)
+        , m_index(0)
+        , m_indexCount(0)
+    {
+
+    }
+
+    bool open(const std::string &filename)
+    {
+        close();
+        try {
+            boost::interprocess::file_mapping dataFile(filename.c_str(), boost::interprocess::read_only);
+            boost::interprocess::mapped_region(dataFile, boost::interprocess::read_only).swap(m_dataRegion);
+        } catch(boost::interprocess::interprocess_exception &e) {
+            std::cout << "Error in " << __FUNCTION__ << ": " << filename << ": " << e.what() << std::endl;
+            return false;
+        }
+        m_data = static_cast<const char *>(m_dataRegion.get_address());
+        m_dataSize = m_dataRegion.get_size();
+        RecordingFileHeader fileHeader;
+        if(m_dataSize < sizeof(fileHeader)) {
+            std::cout << "Error in " << __FUNCTION__ << ": " << filename << " is not a recording" << std::endl;
+            close();
+            return false;
+        }
+        std::memcpy(&fileHeader, m_data, sizeof(fileHeader));
+        if(!isRecordingCompatible(fileHeader)) {
+            std::cout << "Error in " << __FUNCTION__ << ": " << filename
+                << " is not a recording or was written with a different data layout" << std::endl;
+            close();
+            return false;
+        }
+        m_format = (WireFormat_t)fileHeader.format;
+
+        openIndex(recordingIndexFilename(filename));
+        // Frames recorded after the last index entry
+        boost::uint64_t offset = sizeof(RecordingFileHeader);
+        if(m_indexCount > 0) {
+            RecordingFrameHeader last;
+            readFrameHeader(m_index[m_indexCount - 1].offset, last);
+            offset = m_index[m_indexCount - 1].offset + sizeof(last) + last.size;
+        }
+        scanFrames(offset);
+        return true;
+    }
+
+    void close()
+    {
+        boost::interprocess::mapped_region().swap(m_indexRegion);
+        boost::interprocess::mapped_region().swap(m_dataRegion);
+        m_data = 0;
+        m_dataSize = 0;
+        m_index = 0;
+        m_indexCount = 0;
+        m_scanned.clear();
+    }
+
+    bool isOpen() { return m_data != 0; }
+    WireFormat_t format() { return m_format; }
+    size_t frameCount() { return m_indexCount + m_scanned.size(); }
+    double frameTime(size_t index) { return entry(index).simTime; }
+    double startTime() { return frameCount() > 0 ? frameTime(0) : 0.0; }
+    double endTime() { return frameCount() > 0 ? frameTime(frameCount() - 1) : 0.0; }
+
+    // Index of the last frame at or before time, the first frame if time
+    // is before the start of the recording
+    size_t findFrame(double time)
+    {
+        size_t first = 0;
+        size_t count = frameCount();
+        // upper_bound over the mapped and the scanned entries
+        while(count > 0) {
+            size_t step = count / 2;
+            if(entry(first + step).simTime <= time) {
+                first += step + 1;
+                count -= step + 1;
+            } else {
+                count = step;
+            }
+        }
+        return first > 0 ? first - 1 : 0;
+    }
+
+    // Stored frame inside the mapped file, checked against its CRC. This is
+    // a FrameDelta against the frame before it if flags has
+    // RECORDING_FRAME_DELTA set, otherwise the archive.
+    bool frameData(size_t index, const char *&data, size_t &size, boost::uint32_t &flags)
+    {
+        if(index >= frameCount()) {
+            return false;
+        }
+        boost::uint64_t offset = entry(index).offset;
+        RecordingFrameHeader header;
+        if(!readFrameHeader(offset, header)) {
+            return false;
+        }
+        data = m_data + offset + sizeof(header);
+        size = header.size;
+        flags = header.flags;
+        if(crc32c(data, size) != header.crc) {
+            std::cout << "Error in " << __FUNCTION__ << ": frame " << index << " is corrupt" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool isKeyframe(size_t index)
+    {
+        RecordingFrameHeader header;
+        return index < frameCount() && readFrameHeader(entry(index).offset, header)
+            && !(header.flags & RECORDING_FRAME_DELTA);
+    }
+
+    // Nearest keyframe at or before index, every frame is decoded from there
+    size_t keyframeIndex(size_t index)
+    {
+        while(index > 0 && !isKeyframe(index)) {
+            index--;
+        }
+        return index;
+    }
+
+private:
+    boost::interprocess::mapped_region m_dataRegion;
+    const char *m_data;
+    size_t m_dataSize;
+    WireFormat_t m_format;
+
+    boost::interprocess::mapped_region m_indexRegion;
+    const RecordingIndexEntry *m_index;
+    size_t m_indexCount;
+    // Entries of frames the index file does not cover
+    std::vector<RecordingIndexEntry> m_scanned;
+
+    const RecordingIndexEntry &entry(size_t index)
+    {
+        return index < m_indexCount ? m_index[index] : m_scanned[index - m_indexCount];
+    }
+
+    // Maps the index file, only the entries of complete frames are used
+    void openIndex(const std::string &filename)
+    {
+        try {
+            boost::interprocess::file_mapping indexFile(filename.c_str(), boost::interprocess::read_only);
+            boost::interprocess::mapped_region(indexFile, boost::interprocess::read_only).swap(m_indexRegion);
+        } catch(boost::interprocess::interprocess_exception &e) {
+            // Also thrown for an empty file
+            std::cout << "Recording index " << filename << " not readable, scanning the recording" << std::endl;
+            return;
+        }
+        RecordingIndexHeader header;
+        if(m_indexRegion.get_size() < sizeof(header)) {
+            return;
+        }
+        std::memcpy(&header, m_indexRegion.get_address(), sizeof(header));
+        if(header.magic != RECORDING_INDEX_MAGIC || header.version < 1 || header.version > RECORDING_VERSION
+            || header.entrySize != sizeof(RecordingIndexEntry)) {
+            std::cout << "Recording index " << filename << " not compatible, scanning the recording" << std::endl;
+            return;
+        }
+        m_index = reinterpret_cast<const RecordingIndexEntry *>(
+            static_cast<const char *>(m_indexRegion.get_address()) + sizeof(header));
+        m_indexCount = (m_indexRegion.get_size() - sizeof(header)) / sizeof(RecordingIndexEntry);
+        RecordingFrameHeader frame;
+        while(m_indexCount > 0 && !readFrameHeader(m_index[m_indexCount - 1].offset, frame)) {
+            m_indexCount--;
+        }
+    }
+
+    // Indexes the complete frames from offset to the end of the data file
+    void scanFrames(boost::uint64_t offset)
+    {
+        RecordingFrameHeader header;
+        while(readFrameHeader(offset, header)) {
+            RecordingIndexEntry scanned;
+            scanned.simTime = header.simTime;
+            scanned.offset = offset;
+            if(frameCount() > 0 && scanned.simTime < endTime()) {
+                break;
+            }
+            m_scanned.push_back(scanned);
+            offset += sizeof(header) + header.size;
+        }
+    }
+
+    // False unless a complete frame starts at offset
+    bool readFrameHeader(boost::uint64_t offset, RecordingFrameHeader &header)
+    {
+        if(offset + sizeof(header) > m_dataSize) {
+            return false;
+        }
+        std::memcpy(&header, m_data + offset, sizeof(header));
+        return header.magic == RECORDING_FRAME_MAGIC
+            && offset + sizeof(header) + header.size <= m_dataSize;
+    }
+
+    RecordingSegmentReader(const RecordingSegmentReader &);
+    RecordingSegmentReader &operator=(const RecordingSegmentReader &);
+};
+
+// Replays a recording. Opening any segment of a split recording also opens
+// the segments before and after it that continue the same run, i.e. up to a
+// missing segment or one where the simulation time jumps backwards; frame
+// indices then count across all of them. Frames are decoded with a
+// RecordingCursor.
+class TelemetryRecordingReader
+{
+public:
+    TelemetryRecordingReader()
+        : m_frameCount(0)
+    {
+
+    }
+
+    bool open(const std::string &filename)
+    {
+        close();
+        boost::shared_ptr<RecordingSegmentReader> segment(new RecordingSegmentReader);
+        if(!segment->open(filename)) {
+            return false;
+        }
+        m_segments.push_back(segment);
+        std::string recording;
+        size_t number;
+        if(parseRecordingSegmentFilename(filename, recording, number)) {
+            for(size_t i = number; i > 0; i--) {
+                segment = openSegment(recordingSegmentFilename(recording, i - 1));
+                if(!segment || m_segments.front()->frameCount() == 0
+                    || segment->endTime() > m_segments.front()->startTime()) {
+                    break;
+                }
+                m_segments.insert(m_segments.begin(), segment);
+            }
+            for(size_t i = number + 1; ; i++) {
+                segment = openSegment(recordingSegmentFilename(recording, i));
+                if(!segment || m_segments.back()->frameCount() == 0
+                    || segment->startTime() < m_segments.back()->endTime()) {
+                    break;
+                }
+                m_segments.push_back(segment);
+            }
+        }
+        for(size_t i = 0; i < m_segments.size(); i++) {
+            m_firstFrames.push_back(m_frameCount);
+            m_frameCount += m_segments[i]->frameCount();
+        }
+        return true;
+    }
+
+    void close()
+    {
+        m_segments.clear();
+        m_firstFrames.clear();
+        m_frameCount = 0;
+    }
+
+    bool isOpen() { return !m_segments.empty(); }
+    WireFormat_t format() { return m_segments.empty() ? WIRE_FORMAT_BINARY : m_segments.front()->format(); }
+    size_t segmentCount() { return m_segments.size(); }
+    size_t frameCount() { return m_frameCount; }
+    double frameTime(size_t index)
+    {
+        RecordingSegmentReader &reader = segment(index);
+        return reader.frameTime(index);
+    }
+    double startTime() { return frameCount() > 0 ? frameTime(0) : 0.0; }
+    double endTime() { return frameCount() > 0 ? frameTime(frameCount() - 1) : 0.0; }
+
+    // Index of the last frame at or before time, the first frame if time
+    // is before the start of the recording
+    size_t findFrame(double time)
+    {
+        size_t i = m_segments.size();
+        while(i > 1 && (m_segments[i - 1]->frameCount() == 0 || m_segments[i - 1]->startTime() > time)) {
+            i--;
+        }
+        if(i == 0) {
+            return 0;
+        }
+        return m_firstFrames[i - 1] + m_segments[i - 1]->findFrame(time);
+    }
+
+    // See RecordingSegmentReader::frameData
+    bool frameData(size_t index, const char *&data, size_t &size, boost::uint32_t &flags)
+    {
+        if(index >= m_frameCount) {
+            return false;
+        }
+        RecordingSegmentReader &reader = segment(index);
+        return reader.frameData(index, data, size, flags);
+    }
+
+    bool isKeyframe(size_t index)
+    {
+        if(index >= m_frameCount) {
+            return false;
+        }
+        RecordingSegmentReader &reader = segment(index);
+        return reader.isKeyframe(index);
+    }
+
+    // Nearest keyframe at or before index. Every segment starts with a
+    // keyframe, so this never reaches into the segment before.
+    size_t keyframeIndex(size_t index)
+    {
+        if(index >= m_frameCount) {
+            return index;
+        }
+        size_t local = index;
+        RecordingSegmentReader &reader = segment(local);
+        return index - local + reader.keyframeIndex(local);
+    }
+
+private:
+    std::vector<boost::shared_ptr<RecordingSegmentReader> > m_segments;
+    // Index of the first frame of every segment
+    std::vector<size_t> m_firstFrames;
+    size_t m_frameCount;
+
+    // Segment holding frame index, index is made relative to it
+    RecordingSegmentReader &segment(size_t &index)
+    {
+        size_t i = std::upper_bound(m_firstFrames.begin(), m_firstFrames.end(), index) - m_firstFrames.begin() - 1;
+        index -= m_firstFrames[i];
+        return *m_segments[i];
+    }
+
+    // Segment that can continue this recording, empty if there is none
+    boost::shared_ptr<RecordingSegmentReader> openSegment(const std::string &filename)
+    {
+        boost::shared_ptr<RecordingSegmentReader> reader;
+        boost::system::error_code ec;
+        if(!boost::filesystem::exists(filename, ec)) {
+            return reader;
+        }
+        reader.reset(new RecordingSegmentReader);
+        if(!reader->open(filename) || reader->frameCount() == 0 || reader->format() != format()) {
+            reader.reset();
+        }
+        return reader;
+    }
+
+    TelemetryRecordingReader(const TelemetryRecordingReader &);
+    TelemetryRecordingReader &operator=(const TelemetryRecordingReader &);
+};
+
+// Rebuilds the archives of a recording's frames. A frame is decoded from the
+// nearest keyframe before it, or from the cursor's current frame if that is
+// closer, so stepping forward costs one delta per frame and a seek at most a
+// keyframe interval of them. A cursor is used by one thread at a time; any
+// number of cursors may share a reader.
+class RecordingCursor
+{
+public:
+    RecordingCursor()
+        : m_reader(0)
+        , m_index(0)
+        , m_isValid(false)
+    {
+
+    }
+
+    explicit RecordingCursor(TelemetryRecordingReader &reader)
+        : m_reader(&reader)
+        , m_index(0)
+        , m_isValid(false)
+    {
+
+    }
+
+    void setReader(TelemetryRecordingReader &reader)
+    {
+        m_reader = &reader;
+        reset();
+    }
+
+    // Forgets the current frame, needed after the reader was reopened
+    void reset() { m_isValid = false; }
+
+    bool isValid() { return m_isValid; }
+    size_t index() { return m_index; }
+    const std::string &archive() { return m_archive; }
+
+    // Moves to frame index and rebuilds its archive
+    bool seek(size_t index)
+    {
+        if(!m_reader || index >= m_reader->frameCount()) {
+            return false;
+        }
+        if(m_isValid && index == m_index) {
+            return true;
+        }
+        size_t keyframe = m_reader->keyframeIndex(index);
+        size_t next = keyframe;
+        if(m_isValid && m_index >= keyframe && m_index < index) {
+            next = m_index + 1;
+        }
+        m_isValid = false;
+        for(; next <= index; next++) {
+            const char *data;
+            size_t size;
+            boost::uint32_t flags;
+            if(!m_reader->frameData(next, data, size, flags)) {
+                return false;
+            }
+            if(!(flags & RECORDING_FRAME_DELTA)) {
+                m_archive.assign(data, size);
+            } else if(next == keyframe || !applyFrameDelta(m_archive, data, size, m_scratch)) {
+                std::cout << "Error in " << __FUNCTION__ << ": frame " << next << " has no valid reference" << std::endl;
+                return false;
+            } else {
+                m_archive.swap(m_scratch);
+            }
+        }
+        m_index = index;
+        m_isValid = true;
+        return true;
+    }
+
+    template <typename T>
+    bool readFrame(size_t index, T &t)
+    {
+        if(!seek(index)) {
+            return false;
+        }
+        return deserializeArchive(m_archive.data(), m_archive.size(), m_reader->format(), t);
+    }
+
+private:
+    TelemetryRecordingReader *m_reader;
+    size_t m_index;
+    bool m_isValid;
+    std::string m_archive;
+    std::string m_scratch;
+};
+
+#endif // TELEMETRY_RECORDING_HPP
@@ -147,7 +147,7 @@ void Renderer::cleanupShaderPrograms()
     }
 }
 
-bool Renderer::initializeSimObject(QOpenGLShaderProgram *program, SimObject simObject)
+bool Renderer::initializeSimObject(QOpenGLShaderProgram *program, const SimObject &simObject)
 {
     if(!m_geometryManager->initializeGeometry(simObject.geometryName, program)) {
         return false;
@@ -222,16 +222,16 @@ void Renderer::calculateCameraPosition()
 {
     // Get camera position based on current simulation object positions
     // TODO: Adjust this to take into account whether to give position relative to body, orbit, or intertial frames
-    QVector<SimObject> simObjects;
     QVector3D target(0, 0, 0);
     QVector3D eye(1, 0, 0);
     if(m_simDataManager != 0) {
-        simObjects = m_simDataManager->getSimObjects();
+        const QVector<SimObject> &simObjects = m_simDataManager->getSimObjects();
         if(!simObjects.empty()) {
-            target = simObjects.at(m_simDataManager->getTargetObject()).position;
+            const SimObject &targetObject = simObjects.at(m_simDataManager->getTargetObject());
+            target = targetObject.position;
             float dist = 10.0;
-            float temp = m_geometryManager->getGeometryBoundingRadii(simObjects.at(m_simDataManager->getTargetObject()).geometryName);
-            temp *= simObjects.at(m_simDataManager->getTargetObject()).scaleFactor;
+            float temp = m_geometryManager->getGeometryBoundingRadii(targetObject.geometryName);
+            temp *= targetObject.scaleFactor;
             if(temp > 0.0) {
                 dist = temp * 3.0f;
             }
@@ -275,16 +275,20 @@ void Renderer::drawScene(QOpenGLShaderProgram *program)
 
     // Draw the simulation objects
     if(m_simDataManager != 0) {
-        QVector<SimObject> simObjects = m_simDataManager->getSimObjects();
+        const QVector<SimObject> &simObjects = m_simDataManager->getSimObjects();
         for(int i = 0; i < simObjects.length(); i++) {
             drawSceneObject(program, simObjects.at(i), cameraMatrix);
         }
     }
 }
 
-void Renderer::drawSceneObject(QOpenGLShaderProgram *program, SimObject simObject,
-                               QMatrix4x4 cameraMatrix)
+void Renderer::drawSceneObject(QOpenGLShaderProgram *program, const SimObject &simObject,
+                               const QMatrix4x4 &cameraMatrix)
 {
+    if(!simObject.isVisible) {
+        return;
+    }
+
     // If the object is outside the star field, move it relative to the camera
     // and resize it as necessary
     float scaleFactor = simObject.scaleFactor;
@@ -302,34 +306,42 @@ void Renderer::drawSceneObject(QOpenGLShaderProgram *program, SimObject simObjec
         scaleFactor *= newScaleFactor;
         objectPos = cameraPos + objectDir.normalized() * newDist;
     }
-    simObject.position = objectPos;
-    simObject.scaleFactor = scaleFactor;
+
+    // The adjusted placement only applies to the top parent object, so it is
+    // passed down as a matrix instead of being written into a copy
+    QMatrix4x4 objectMatrix;
+    objectMatrix.translate(objectPos);
+    objectMatrix.rotate(simObject.quaternion);
 
     // Only perform check on top parent object, and then draw the rest normally
-    drawSceneObjectRecursion(program, simObject, cameraMatrix, QMatrix4x4(), 1.0f);
+    drawSceneObjectRecursion(program, simObject, cameraMatrix, objectMatrix, scaleFactor);
 }
 
-void Renderer::drawSceneObjectRecursion(QOpenGLShaderProgram *program, SimObject simObject,
-                                        QMatrix4x4 cameraMatrix, QMatrix4x4 objectMatrix, float scaleFactor)
+// objectMatrix and scaleFactor already include simObject's own placement
+void Renderer::drawSceneObjectRecursion(QOpenGLShaderProgram *program, const SimObject &simObject,
+                                        const QMatrix4x4 &cameraMatrix, const QMatrix4x4 &objectMatrix, float scaleFactor)
 {
-    QMatrix4x4 m;
-    m.translate(simObject.position);
-    m.rotate(simObject.quaternion);
-
-    scaleFactor *= simObject.scaleFactor;
-    objectMatrix *= m;
-
     m_geometryManager->initializeGeometry(simObject.geometryName, program);
     m_geometryManager->drawGeometry(simObject.geometryName, program, cameraMatrix, objectMatrix, scaleFactor,
                                     simObject.defaultMaterialOverride, simObject.updateParameters);
 
     // Recursively draw this sceneObject's child sceneObjects
     for(int i = 0; i < simObject.simObjects.size(); i++) {
+        const SimObject &child = simObject.simObjects.at(i);
+        if(!child.isVisible) {
+            continue;
+        }
         float childScaleFactor = scaleFactor;
-        if(simObject.simObjects.at(i).scaleByParentBoundingRadii) {
+        if(child.scaleByParentBoundingRadii) {
             childScaleFactor *= m_geometryManager->getGeometryBoundingRadii(simObject.geometryName);
         }
-        drawSceneObjectRecursion(program, simObject.simObjects.at(i), cameraMatrix, objectMatrix, childScaleFactor);
+        childScaleFactor *= child.scaleFactor;
+
+        QMatrix4x4 childMatrix = objectMatrix;
+        childMatrix.translate(child.position);
+        childMatrix.rotate(child.quaternion);
+
+        drawSceneObjectRecursion(program, child, cameraMatrix, childMatrix, childScaleFactor);
     }
 }
 
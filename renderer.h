@@ -74,17 +74,17 @@ private:
     QVector3D m_lightPosition;
     QVector3D m_lightIntensity;
 
-    bool initializeSimObject(QOpenGLShaderProgram *program, SimObject simObject);
+    bool initializeSimObject(QOpenGLShaderProgram *program, const SimObject &simObject);
 
     void initializeWatermark();
     void drawWatermark();
 
     void calculateCameraPosition();
     void drawScene(QOpenGLShaderProgram *program);
-    void drawSceneObject(QOpenGLShaderProgram *program, SimObject simObject,
-                         QMatrix4x4 cameraMatrix);
-    void drawSceneObjectRecursion(QOpenGLShaderProgram *program, SimObject simObject,
-                                  QMatrix4x4 cameraMatrix, QMatrix4x4 objectMatrix, float scaleFactor);
+    void drawSceneObject(QOpenGLShaderProgram *program, const SimObject &simObject,
+                         const QMatrix4x4 &cameraMatrix);
+    void drawSceneObjectRecursion(QOpenGLShaderProgram *program, const SimObject &simObject,
+                                  const QMatrix4x4 &cameraMatrix, const QMatrix4x4 &objectMatrix, float scaleFactor);
 
 };
 
@@ -11,6 +11,8 @@ uniform mat4 viewMatrix;
 uniform mat4 modelMatrix;
 uniform mat3 normalMatrix;
 uniform vec3 lightPosition_worldSpace;
+// Scale and offset of the texture coordinate u, set per draw
+uniform vec2 textureTransform;
 
 // Output data to be interpolated for each fragment
 varying vec3 position_worldSpace;
@@ -46,5 +48,5 @@ void main()
     normal_cameraSpace = normalize(normalMatrix * vertexNormal_modelSpace);
 
     // UV of the vertex
-    UV = vertexUV;
+    UV = vec2(vertexUV.x * textureTransform.x + textureTransform.y, vertexUV.y);
 }
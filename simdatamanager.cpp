@@ -23,10 +23,15 @@
 #include "fieldOfView.h"
 #include "reactionwheeldisk.h"
 #include "startrackerfov.h"
+#include "linearAlgebra.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 
 SimDataManager::SimDataManager(QObject *parent)
     : QObject(parent)
-    , m_preferredCameraTarget(0)
+    , m_scene(&m_emptyScene)
     , m_simTime(0.0)
 {
 
@@ -51,8 +56,8 @@ void SimDataManager::setTargetObject(int targetIndex)
 {
     if(m_targetObjectIndex != targetIndex && targetIndex != -1) {
         m_targetObjectIndex = targetIndex;
-        if(m_simObjects.size() > targetIndex) {
-            m_isSpacecraftTarget = this->m_simObjects.at(m_targetObjectIndex).name.compare("Spacecraft", Qt::CaseInsensitive) == 0; // si la mida del vector m_simObject es mes gran que targetIndex, m_isSpaceCraftTarget=false
+        if(m_scene->simObjects.size() > targetIndex) {
+            m_isSpacecraftTarget = this->m_scene->simObjects.at(m_targetObjectIndex).name.compare("Spacecraft", Qt::CaseInsensitive) == 0; // si la mida del vector m_simObject es mes gran que targetIndex, m_isSpaceCraftTarget=false
         }
     }
 }
@@ -96,59 +101,140 @@ SimObject SimDataManager::createZAxis(QVector4D color)
     return temp;
 }
 
-SimObject SimDataManager::createOrbit(classicElements oe, int type, double mu, QString name)
+// Largest relative change of the semi-major axis and change of the
+// eccentricity vector and orbit normal before a cached orbit curve is
+// sampled again
+static const double orbitElementTolerance = 1e-4;
+
+// Curve of an orbit, shared by the scenes built so that their orbits hold
+// the same points and are only uploaded after it was sampled again. It only
+// depends on the shape and orientation of the orbit.
+struct OrbitCurve
 {
-    SimObject           temp;
-    QVector<QVector3D>  points;
-    QVector3D           point;
-    double              f0;
-    float               angle;
-    double              r[3];
-    double              v[3];
-    float               numPoints = 360.;
-    int                 i;
-    int                 clippingState = 0;
+    OrbitCurve()
+        : mu(0.0)
+        , isClosed(false)
+    {
+        memset(&elements, 0, sizeof(elements));
+    }
 
-    temp.name = "Orbit" + name;
-    f0 = oe.f;
+    // Elements and gravitational parameter of the curve
+    classicElements elements;
+    double mu;
+    // Closed curves cover a whole revolution, open ones the arc of a
+    // hyperbola up to short of its asymptotes
+    bool isClosed;
+    // Points of the curve in order of increasing true anomaly. The points
+    // of closed curves are stored twice in a row, so that a whole revolution
+    // from any point on is one part of them.
+    QVector<double> anomalies;
+    QVector<QVector3D> points;
+};
 
-    if (type == 1) {
-        /* hyperbolic departure orbit fraction */
-        angle = (float)M_PI*2.0;
-        for(i = 0; i <= numPoints; i++) {
-            oe.f = f0 + angle * i / numPoints;
-            if (cos(oe.f) > -1.0/oe.e) {
-                elem2rv(mu, &oe, r, v);
-                point = QVector3D (r[0], r[1], r[2]);
-                points.push_back(point);
-            } else {
-                // add a large increment to force exit of loop and finish the hyperbolic departure arc
-                i += numPoints;
-            }
+// Directions of periapsis, of the velocity at periapsis and of the orbit
+// normal
+static void orbitFrame(const classicElements &oe, double p[3], double q[3], double h[3])
+{
+    double cO = cos(oe.Omega);
+    double sO = sin(oe.Omega);
+    double cw = cos(oe.omega);
+    double sw = sin(oe.omega);
+    double ci = cos(oe.i);
+    double si = sin(oe.i);
+
+    p[0] = cO*cw - sO*sw*ci;
+    p[1] = sO*cw + cO*sw*ci;
+    p[2] = sw*si;
+    q[0] = -cO*sw - sO*cw*ci;
+    q[1] = -sO*sw + cO*cw*ci;
+    q[2] = cw*si;
+    h[0] = sO*si;
+    h[1] = -cO*si;
+    h[2] = ci;
+}
+
+// Compares the eccentricity vectors and orbit normals rather than the
+// angles, the argument of periapsis is meaningless on nearly circular orbits
+// and the node on nearly equatorial ones
+static bool isOrbitDrifted(const classicElements &a, const classicElements &b)
+{
+    double pa[3], qa[3], ha[3];
+    double pb[3], qb[3], hb[3];
+    double d[3];
+
+    if ((a.alpha < 0.) != (b.alpha < 0.)
+        || fabs(a.a - b.a) > orbitElementTolerance * fabs(b.a)) {
+        return true;
+    }
+    orbitFrame(a, pa, qa, ha);
+    orbitFrame(b, pb, qb, hb);
+    v3Scale(a.e, pa, pa);
+    v3Scale(b.e, pb, pb);
+    v3Subtract(pa, pb, d);
+    if (v3Norm(d) > orbitElementTolerance) {
+        return true;
+    }
+    v3Subtract(ha, hb, d);
+    return v3Norm(d) > orbitElementTolerance;
+}
+
+// Samples closed orbits evenly in eccentric anomaly and hyperbolas evenly in
+// hyperbolic anomaly, which puts the points closest together at periapsis
+// where the curve bends most. Nearly circular orbits get fewer points.
+static void sampleOrbit(OrbitCurve *curve, classicElements oe, double mu, int minPointCount, int maxPointCount)
+{
+    double r[3];
+    double v[3];
+    int    count;
+    int    i;
+
+    curve->isClosed = oe.alpha >= 0.;
+    if (curve->isClosed) {
+        count = minPointCount + (int)((maxPointCount - minPointCount) * (oe.e < 1.0 ? oe.e : 1.0));
+    } else {
+        count = maxPointCount;
+    }
+    curve->anomalies.resize(count);
+    curve->points.resize(curve->isClosed ? 2*count : count);
+
+    if (curve->isClosed) {
+        for(i = 0; i < count; i++) {
+            double E = -M_PI + 2.0*M_PI * i / count;
+            oe.f = oe.e < 1.0 ? E2f(E, oe.e) : E;
+            elem2rv(mu, &oe, r, v);
+            curve->anomalies[i] = oe.f;
+            curve->points[i] = QVector3D(r[0], r[1], r[2]);
+            curve->points[count + i] = curve->points[i];
+        }
+    } else {
+        // Stop a segment short of the asymptotes, where the radius grows
+        // without bound
+        double fMax = acos(-1.0/oe.e) - 2.0*M_PI / maxPointCount;
+        double HMax = fMax > 0. ? f2H(fMax, oe.e) : 0.;
+        for(i = 0; i < count; i++) {
+            oe.f = H2f(-HMax + 2.0*HMax * i / (count - 1), oe.e);
+            elem2rv(mu, &oe, r, v);
+            curve->anomalies[i] = oe.f;
+            curve->points[i] = QVector3D(r[0], r[1], r[2]);
         }
-        QSharedPointer<LineStripUpdateParameters> parameters(new LineStripUpdateParameters);
-        parameters->linePoints = points;
-        temp.updateParameters = parameters;
+    }
+    curve->elements = oe;
+    curve->mu = mu;
+}
+
+// The points of the orbit are set by updateOrbit
+SimObject SimDataManager::createOrbit(int type, QString name)
+{
+    SimObject temp;
+    QSharedPointer<LineStripUpdateParameters> parameters(new LineStripUpdateParameters);
+
+    temp.name = "Orbit" + name;
+    temp.updateParameters = parameters;
+    if (type == 1) {
         temp.geometryName = "LineStrip";
         QVector4D color(1, 1, 0, 0.3);
         temp.defaultMaterialOverride = QSharedPointer<Geometry::MaterialInfo>(new Geometry::MaterialInfo(color));
     } else {
-        /* full orbit */
-        angle = (float)M_PI*2.0;
-        for(i = 0; i <= numPoints; i++) {
-            oe.f = f0 - angle * i / numPoints;
-            if ((oe.alpha>=0. || cos(oe.f) > -1.0/oe.e) && !clippingState) {
-                elem2rv(mu, &oe, r, v);
-                point = QVector3D (r[0], r[1], r[2]);
-                points.push_back(point);
-            } else {
-                // add a large increment to force exit of loop and finish the hyperbolic arrival arc
-                i += numPoints;
-            }
-        }
-        QSharedPointer<LineStripUpdateParameters> parameters(new LineStripUpdateParameters);
-        parameters->linePoints = points;
-        temp.updateParameters = parameters;
         temp.geometryName = "FadingLineStrip";
         QVector4D color(1, 1, 0, 1);
         temp.defaultMaterialOverride = QSharedPointer<Geometry::MaterialInfo>(new Geometry::MaterialInfo(color));
@@ -157,6 +243,70 @@ SimObject SimDataManager::createOrbit(classicElements oe, int type, double mu, Q
     return temp;
 }
 
+// Type 0 draws the orbit backwards from the current position, fading with
+// the distance, type 1 draws a hyperbolic departure forwards. The points are
+// the cached curve, the current position is joined to it when drawing.
+void SimDataManager::updateOrbit(SimObject &orbit, classicElements oe, int type, double mu)
+{
+    LineStripUpdateParameters *parameters = (LineStripUpdateParameters *)orbit.updateParameters.data();
+    QSharedPointer<OrbitCurve> &curve = m_orbitCurves[orbit.name];
+    double              r[3];
+    double              v[3];
+    double              p[3];
+    double              q[3];
+    double              h[3];
+    double              f;
+    int                 next;
+    int                 count;
+
+    if (curve.isNull()) {
+        curve = QSharedPointer<OrbitCurve>(new OrbitCurve);
+    }
+    if (curve->points.isEmpty() || curve->mu != mu || isOrbitDrifted(oe, curve->elements)) {
+        sampleOrbit(curve.data(), oe, mu, orbitMinPointCount, orbitPointCount);
+    }
+    // Shares the points of the curve, the comparison is cheap until it was
+    // sampled again
+    if (!(parameters->linePoints == curve->points)) {
+        parameters->linePoints = curve->points;
+        parameters->markChanged();
+    }
+
+    // The current position is exact, only the rest of the orbit is cached.
+    // Its anomaly is taken on the curve, whose periapsis may differ from
+    // the current one while the orbit is nearly circular.
+    elem2rv(mu, &oe, r, v);
+    orbitFrame(curve->elements, p, q, h);
+    f = atan2(v3Dot(r, q), v3Dot(r, p));
+    // First point of the curve past the current position
+    const QVector<double> &anomalies = curve->anomalies;
+    next = (int)(std::upper_bound(anomalies.begin(), anomalies.end(), f) - anomalies.begin());
+    count = anomalies.size();
+
+    parameters->hasAnchor = true;
+    parameters->anchor = QVector3D(r[0], r[1], r[2]);
+    parameters->isAnchorClosing = curve->isClosed;
+    if (curve->isClosed) {
+        if (type == 1) {
+            parameters->firstPoint = next;
+            parameters->lastPoint = next + count - 1;
+        } else {
+            parameters->firstPoint = next - 1 + count;
+            parameters->lastPoint = next;
+        }
+    } else if (type == 1) {
+        // Past either end of the arc nothing is drawn, a single point is not
+        // a line
+        parameters->hasAnchor = next < count;
+        parameters->firstPoint = std::min(next, count - 1);
+        parameters->lastPoint = count - 1;
+    } else {
+        parameters->hasAnchor = next > 0;
+        parameters->firstPoint = std::max(next - 1, 0);
+        parameters->lastPoint = 0;
+    }
+}
+
 SimObject SimDataManager::createSun(QVector3D position, double scaleFactor)
 {
     SimObject sun;
@@ -188,6 +338,17 @@ SimObject SimDataManager::createThruster(QVector3D position, QQuaternion orienta
     return thruster;
 }
 
+void SimDataManager::updateThruster(SimObject &thruster, double thrustLevel, double plumeDiameter)
+{
+    ThrusterGeometryUpdateParameters *parameters = (ThrusterGeometryUpdateParameters *)thruster.updateParameters.data();
+    float length = thrustLevel/100.;
+    if(parameters->length != length || parameters->plumeDiameter != (float)plumeDiameter) {
+        parameters->length = length;
+        parameters->plumeDiameter = plumeDiameter;
+        parameters->markChanged();
+    }
+}
+
 SimObject SimDataManager::createFieldOfView(QVector3D position, QQuaternion orientation, double scaleFactor, double fovAngle, QVector4D color)
 {
     SimObject fieldOfView;
@@ -241,6 +402,52 @@ SimObject SimDataManager::createDiskRW(QVector3D position, QQuaternion orientati
     return DiskRW;
 }
 
+void SimDataManager::updateDiskRW(SimObject &diskRW, bool flag)
+{
+    ReactionWheelDiskUpdateParameters *parameters = (ReactionWheelDiskUpdateParameters *)diskRW.updateParameters.data();
+    if(parameters->flag != flag) {
+        parameters->flag = flag;
+        parameters->markChanged();
+    }
+}
+
+// The material is copied to the geometry when drawing, it needs no update
+void SimDataManager::updateColor(SimObject &simObject, QVector4D color)
+{
+    simObject.defaultMaterialOverride->ambientColor = color;
+}
+
+static void listParameters(const QVector<SimObject> &simObjects, QVector<GeometryUpdateParameters *> &parameters)
+{
+    for(int i = 0; i < simObjects.size(); i++) {
+        parameters.append(simObjects.at(i).updateParameters.data());
+        listParameters(simObjects.at(i).simObjects, parameters);
+    }
+}
+
+void SimDataManager::numberSceneObjects(QVector<SimObject> &simObjects, const QVector<SimObject> *previousObjects)
+{
+    // Objects are numbered in preorder, so the numbers stay the same as long
+    // as the layout of the scene does
+    QVector<GeometryUpdateParameters *> parameters;
+    listParameters(simObjects, parameters);
+    QVector<GeometryUpdateParameters *> previousParameters;
+    if(previousObjects) {
+        listParameters(*previousObjects, previousParameters);
+    }
+    for(int i = 0; i < parameters.size(); i++) {
+        if(!parameters[i]) {
+            continue;
+        }
+        parameters[i]->node = i;
+        if(i < previousParameters.size() && previousParameters[i]
+           && previousParameters[i]->revision != parameters[i]->revision
+           && parameters[i]->isSameAs(*previousParameters[i])) {
+            parameters[i]->revision = previousParameters[i]->revision;
+        }
+    }
+}
+
 SimObject SimDataManager::createTorqueBar(QVector3D position, QQuaternion orientation, double scaleFactor, QVector4D color)
 {
     SimObject TorqueBar;
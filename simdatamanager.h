@@ -23,6 +23,7 @@
 #include <QVector>
 #include <QVector3D>
 #include <QMap>
+#include <QHash>
 #include <QString>
 
 extern "C" {
@@ -32,9 +33,28 @@ extern "C" {
 
 #include "simobject.h"
 
+struct OrbitCurve;
+
 // Create a convience typedef
 typedef QMap<QString, bool> toggleableObjectMap;
 
+// Objects of the scene and what else the renderer needs to draw them. Data
+// managers may build scenes on another thread, a scene is not changed while
+// it is shown.
+struct SceneSnapshot
+{
+    SceneSnapshot()
+        : preferredCameraTarget(0)
+        , lightPosition(0, 0, 0)
+    {
+
+    }
+
+    QVector<SimObject> simObjects;
+    int preferredCameraTarget;
+    QVector3D lightPosition;
+};
+
 class SimDataManager : public QObject
 {
     Q_OBJECT
@@ -54,15 +74,18 @@ public:
     }
     virtual bool closeFile() = 0;
 
-    // Methods for dispersing data loaded in
-    QVector<SimObject> getSimObjects() {
-        return m_simObjects;
+    // Methods for dispersing data loaded in, they describe the scene
+    // simDataUpdated was last emitted for. The returned objects are owned by
+    // the scene and stay valid until the next simDataUpdated, so callers
+    // should hold on to top level indices rather than references or copies
+    const QVector<SimObject> &getSimObjects() const {
+        return m_scene->simObjects;
     }
     int getPreferredCameraTarget() {
-        return m_preferredCameraTarget;
+        return m_scene->preferredCameraTarget;
     }
-    virtual QVector3D getLightPosition() {
-        return QVector3D(0, 0, 0);
+    QVector3D getLightPosition() {
+        return m_scene->lightPosition;
     }
 
     // Get the simulation time
@@ -100,8 +123,9 @@ public slots:
     virtual void setSimTime(double time) = 0;
 
 protected:
-    QVector<SimObject> m_simObjects;
-    int m_preferredCameraTarget;
+    // Scene shown, only changed on the GUI thread
+    const SceneSnapshot *m_scene;
+    SceneSnapshot m_emptyScene;
     double m_simTime;
     int m_targetObjectIndex;
     bool m_isSpacecraftTarget;
@@ -114,16 +138,33 @@ protected:
         INPUT_FILE
     } m_inputType;
 
+    // Points of the curve of an orbit drawn as a line strip, nearly circular
+    // orbits get as few as orbitMinPointCount
+    static const int orbitPointCount = 360;
+    static const int orbitMinPointCount = 120;
+    // Curves of the orbits by name, used by whichever thread builds scenes
+    QHash<QString, QSharedPointer<OrbitCurve> > m_orbitCurves;
+
     SimObject createXAxis(QVector4D color = QVector4D(1.0, 0.0, 0.0, 1.0));
     SimObject createYAxis(QVector4D color = QVector4D(0.0, 1.0, 0.0, 1.0));
     SimObject createZAxis(QVector4D color = QVector4D(0.0, 0.0, 1.0, 1.0));
-    SimObject createOrbit(classicElements oe,  int type, double mu, QString name);
+    // Orbits, thrusters, reaction wheel disks and colors are updated in
+    // place so the scene objects can be kept from frame to frame
+    SimObject createOrbit(int type, QString name);
+    void updateOrbit(SimObject &orbit, classicElements oe, int type, double mu);
     SimObject createSun(QVector3D position, double scaleFactor);
     SimObject createThruster(QVector3D position, QQuaternion orientation, double thrustLevel, double plumeDiameter, double scaleFactor, QVector4D color = QVector4D(0.4f, 0.8f, 1.0f, 1.0f));
+    void updateThruster(SimObject &thruster, double thrustLevel, double plumeDiameter);
     SimObject createFieldOfView(QVector3D position, QQuaternion orientation, double scaleFactor, double fovAngle, QVector4D color);
     SimObject createFadingAxis(QVector3D position, QQuaternion orientation, QVector4D color);
     
     SimObject createDiskRW(QVector3D position, QQuaternion orientation, double scaleFactor, QVector4D color, bool flag);
+    void updateDiskRW(SimObject &diskRW, bool flag);
+    void updateColor(SimObject &simObject, QVector4D color);
+    // Numbers the objects of a scene so that geometries keep their buffers
+    // per object, and gives the parameters holding the same values as in the
+    // previous scene its revision so they are not uploaded again
+    static void numberSceneObjects(QVector<SimObject> &simObjects, const QVector<SimObject> *previousObjects);
     
     SimObject createTorqueBar (QVector3D position, QQuaternion orientation, double scaleFactor, QVector4D color);
     
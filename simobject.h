@@ -38,7 +38,8 @@ public:
         , scaleByParentBoundingRadii(false)
         , scaleFactor(1.0f)
         , defaultMaterialOverride(0)
-        , restrictToSceneBoundary(true) {}
+        , restrictToSceneBoundary(true)
+        , isVisible(true) {}
     ~SimObject();
 
     QString name;
@@ -62,6 +63,9 @@ public:
     // Determines if object should be scaled and placed at edge of scene
     bool restrictToSceneBoundary;
 
+    // Hidden objects and their children are kept in the scene but not drawn
+    bool isVisible;
+
     // Store child objects
     QVector<SimObject> simObjects;
 
@@ -0,0 +1,235 @@
+/*
+ ISC License
+
+ Copyright (c) 2016-2017, Autonomous Vehicle Systems Lab, University of Colorado at Boulder
+
+ Permission to use, copy, modify, and/or distribute this software for any
+ purpose with or without fee is hereby granted, provided that the above
+ copyright notice and this permission notice appear in all copies.
+
+ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+#include "SpacecraftSimDefinitions.h"
+#include "SerializeArchive.hpp"
+#include "FrameDelta.hpp"
+#include "FrameCompression.hpp"
+
+#include <boost/chrono.hpp>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+// Reports size and serialization time per frame of the text and binary
+// archives, then compression ratio and time per frame of every codec built
+// in, for full archives and for the delta payloads sent between keyframes,
+// each with and without a dictionary trained on the first frames.
+//
+// Usage: compressionBenchmark [frames] [dictionary output file]
+
+namespace {
+
+// Moves a spacecraft along a circular orbit with a slow tumble so that
+// consecutive archives differ the way simulation frames do
+void advanceFrame(SpacecraftSim &sc, int index)
+{
+    double t = index * 0.1;
+    double radius = 7000.0;
+    double rate = std::sqrt(sc.mu / (radius * radius * radius));
+    sc.time = t;
+    sc.timeStamp = 1000000 + index * 100;
+    sc.r_N[0] = radius * std::cos(rate * t);
+    sc.r_N[1] = radius * std::sin(rate * t);
+    sc.r_N[2] = 0.0;
+    sc.v_N[0] = -radius * rate * std::sin(rate * t);
+    sc.v_N[1] = radius * rate * std::cos(rate * t);
+    sc.v_N[2] = 0.0;
+    for(int i = 0; i < 3; i++) {
+        sc.omega[i] = 0.01 * std::sin(0.05 * t + i);
+        sc.sigma[i] = 0.3 * std::sin(0.01 * t + 2.0 * i);
+    }
+    for(size_t i = 0; i < sc.reactionWheels.size(); i++) {
+        sc.reactionWheels[i].Omega = 100.0 + 10.0 * std::sin(0.02 * t + (double)i);
+        sc.reactionWheels[i].u_current = 0.001 * std::cos(0.02 * t + (double)i);
+    }
+}
+
+struct Result {
+    Result() : inputBytes(0), outputBytes(0), compressTime(0.0), decompressTime(0.0), failures(0) {}
+    double inputBytes;
+    double outputBytes;
+    double compressTime;
+    double decompressTime;
+    int failures;
+};
+
+Result runCodec(FrameCompressor &compressor, Compression_t codec, bool useDictionary,
+    const std::vector<std::string> &payloads)
+{
+    typedef boost::chrono::high_resolution_clock Clock;
+    Result result;
+    std::string compressed;
+    std::string decompressed;
+    for(size_t i = 0; i < payloads.size(); i++) {
+        Clock::time_point start = Clock::now();
+        bool ok = compressor.compress(codec, useDictionary, payloads[i].data(), payloads[i].size(), compressed);
+        Clock::time_point middle = Clock::now();
+        ok = ok && compressor.decompress(codec, useDictionary, compressed.data(), compressed.size(), decompressed);
+        Clock::time_point end = Clock::now();
+        if(!ok || decompressed != payloads[i]) {
+            result.failures++;
+        }
+        result.inputBytes += payloads[i].size();
+        result.outputBytes += compressed.size();
+        result.compressTime += boost::chrono::duration<double, boost::micro>(middle - start).count();
+        result.decompressTime += boost::chrono::duration<double, boost::micro>(end - middle).count();
+    }
+    return result;
+}
+
+struct ArchiveResult {
+    ArchiveResult() : bytes(0.0), serializeTime(0.0), deserializeTime(0.0), failures(0) {}
+    double bytes;
+    double serializeTime;
+    double deserializeTime;
+    int failures;
+};
+
+// Deserializes every archive and reserializes the frame, a failure is an
+// archive that does not read back or does not reproduce itself
+ArchiveResult runArchive(WireFormat_t format, const std::vector<std::string> &archives)
+{
+    typedef boost::chrono::high_resolution_clock Clock;
+    ArchiveResult result;
+    SpacecraftSim sc;
+    sc.reactionWheels.resize(4);
+    std::string archive;
+    for(size_t i = 0; i < archives.size(); i++) {
+        Clock::time_point start = Clock::now();
+        bool ok = deserializeArchive(archives[i].data(), archives[i].size(), format, sc);
+        Clock::time_point middle = Clock::now();
+        ok = ok && serializeArchive(sc, format, archive);
+        Clock::time_point end = Clock::now();
+        if(!ok || archive != archives[i]) {
+            result.failures++;
+        }
+        result.bytes += archives[i].size();
+        result.deserializeTime += boost::chrono::duration<double, boost::micro>(middle - start).count();
+        result.serializeTime += boost::chrono::duration<double, boost::micro>(end - middle).count();
+    }
+    return result;
+}
+
+void report(const std::string &name, const ArchiveResult &result, size_t frames)
+{
+    std::cout << std::left << std::setw(34) << name << std::right << std::fixed
+        << std::setw(10) << std::setprecision(0) << result.bytes / frames
+        << std::setw(12) << std::setprecision(2) << result.serializeTime / frames
+        << std::setw(12) << std::setprecision(2) << result.deserializeTime / frames;
+    if(result.failures) {
+        std::cout << "  " << result.failures << " round trips failed";
+    }
+    std::cout << std::endl;
+}
+
+void report(const std::string &name, const Result &result, size_t frames)
+{
+    std::cout << std::left << std::setw(34) << name << std::right << std::fixed
+        << std::setw(10) << std::setprecision(0) << result.inputBytes / frames
+        << std::setw(10) << std::setprecision(0) << result.outputBytes / frames
+        << std::setw(8) << std::setprecision(2) << (result.outputBytes > 0 ? result.inputBytes / result.outputBytes : 0.0)
+        << std::setw(12) << std::setprecision(2) << result.compressTime / frames
+        << std::setw(12) << std::setprecision(2) << result.decompressTime / frames;
+    if(result.failures) {
+        std::cout << "  " << result.failures << " round trips failed";
+    }
+    std::cout << std::endl;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    int frameCount = argc > 1 ? std::atoi(argv[1]) : 2000;
+    if(frameCount < 20) {
+        frameCount = 20;
+    }
+    // Frames used for training are not measured
+    int trainingCount = frameCount / 10;
+
+    SpacecraftSim sc;
+    sc.reactionWheels.resize(4);
+    std::vector<std::string> training[2];
+    std::vector<std::string> archives[2];
+    std::vector<std::string> deltas[2];
+    WireFormat_t formats[2] = { WIRE_FORMAT_TEXT, WIRE_FORMAT_BINARY };
+    for(int i = 0; i < frameCount; i++) {
+        advanceFrame(sc, i);
+        for(int f = 0; f < 2; f++) {
+            std::string archive;
+            serializeArchive(sc, formats[f], archive);
+            if(i < trainingCount) {
+                training[f].push_back(archive);
+                continue;
+            }
+            if(!archives[f].empty()) {
+                std::string delta;
+                encodeFrameDelta(archives[f].back(), archive, delta);
+                deltas[f].push_back(delta);
+            }
+            archives[f].push_back(archive);
+        }
+    }
+
+    const char *formatNames[2] = { "text", "binary" };
+    std::cout << std::left << std::setw(34) << "archive format" << std::right
+        << std::setw(10) << "bytes" << std::setw(12) << "ser us" << std::setw(12) << "deser us" << std::endl;
+    for(int f = 0; f < 2; f++) {
+        report(formatNames[f], runArchive(formats[f], archives[f]), archives[f].size());
+    }
+    std::cout << std::endl;
+
+    int codecs = availableCompressions();
+    if(codecs == COMPRESSION_NONE) {
+        std::cout << "No compression built in, configure with USE_LZ4 and/or USE_ZSTD" << std::endl;
+        return 1;
+    }
+
+    std::cout << std::left << std::setw(34) << "payload / codec" << std::right
+        << std::setw(10) << "bytes" << std::setw(10) << "out" << std::setw(8) << "ratio"
+        << std::setw(12) << "comp us" << std::setw(12) << "decomp us" << std::endl;
+    Compression_t codecList[2] = { COMPRESSION_LZ4, COMPRESSION_ZSTD };
+    for(int f = 0; f < 2; f++) {
+        boost::shared_ptr<std::string> dictionary(new std::string);
+        trainCompressionDictionary(training[f], 16 * 1024, *dictionary);
+        if(argc > 2 && formats[f] == WIRE_FORMAT_BINARY) {
+            std::ofstream file(argv[2], std::ios::binary);
+            file.write(dictionary->data(), dictionary->size());
+            std::cout << "Wrote " << dictionary->size() << " byte binary archive dictionary to " << argv[2] << std::endl;
+        }
+        FrameCompressor compressor;
+        compressor.setDictionary(dictionary);
+
+        for(int c = 0; c < 2; c++) {
+            if(!(codecs & codecList[c])) {
+                continue;
+            }
+            for(int d = 0; d < 2; d++) {
+                std::string suffix = std::string(compressionName(codecList[c])) + (d ? " + dict" : "");
+                report(std::string(formatNames[f]) + " keyframe " + suffix,
+                    runCodec(compressor, codecList[c], d != 0, archives[f]), archives[f].size());
+                report(std::string(formatNames[f]) + " delta " + suffix,
+                    runCodec(compressor, codecList[c], d != 0, deltas[f]), deltas[f].size());
+            }
+        }
+    }
+    return 0;
+}
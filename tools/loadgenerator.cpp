@@ -0,0 +1,986 @@
+/*
+ ISC License
+
+ Copyright (c) 2016-2017, Autonomous Vehicle Systems Lab, University of Colorado at Boulder
+
+ Permission to use, copy, modify, and/or distribute this software for any
+ purpose with or without fee is hereby granted, provided that the above
+ copyright notice and this permission notice appear in all copies.
+
+ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+#include "SpacecraftSimDefinitions.h"
+#include "SerializeArchive.hpp"
+#include "TcpSerializeServer.hpp"
+#include "TcpSerializeClient.hpp"
+#include "UdpSerializeServer.hpp"
+#include "UdpSerializeClient.hpp"
+#include "ShmSerializeServer.hpp"
+#include "ShmSerializeClient.hpp"
+#include "TcpJsonClient.hpp"
+#include "JsonFieldTable.hpp"
+
+#include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
+#include <boost/thread/thread.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "utilities/orbitalMotion.h"
+#include "utilities/rigidBodyKinematics.h"
+}
+#include "utilities/astroConstants.h"
+
+// Serves synthetic SpacecraftSim frames through one of the transports so the
+// viewer can be exercised without a simulation, and reports the achieved
+// frame rate and throughput. With --loopback the frames are also received in
+// this process and the latency from handing a frame to the server to its
+// arrival at the client is reported, which needs neither a GPU nor a network.
+// Frames carry the wall clock in timeStamp, so a viewer connected instead
+// shows its own latency to the generator.
+//
+// Usage: bskQtViz-loadgen [options]
+//   --transport tcp|tcp-binary|udp|shm|json  (tcp, text archives unless binary)
+//   --rate hz          frames per second, 0 sends as fast as possible (100)
+//   --duration s       seconds to run, 0 runs until killed (10)
+//   --wheels n         reaction wheels (4)
+//   --thrusters n      ACS thrusters (8)
+//   --css n            coarse sun sensors switched on, at most NUM_CSS (NUM_CSS)
+//   --size bytes       adds ACS thrusters until an archive has at least this size
+//   --batch n          simulation steps per frame carried as samples, 0 sends
+//                      frames without samples (0)
+//   --address a        TCP address or UDP multicast group (127.0.0.1 / 239.255.0.1)
+//   --port p           TCP or UDP port (50000)
+//   --name n           shared memory segment name (bskQtViz)
+//   --loopback         receives the frames in this process and reports latency
+//   --receivers n      UDP loopback clients joining the multicast group, each
+//                      polled on its own thread; received/s and latency
+//                      cover all of them, the frames each one received and
+//                      lost are reported at the end (1)
+//   --client-rate hz   frames per second the loopback client asks a streaming
+//                      TCP server for, 0 takes every frame (0)
+//   --report s         seconds between reports (1)
+//   --replay file      serves the lines of a JSON capture once, in order at
+//                      --rate, instead of synthetic frames (json only)
+
+namespace {
+
+typedef boost::chrono::steady_clock Clock;
+
+typedef enum {
+    TRANSPORT_TCP,
+    TRANSPORT_UDP,
+    TRANSPORT_SHM,
+    TRANSPORT_JSON
+} Transport_t;
+
+struct Options {
+    Options()
+        : transport(TRANSPORT_TCP)
+        , format(WIRE_FORMAT_TEXT)
+        , rate(100.0)
+        , duration(10.0)
+        , wheels(4)
+        , thrusters(8)
+        , css(NUM_CSS)
+        , size(0)
+        , batch(0)
+        , port("50000")
+        , name("bskQtViz")
+        , isLoopback(false)
+        , clientRate(0.0)
+        , receivers(1)
+        , reportInterval(1.0)
+    {
+
+    }
+
+    Transport_t transport;
+    WireFormat_t format;
+    double rate;
+    double duration;
+    int wheels;
+    int thrusters;
+    int css;
+    size_t size;
+    int batch;
+    std::string address;
+    std::string port;
+    std::string name;
+    bool isLoopback;
+    double clientRate;
+    int receivers;
+    double reportInterval;
+    std::string replayFile;
+};
+
+void printUsage()
+{
+    std::cout << "Usage: bskQtViz-loadgen [--transport tcp|tcp-binary|udp|shm|json] [--rate hz] [--duration s]" << std::endl
+        << "    [--wheels n] [--thrusters n] [--css n] [--size bytes] [--batch n] [--address a] [--port p]" << std::endl
+        << "    [--name n] [--loopback] [--client-rate hz] [--receivers n] [--report s] [--replay file]" << std::endl;
+}
+
+bool parseOptions(int argc, char *argv[], Options &options)
+{
+    for(int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        if(option == "--loopback") {
+            options.isLoopback = true;
+            continue;
+        }
+        if(i + 1 >= argc) {
+            return false;
+        }
+        std::string value = argv[++i];
+        if(option == "--transport") {
+            if(value == "tcp") {
+                options.transport = TRANSPORT_TCP;
+                options.format = WIRE_FORMAT_TEXT;
+            } else if(value == "tcp-binary") {
+                options.transport = TRANSPORT_TCP;
+                options.format = WIRE_FORMAT_BINARY;
+            } else if(value == "udp") {
+                options.transport = TRANSPORT_UDP;
+                options.format = WIRE_FORMAT_BINARY;
+            } else if(value == "shm") {
+                options.transport = TRANSPORT_SHM;
+                options.format = WIRE_FORMAT_BINARY;
+            } else if(value == "json") {
+                options.transport = TRANSPORT_JSON;
+                options.format = WIRE_FORMAT_TEXT;
+            } else {
+                return false;
+            }
+        } else if(option == "--rate") {
+            options.rate = std::atof(value.c_str());
+        } else if(option == "--duration") {
+            options.duration = std::atof(value.c_str());
+        } else if(option == "--wheels") {
+            options.wheels = std::atoi(value.c_str());
+        } else if(option == "--thrusters") {
+            options.thrusters = std::atoi(value.c_str());
+        } else if(option == "--css") {
+            options.css = std::atoi(value.c_str());
+        } else if(option == "--size") {
+            options.size = (size_t)std::atol(value.c_str());
+        } else if(option == "--batch") {
+            options.batch = std::atoi(value.c_str());
+        } else if(option == "--address") {
+            options.address = value;
+        } else if(option == "--port") {
+            options.port = value;
+        } else if(option == "--name") {
+            options.name = value;
+        } else if(option == "--client-rate") {
+            options.clientRate = std::atof(value.c_str());
+        } else if(option == "--receivers") {
+            options.receivers = std::atoi(value.c_str());
+        } else if(option == "--report") {
+            options.reportInterval = std::atof(value.c_str());
+        } else if(option == "--replay") {
+            options.replayFile = value;
+        } else {
+            return false;
+        }
+    }
+    if(!options.replayFile.empty() && (options.transport != TRANSPORT_JSON || options.isLoopback)) {
+        // Latency is matched by the frame times of the generator
+        std::cout << "--replay needs --transport json and no --loopback" << std::endl;
+        return false;
+    }
+    if(options.receivers > 1 && (options.transport != TRANSPORT_UDP || !options.isLoopback)) {
+        std::cout << "--receivers needs --transport udp and --loopback" << std::endl;
+        return false;
+    }
+    if(options.address.empty()) {
+        options.address = options.transport == TRANSPORT_UDP ? "239.255.0.1" : "127.0.0.1";
+    }
+    options.wheels = std::max(options.wheels, 0);
+    options.thrusters = std::max(options.thrusters, 0);
+    options.css = std::min(std::max(options.css, 0), NUM_CSS);
+    options.batch = std::max(options.batch, 0);
+    options.receivers = std::max(options.receivers, 1);
+    options.rate = std::max(options.rate, 0.0);
+    options.clientRate = std::max(options.clientRate, 0.0);
+    if(options.reportInterval <= 0.0) {
+        options.reportInterval = 1.0;
+    }
+    return true;
+}
+
+// Lines of a capture, blank lines are left out
+bool readCapture(const std::string &filename, std::vector<std::string> &lines)
+{
+    std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+    if(!file.is_open()) {
+        std::cout << "Error in " << __FUNCTION__ << ": could not open " << filename << std::endl;
+        return false;
+    }
+    std::string line;
+    while(std::getline(file, line)) {
+        if(!line.empty() && line[line.size() - 1] == '\r') {
+            line.erase(line.size() - 1);
+        }
+        if(!line.empty()) {
+            lines.push_back(line);
+        }
+    }
+    return true;
+}
+
+// Bytes of frame as the transport sends it before deltas and compression
+size_t frameSize(const SpacecraftSim &frame, const Options &options, std::string &buffer)
+{
+    if(options.transport == TRANSPORT_JSON) {
+        writeJsonFrame(frame, buffer);
+        return buffer.size() + 1;
+    }
+    serializeArchive(frame, options.format, buffer);
+    return buffer.size();
+}
+
+long wallClockMilliseconds()
+{
+    return (long)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Fills frames with analytic trajectories: a slightly eccentric, inclined
+// low Earth orbit, a tumble about a fixed body axis, wheels spinning up and
+// down, thrusters pulsing in turn and sun sensors seeing the Sun over the
+// tumble. Any frame can be generated directly from its index.
+class FrameGenerator
+{
+public:
+    FrameGenerator(const Options &options)
+        : m_step(options.rate > 0.0 ? 1.0 / options.rate : 0.01)
+        , m_batch(options.batch)
+    {
+        m_frame.celestialObject = CELESTIAL_EARTH;
+        m_frame.mu = MU_EARTH;
+        m_frame.req = REQ_EARTH;
+        m_frame.realTimeSpeedUpFactor = 1.0;
+        m_frame.reactionWheels.resize(options.wheels);
+        for(int i = 0; i < options.wheels; i++) {
+            RWSim &wheel = m_frame.reactionWheels[i];
+            double angle = 2.0 * M_PI * i / options.wheels;
+            wheel.state = COMPONENT_ON;
+            wheel.gsHat_S[0] = 0.8 * std::cos(angle);
+            wheel.gsHat_S[1] = 0.8 * std::sin(angle);
+            wheel.gsHat_S[2] = 0.6;
+            wheel.Omega_max = 600.0;
+        }
+        setThrusterCount(options.thrusters);
+        for(int i = 0; i < NUM_CSS; i++) {
+            CoarseSunSensor &sensor = m_frame.css[i];
+            sensor.state = i < options.css ? COMPONENT_ON : COMPONENT_OFF;
+            sensor.theta = 2.0 * M_PI * i / NUM_CSS;
+            sensor.phi = i % 2 ? 0.5 : -0.5;
+            sensor.nHatB[0] = std::cos(sensor.phi) * std::cos(sensor.theta);
+            sensor.nHatB[1] = std::cos(sensor.phi) * std::sin(sensor.theta);
+            sensor.nHatB[2] = std::sin(sensor.phi);
+        }
+
+        m_oe.a = 6878.0;
+        m_oe.e = 0.001;
+        m_oe.i = 51.6 * M_PI / 180.0;
+        m_oe.Omega = 0.3;
+        m_oe.omega = 0.5;
+        m_oe.f = 0.0;
+        m_meanAnomaly = E2M(f2E(m_oe.f, m_oe.e), m_oe.e);
+    }
+
+    // Adds ACS thrusters until the archive of a frame in format has at
+    // least size bytes
+    void growTo(size_t size, WireFormat_t format)
+    {
+        std::string archive;
+        advance(0);
+        while(serializeArchive(m_frame, format, archive) && archive.size() < size) {
+            // Grow proportionally instead of one thruster per archive
+            size_t perThruster = m_frame.acsThrusters.empty() ? 0
+                : (archive.size() - baseSize(format)) / m_frame.acsThrusters.size();
+            size_t add = perThruster > 0 ? (size - archive.size() + perThruster - 1) / perThruster : 1;
+            setThrusterCount((int)(m_frame.acsThrusters.size() + add));
+            advance(0);
+        }
+    }
+
+    // Frame index with the batch of steps since frame index - 1 as samples
+    SpacecraftSim &advance(unsigned long index)
+    {
+        double t = index * m_step;
+        m_frame.samples.clear();
+        for(int i = m_batch - 1; i > 0; i--) {
+            double sampleTime = t - i * m_step / m_batch;
+            if(sampleTime >= 0.0) {
+                setState(sampleTime);
+                appendSample(m_frame, m_frame.samples);
+            }
+        }
+        setState(t);
+        if(m_batch > 0) {
+            appendSample(m_frame, m_frame.samples);
+        }
+        m_frame.timeStamp = wallClockMilliseconds();
+        return m_frame;
+    }
+
+    // Index of the frame generated at simulation time
+    unsigned long frameIndex(double time) { return (unsigned long)std::floor(time / m_step + 0.5); }
+    size_t thrusterCount() { return m_frame.acsThrusters.size(); }
+
+private:
+    double m_step;
+    int m_batch;
+    SpacecraftSim m_frame;
+    classicElements m_oe;
+    double m_meanAnomaly;
+
+    void setState(double t)
+    {
+        m_frame.time = t;
+        m_frame.spiceTime.J2000Current = t;
+        m_frame.gamma = std::fmod(OMEGA_EARTH * t, 2.0 * M_PI);
+
+        classicElements oe = m_oe;
+        double n = std::sqrt(MU_EARTH / (oe.a * oe.a * oe.a));
+        double M = std::fmod(m_meanAnomaly + n * t, 2.0 * M_PI);
+        oe.f = E2f(M2E(M, oe.e), oe.e);
+        elem2rv(MU_EARTH, &oe, m_frame.r_N, m_frame.v_N);
+        m_frame.oe = oe;
+        m_frame.n = n;
+
+        // Tumble at a constant rate about a fixed body axis
+        const double tumbleRate = 0.02;
+        double axis[3] = {0.267261, 0.534522, 0.801784};
+        double halfAngle = 0.5 * std::fmod(tumbleRate * t, 2.0 * M_PI);
+        double q[4] = {std::cos(halfAngle), std::sin(halfAngle) * axis[0],
+            std::sin(halfAngle) * axis[1], std::sin(halfAngle) * axis[2]};
+        EP2MRP(q, m_frame.sigma);
+        for(int i = 0; i < 3; i++) {
+            m_frame.omega[i] = tumbleRate * axis[i];
+        }
+
+        for(size_t i = 0; i < m_frame.reactionWheels.size(); i++) {
+            RWSim &wheel = m_frame.reactionWheels[i];
+            double phase = 0.05 * t + (double)i;
+            wheel.Omega = 300.0 * std::sin(phase);
+            wheel.u_current = 0.015 * std::cos(phase);
+            wheel.wheelAngle = std::fmod(6000.0 * (std::cos((double)i) - std::cos(phase)), 2.0 * M_PI);
+        }
+        // One thruster fires at a time for a tenth of a second
+        size_t firing = m_frame.acsThrusters.empty() ? 0
+            : (size_t)(t * 10.0) % m_frame.acsThrusters.size();
+        for(size_t i = 0; i < m_frame.acsThrusters.size(); i++) {
+            Thruster &thruster = m_frame.acsThrusters[i];
+            thruster.isValveOpen = i == firing;
+            thruster.thrustState = i == firing ? CMD_ON : CMD_OFF;
+            thruster.level = i == firing ? 1.0 : 0.0;
+        }
+
+        // Sun fixed along inertial x, seen by the sensors facing it
+        double dcm[3][3];
+        MRP2C(m_frame.sigma, dcm);
+        double sunN[3] = {1.0, 0.0, 0.0};
+        for(int i = 0; i < 3; i++) {
+            m_frame.sHatN[i] = sunN[i];
+            m_frame.sHatB[i] = dcm[i][0];
+        }
+        for(int i = 0; i < NUM_CSS; i++) {
+            CoarseSunSensor &sensor = m_frame.css[i];
+            double cosAngle = sensor.nHatB[0] * m_frame.sHatB[0] + sensor.nHatB[1] * m_frame.sHatB[1]
+                + sensor.nHatB[2] * m_frame.sHatB[2];
+            sensor.directValue = sensor.state == COMPONENT_ON && cosAngle > 0.0 ? cosAngle : 0.0;
+            sensor.sensedValue = sensor.directValue;
+        }
+    }
+
+    void setThrusterCount(int count)
+    {
+        m_frame.acsThrusters.resize(count);
+        for(int i = 0; i < count; i++) {
+            Thruster &thruster = m_frame.acsThrusters[i];
+            double angle = 2.0 * M_PI * i / count;
+            thruster.r_B[0] = std::cos(angle);
+            thruster.r_B[1] = std::sin(angle);
+            thruster.r_B[2] = i % 2 ? 0.5 : -0.5;
+            thruster.gt_B[0] = -std::sin(angle);
+            thruster.gt_B[1] = std::cos(angle);
+            thruster.gt_B[2] = 0.0;
+            thruster.maxThrust = 1.0;
+        }
+    }
+
+    size_t baseSize(WireFormat_t format)
+    {
+        SpacecraftSim frame = m_frame;
+        frame.acsThrusters.clear();
+        std::string archive;
+        serializeArchive(frame, format, archive);
+        return archive.size();
+    }
+};
+
+// Streams lines to every client of the TcpJsonClient protocol on its own
+// thread. Requests from the clients are read and discarded. Lines queue up
+// per client while it is slow, up to maxPending bytes; beyond that they are
+// dropped, which a client decoding full frames recovers from.
+class JsonLineServer
+{
+public:
+    JsonLineServer()
+        : m_acceptor(m_ioService)
+        , m_droppedLines(0)
+    {
+
+    }
+
+    ~JsonLineServer()
+    {
+        close();
+    }
+
+    bool open(const std::string &address, const std::string &port)
+    {
+        boost::system::error_code ec;
+        boost::asio::ip::tcp::resolver resolver(m_ioService);
+        boost::asio::ip::tcp::resolver::query query(address, port);
+        boost::asio::ip::tcp::endpoint endpoint = *resolver.resolve(query, ec);
+        if(!ec) {
+            m_acceptor.open(endpoint.protocol(), ec);
+        }
+        if(!ec) {
+            m_acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true), ec);
+            m_acceptor.bind(endpoint, ec);
+        }
+        if(!ec) {
+            m_acceptor.listen(boost::asio::socket_base::max_connections, ec);
+        }
+        if(ec) {
+            std::cout << "Error in " << __FUNCTION__ << " (" << ec.value() << ") " << ec.message() << std::endl;
+            return false;
+        }
+        startAccept();
+        m_work.reset(new boost::asio::io_service::work(m_ioService));
+        m_thread.reset(new boost::thread(boost::bind(&boost::asio::io_service::run, &m_ioService)));
+        return true;
+    }
+
+    void close()
+    {
+        if(m_thread) {
+            m_work.reset();
+            m_ioService.stop();
+            m_thread->join();
+            m_thread.reset();
+        }
+        boost::system::error_code ec;
+        m_acceptor.close(ec);
+        m_sessions.clear();
+    }
+
+    // line is sent followed by a newline
+    void send(const std::string &line)
+    {
+        m_ioService.post(boost::bind(&JsonLineServer::queueLine, this, line));
+    }
+
+    unsigned long droppedLines() { return m_droppedLines; }
+
+private:
+    enum { maxPending = 64 * 1024 * 1024, requestBufferSize = 4096 };
+
+    struct Session
+    {
+        Session(boost::asio::io_service &ioService)
+            : socket(ioService)
+            , request(requestBufferSize)
+            , isWriting(false)
+        {
+
+        }
+
+        boost::asio::ip::tcp::socket socket;
+        std::vector<char> request;
+        // Lines being written and the ones queued after them
+        std::string sending;
+        std::string pending;
+        bool isWriting;
+    };
+    typedef boost::shared_ptr<Session> SessionPtr;
+
+    boost::asio::io_service m_ioService;
+    boost::scoped_ptr<boost::asio::io_service::work> m_work;
+    boost::scoped_ptr<boost::thread> m_thread;
+    boost::asio::ip::tcp::acceptor m_acceptor;
+    // Only touched on the server thread
+    std::vector<SessionPtr> m_sessions;
+    SessionPtr m_accepting;
+    boost::atomic<unsigned long> m_droppedLines;
+
+    void startAccept()
+    {
+        m_accepting.reset(new Session(m_ioService));
+        m_acceptor.async_accept(m_accepting->socket, boost::bind(&JsonLineServer::handleAccept, this,
+            boost::asio::placeholders::error));
+    }
+
+    void handleAccept(const boost::system::error_code &ec)
+    {
+        if(ec) {
+            if(ec != boost::asio::error::operation_aborted) {
+                std::cout << "Error in " << __FUNCTION__ << " (" << ec.value() << ") " << ec.message() << std::endl;
+            }
+            return;
+        }
+        boost::system::error_code optionError;
+        m_accepting->socket.set_option(boost::asio::ip::tcp::no_delay(true), optionError);
+        m_sessions.push_back(m_accepting);
+        startRead(m_accepting);
+        startAccept();
+    }
+
+    void startRead(SessionPtr session)
+    {
+        session->socket.async_read_some(boost::asio::buffer(session->request),
+            boost::bind(&JsonLineServer::handleRead, this, session, boost::asio::placeholders::error));
+    }
+
+    void handleRead(SessionPtr session, const boost::system::error_code &ec)
+    {
+        if(ec) {
+            removeSession(session);
+            return;
+        }
+        startRead(session);
+    }
+
+    void queueLine(const std::string &line)
+    {
+        for(size_t i = 0; i < m_sessions.size(); i++) {
+            Session &session = *m_sessions[i];
+            if(session.pending.size() + line.size() + 1 > maxPending) {
+                m_droppedLines++;
+                continue;
+            }
+            session.pending.append(line);
+            session.pending.push_back('\n');
+            startWrite(m_sessions[i]);
+        }
+    }
+
+    void startWrite(SessionPtr session)
+    {
+        if(session->isWriting || session->pending.empty()) {
+            return;
+        }
+        session->sending.swap(session->pending);
+        session->pending.clear();
+        session->isWriting = true;
+        boost::asio::async_write(session->socket, boost::asio::buffer(session->sending),
+            boost::bind(&JsonLineServer::handleWrite, this, session, boost::asio::placeholders::error));
+    }
+
+    void handleWrite(SessionPtr session, const boost::system::error_code &ec)
+    {
+        session->isWriting = false;
+        if(ec) {
+            removeSession(session);
+            return;
+        }
+        startWrite(session);
+    }
+
+    void removeSession(SessionPtr session)
+    {
+        boost::system::error_code ec;
+        session->socket.close(ec);
+        m_sessions.erase(std::remove(m_sessions.begin(), m_sessions.end(), session), m_sessions.end());
+    }
+};
+
+// Frames sent and their arrival at the loopback client, for the current
+// report interval
+class Statistics
+{
+public:
+    Statistics()
+        : m_sent(0)
+        , m_received(0)
+        , m_sendTimes(sendTimeCount)
+    {
+
+    }
+
+    void frameSent(unsigned long index, Clock::time_point time)
+    {
+        boost::lock_guard<boost::mutex> guard(m_mutex);
+        m_sendTimes[index % sendTimeCount] = SendTime(index, time);
+        m_sent++;
+    }
+
+    void frameReceived(unsigned long index, Clock::time_point time)
+    {
+        boost::lock_guard<boost::mutex> guard(m_mutex);
+        const SendTime &sent = m_sendTimes[index % sendTimeCount];
+        if(sent.index != index) {
+            // Too old to be measured
+            return;
+        }
+        m_received++;
+        m_latencies.push_back(boost::chrono::duration<double, boost::milli>(time - sent.time).count());
+    }
+
+    void report(double elapsed, size_t archiveSize, bool isLoopback)
+    {
+        unsigned long sent;
+        unsigned long received;
+        std::vector<double> latencies;
+        {
+            boost::lock_guard<boost::mutex> guard(m_mutex);
+            sent = m_sent;
+            received = m_received;
+            latencies.swap(m_latencies);
+            m_sent = 0;
+            m_received = 0;
+        }
+        std::cout << std::fixed << std::setprecision(1)
+            << std::setw(9) << sent / elapsed << " frames/s"
+            << std::setw(9) << sent * archiveSize / elapsed / 1.0e6 << " MB/s";
+        if(isLoopback) {
+            std::cout << std::setw(9) << received / elapsed << " received/s";
+            if(!latencies.empty()) {
+                std::sort(latencies.begin(), latencies.end());
+                double sum = 0.0;
+                for(size_t i = 0; i < latencies.size(); i++) {
+                    sum += latencies[i];
+                }
+                std::cout << std::setprecision(3)
+                    << "  latency ms mean " << sum / latencies.size()
+                    << " p99 " << latencies[(size_t)(0.99 * (latencies.size() - 1))]
+                    << " max " << latencies.back();
+            }
+        }
+        std::cout << std::endl;
+    }
+
+private:
+    enum { sendTimeCount = 4096 };
+
+    struct SendTime {
+        SendTime(unsigned long index = (unsigned long)-1, Clock::time_point time = Clock::time_point())
+            : index(index), time(time) {}
+        unsigned long index;
+        Clock::time_point time;
+    };
+
+    boost::mutex m_mutex;
+    unsigned long m_sent;
+    unsigned long m_received;
+    std::vector<SendTime> m_sendTimes;
+    std::vector<double> m_latencies;
+};
+
+// Hands frames to the transport's server and, with --loopback, receives
+// them with the matching client
+class LoadServer
+{
+public:
+    LoadServer(const Options &options, FrameGenerator &generator, Statistics &statistics)
+        : m_options(options)
+        , m_generator(generator)
+        , m_statistics(statistics)
+        , m_shouldStop(false)
+    {
+
+    }
+
+    ~LoadServer()
+    {
+        stop();
+    }
+
+    bool start()
+    {
+        switch(m_options.transport) {
+            case TRANSPORT_TCP:
+                m_tcpServer.setWireFormats(WIRE_FORMAT_TEXT | m_options.format);
+                if(!m_tcpServer.acceptConnections(m_options.address, m_options.port)) {
+                    return false;
+                }
+                if(m_options.isLoopback) {
+                    m_tcpClient.setWireFormats(m_options.format);
+                    m_tcpClient.setStreaming(true);
+                    m_tcpClient.setDeltaFrames(true);
+                    m_tcpClient.setMaxFrameRate(m_options.clientRate);
+                    m_tcpClient.setThreaded(true);
+                    m_tcpClient.setFrameHandler(boost::bind(&LoadServer::handleFrame, this, _1));
+                    m_tcpClient.connect(m_options.address, m_options.port);
+                }
+                break;
+            case TRANSPORT_UDP:
+                m_udpServer.reset(new UdpSerializeServer<SpacecraftSim>(&m_ioService));
+                m_udpServer->setWireFormat(m_options.format);
+                if(m_udpServer->startBroadcast(m_options.address, m_options.port)) {
+                    return false;
+                }
+                for(int i = 0; m_options.isLoopback && i < m_options.receivers; i++) {
+                    UdpReceiverPtr receiver(new UdpReceiver);
+                    receiver->client.reset(new UdpSerializeClient<SpacecraftSim>(&receiver->ioService));
+                    if(receiver->client->connect(m_options.address, m_options.port)) {
+                        return false;
+                    }
+                    receiver->thread.reset(new boost::thread(boost::bind(&LoadServer::pollUdp, this, receiver.get())));
+                    m_udpReceivers.push_back(receiver);
+                }
+                break;
+            case TRANSPORT_SHM:
+                m_shmServer.setWireFormat(m_options.format);
+                if(!m_shmServer.open(m_options.name)) {
+                    return false;
+                }
+                if(m_options.isLoopback) {
+                    if(!m_shmClient.connect(m_options.name)) {
+                        return false;
+                    }
+                    m_receiver.reset(new boost::thread(boost::bind(&LoadServer::pollShm, this)));
+                }
+                break;
+            case TRANSPORT_JSON:
+                if(!m_jsonServer.open(m_options.address, m_options.port)) {
+                    return false;
+                }
+                if(m_options.isLoopback) {
+                    m_receiver.reset(new boost::thread(boost::bind(&LoadServer::pollJson, this)));
+                }
+                break;
+        }
+        return true;
+    }
+
+    void stop()
+    {
+        m_shouldStop = true;
+        if(m_receiver) {
+            m_receiver->join();
+            m_receiver.reset();
+        }
+        for(size_t i = 0; i < m_udpReceivers.size(); i++) {
+            if(m_udpReceivers[i]->thread) {
+                m_udpReceivers[i]->thread->join();
+                m_udpReceivers[i]->thread.reset();
+            }
+        }
+        m_tcpClient.close();
+        m_tcpServer.close();
+        m_shmClient.close();
+        m_shmServer.close();
+        m_jsonServer.close();
+    }
+
+    void send(SpacecraftSim &frame)
+    {
+        m_statistics.frameSent(m_generator.frameIndex(frame.time), Clock::now());
+        switch(m_options.transport) {
+            case TRANSPORT_TCP:
+                m_tcpServer.setOutboundData(&frame);
+                break;
+            case TRANSPORT_UDP:
+                m_udpServer->sendData(&frame);
+                break;
+            case TRANSPORT_SHM:
+                m_shmServer.setOutboundData(&frame);
+                break;
+            case TRANSPORT_JSON:
+                writeJsonFrame(frame, m_line);
+                m_jsonServer.send(m_line);
+                break;
+        }
+    }
+
+    // Lines of a capture are sent as they are
+    void sendLine(const std::string &line)
+    {
+        m_jsonServer.send(line);
+    }
+
+    // Frames each UDP loopback client completed and lost, after stop()
+    void reportReceivers()
+    {
+        for(size_t i = 0; i < m_udpReceivers.size(); i++) {
+            UdpSerializeClient<SpacecraftSim> &client = *m_udpReceivers[i]->client;
+            std::cout << "receiver " << i << ": " << client.framesReceived() << " frames received, "
+                << client.framesLost() << " lost" << std::endl;
+        }
+    }
+
+private:
+    // A UDP client with its own socket and polling thread, as a viewer of
+    // its own would have
+    struct UdpReceiver
+    {
+        boost::asio::io_service ioService;
+        boost::scoped_ptr<UdpSerializeClient<SpacecraftSim> > client;
+        boost::scoped_ptr<boost::thread> thread;
+        SpacecraftSim frame;
+    };
+    typedef boost::shared_ptr<UdpReceiver> UdpReceiverPtr;
+
+    const Options &m_options;
+    FrameGenerator &m_generator;
+    Statistics &m_statistics;
+    boost::atomic<bool> m_shouldStop;
+
+    TcpSerializeServer<SpacecraftSim, SpacecraftSim> m_tcpServer;
+    TcpSerializeClient<SpacecraftSim, SpacecraftSim> m_tcpClient;
+    boost::asio::io_service m_ioService;
+    boost::scoped_ptr<UdpSerializeServer<SpacecraftSim> > m_udpServer;
+    std::vector<UdpReceiverPtr> m_udpReceivers;
+    ShmSerializeServer<SpacecraftSim, SpacecraftSim> m_shmServer;
+    ShmSerializeClient<SpacecraftSim, SpacecraftSim> m_shmClient;
+    JsonLineServer m_jsonServer;
+    std::string m_line;
+    boost::scoped_ptr<boost::thread> m_receiver;
+    SpacecraftSim m_received;
+
+    void handleFrame(const SpacecraftSim &frame)
+    {
+        m_statistics.frameReceived(m_generator.frameIndex(frame.time), Clock::now());
+    }
+
+    // Neither client notifies about new frames, they are polled at a rate
+    // well above any frame rate measured
+    void pollUdp(UdpReceiver *receiver)
+    {
+        while(!m_shouldStop) {
+            if(receiver->client->getData(&receiver->frame) == 0) {
+                handleFrame(receiver->frame);
+            } else {
+                boost::this_thread::sleep_for(boost::chrono::microseconds(pollInterval));
+            }
+        }
+    }
+
+    void pollShm()
+    {
+        while(!m_shouldStop) {
+            if(m_shmClient.poll()) {
+                handleFrame(m_shmClient.getInboundData());
+            } else {
+                boost::this_thread::sleep_for(boost::chrono::microseconds(pollInterval));
+            }
+        }
+    }
+
+    // The client is connected and polled on the receiving thread
+    void pollJson()
+    {
+        TcpJsonClient<SpacecraftSim, SpacecraftSim> client;
+        client.connect(m_options.address, m_options.port);
+        while(!m_shouldStop) {
+            if(client.poll()) {
+                handleFrame(client.getInboundData());
+            } else {
+                boost::this_thread::sleep_for(boost::chrono::microseconds(pollInterval));
+            }
+        }
+        client.close();
+    }
+
+    enum { pollInterval = 100 };
+};
+
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    if(!parseOptions(argc, argv, options)) {
+        printUsage();
+        return 1;
+    }
+
+    std::vector<std::string> capture;
+    if(!options.replayFile.empty() && !readCapture(options.replayFile, capture)) {
+        return 1;
+    }
+    FrameGenerator generator(options);
+    if(options.size > 0) {
+        generator.growTo(options.size, options.format);
+    }
+    std::string archive;
+    size_t archiveSize = frameSize(generator.advance(0), options, archive);
+    if(capture.empty()) {
+        std::cout << "Serving " << options.wheels << " wheels, " << generator.thrusterCount() << " thrusters, "
+            << options.css << " sun sensors, " << archiveSize << " byte frames at ";
+    } else {
+        std::cout << "Replaying " << capture.size() << " lines of " << options.replayFile << " at ";
+    }
+    std::cout << (options.rate > 0.0 ? options.rate : 0.0) << " Hz" << (options.rate > 0.0 ? "" : " (unlimited)")
+        << std::endl;
+
+    Statistics statistics;
+    LoadServer server(options, generator, statistics);
+    if(!server.start()) {
+        return 1;
+    }
+
+    Clock::time_point start = Clock::now();
+    Clock::time_point lastReport = start;
+    Clock::duration interval = boost::chrono::duration_cast<Clock::duration>(
+        boost::chrono::duration<double>(options.rate > 0.0 ? 1.0 / options.rate : 0.0));
+    for(unsigned long index = 0; ; index++) {
+        Clock::time_point due = start + interval * index;
+        if(options.rate > 0.0) {
+            boost::this_thread::sleep_until(due);
+        }
+        SpacecraftSim *frame = 0;
+        if(!capture.empty()) {
+            if(index >= capture.size()) {
+                break;
+            }
+            statistics.frameSent(index, Clock::now());
+            server.sendLine(capture[index]);
+            archiveSize = capture[index].size() + 1;
+        } else {
+            frame = &generator.advance(index);
+            server.send(*frame);
+        }
+
+        Clock::time_point now = Clock::now();
+        double sinceReport = boost::chrono::duration<double>(now - lastReport).count();
+        if(sinceReport >= options.reportInterval) {
+            // Size of the current frame, deltas and compression on TCP make
+            // the bytes on the wire smaller
+            if(frame) {
+                archiveSize = frameSize(*frame, options, archive);
+            }
+            statistics.report(sinceReport, archiveSize, options.isLoopback);
+            lastReport = now;
+        }
+        if(options.duration > 0.0 && boost::chrono::duration<double>(now - start).count() >= options.duration) {
+            break;
+        }
+    }
+    server.stop();
+    server.reportReceivers();
+    return 0;
+}
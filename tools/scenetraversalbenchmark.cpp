@@ -0,0 +1,236 @@
+/*
+ ISC License
+
+ Copyright (c) 2016-2017, Autonomous Vehicle Systems Lab, University of Colorado at Boulder
+
+ Permission to use, copy, modify, and/or distribute this software for any
+ purpose with or without fee is hereby granted, provided that the above
+ copyright notice and this permission notice appear in all copies.
+
+ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+#include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
+#include <boost/shared_ptr.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+// Time per frame of walking the scene object tree the way the renderer did,
+// copying every SimObject and matrix on the way down, against walking it
+// through const references as it does now. Built without Qt: the implicitly
+// shared QString, QSharedPointer and QVector members of SimObject are
+// modelled by handles with an atomic reference count, which is what copying
+// them costs. The GL calls are left out.
+//
+// Usage: sceneTraversalBenchmark [frames]
+
+namespace {
+
+// Copies of a handle share one reference counted block like Qt's
+// implicitly shared classes
+class SharedHandle
+{
+public:
+    SharedHandle() : m_data(new Data) {}
+    SharedHandle(const SharedHandle &other) : m_data(other.m_data) { m_data->ref++; }
+    ~SharedHandle() { release(); }
+    SharedHandle &operator=(const SharedHandle &other)
+    {
+        other.m_data->ref++;
+        release();
+        m_data = other.m_data;
+        return *this;
+    }
+
+private:
+    struct Data {
+        Data() : ref(1) {}
+        boost::atomic<int> ref;
+    };
+
+    Data *m_data;
+
+    void release()
+    {
+        if(--m_data->ref == 0) {
+            delete m_data;
+        }
+    }
+};
+
+// Stands in for QMatrix4x4
+struct Matrix {
+    float m[16];
+
+    void translate(const float *position)
+    {
+        for(int i = 0; i < 3; i++) {
+            m[12 + i] += position[i];
+        }
+    }
+};
+
+struct SceneObject;
+
+// Stands in for QVector<SimObject>, copied by reference count
+struct SceneObjects {
+    SceneObjects() : objects(new std::vector<SceneObject>) {}
+    SharedHandle handle;
+    boost::shared_ptr<std::vector<SceneObject> > objects;
+};
+
+// Has the members of SimObject that are copied along with it
+struct SceneObject {
+    SharedHandle name;
+    float position[3];
+    float quaternion[4];
+    SharedHandle geometryName;
+    bool scaleByParentBoundingRadii;
+    float scaleFactor;
+    SharedHandle defaultMaterialOverride;
+    SharedHandle updateParameters;
+    bool restrictToSceneBoundary;
+    bool isVisible;
+    SceneObjects simObjects;
+};
+
+volatile float drawSink;
+
+void drawGeometry(const Matrix &cameraMatrix, const Matrix &objectMatrix, float scaleFactor)
+{
+    drawSink = drawSink + cameraMatrix.m[0] + objectMatrix.m[12] + scaleFactor;
+}
+
+// The traversal before: objects and matrices passed by value, the top
+// object's adjusted placement written into its copy
+void drawRecursionByValue(SceneObject object, Matrix cameraMatrix, Matrix parentMatrix, float scaleFactor)
+{
+    if(!object.isVisible) {
+        return;
+    }
+    Matrix objectMatrix = parentMatrix;
+    objectMatrix.translate(object.position);
+    scaleFactor *= object.scaleFactor;
+    drawGeometry(cameraMatrix, objectMatrix, scaleFactor);
+    for(size_t i = 0; i < object.simObjects.objects->size(); i++) {
+        drawRecursionByValue(object.simObjects.objects->at(i), cameraMatrix, objectMatrix, scaleFactor);
+    }
+}
+
+void drawByValue(SceneObject object, Matrix cameraMatrix)
+{
+    object.position[0] += 1.0f;
+    Matrix identity = Matrix();
+    drawRecursionByValue(object, cameraMatrix, identity, 1.0f);
+}
+
+// The traversal now: const references, each node's placement applied by its
+// parent and hidden children skipped before descending
+void drawRecursionByReference(const SceneObject &object, const Matrix &cameraMatrix,
+    const Matrix &objectMatrix, float scaleFactor)
+{
+    drawGeometry(cameraMatrix, objectMatrix, scaleFactor);
+    for(size_t i = 0; i < object.simObjects.objects->size(); i++) {
+        const SceneObject &child = object.simObjects.objects->at(i);
+        if(!child.isVisible) {
+            continue;
+        }
+        Matrix childMatrix = objectMatrix;
+        childMatrix.translate(child.position);
+        drawRecursionByReference(child, cameraMatrix, childMatrix, scaleFactor * child.scaleFactor);
+    }
+}
+
+void drawByReference(const SceneObject &object, const Matrix &cameraMatrix)
+{
+    if(!object.isVisible) {
+        return;
+    }
+    float position[3] = { object.position[0] + 1.0f, object.position[1], object.position[2] };
+    Matrix objectMatrix = Matrix();
+    objectMatrix.translate(position);
+    drawRecursionByReference(object, cameraMatrix, objectMatrix, object.scaleFactor);
+}
+
+SceneObject makeObject(int depth, int childCount)
+{
+    SceneObject object;
+    std::memset(object.position, 0, sizeof(object.position));
+    std::memset(object.quaternion, 0, sizeof(object.quaternion));
+    object.scaleByParentBoundingRadii = false;
+    object.scaleFactor = 1.0f;
+    object.restrictToSceneBoundary = true;
+    object.isVisible = true;
+    for(int i = 0; depth > 0 && i < childCount; i++) {
+        object.simObjects.objects->push_back(makeObject(depth - 1, childCount));
+    }
+    return object;
+}
+
+int countObjects(const SceneObject &object)
+{
+    int count = 1;
+    for(size_t i = 0; i < object.simObjects.objects->size(); i++) {
+        count += countObjects(object.simObjects.objects->at(i));
+    }
+    return count;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    int frameCount = argc > 1 ? std::atoi(argv[1]) : 200000;
+    if(frameCount < 1) {
+        frameCount = 1;
+    }
+
+    // Roughly the scene of a spacecraft around a planet: a few bodies with
+    // their axes and a spacecraft with its components and their normals
+    SceneObjects scene;
+    for(int i = 0; i < 6; i++) {
+        scene.objects->push_back(makeObject(1, 3));
+    }
+    scene.objects->push_back(makeObject(2, 7));
+    int objectCount = 0;
+    for(size_t i = 0; i < scene.objects->size(); i++) {
+        objectCount += countObjects(scene.objects->at(i));
+    }
+
+    typedef boost::chrono::high_resolution_clock Clock;
+    Matrix cameraMatrix = Matrix();
+    Clock::time_point start = Clock::now();
+    for(int f = 0; f < frameCount; f++) {
+        // getSimObjects() returned the vector by value
+        SceneObjects objects = scene;
+        for(size_t i = 0; i < objects.objects->size(); i++) {
+            drawByValue(objects.objects->at(i), cameraMatrix);
+        }
+    }
+    Clock::time_point middle = Clock::now();
+    for(int f = 0; f < frameCount; f++) {
+        const SceneObjects &objects = scene;
+        for(size_t i = 0; i < objects.objects->size(); i++) {
+            drawByReference(objects.objects->at(i), cameraMatrix);
+        }
+    }
+    Clock::time_point end = Clock::now();
+
+    double byValue = boost::chrono::duration<double, boost::micro>(middle - start).count() / frameCount;
+    double byReference = boost::chrono::duration<double, boost::micro>(end - middle).count() / frameCount;
+    std::cout << objectCount << " scene objects, " << frameCount << " frames" << std::endl;
+    std::cout << std::fixed << std::setprecision(2)
+        << "by value        " << std::setw(10) << byValue << " us/frame" << std::endl
+        << "const reference " << std::setw(10) << byReference << " us/frame" << std::endl;
+    return 0;
+}